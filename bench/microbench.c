@@ -0,0 +1,477 @@
+// ============================= microbench.c =============================
+// Microbenchmarks des builders / parsers de paquets (tftp_utils.c) :
+// ns/op et paquets/s pour chaque fonction du chemin par paquet, sur plusieurs
+// tailles de bloc et avec des RRQ chargées d'options. Conversion netascii
+// (netascii.c) par implémentation de la recherche, face à un memcpy du même
+// bloc (coût du mode octet) ; CRC32C de l'option checksum, table / SSE4.2 ;
+// compression / décompression LZ (option compress) du même texte ;
+// découpage par le contenu et SHA-256 des dépôts dédupliqués (dedup.c).
+//
+// Méthode : échauffement, puis R répétitions de N appels ; on rapporte la
+// médiane, le minimum et l'écart-type relatif des répétitions (une variance
+// élevée = mesure bruitée, à relancer). Référence pour toute optimisation
+// future de l'encodage (vectorisation, zéro copie...).
+//
+//   make microbench MICROBENCH_ARGS="-r 15 -n 2000000 -f parse -J"
+
+#include "dedup.h"
+#include "lz.h"
+#include "netascii.h"
+#include "tftp_utils.h"
+#include <math.h>
+#include <time.h>
+
+#define MAX_REPS 101
+
+// empêche le compilateur d'éliminer ou de sortir de la boucle l'appel mesuré
+#define CLOBBER() __asm__ volatile("" ::: "memory")
+
+struct mb_case
+{
+    const char *name;
+    size_t param; // taille de bloc / de données (0 = sans objet)
+    void (*run)(size_t param, uint64_t iters);
+    const char *impl; // netascii_set_impl / crc32c_set_impl (cas "crc32c...") /
+                      // sha256_set_impl (cas "sha256...") avant la mesure (cas
+                      // ignoré si indisponible)
+};
+
+static uint8_t pkt[4 + MAX_BLKSIZE];
+static uint8_t payload[MAX_BLKSIZE];
+static uint8_t rrq_plain[600];
+static size_t rrq_plain_len;
+static uint8_t rrq_opts[600];
+static size_t rrq_opts_len;
+static uint8_t oack[256];
+static size_t oack_len;
+static struct tftp_opt opts3[3];
+static uint8_t text[MAX_BLKSIZE]; // texte de configuration (lignes de ~60 octets)
+static uint8_t text_na[2 * MAX_BLKSIZE];
+static size_t text_na_len;
+static uint8_t na_out[2 * MAX_BLKSIZE];
+static uint8_t text_lz[MAX_BLKSIZE];
+static uint8_t noise[MAX_BLKSIZE]; // octets pseudo-aléatoires (frontières CDC réparties)
+static size_t text_lz_len;
+static volatile int sink; // résultat "observé"
+
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* ---------------------------- Builders ---------------------------- */
+
+static void run_build_data(size_t len, uint64_t iters)
+{
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sink = build_data(pkt, sizeof(pkt), (uint16_t)i, payload, len);
+        CLOBBER();
+    }
+}
+
+// chemin du serveur pour blksize > 512 : données déjà derrière l'en-tête,
+// on ne compte que la copie qu'un pread aurait faite + l'en-tête
+static void run_build_data_header(size_t len, uint64_t iters)
+{
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        memcpy(pkt + 4, payload, len);
+        sink = build_data_header(pkt, sizeof(pkt), (uint16_t)i);
+        CLOBBER();
+    }
+}
+
+static void run_build_ack(size_t param, uint64_t iters)
+{
+    (void)param;
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sink = build_ack(pkt, sizeof(pkt), (uint16_t)i);
+        CLOBBER();
+    }
+}
+
+static void run_build_error(size_t param, uint64_t iters)
+{
+    (void)param;
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sink = build_error(pkt, sizeof(pkt), 1, "File not found");
+        CLOBBER();
+    }
+}
+
+static void run_build_rrq(size_t param, uint64_t iters)
+{
+    (void)param;
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sink = build_rrq_wrq(OPCODE_RRQ, pkt, sizeof(pkt), "images/firmware-v2.bin");
+        CLOBBER();
+    }
+}
+
+static void run_build_rrq_opts(size_t param, uint64_t iters)
+{
+    (void)param;
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sink = build_rrq_wrq_opts(OPCODE_RRQ, pkt, sizeof(pkt), "images/firmware-v2.bin",
+                                  "octet", opts3, 3);
+        CLOBBER();
+    }
+}
+
+static void run_build_oack(size_t param, uint64_t iters)
+{
+    (void)param;
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sink = build_oack(pkt, sizeof(pkt), opts3, 3);
+        CLOBBER();
+    }
+}
+
+/* ---------------------------- Parsers ---------------------------- */
+
+static void run_parse_opcode(size_t param, uint64_t iters)
+{
+    (void)param;
+    uint16_t op;
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sink = parse_opcode(pkt, 4 + DATA_SIZE, &op);
+        CLOBBER();
+    }
+    sink += op;
+}
+
+static void run_parse_block(size_t len, uint64_t iters)
+{
+    uint16_t b;
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sink = parse_block(pkt, 4 + len, &b);
+        CLOBBER();
+    }
+    sink += b;
+}
+
+static void run_parse_rrq(size_t param, uint64_t iters)
+{
+    (void)param;
+    char filename[256], mode[32];
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sink = parse_rrq_wrq(rrq_plain, rrq_plain_len, filename, sizeof(filename), mode, sizeof(mode));
+        CLOBBER();
+    }
+}
+
+static void run_parse_rrq_opts(size_t param, uint64_t iters)
+{
+    (void)param;
+    char filename[256], mode[32];
+    struct tftp_opt opts[MAX_OPTIONS];
+    size_t nopts;
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sink = parse_rrq_wrq_opts(rrq_opts, rrq_opts_len, filename, sizeof(filename),
+                                  mode, sizeof(mode), opts, MAX_OPTIONS, &nopts);
+        CLOBBER();
+    }
+}
+
+static void run_parse_oack(size_t param, uint64_t iters)
+{
+    (void)param;
+    struct tftp_opt opts[MAX_OPTIONS];
+    size_t nopts;
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sink = parse_oack(oack, oack_len, opts, MAX_OPTIONS, &nopts);
+        CLOBBER();
+    }
+}
+
+/* ---------------------------- netascii ---------------------------- */
+
+static void run_memcpy(size_t len, uint64_t iters)
+{
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        memcpy(na_out, text, len);
+        CLOBBER();
+    }
+}
+
+static void run_na_encode(size_t len, uint64_t iters)
+{
+    size_t used;
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        int pend = NETASCII_NONE;
+        sink = (int)netascii_encode(text, len, &used, na_out, sizeof(na_out), &pend);
+        CLOBBER();
+    }
+}
+
+static void run_na_decode(size_t len, uint64_t iters)
+{
+    if (len > text_na_len)
+        len = text_na_len;
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        int cr = 0;
+        sink = (int)netascii_decode(text_na, len, na_out, &cr);
+        CLOBBER();
+    }
+}
+
+/* ---------------------------- checksum ---------------------------- */
+
+static void run_crc32c(size_t len, uint64_t iters)
+{
+    uint32_t crc = 0;
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        crc = crc32c(crc, payload, len);
+        CLOBBER();
+    }
+    sink = (int)crc;
+}
+
+/* ---------------------------- compression ---------------------------- */
+
+static void run_lz_compress(size_t len, uint64_t iters)
+{
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sink = (int)lz_compress_frame(text, len, na_out, sizeof(na_out));
+        CLOBBER();
+    }
+}
+
+static void run_lz_decompress(size_t len, uint64_t iters)
+{
+    (void)len;
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sink = (int)lz_decompress_frame(text_lz, text_lz_len, na_out, sizeof(na_out));
+        CLOBBER();
+    }
+}
+
+/* ---------------------------- dédup ---------------------------- */
+
+static void run_dedup_cut(size_t len, uint64_t iters)
+{
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sink = (int)dedup_cut(noise, len);
+        CLOBBER();
+    }
+}
+
+static void run_sha256(size_t len, uint64_t iters)
+{
+    uint8_t h[SHA256_LEN];
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        sha256(noise, len, h);
+        CLOBBER();
+    }
+    sink = h[0];
+}
+
+static const struct mb_case cases[] = {
+    {"build_data", 0, run_build_data, NULL},
+    {"build_data", 128, run_build_data, NULL},
+    {"build_data", DATA_SIZE, run_build_data, NULL},
+    {"build_data_header+copy", DATA_SIZE, run_build_data_header, NULL},
+    {"build_data_header+copy", 1428, run_build_data_header, NULL},
+    {"build_data_header+copy", 8192, run_build_data_header, NULL},
+    {"build_data_header+copy", MAX_BLKSIZE, run_build_data_header, NULL},
+    {"build_ack", 0, run_build_ack, NULL},
+    {"build_error", 0, run_build_error, NULL},
+    {"build_rrq_wrq", 0, run_build_rrq, NULL},
+    {"build_rrq_wrq_opts(3)", 0, run_build_rrq_opts, NULL},
+    {"build_oack(3)", 0, run_build_oack, NULL},
+    {"parse_opcode", 0, run_parse_opcode, NULL},
+    {"parse_block", DATA_SIZE, run_parse_block, NULL},
+    {"parse_block", MAX_BLKSIZE, run_parse_block, NULL},
+    {"parse_rrq_wrq", 0, run_parse_rrq, NULL},
+    {"parse_rrq_wrq_opts(3)", 0, run_parse_rrq_opts, NULL},
+    {"parse_oack(3)", 0, run_parse_oack, NULL},
+    {"memcpy", 8192, run_memcpy, NULL},
+    {"netascii_encode/scalar", 8192, run_na_encode, "scalar"},
+    {"netascii_encode/sse2", 8192, run_na_encode, "sse2"},
+    {"netascii_encode/avx2", 8192, run_na_encode, "avx2"},
+    {"netascii_decode/scalar", 8192, run_na_decode, "scalar"},
+    {"netascii_decode/sse2", 8192, run_na_decode, "sse2"},
+    {"netascii_decode/avx2", 8192, run_na_decode, "avx2"},
+    {"crc32c/table", 1428, run_crc32c, "table"},
+    {"crc32c/table", 8192, run_crc32c, "table"},
+    {"crc32c/sse4.2", 1428, run_crc32c, "sse4.2"},
+    {"crc32c/sse4.2", 8192, run_crc32c, "sse4.2"},
+    {"lz_compress_frame", 8192, run_lz_compress, NULL},
+    {"lz_decompress_frame", 8192, run_lz_decompress, NULL},
+    {"dedup_cut", 8192, run_dedup_cut, NULL},
+    {"sha256/scalar", 8192, run_sha256, "scalar"},
+    {"sha256/sha-ni", 8192, run_sha256, "sha-ni"},
+};
+
+static int set_impl(const struct mb_case *mc)
+{
+    if (!mc->impl)
+        return 0;
+    if (strncmp(mc->name, "crc32c", 6) == 0)
+        return crc32c_set_impl(mc->impl);
+    if (strncmp(mc->name, "sha256", 6) == 0)
+        return sha256_set_impl(mc->impl);
+    return netascii_set_impl(mc->impl);
+}
+
+/* ---------------------------- Mesure ---------------------------- */
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void prepare(void)
+{
+    for (size_t i = 0; i < sizeof(payload); i++)
+        payload[i] = (uint8_t)(i * 131 + 7);
+
+    size_t n = 0;
+    set_opt(opts3, &n, 3, "blksize", 1428);
+    set_opt(opts3, &n, 3, "windowsize", 16);
+    set_opt(opts3, &n, 3, "tsize", 0);
+
+    rrq_plain_len = (size_t)build_rrq_wrq(OPCODE_RRQ, rrq_plain, sizeof(rrq_plain),
+                                          "images/firmware-v2.bin");
+    rrq_opts_len = (size_t)build_rrq_wrq_opts(OPCODE_RRQ, rrq_opts, sizeof(rrq_opts),
+                                              "images/firmware-v2.bin", "octet", opts3, 3);
+    oack_len = (size_t)build_oack(oack, sizeof(oack), opts3, 3);
+
+    build_data_header(pkt, sizeof(pkt), 1);
+
+    for (size_t i = 0; i < sizeof(text); i++)
+        text[i] = (i % 61 == 60) ? '\n' : (uint8_t)('a' + i % 23);
+    size_t used;
+    int pend = NETASCII_NONE;
+    text_na_len = netascii_encode(text, sizeof(text), &used, text_na, sizeof(text_na), &pend);
+    text_lz_len = lz_compress_frame(text, 8192, text_lz, sizeof(text_lz));
+    uint32_t r = 1;
+    for (size_t i = 0; i < sizeof(noise); i++)
+    {
+        r = r * 1103515245u + 12345u;
+        noise[i] = (uint8_t)(r >> 16);
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-r reps] [-n iters] [-w warmup_iters] [-f filtre] [-J]\n"
+            "  -r N  répétitions mesurées (défaut 11, max %d)\n"
+            "  -n N  appels par répétition (défaut 1000000)\n"
+            "  -w N  appels d'échauffement (défaut n/10)\n"
+            "  -f S  seulement les cas dont le nom contient S\n"
+            "  -J    sortie JSON (une ligne par cas)\n",
+            prog, MAX_REPS);
+}
+
+int main(int argc, char **argv)
+{
+    int reps = 11;
+    uint64_t iters = 1000000;
+    uint64_t warmup = 0;
+    const char *filter = NULL;
+    int json = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:n:w:f:J")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 'n':
+            iters = strtoull(optarg, NULL, 10);
+            break;
+        case 'w':
+            warmup = strtoull(optarg, NULL, 10);
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'J':
+            json = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (reps < 1 || reps > MAX_REPS || iters == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (warmup == 0)
+        warmup = iters / 10 ? iters / 10 : 1;
+
+    prepare();
+
+    if (!json)
+        printf("%-24s %7s %10s %10s %8s %12s\n", "case", "size", "ns/op", "min", "rsd%", "Mpkt/s");
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        const struct mb_case *mc = &cases[c];
+        if (filter && !strstr(mc->name, filter))
+            continue;
+        if (set_impl(mc) < 0)
+            continue;
+
+        mc->run(mc->param, warmup);
+
+        double ns[MAX_REPS];
+        double sum = 0;
+        for (int r = 0; r < reps; r++)
+        {
+            uint64_t t0 = mono_ns();
+            mc->run(mc->param, iters);
+            uint64_t t1 = mono_ns();
+            ns[r] = (double)(t1 - t0) / (double)iters;
+            sum += ns[r];
+        }
+        double mean = sum / reps;
+        double var = 0;
+        for (int r = 0; r < reps; r++)
+            var += (ns[r] - mean) * (ns[r] - mean);
+        double rsd = reps > 1 && mean > 0 ? 100.0 * sqrt(var / (reps - 1)) / mean : 0;
+
+        qsort(ns, (size_t)reps, sizeof(double), cmp_double);
+        double med = ns[reps / 2];
+        double mpps = med > 0 ? 1e3 / med : 0;
+
+        if (json)
+            printf("{\"case\":\"%s\",\"size\":%zu,\"reps\":%d,\"iters\":%llu,"
+                   "\"ns_per_op\":%.3f,\"ns_min\":%.3f,\"ns_mean\":%.3f,\"rsd_pct\":%.2f,"
+                   "\"mpkt_per_s\":%.2f}\n",
+                   mc->name, mc->param, reps, (unsigned long long)iters,
+                   med, ns[0], mean, rsd, mpps);
+        else
+            printf("%-24s %7zu %10.2f %10.2f %8.2f %12.2f\n",
+                   mc->name, mc->param, med, ns[0], rsd, mpps);
+    }
+    return 0;
+}
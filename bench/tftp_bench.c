@@ -0,0 +1,757 @@
+// ============================= tftp_bench.c =============================
+// Benchmark de bout en bout sur loopback :
+// - lance tftp_server sur un port éphémère avec un root_dir temporaire
+// - N clients concurrents (threads) enchaînent des GET/PUT selon un mélange
+//   de tailles de fichiers et un ratio PUT, avec blksize/windowsize au choix
+// - rapporte Mo/s, requêtes/s, p50/p99/p999 du temps de transfert, CPU par Mo
+//   (serveur et clients) et appels système du serveur par Mo
+// - compression (-z, contenu texte compressible avec -t) : Mo/s utiles (taille
+//   des fichiers) et octets réellement transférés, à comparer sans -z
+// - redémarrages sous charge (-R) : le serveur est remplacé par passation
+//   (-U, handoff.h) pendant la mesure ; aucun transfert ne doit échouer
+// - épinglage (-A) : même mesure sans puis avec les workers épinglés (-c,
+//   affinity.h), débit et p99 des deux comparés
+// - pacing (-P) : même mesure sans puis avec DATA espacés (serveur -R, PUT
+//   des clients, pace.h), à lancer avec un goulot simulé (-N rate=,queue=)
+//
+// 1 Mo = 10^6 octets. Sortie texte par défaut, JSON avec -J (suivi des
+// régressions entre versions).
+
+#include "client.h"
+#include "pace.h"
+#include "sockets.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define MAX_SIZE_CLASSES 16
+#define MAX_SERVER_ARGS 32
+#define PUT_NAMES 4 // noms distants réutilisés par client pour les PUT
+
+struct size_class
+{
+    char name[16];
+    uint64_t size;
+    unsigned weight;
+};
+
+struct bench_cfg
+{
+    unsigned clients;
+    double duration; // secondes
+    unsigned long max_transfers;
+    struct size_class sizes[MAX_SIZE_CLASSES];
+    unsigned nsizes;
+    unsigned total_weight;
+    double put_ratio;
+    struct tftp_client_opts copts;
+    const char *server_bin;
+    char *server_args[MAX_SERVER_ARGS];
+    int nserver_args;
+    int json;
+    int text; // fichiers texte compressibles au lieu d'aléatoires
+    unsigned restart_ms; // 0 : pas de redémarrage
+    int compare_pin;     // -A : mesure sans puis avec workers épinglés
+    int pin;             // mesure en cours : serveur lancé avec -c auto
+    const char *pace;    // -P : mesure sans puis avec pacing à ce débit
+    uint64_t pace_rate;  // octets/s
+    int paced;           // mesure en cours : serveur -R, PUT espacés
+};
+
+struct sample
+{
+    uint64_t ns;
+    uint64_t bytes; // taille du fichier (utile)
+    uint64_t wire;  // octets transférés (compressés avec -z)
+};
+
+struct client_thread
+{
+    pthread_t thread;
+    unsigned id;
+    struct sample *samples;
+    size_t n, cap;
+    uint64_t errors;
+    uint64_t puts;
+};
+
+static struct bench_cfg cfg;
+static char tmp_dir[64];
+static uint16_t server_port;
+static uint64_t end_ns;
+static unsigned long started_transfers; // atomique (__atomic)
+static unsigned finished_clients;       // atomique
+
+/* ---------------------------- Préparation ---------------------------- */
+
+static int parse_size(const char *s, uint64_t *out)
+{
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    switch (*end)
+    {
+    case 'k':
+    case 'K':
+        v <<= 10;
+        end++;
+        break;
+    case 'm':
+    case 'M':
+        v <<= 20;
+        end++;
+        break;
+    case 'g':
+    case 'G':
+        v <<= 30;
+        end++;
+        break;
+    }
+    if (end == s || (*end != 0 && *end != ':'))
+        return -1;
+    *out = v;
+    return 0;
+}
+
+// "1k:50,64k:30,1m:20" -> classes de taille pondérées
+static int parse_mix(const char *mix)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", mix);
+    cfg.nsizes = 0;
+    cfg.total_weight = 0;
+
+    for (char *tok = strtok(buf, ","); tok; tok = strtok(NULL, ","))
+    {
+        if (cfg.nsizes >= MAX_SIZE_CLASSES)
+            return -1;
+        struct size_class *c = &cfg.sizes[cfg.nsizes];
+        char *colon = strchr(tok, ':');
+        c->weight = colon ? (unsigned)atoi(colon + 1) : 1;
+        if (colon)
+            *colon = 0;
+        if (parse_size(tok, &c->size) < 0 || c->weight == 0)
+            return -1;
+        snprintf(c->name, sizeof(c->name), "%s", tok);
+        cfg.total_weight += c->weight;
+        cfg.nsizes++;
+    }
+    return cfg.nsizes ? 0 : -1;
+}
+
+// aléatoire (incompressible) ou texte : lignes de mots tirés d'un petit
+// vocabulaire, proche d'une configuration ou d'un journal
+static void fill_text(uint8_t *buf, size_t len, unsigned *seed)
+{
+    static const char *const words[] = {"kernel", "initrd", "append", "label", "default", "timeout",
+                                        "console=ttyS0", "root=/dev/nfs", "ip=dhcp", "node", "vlan"};
+    for (size_t i = 0; i < len;)
+    {
+        const char *w = words[(unsigned)rand_r(seed) % (sizeof(words) / sizeof(words[0]))];
+        for (; *w && i < len; w++)
+            buf[i++] = (uint8_t)*w;
+        if (i < len)
+            buf[i++] = (uint8_t)(rand_r(seed) % 8 ? ' ' : '\n');
+    }
+}
+
+static int write_bench_file(const char *path, uint64_t size)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    uint8_t buf[65536];
+    unsigned seed = (unsigned)size;
+    while (size > 0)
+    {
+        size_t chunk = size > sizeof(buf) ? sizeof(buf) : (size_t)size;
+        if (cfg.text)
+            fill_text(buf, chunk, &seed);
+        else
+            for (size_t i = 0; i < chunk; i++)
+                buf[i] = (uint8_t)rand_r(&seed);
+        if (write(fd, buf, chunk) != (ssize_t)chunk)
+        {
+            close(fd);
+            return -1;
+        }
+        size -= chunk;
+    }
+    close(fd);
+    return 0;
+}
+
+static void remove_tmp_dir(void)
+{
+    DIR *d = opendir(tmp_dir);
+    if (!d)
+        return;
+    struct dirent *e;
+    char path[512];
+    while ((e = readdir(d)) != NULL)
+    {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", tmp_dir, e->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    rmdir(tmp_dir);
+}
+
+// port UDP libre sur loopback (le noyau en choisit un, on le libère aussitôt)
+static uint16_t pick_free_port(void)
+{
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t al = sizeof(a);
+    if (s < 0 || bind(s, (struct sockaddr *)&a, sizeof(a)) < 0 ||
+        getsockname(s, (struct sockaddr *)&a, &al) < 0)
+        die("pick_free_port");
+    close(s);
+    return ntohs(a.sin_port);
+}
+
+/* ---------------------------- Serveur ---------------------------- */
+
+// -R : les serveurs successifs écrivent à la suite dans le même journal
+static pid_t start_server(int restart)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+        die("fork");
+    if (pid == 0)
+    {
+        char log[128], port[8], ctl[128];
+        snprintf(log, sizeof(log), "%s/server.log", tmp_dir);
+        snprintf(port, sizeof(port), "%u", server_port);
+        snprintf(ctl, sizeof(ctl), "%s/handoff.sock", tmp_dir);
+        int fd = open(log, O_WRONLY | O_CREAT | (restart ? O_APPEND : O_TRUNC), 0644);
+        if (fd >= 0)
+        {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+
+        char *argv[MAX_SERVER_ARGS + 8];
+        int a = 0;
+        argv[a++] = (char *)cfg.server_bin;
+        for (int i = 0; i < cfg.nserver_args; i++)
+            argv[a++] = cfg.server_args[i];
+        if (cfg.restart_ms)
+        {
+            argv[a++] = "-U";
+            argv[a++] = ctl;
+        }
+        if (cfg.pin)
+        {
+            argv[a++] = "-c";
+            argv[a++] = "auto";
+        }
+        if (cfg.paced)
+        {
+            argv[a++] = "-R";
+            argv[a++] = (char *)cfg.pace;
+        }
+        argv[a++] = port;
+        argv[a++] = tmp_dir;
+        argv[a] = NULL;
+        execv(cfg.server_bin, argv);
+        perror("execv");
+        _exit(127);
+    }
+    return pid;
+}
+
+// le serveur est prêt quand il répond ERROR à un RRQ sur un fichier absent
+static int wait_server_ready(void)
+{
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in srv;
+    memset(&srv, 0, sizeof(srv));
+    srv.sin_family = AF_INET;
+    srv.sin_port = htons(server_port);
+    srv.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    uint8_t req[64], rx[512];
+    int len = build_rrq_wrq(OPCODE_RRQ, req, sizeof(req), "__bench_probe__");
+    for (int i = 0; i < 50; i++)
+    {
+        net_sendto(s, req, len, 0, (struct sockaddr *)&srv, sizeof(srv));
+        struct sockaddr_in src;
+        if (recvfrom_timeout(s, rx, sizeof(rx), &src, 100) > 0)
+        {
+            close(s);
+            return 0;
+        }
+    }
+    close(s);
+    return -1;
+}
+
+// temps CPU (utilisateur + système) d'un processus, en secondes
+static double proc_cpu_seconds(pid_t pid)
+{
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = 0;
+
+    // champs 14 (utime) et 15 (stime), après le nom entre parenthèses
+    char *p = strrchr(buf, ')');
+    if (!p)
+        return 0;
+    unsigned long ut = 0, st = 0;
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &ut, &st) != 2)
+        return 0;
+    return (double)(ut + st) / (double)sysconf(_SC_CLK_TCK);
+}
+
+// lignes "syscalls=N" écrites par le serveur à l'arrêt (une par processus,
+// plusieurs avec -R)
+static long long read_server_syscalls(void)
+{
+    char path[128], line[512];
+    snprintf(path, sizeof(path), "%s/server.log", tmp_dir);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    long long v = -1;
+    while (fgets(line, sizeof(line), f))
+    {
+        char *p = strstr(line, "syscalls=");
+        if (p)
+            v = (v < 0 ? 0 : v) + atoll(p + strlen("syscalls="));
+    }
+    fclose(f);
+    return v;
+}
+
+/* ---------------------------- Clients ---------------------------- */
+
+static void record(struct client_thread *t, uint64_t ns, uint64_t bytes, uint64_t wire)
+{
+    if (t->n == t->cap)
+    {
+        t->cap = t->cap ? 2 * t->cap : 1024;
+        t->samples = realloc(t->samples, t->cap * sizeof(struct sample));
+        if (!t->samples)
+            die("realloc");
+    }
+    t->samples[t->n].ns = ns;
+    t->samples[t->n].bytes = bytes;
+    t->samples[t->n].wire = wire;
+    t->n++;
+}
+
+static void *client_loop(void *arg)
+{
+    struct client_thread *t = arg;
+    unsigned seed = 0x9e3779b9u * (t->id + 1);
+    char ip[] = "127.0.0.1";
+    char local[128], remote[64];
+    unsigned long k = 0;
+    struct tftp_xfer_stats xs;
+    struct tftp_client_opts copts = cfg.copts;
+    copts.stats = &xs;
+    copts.pace_rate = cfg.paced ? cfg.pace_rate : 0;
+
+    for (;;)
+    {
+        if (now_ns() >= end_ns)
+            break;
+        if (cfg.max_transfers &&
+            __atomic_fetch_add(&started_transfers, 1, __ATOMIC_RELAXED) >= cfg.max_transfers)
+            break;
+
+        // classe de taille tirée selon les poids
+        unsigned r = (unsigned)rand_r(&seed) % cfg.total_weight;
+        const struct size_class *c = cfg.sizes;
+        while (r >= c->weight)
+        {
+            r -= c->weight;
+            c++;
+        }
+        int put = (double)rand_r(&seed) / RAND_MAX < cfg.put_ratio;
+
+        int rc;
+        uint64_t t0 = now_ns();
+        if (put)
+        {
+            snprintf(local, sizeof(local), "%s/f_%s", tmp_dir, c->name);
+            snprintf(remote, sizeof(remote), "put_%u_%lu", t->id, k++ % PUT_NAMES);
+            rc = tftp_client_put_opts(ip, server_port, local, remote, &copts);
+            t->puts++;
+        }
+        else
+        {
+            snprintf(remote, sizeof(remote), "f_%s", c->name);
+            rc = tftp_client_get_opts(ip, server_port, remote, "/dev/null", &copts);
+        }
+        uint64_t t1 = now_ns();
+
+        if (rc == 0)
+            record(t, t1 - t0, c->size, xs.bytes);
+        else
+            t->errors++;
+    }
+    __atomic_add_fetch(&finished_clients, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+// -R : toutes les restart_ms, un nouveau serveur reprend les transferts de
+// l'actuel, qui s'arrête ; *spid devient le nouveau, CPU des anciens dans
+// *old_cpu ; passation = lancement du nouveau -> sortie de l'ancien
+static unsigned restart_loop(pid_t *spid, double *old_cpu, double *max_handoff_ms)
+{
+    unsigned restarts = 0;
+    for (;;)
+    {
+        uint64_t next = now_ns() + (uint64_t)cfg.restart_ms * 1000000ULL;
+        while (now_ns() < next && __atomic_load_n(&finished_clients, __ATOMIC_RELAXED) < cfg.clients)
+            usleep(10000);
+        if (__atomic_load_n(&finished_clients, __ATOMIC_RELAXED) >= cfg.clients || now_ns() >= end_ns)
+            return restarts;
+
+        uint64_t t0 = now_ns();
+        pid_t npid = start_server(1);
+        struct rusage ru;
+        int status;
+        if (wait4(*spid, &status, 0, &ru) < 0)
+            die("wait4");
+        double ms = (double)(now_ns() - t0) / 1e6;
+        if (ms > *max_handoff_ms)
+            *max_handoff_ms = ms;
+        *old_cpu += (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+                    (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+        *spid = npid;
+        restarts++;
+    }
+}
+
+/* ---------------------------- Rapport ---------------------------- */
+
+static int cmp_sample(const void *a, const void *b)
+{
+    uint64_t x = ((const struct sample *)a)->ns, y = ((const struct sample *)b)->ns;
+    return (x > y) - (x < y);
+}
+
+static double pct_ms(const struct sample *s, size_t n, double q)
+{
+    if (n == 0)
+        return 0;
+    size_t i = (size_t)(q * (double)n);
+    if (i >= n)
+        i = n - 1;
+    return (double)s[i].ns / 1e6;
+}
+
+// une mesure complète (serveur lancé puis arrêté) et son rapport ; pin :
+// serveur lancé avec -c auto ; paced : DATA espacés à cfg.pace ; 2 si des
+// transferts ont échoué, 1 si le serveur ne répond pas
+static int run_bench(int pin, int paced, const char *mix, const char *server_args, const char *netsim,
+                     double *mbps_out, double *p99_out)
+{
+    cfg.pin = pin;
+    cfg.paced = paced;
+    server_port = pick_free_port();
+    pid_t spid = start_server(0);
+    if (wait_server_ready() < 0)
+    {
+        fprintf(stderr, "tftp_bench: le serveur ne répond pas (voir %s/server.log)\n", tmp_dir);
+        kill(spid, SIGKILL);
+        waitpid(spid, NULL, 0);
+        return 1;
+    }
+    started_transfers = 0;
+    finished_clients = 0;
+
+    struct client_thread *threads = calloc(cfg.clients, sizeof(struct client_thread));
+    if (!threads)
+        die("calloc");
+
+    struct rusage ru0, ru1;
+    getrusage(RUSAGE_SELF, &ru0);
+    double scpu0 = proc_cpu_seconds(spid);
+    uint64_t t0 = now_ns();
+    end_ns = t0 + (uint64_t)(cfg.duration * 1e9);
+
+    for (unsigned i = 0; i < cfg.clients; i++)
+    {
+        threads[i].id = i;
+        if (pthread_create(&threads[i].thread, NULL, client_loop, &threads[i]) != 0)
+            die("pthread_create");
+    }
+    unsigned restarts = 0;
+    double old_cpu = 0, max_handoff_ms = 0;
+    if (cfg.restart_ms)
+        restarts = restart_loop(&spid, &old_cpu, &max_handoff_ms);
+    for (unsigned i = 0; i < cfg.clients; i++)
+        pthread_join(threads[i].thread, NULL);
+
+    uint64_t t1 = now_ns();
+    double scpu1 = proc_cpu_seconds(spid) + old_cpu;
+    getrusage(RUSAGE_SELF, &ru1);
+
+    kill(spid, SIGTERM);
+    waitpid(spid, NULL, 0);
+    long long syscalls = read_server_syscalls();
+
+    // agrégation
+    size_t total = 0;
+    uint64_t errors = 0, puts = 0, bytes = 0, wire = 0;
+    for (unsigned i = 0; i < cfg.clients; i++)
+    {
+        total += threads[i].n;
+        errors += threads[i].errors;
+        puts += threads[i].puts;
+    }
+    struct sample *all = malloc((total ? total : 1) * sizeof(struct sample));
+    if (!all)
+        die("malloc");
+    size_t k = 0;
+    for (unsigned i = 0; i < cfg.clients; i++)
+    {
+        memcpy(all + k, threads[i].samples, threads[i].n * sizeof(struct sample));
+        k += threads[i].n;
+        free(threads[i].samples);
+    }
+    for (size_t i = 0; i < total; i++)
+    {
+        bytes += all[i].bytes;
+        wire += all[i].wire;
+    }
+    qsort(all, total, sizeof(struct sample), cmp_sample);
+
+    double elapsed = (double)(t1 - t0) / 1e9;
+    double mb = (double)bytes / 1e6;
+    double ccpu = (double)(ru1.ru_utime.tv_sec - ru0.ru_utime.tv_sec + ru1.ru_stime.tv_sec - ru0.ru_stime.tv_sec) +
+                  (double)(ru1.ru_utime.tv_usec - ru0.ru_utime.tv_usec + ru1.ru_stime.tv_usec - ru0.ru_stime.tv_usec) / 1e6;
+    double scpu = scpu1 - scpu0;
+    double mbps = elapsed > 0 ? mb / elapsed : 0;
+    double rps = elapsed > 0 ? (double)total / elapsed : 0;
+    double p50 = pct_ms(all, total, 0.50), p99 = pct_ms(all, total, 0.99), p999 = pct_ms(all, total, 0.999);
+    double scpu_mb = mb > 0 ? scpu * 1e3 / mb : 0;
+    double ccpu_mb = mb > 0 ? ccpu * 1e3 / mb : 0;
+    double sys_mb = (mb > 0 && syscalls >= 0) ? (double)syscalls / mb : -1;
+    double wire_mbps = elapsed > 0 ? (double)wire / 1e6 / elapsed : 0;
+    double ratio = wire > 0 ? (double)bytes / (double)wire : 0;
+
+    if (cfg.json)
+    {
+        printf("{\"clients\":%u,\"duration_s\":%.3f,\"mix\":\"%s\",\"put_ratio\":%.3f,"
+               "\"blksize\":%u,\"windowsize\":%u,\"stripes\":%u,\"compress\":%d,\"text\":%d,"
+               "\"server_args\":\"%s\",\"netsim\":\"%s\","
+               "\"transfers\":%zu,\"puts\":%llu,\"errors\":%llu,\"bytes\":%llu,\"wire_bytes\":%llu,"
+               "\"mb_per_s\":%.3f,\"wire_mb_per_s\":%.3f,\"compress_ratio\":%.3f,\"req_per_s\":%.1f,"
+               "\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"p999_ms\":%.3f,"
+               "\"server_cpu_ms_per_mb\":%.3f,\"client_cpu_ms_per_mb\":%.3f,"
+               "\"server_syscalls_per_mb\":%.1f,\"restarts\":%u,\"max_handoff_ms\":%.3f,\"pinning\":%d,"
+               "\"pacing\":\"%s\"}\n",
+               cfg.clients, elapsed, mix, cfg.put_ratio,
+               cfg.copts.blksize ? cfg.copts.blksize : DATA_SIZE,
+               cfg.copts.windowsize ? cfg.copts.windowsize : 1,
+               cfg.copts.stripes > 1 ? cfg.copts.stripes : 1, cfg.copts.compress, cfg.text, server_args,
+               netsim, total, (unsigned long long)puts, (unsigned long long)errors,
+               (unsigned long long)bytes, (unsigned long long)wire, mbps, wire_mbps, ratio, rps, p50, p99,
+               p999, scpu_mb, ccpu_mb, sys_mb, restarts, max_handoff_ms, pin, paced ? cfg.pace : "");
+    }
+    else
+    {
+        printf("tftp_bench: %u clients, %.2f s, mix=%s, put_ratio=%.2f, blksize=%u, windowsize=%u, stripes=%u%s%s%s%s%s%s%s%s%s\n",
+               cfg.clients, elapsed, mix, cfg.put_ratio,
+               cfg.copts.blksize ? cfg.copts.blksize : DATA_SIZE,
+               cfg.copts.windowsize ? cfg.copts.windowsize : 1,
+               cfg.copts.stripes > 1 ? cfg.copts.stripes : 1,
+               cfg.copts.compress ? ", compress" : "", cfg.text ? ", text" : "",
+               cfg.nserver_args ? ", server args: " : "", server_args,
+               *netsim ? ", netsim: " : "", netsim, pin ? ", pinned workers (-c auto)" : "",
+               paced ? ", paced at " : "", paced ? cfg.pace : "");
+        printf("  transfers       : %zu ok (%llu PUT), %llu errors\n",
+               total, (unsigned long long)puts, (unsigned long long)errors);
+        printf("  throughput      : %.2f MB/s, %.1f req/s\n", mbps, rps);
+        printf("  on the wire     : %.2f MB/s (%.2fx)\n", wire_mbps, ratio);
+        printf("  transfer time   : p50 %.3f ms, p99 %.3f ms, p999 %.3f ms\n", p50, p99, p999);
+        printf("  server CPU      : %.2f ms/MB\n", scpu_mb);
+        printf("  client CPU      : %.2f ms/MB\n", ccpu_mb);
+        if (sys_mb >= 0)
+            printf("  server syscalls : %.1f /MB\n", sys_mb);
+        else
+            printf("  server syscalls : n/a\n");
+        if (cfg.restart_ms)
+            printf("  restarts        : %u (handoff max %.1f ms)\n", restarts, max_handoff_ms);
+    }
+
+    free(all);
+    free(threads);
+    *mbps_out = mbps;
+    *p99_out = p99;
+    return errors ? 2 : 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -c N       clients concurrents (défaut 4)\n"
+            "  -d SEC     durée de la mesure (défaut 5)\n"
+            "  -n N       arrêt après N transferts (défaut: illimité)\n"
+            "  -m MIX     mélange de tailles, ex. 1k:50,64k:30,1m:20\n"
+            "  -p RATIO   proportion de PUT entre 0 et 1 (défaut 0)\n"
+            "  -b N       option blksize\n"
+            "  -w N       option windowsize\n"
+            "  -k N       GET par N sessions parallèles (plages d'octets)\n"
+            "  -z         GET compressés (option compress)\n"
+            "  -t         fichiers texte compressibles (défaut : aléatoires)\n"
+            "  -S PATH    binaire du serveur (défaut ./tftp_server)\n"
+            "  -a ARGS    arguments supplémentaires du serveur, ex. \"-s 4 -j 2\"\n"
+            "  -N SPEC    pertes / délais simulés des deux côtés, ex. loss=0.01,delay=2ms\n"
+            "  -R MS      serveur remplacé par passation (-U) toutes les MS ms\n"
+            "  -A         deux mesures : workers libres puis épinglés (serveur avec -c auto)\n"
+            "  -P RATE    deux mesures : sans puis avec pacing à RATE bits/s, ex. 180m\n"
+            "             (serveur -R, PUT des clients ; avec -N rate=...,queue=...)\n"
+            "  -J         sortie JSON\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    cfg.clients = 4;
+    cfg.duration = 5;
+    cfg.server_bin = "./tftp_server";
+    const char *mix = "1k:40,64k:40,1m:20";
+    const char *server_args = "";
+    const char *netsim = "";
+    static char args_buf[256];
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:d:n:m:p:b:w:k:S:a:N:R:P:AJzt")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            cfg.clients = (unsigned)atoi(optarg);
+            break;
+        case 'd':
+            cfg.duration = atof(optarg);
+            break;
+        case 'n':
+            cfg.max_transfers = strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            mix = optarg;
+            break;
+        case 'p':
+            cfg.put_ratio = atof(optarg);
+            break;
+        case 'b':
+            cfg.copts.blksize = (uint16_t)atoi(optarg);
+            break;
+        case 'w':
+            cfg.copts.windowsize = (uint16_t)atoi(optarg);
+            break;
+        case 'k':
+            cfg.copts.stripes = (unsigned)atoi(optarg);
+            break;
+        case 'z':
+            cfg.copts.compress = 1;
+            break;
+        case 't':
+            cfg.text = 1;
+            break;
+        case 'S':
+            cfg.server_bin = optarg;
+            break;
+        case 'a':
+            server_args = optarg;
+            snprintf(args_buf, sizeof(args_buf), "%s", optarg);
+            for (char *tok = strtok(args_buf, " "); tok && cfg.nserver_args < MAX_SERVER_ARGS;
+                 tok = strtok(NULL, " "))
+                cfg.server_args[cfg.nserver_args++] = tok;
+            break;
+        case 'N':
+            // clients du bench + serveur (hérite de TFTP_NETSIM)
+            if (netsim_configure(optarg) < 0 || setenv("TFTP_NETSIM", optarg, 1) < 0)
+                return 1;
+            netsim = optarg;
+            break;
+        case 'R':
+            cfg.restart_ms = (unsigned)atoi(optarg);
+            break;
+        case 'A':
+            cfg.compare_pin = 1;
+            break;
+        case 'P':
+            if (pace_parse_rate(optarg, &cfg.pace_rate) < 0)
+            {
+                fprintf(stderr, "tftp_bench: débit invalide '%s' (ex. 200m, 1g)\n", optarg);
+                return 1;
+            }
+            cfg.pace = optarg;
+            break;
+        case 'J':
+            cfg.json = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.clients == 0 || parse_mix(mix) < 0 || (cfg.compare_pin && cfg.pace))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    cfg.copts.quiet = 1;
+
+    snprintf(tmp_dir, sizeof(tmp_dir), "/tmp/tftp_bench.XXXXXX");
+    if (!mkdtemp(tmp_dir))
+        die("mkdtemp");
+    for (unsigned i = 0; i < cfg.nsizes; i++)
+    {
+        char path[128];
+        snprintf(path, sizeof(path), "%s/f_%s", tmp_dir, cfg.sizes[i].name);
+        if (write_bench_file(path, cfg.sizes[i].size) < 0)
+        {
+            perror(path);
+            remove_tmp_dir();
+            return 1;
+        }
+    }
+
+    double mbps[2], p99[2];
+    int errors = run_bench(0, 0, mix, server_args, netsim, &mbps[0], &p99[0]);
+    if (cfg.compare_pin && errors != 1)
+    {
+        int e = run_bench(1, 0, mix, server_args, netsim, &mbps[1], &p99[1]);
+        if (e > errors)
+            errors = e;
+        if (!cfg.json && e != 1)
+            printf("pinning: off %.2f MB/s p99 %.3f ms, on %.2f MB/s p99 %.3f ms (%+.1f%% MB/s)\n", mbps[0], p99[0],
+                   mbps[1], p99[1], mbps[0] > 0 ? (mbps[1] / mbps[0] - 1) * 100 : 0.0);
+    }
+    if (cfg.pace && errors != 1)
+    {
+        int e = run_bench(0, 1, mix, server_args, netsim, &mbps[1], &p99[1]);
+        if (e > errors)
+            errors = e;
+        if (!cfg.json && e != 1)
+            printf("pacing: off %.2f MB/s p99 %.3f ms, %s %.2f MB/s p99 %.3f ms (%+.1f%% MB/s)\n", mbps[0], p99[0],
+                   cfg.pace, mbps[1], p99[1], mbps[0] > 0 ? (mbps[1] / mbps[0] - 1) * 100 : 0.0);
+    }
+
+    remove_tmp_dir();
+    return errors;
+}
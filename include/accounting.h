@@ -0,0 +1,101 @@
+#ifndef TFTP_ACCOUNTING_H
+#define TFTP_ACCOUNTING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bilan d'un transfert (serveur : journal de comptabilité -A, client : --stats)
+ *
+ * Une ligne par transfert, format clé=valeur (logfmt), ajoutée par un seul
+ * write() sur un fichier ouvert en O_APPEND : les lignes de plusieurs workers
+ * ou processus ne s'entremêlent pas.
+ *
+ *   ts=2026-10-19T06:13:22.956Z side=server dir=get peer=10.0.0.7:41000
+ *   file="boot/vmlinuz" result=ok bytes=1048576 blocks=735 blksize=1428
+ *   windowsize=8 tsize=1048576 duration_ms=84.210 goodput_Bps=12451913
+ *   retransmits=3 duplicates=0 rtt_samples=92 rtt_min_us=41 rtt_avg_us=77
+ *   rtt_max_us=2012
+ *
+ * dir est vu du client (get = RRQ, put = WRQ) ; tsize=- si l'option n'a pas
+ * été négociée ; rtt_* absents faute d'échantillon ; rxq_avg_us / rxq_max_us :
+ * attente des datagrammes reçus entre leur arrivée dans le noyau et leur
+ * traitement (horodatage noyau, tstamp.h ; absents sans) : un rtt élevé avec
+ * rxq faible vient du réseau, pas de notre file ; offset=N ajouté pour
+ * un transfert repris à l'octet N ; drops=N ajouté si le noyau a jeté N
+ * datagrammes destinés au transfert faute de place dans la file de sa socket
+ * (retransmissions dues à cette file pleine et non au réseau).
+ */
+
+enum tftp_xfer_result
+{
+    XFER_OK,
+    XFER_TIMEOUT,     // plus de réponse après MAX_RETRIES
+    XFER_PEER_ERROR,  // ERROR reçu de l'autre extrémité
+    XFER_REJECTED,    // ERROR envoyé : fichier absent, accès refusé, option invalide
+    XFER_LOCAL_ERROR, // lecture / écriture du fichier ou socket en échec
+    XFER_SHUTDOWN,    // serveur arrêté pendant le transfert
+    XFER_CHECKSUM,    // somme de contrôle de bout en bout différente (option checksum)
+    XFER_RESULTS
+};
+
+// aller-retours d'un transfert (min / max saturés à ~4,3 s)
+struct tftp_rtt
+{
+    uint64_t sum_ns;
+    uint32_t min_ns;
+    uint32_t max_ns;
+    uint32_t samples;
+};
+
+static inline void rtt_add(struct tftp_rtt *r, uint64_t ns)
+{
+    uint32_t v = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+    if (r->samples == 0 || v < r->min_ns)
+        r->min_ns = v;
+    if (v > r->max_ns)
+        r->max_ns = v;
+    r->sum_ns += ns;
+    r->samples++;
+}
+
+static inline void rtt_merge(struct tftp_rtt *dst, const struct tftp_rtt *src)
+{
+    if (src->samples && (dst->samples == 0 || src->min_ns < dst->min_ns))
+        dst->min_ns = src->min_ns;
+    if (src->max_ns > dst->max_ns)
+        dst->max_ns = src->max_ns;
+    dst->sum_ns += src->sum_ns;
+    dst->samples += src->samples;
+}
+
+struct tftp_xfer_stats
+{
+    const char *side; // "server" / "client"
+    const char *file;
+    uint32_t peer_addr; // ordre réseau
+    uint16_t peer_port; // ordre réseau
+    uint16_t op;        // OPCODE_RRQ / OPCODE_WRQ
+    enum tftp_xfer_result result;
+    uint64_t bytes;
+    uint32_t blocks;
+    uint16_t blksize;
+    uint16_t windowsize;
+    int64_t tsize; // -1 : option non négociée
+    uint64_t offset; // reprise : octets déjà présents, non transférés (bytes les exclut)
+    uint64_t duration_ns;
+    uint32_t retransmits; // paquets renvoyés par ce côté
+    uint32_t duplicates;  // paquets reçus en double ou hors fenêtre
+    uint32_t drops;       // datagrammes jetés par le noyau, file de la socket pleine
+    struct tftp_rtt rtt;
+    struct tftp_rtt rxq;  // attente des datagrammes reçus dans la file (horodatage noyau)
+};
+
+const char *xfer_result_name(enum tftp_xfer_result r);
+
+// ligne de bilan terminée par '\n', retourne sa longueur (tronquée si size trop petit)
+size_t xfer_format(const struct tftp_xfer_stats *s, char *buf, size_t size);
+
+int acct_open(const char *path); // fd en ajout (créé si besoin), -1 si erreur
+int acct_write(int fd, const struct tftp_xfer_stats *s);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef TFTP_AFFINITY_H
+#define TFTP_AFFINITY_H
+
+#include <stdint.h>
+
+/* Placement des workers du serveur (-c, -b) :
+ * - worker i épinglé au i-ème CPU de la liste (modulo sa longueur) ; "auto" :
+ *   CPU du masque d'affinité du processus, dans l'ordre
+ * - SO_INCOMING_CPU sur la socket de requêtes de chaque worker : dans un
+ *   groupe SO_REUSEPORT, le noyau (6.2+) donne la requête à la socket dont
+ *   le CPU est celui qui a reçu le paquet ; la session (et sa socket TID)
+ *   reste ensuite sur ce worker, donc sur ce CPU
+ * - mémoire d'un worker (table de sessions) allouée et remplie par le thread
+ *   principal placé un moment sur le CPU du worker : pages sur le nœud NUMA
+ *   de ce CPU (première écriture), sans libnuma
+ * - attente active (busy_poll_us) : SO_BUSY_POLL / SO_PREFER_BUSY_POLL sur
+ *   les sockets du worker, et sur son epoll (EPIOCSPARAMS, noyau 6.9+), seul
+ *   réglage utile à une boucle epoll ; sans effet sur loopback (pas de NAPI)
+ * Réglage refusé (droits, noyau trop ancien) : avertissement, le serveur
+ * continue sans.
+ */
+
+#define AFFINITY_MAX_CPUS 1024
+
+// masque d'affinité d'un thread (taille d'un cpu_set_t)
+struct affinity_mask
+{
+    uint64_t bits[AFFINITY_MAX_CPUS / 64];
+};
+
+// "auto" ou liste "0-3,8,10-11" : CPU dans cpus (au plus max) ; nombre de
+// CPU, -1 si la liste est invalide ou vide
+int affinity_parse(const char *spec, int *cpus, int max);
+
+// thread appelant épinglé sur cpu ; -1 (errno) si refusé
+int affinity_pin(int cpu);
+int affinity_get(struct affinity_mask *m);
+int affinity_set(const struct affinity_mask *m);
+// nœud NUMA de cpu (sysfs), -1 si inconnu
+int affinity_node(int cpu);
+
+// paquets de la socket traités de préférence sur cpu (SO_INCOMING_CPU)
+int affinity_steer(int sock, int cpu);
+// SO_BUSY_POLL (us) + SO_PREFER_BUSY_POLL ; -1 (errno) si refusé
+int affinity_busy_poll(int sock, uint32_t usecs);
+// attente active d'epoll_wait sur epfd ; -1 (errno) si refusé ou inconnu du noyau
+int affinity_epoll_busy_poll(int epfd, uint32_t usecs);
+
+#endif
@@ -1,17 +1,100 @@
-#ifndef TFTP_CLIENT_H
-#define TFTP_CLIENT_H
-#include <stdint.h>
-
-/* Partie 1:
- * - tftp_client_get : RRQ (download)
- * - tftp_client_put : WRQ (upload)
- *
- * Retour: 0 si OK, -1 si erreur
- */
-int tftp_client_get(const char *server_ip, uint16_t server_port,
-                    const char *remote_file, const char *local_file);
-
-int tftp_client_put(const char *server_ip, uint16_t server_port,
-                    const char *local_file, const char *remote_file);
-
-#endif
+#ifndef TFTP_CLIENT_H
+#define TFTP_CLIENT_H
+#include "libtftp.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Partie 1:
+ * - tftp_client_get : RRQ (download)
+ * - tftp_client_put : WRQ (upload)
+ *
+ * Appels bloquants construits sur libtftp.h (une poignée, poll sur sa socket) ;
+ * pour intégrer des transferts dans sa propre boucle, utiliser libtftp.h.
+ *
+ * Retour: 0 si OK, -1 si erreur
+ */
+int tftp_client_get(const char *server_ip, uint16_t server_port,
+                    const char *remote_file, const char *local_file);
+
+int tftp_client_put(const char *server_ip, uint16_t server_port,
+                    const char *local_file, const char *remote_file);
+
+/* Variantes avec options (RFC 2347) : blksize / windowsize ne sont envoyés
+ * que s'ils sont non nuls ; si le serveur les ignore on reste en 512 / 1.
+ */
+struct tftp_client_opts
+{
+    uint16_t blksize;    // 0 = pas d'option (512)
+    uint16_t windowsize; // 0 = pas d'option (1)
+    int quiet;           // pas de message en cas de succès
+    int resume;          // reprise (offset, tftp_utils.h) : GET après le contenu du
+                         // fichier local, PUT après ce que le serveur a déjà
+    unsigned stripes;    // GET vers un fichier : K sessions parallèles, une plage
+                         // chacune (0 / 1 = une seule ; repli si le serveur ne les gère pas ;
+                         // ignoré avec resume : la reprise se fait en une session)
+    int netascii;        // mode netascii (fins de ligne CR LF sur le réseau) ;
+                         // ni reprise ni plages dans ce mode
+    int checksum;        // somme CRC32C de bout en bout (mode octet, si le serveur l'accepte)
+    int compress;        // GET : compression si le serveur juge le contenu compressible ;
+                         // une seule session (stripes ignoré), pas avec une reprise
+    int tx_timestamps;   // aller-retours datés aussi à l'émission par le noyau (tstamp.h)
+    uint64_t pace_rate;  // PUT : DATA espacés à pace_rate octets/s (pace.h), 0 = non
+    struct tftp_xfer_stats *stats; // si non NULL : bilan du transfert, même en cas d'échec
+};
+
+int tftp_client_get_opts(const char *server_ip, uint16_t server_port,
+                         const char *remote_file, const char *local_file,
+                         const struct tftp_client_opts *opts);
+
+int tftp_client_put_opts(const char *server_ip, uint16_t server_port,
+                         const char *local_file, const char *remote_file,
+                         const struct tftp_client_opts *opts);
+
+/* Transferts sans fichier local (puits / sources de libtftp.h) :
+ * - get_mem : contenu reçu dans out (agrandi à la demande, out->max pour
+ *   plafonner) ; à libérer avec tftp_membuf_free
+ * - put_mem : envoie len octets de data
+ * - get_sink / put_source : fonctions de l'appelant (flux vers un pipeline)
+ * Pas de message de succès sur stdout (sortie éventuellement utilisée pour les données).
+ */
+int tftp_client_get_mem(const char *server_ip, uint16_t server_port, const char *remote_file,
+                        struct tftp_membuf *out, const struct tftp_client_opts *opts);
+
+int tftp_client_put_mem(const char *server_ip, uint16_t server_port, const void *data, size_t len,
+                        const char *remote_file, const struct tftp_client_opts *opts);
+
+int tftp_client_get_sink(const char *server_ip, uint16_t server_port, const char *remote_file,
+                         const struct tftp_sink *sink, const struct tftp_client_opts *opts);
+
+int tftp_client_put_source(const char *server_ip, uint16_t server_port,
+                           const struct tftp_source *source, const char *remote_file,
+                           const struct tftp_client_opts *opts);
+
+/* Mode batch : opérations d'un manifeste exécutées avec `concurrency`
+ * transferts simultanés dans une seule boucle epoll (une socket par transfert
+ * en cours, tampon de réception partagé). Chaque élément reçoit son résultat
+ * et son bilan ; une ligne de bilan par transfert sur stdout sauf opts->quiet.
+ *
+ * Manifeste : une opération par ligne, '#' pour les commentaires
+ *   get <fichier_distant> <fichier_local>
+ *   put <fichier_local> <fichier_distant>
+ *
+ * Retour: nombre de transferts en échec, -1 si erreur avant le premier transfert
+ */
+struct tftp_batch_item
+{
+    int put; // 0 = get, 1 = put
+    char *local;
+    char *remote;
+    int ret; // 0 si OK, -1 si erreur
+    struct tftp_xfer_stats stats;
+};
+
+int tftp_manifest_load(const char *path, struct tftp_batch_item **items, size_t *n);
+void tftp_manifest_free(struct tftp_batch_item *items, size_t n);
+
+int tftp_client_batch(const char *server_ip, uint16_t server_port,
+                      struct tftp_batch_item *items, size_t n, unsigned concurrency,
+                      const struct tftp_client_opts *opts);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef TFTP_DEDUP_H
+#define TFTP_DEDUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Stockage dédupliqué des WRQ (serveur, -D) :
+ * - le flux reçu est coupé en morceaux par le contenu (CDC) : hash roulant
+ *   "gear" sur les derniers octets, frontière quand ses 13 bits de poids fort
+ *   sont nuls (8 Ko en moyenne, entre DEDUP_MIN_CHUNK et DEDUP_MAX_CHUNK) ;
+ *   une insertion ou une suppression ne décale que les morceaux voisins
+ * - chaque morceau est rangé une seule fois sous root_dir/.dedup/xx/<sha256>
+ *   (xx : deux premiers chiffres hexadécimaux) ; déjà présent : rien d'écrit
+ * - le fichier déposé devient un manifeste (liste longueur + SHA-256 des
+ *   morceaux), publié par rename() à la fin du transfert : un WRQ en échec
+ *   laisse la version précédente intacte
+ * - un RRQ sur un manifeste relit les morceaux dans l'ordre (dedup_pread)
+ *
+ * Format du manifeste (texte) :
+ *   TFTPDEDUP 1 <taille> <nombre de morceaux>
+ *   <longueur> <sha256 en hexadécimal>      (une ligne par morceau)
+ *
+ * Les morceaux ne sont jamais supprimés (pas de ramasse-miettes) : un
+ * manifeste remplacé laisse ses morceaux dans le store.
+ */
+
+#define DEDUP_DIR ".dedup"
+#define DEDUP_MIN_CHUNK 2048
+#define DEDUP_AVG_BITS 13 // 8 Ko en moyenne
+#define DEDUP_MAX_CHUNK 65536
+#define SHA256_LEN 32
+
+struct tftp_dedup
+{
+    int dirfd; // root_dir/.dedup
+    uint64_t files; // statistiques (atomiques, partagées par les workers)
+    uint64_t bytes_in;
+    uint64_t bytes_stored; // octets des nouveaux morceaux
+    uint64_t chunks_new;
+    uint64_t chunks_dup;
+};
+
+struct dedup_writer;
+struct dedup_reader;
+
+// empreinte des morceaux ; extensions SHA du processeur si disponibles
+void sha256(const void *data, size_t len, uint8_t out[SHA256_LEN]);
+// implémentation : "sha-ni" ou "scalar" ; la forcer (tests, microbench) : -1
+// si indisponible sur ce processeur
+const char *sha256_impl(void);
+int sha256_set_impl(const char *name);
+
+// longueur du premier morceau de data (len si aucune frontière avant la fin)
+size_t dedup_cut(const uint8_t *data, size_t len);
+
+// crée root_dir/.dedup et ses 256 sous-répertoires ; -1 si impossible
+int dedup_init(struct tftp_dedup *d, const char *root_dir);
+void dedup_free(struct tftp_dedup *d);
+
+// 1 si name désigne le store lui-même (interdit aux clients)
+int dedup_reserved(const char *name);
+
+// dépôt de path : NULL (errno) si le fichier temporaire ne peut être créé à côté
+struct dedup_writer *dedup_writer_new(struct tftp_dedup *d, const char *path);
+// suite du flux, dans l'ordre ; -1 (errno) si un morceau n'a pu être écrit
+int dedup_write(struct dedup_writer *wr, const uint8_t *data, size_t len);
+// dernier morceau, manifeste publié sous path ; wr libéré dans tous les cas
+int dedup_commit(struct dedup_writer *wr);
+// dépôt abandonné (rien de publié) ; wr peut être NULL
+void dedup_abort(struct dedup_writer *wr);
+
+// fd ouvert en lecture : 1 et *out si c'est un manifeste valide, 0 si c'est
+// un fichier ordinaire, -1 si manifeste illisible ou invalide
+int dedup_open(struct tftp_dedup *d, int fd, struct dedup_reader **out);
+uint64_t dedup_size(const struct dedup_reader *rd);
+// len octets à l'offset off (moins en fin de fichier) ; -1 si un morceau
+// manque ou n'a pas la taille attendue
+ssize_t dedup_pread(struct dedup_reader *rd, uint8_t *buf, size_t len, uint64_t off);
+// rd peut être NULL
+void dedup_close(struct dedup_reader *rd);
+
+// passation d'un transfert à un autre processus (handoff.h) : état sérialisé
+// (malloc, *len), NULL si allocation impossible ; le manifeste en cours du
+// writer reste ouvert dans dedup_writer_fd, à passer à part
+uint8_t *dedup_writer_save(const struct dedup_writer *wr, size_t *len);
+int dedup_writer_fd(const struct dedup_writer *wr);
+// état repris avec le manifeste en cours fd (à wr ensuite) ; NULL si invalide
+struct dedup_writer *dedup_writer_load(struct tftp_dedup *d, const uint8_t *blob, size_t len, int fd);
+// wr libéré sans rien supprimer : le dépôt continue dans l'autre processus
+void dedup_writer_drop(struct dedup_writer *wr);
+uint8_t *dedup_reader_save(const struct dedup_reader *rd, size_t *len);
+struct dedup_reader *dedup_reader_load(struct tftp_dedup *d, const uint8_t *blob, size_t len);
+
+#endif
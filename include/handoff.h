@@ -0,0 +1,167 @@
+#ifndef TFTP_HANDOFF_H
+#define TFTP_HANDOFF_H
+
+#include "accounting.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Redémarrage sans coupure du serveur (-U chemin) :
+ * - le serveur en marche écoute sur une socket Unix (SOCK_STREAM) à chemin
+ * - un nouveau processus lancé avec le même -U s'y connecte : l'ancien arrête
+ *   ses workers sans terminer les sessions, lui passe ses sockets de requêtes
+ *   et ses sockets TID (SCM_RIGHTS) avec l'état de chaque session (pair,
+ *   fichier, position, options négociées), attend l'acquittement puis se
+ *   termine sans rien envoyer aux clients
+ * - le nouveau reprend les sessions où elles en étaient : les paquets arrivés
+ *   pendant la passation attendent dans les sockets, une échéance dépassée
+ *   est retransmise comme d'habitude ; il écoute ensuite à son tour sur chemin
+ * - passation ratée (nouveau processus mort ou incompatible avant
+ *   l'acquittement) : l'ancien reprend son service
+ *
+ * Trame : en-tête fixe (struct handoff_hdr) envoyé avec ses fd en données
+ * annexes, puis la charge. Séquence : HELLO, LISTEN (sockets de requêtes des
+ * workers), POOL (sockets TID partagées d'un worker), SESS (enregistrements
+ * de sessions et leurs fd), END ; réponse ACK.
+ *
+ * Les enregistrements sont binaires (même exécutable ou même version des deux
+ * côtés : HANDOFF_VERSION et la taille d'un enregistrement sont vérifiées).
+ */
+
+#define HANDOFF_VERSION 5
+#define HANDOFF_MAX_FDS 253         // SCM_MAX_FD du noyau
+#define HANDOFF_MAX_FRAME (16u << 20)
+#define HANDOFF_TIMEOUT_MS 10000    // attente max d'une trame ou de l'acquittement
+
+enum handoff_type
+{
+    HO_HELLO,
+    HO_LISTEN,
+    HO_POOL,
+    HO_SESS,
+    HO_END,
+    HO_ACK
+};
+
+struct handoff_hdr
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type; // HO_*
+    uint32_t len;  // octets de charge après l'en-tête
+    uint32_t nfds; // fd passés avec l'en-tête
+};
+
+struct handoff_hello
+{
+    uint32_t rec_size; // sizeof(struct handoff_sess)
+    uint32_t workers;
+    uint16_t port;
+};
+
+// POOL : sockets TID partagées du worker, à partir de l'index first
+struct handoff_pool
+{
+    uint32_t worker;
+    uint32_t first;
+};
+
+#define HO_FD_SOCK 0x1  // socket TID propre à la session
+#define HO_FD_FILE 0x2  // hot.fd
+#define HO_FD_OBJ 0x4   // contenu de cold.obj (memfd)
+#define HO_FD_DEDUP 0x8 // manifeste en cours d'un WRQ dédupliqué
+
+#define HO_DD_READER 1 // blob : dedup_reader_save
+#define HO_DD_WRITER 2 // blob : dedup_writer_save
+
+// session : champs de tftp_sess_hot / tftp_sess_cold hors fd et pointeurs ;
+// suivie du nom (name_len octets, '\0' compris) puis du blob dedup ; ses fd
+// suivent ceux de la session précédente dans la trame, dans l'ordre HO_FD_*
+struct handoff_sess
+{
+    uint32_t worker;
+    int32_t pool; // socket du pool du worker, -1 : socket propre (HO_FD_SOCK)
+    uint32_t peer_addr;
+    uint16_t peer_port;
+    uint8_t state;
+    uint8_t retries;
+    uint16_t blksize;
+    uint16_t windowsize;
+    uint32_t next_block;
+    uint32_t acked;
+    uint32_t last_block;
+    uint32_t flags;
+    uint32_t rtt_block;
+    uint64_t deadline; // CLOCK_MONOTONIC : commune aux deux processus
+    uint64_t size;
+    uint64_t rtt_sent;
+    uint64_t start;
+    uint64_t bytes;
+    uint64_t offset;
+    uint64_t total;
+    uint64_t na_src;  // RRQ netascii : début du bloc acked + 1 dans le contenu
+    int32_t na_pend;  // ... et octet en attente (netascii.h)
+    uint32_t lz;      // 1 : RRQ compressé produit au fil des blocs, repris à la
+    uint64_t lz_src;  // trame qui commence à lz_src dans le contenu
+    uint64_t lz_base; // ... et à lz_base dans le flux (zcache.h)
+    uint32_t retransmits;
+    uint32_t duplicates;
+    uint32_t offcrc;
+    uint32_t sum;
+    uint32_t drops;
+    uint8_t sum_at[4];
+    uint8_t fds; // HO_FD_*
+    uint8_t dd;  // 0 ou HO_DD_*
+    uint16_t name_len;
+    uint32_t blob_len;
+    struct tftp_rtt rtt;
+    struct tftp_rtt rxq;
+};
+
+struct handoff_frame
+{
+    uint16_t type;
+    uint8_t *data; // charge (malloc), NULL si vide
+    size_t len;
+    int fds[HANDOFF_MAX_FDS]; // mis à -1 quand repris par l'appelant
+    size_t nfds;
+};
+
+// charge d'une trame en construction
+struct handoff_buf
+{
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+};
+
+// socket d'écoute à path (remplace celle d'un processus précédent), non
+// bloquante, accessible au seul propriétaire (0600) ; -1 (errno) si erreur
+int handoff_listen(const char *path);
+// connexion au serveur en marche ; -1 (errno ENOENT / ECONNREFUSED si aucun)
+int handoff_connect(const char *path);
+// pair d'une connexion acceptée (SO_PEERCRED, *pid et *uid) : même
+// utilisateur et même exécutable (/proc/<pid>/exe) que ce processus ;
+// -1 (errno EACCES si autre pair) sinon
+int handoff_peer_check(int sock, pid_t *pid, uid_t *uid);
+
+// -1 (errno) si la connexion est coupée ou trop de fd / charge trop longue
+int handoff_send(int sock, uint16_t type, const void *data, size_t len, const int *fds, size_t nfds);
+// trame suivante (attente max HANDOFF_TIMEOUT_MS) ; -1 si connexion coupée,
+// délai dépassé ou trame invalide (aucun fd gardé)
+int handoff_recv(int sock, struct handoff_frame *f);
+// ferme les fd non repris, libère la charge
+void handoff_frame_free(struct handoff_frame *f);
+
+int handoff_buf_put(struct handoff_buf *b, const void *data, size_t len);
+void handoff_buf_free(struct handoff_buf *b);
+
+// ajoute une session (rec->name_len et rec->blob_len renseignés ici) ; -1 si allocation impossible
+int handoff_sess_put(struct handoff_buf *b, struct handoff_sess *rec, const char *name,
+                     const void *blob, size_t blob_len);
+// session suivante de la charge d'une trame SESS à partir de *pos ; 1 et
+// *rec, *name, *blob si présente, 0 en fin de charge, -1 si invalide
+int handoff_sess_next(const struct handoff_frame *f, size_t *pos, struct handoff_sess *rec,
+                      const char **name, const uint8_t **blob);
+
+#endif
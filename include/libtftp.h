@@ -0,0 +1,137 @@
+#ifndef TFTP_LIBTFTP_H
+#define TFTP_LIBTFTP_H
+
+#include "accounting.h"
+#include "tftp_utils.h"
+#include <sys/types.h>
+
+/* libtftp : client TFTP non bloquant (libtftp.a)
+ *
+ * Un transfert = une poignée (struct tftp_xfer) avec sa propre socket UDP non
+ * bloquante. Rien ne bloque et rien ne termine le processus : la boucle
+ * d'événements appartient à l'appelant.
+ *
+ *   struct tftp_xfer *x = tftp_xfer_start(&req);   // envoie RRQ / WRQ
+ *   epoll : tftp_xfer_fd(x) en lecture (EPOLLIN)
+ *   attente maximale : tftp_xfer_timeout_ms(x) (tftp_xfer_timeout_us avec pace_rate)
+ *   à chaque réveil (fd lisible ou délai écoulé) : tftp_xfer_process_events(x)
+ *   fin : req.on_done(x, req.user), puis tftp_xfer_free(x)
+ *
+ * Les données passent par un puits (GET) ou une source (PUT) : fichier,
+ * tampon mémoire, ou fonctions de l'appelant (flux vers un pipeline).
+ * Pas de message sur stdout / stderr : résultat, bilan et texte de l'erreur
+ * sont disponibles sur la poignée.
+ */
+
+#define TFTP_SIZE_UNKNOWN UINT64_MAX
+
+// GET : blocs reçus, en ordre et une seule fois chacun ; -1 = abandon du transfert
+struct tftp_sink
+{
+    int (*write)(void *ctx, uint64_t off, const uint8_t *data, size_t len);
+    void *ctx;
+};
+
+// PUT : jusqu'à len octets à l'offset off, relus pour les retransmissions ;
+// moins que len = fin des données, -1 = erreur
+struct tftp_source
+{
+    ssize_t (*read)(void *ctx, uint64_t off, uint8_t *buf, size_t len);
+    void *ctx;
+    uint64_t size; // TFTP_SIZE_UNKNOWN : fin détectée à la première lecture courte
+};
+
+// tampon mémoire : puits (agrandi à la demande) ou source (data / len)
+struct tftp_membuf
+{
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+    size_t max; // puits : taille maximale acceptée (0 = sans limite)
+};
+
+void tftp_sink_file(struct tftp_sink *s, int fd); // pwrite, fd reste à l'appelant
+void tftp_source_file(struct tftp_source *s, int fd, uint64_t size); // pread
+void tftp_sink_mem(struct tftp_sink *s, struct tftp_membuf *m);
+void tftp_source_mem(struct tftp_source *s, const struct tftp_membuf *m);
+void tftp_membuf_free(struct tftp_membuf *m);
+
+struct tftp_xfer;
+
+// appelé une fois, depuis tftp_xfer_process_events, quand le transfert se
+// termine (succès ou échec) ; peut appeler tftp_xfer_free(x)
+typedef void (*tftp_done_cb)(struct tftp_xfer *x, void *user);
+
+struct tftp_xfer_req
+{
+    uint16_t op; // OPCODE_RRQ (get) / OPCODE_WRQ (put)
+    struct sockaddr_in server;
+    const char *remote; // copié
+    uint16_t blksize;    // 0 = pas d'option (512)
+    uint16_t windowsize; // 0 = pas d'option (1)
+    // reprise (options offset / offcrc, voir tftp_utils.h) ; 0 = transfert complet
+    //  GET : octets déjà présents dans le puits, offset_crc = resume_crc de ce
+    //        préfixe si offset_check ; le puits reçoit les blocs à partir de
+    //        l'offset retenu par le serveur (stats->offset, 0 s'il refuse)
+    //  PUT : demande au serveur où il en est (source de taille connue), préfixe
+    //        comparé à la source ; différent => XFER_REJECTED
+    uint64_t offset;
+    int offset_check;
+    uint32_t offset_crc;
+    // GET par plage : length octets à partir de offset (0 = jusqu'à la fin) ;
+    // un serveur qui l'ignore envoie la suite du fichier
+    uint64_t length;
+    int tsize; // GET : demande la taille du fichier (stats->tsize, -1 si refusée)
+    // mode netascii (netascii.h) : le puits reçoit le texte décodé (LF), la
+    // source est encodée à l'envoi ; pas de reprise ni de plage, stats->bytes
+    // compte les octets sur le réseau
+    int netascii;
+    // somme de contrôle de bout en bout (option checksum=crc32c, tftp_utils.h),
+    // mode octet seulement ; si le serveur l'accepte, une différence termine
+    // en XFER_CHECKSUM (GET : le puits a déjà reçu les données)
+    int checksum;
+    // GET : compression (option compress=lz, lz.h), décompressée au fil de
+    // l'eau dans le puits ; ignorée avec offset / length / netascii, serveur
+    // libre de l'ignorer (contenu incompressible) ; stats->bytes compte les
+    // octets sur le réseau
+    int compress;
+    // aller-retours (stats->rtt) datés par le noyau à la réception (toujours,
+    // si SO_TIMESTAMPING est accepté) et à l'émission si tx_timestamps (un
+    // appel système de plus par réveil, tstamp.h)
+    int tx_timestamps;
+    // PUT : DATA espacés à pace_rate octets/s (pace.h), 0 = fenêtre d'un coup ;
+    // créneaux plus fins que la ms : attendre tftp_xfer_timeout_us
+    uint64_t pace_rate;
+    struct tftp_sink sink;     // GET
+    struct tftp_source source; // PUT
+    tftp_done_cb on_done;      // facultatif
+    void *user;
+};
+
+// NULL si la requête ne peut pas partir (errno positionné)
+struct tftp_xfer *tftp_xfer_start(const struct tftp_xfer_req *req);
+
+// socket à surveiller en lecture, -1 une fois le transfert terminé (fermée :
+// elle quitte l'epoll d'elle-même)
+int tftp_xfer_fd(const struct tftp_xfer *x);
+
+// ms avant le prochain appel obligatoire de tftp_xfer_process_events
+// (0 = tout de suite), -1 si le transfert est terminé
+int tftp_xfer_timeout_ms(struct tftp_xfer *x);
+// idem en microsecondes
+long tftp_xfer_timeout_us(struct tftp_xfer *x);
+
+// lit tous les datagrammes en attente, gère timeouts et retransmissions ;
+// 1 = transfert en cours, 0 = terminé (x peut avoir été libéré par on_done)
+int tftp_xfer_process_events(struct tftp_xfer *x);
+
+int tftp_xfer_done(const struct tftp_xfer *x);
+enum tftp_xfer_result tftp_xfer_result(const struct tftp_xfer *x);
+const struct tftp_xfer_stats *tftp_xfer_stats(const struct tftp_xfer *x);
+const char *tftp_xfer_error(const struct tftp_xfer *x); // "" si aucune erreur
+void *tftp_xfer_user(const struct tftp_xfer *x);
+
+// ferme la socket ; un transfert encore en cours est abandonné sans callback
+void tftp_xfer_free(struct tftp_xfer *x);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef TFTP_LOG_H
+#define TFTP_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Journal asynchrone :
+ * - un appel LOG_* sur le chemin chaud n'écrit qu'un enregistrement binaire
+ *   (horodatage, format littéral, arguments numériques, une chaîne copiée)
+ *   dans un anneau propre au thread : aucun formatage, aucun verrou, aucun
+ *   appel système ; anneau plein => enregistrement perdu et compté
+ * - un thread de fond vide les anneaux, formate et écrit (stdout pour INFO et
+ *   en dessous, stderr pour WARN/ERROR)
+ * - sans log_start() (client, tests) le formatage est fait sur place
+ *
+ * Niveaux : à la compilation (-DLOG_COMPILE_LEVEL=LOG_WARN supprime les appels
+ * plus bavards) et à l'exécution (log_set_level).
+ *
+ * Format : sous-ensemble de printf, arguments passés en entiers 64 bits :
+ *   %d %u %x  entiers     %s  la chaîne copiée (une seule par message)
+ *   %I        IPv4 (uint32 en ordre réseau)      %%  le caractère %
+ *   LOG_INF("RRQ from %I:%u file=%s", filename, addr, port);
+ */
+
+#define LOG_ERROR 0
+#define LOG_WARN 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#endif
+
+#define LOG_MAX_ARGS 4
+#define LOG_STR_MAX 46 // chaîne copiée, tronquée au-delà (enregistrement de 96 octets)
+
+extern int log_level; // niveau à l'exécution (LOG_INFO par défaut)
+
+void log_write(int level, const char *fmt, const char *str, const uint64_t *args, size_t nargs);
+
+#define LOG_AT(lvl, fmt, str, ...)                                                    \
+    do                                                                                \
+    {                                                                                 \
+        if ((lvl) <= LOG_COMPILE_LEVEL && (lvl) <= log_level)                         \
+        {                                                                             \
+            const uint64_t log_a_[] = {0, ##__VA_ARGS__};                             \
+            log_write((lvl), (fmt), (str), log_a_ + 1,                                \
+                      sizeof(log_a_) / sizeof(log_a_[0]) - 1);                        \
+        }                                                                             \
+    } while (0)
+
+// str : argument du %s (NULL si le format n'en a pas), puis les entiers
+#define LOG_ERR(fmt, str, ...) LOG_AT(LOG_ERROR, fmt, str, ##__VA_ARGS__)
+#define LOG_WRN(fmt, str, ...) LOG_AT(LOG_WARN, fmt, str, ##__VA_ARGS__)
+#define LOG_INF(fmt, str, ...) LOG_AT(LOG_INFO, fmt, str, ##__VA_ARGS__)
+#define LOG_DBG(fmt, str, ...) LOG_AT(LOG_DEBUG, fmt, str, ##__VA_ARGS__)
+
+int log_parse_level(const char *name); // "error".."debug" ou chiffre, -1 si inconnu
+void log_set_level(int level);
+
+int log_start(void);        // démarre le thread de fond (mode asynchrone)
+void log_stop(void);        // vide les anneaux puis arrête le thread
+uint64_t log_dropped(void); // enregistrements perdus (anneaux pleins)
+
+// formate un enregistrement dans out (utilisé aussi par les tests)
+size_t log_format(char *out, size_t size, const char *fmt, const char *str,
+                  const uint64_t *args, size_t nargs);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef TFTP_LZ_H
+#define TFTP_LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Compression LZ (option "compress", valeur "lz") : codec LZ77 de la famille
+ * LZ4, sans dépendance externe.
+ *
+ * Flux = suite de trames indépendantes de LZ_FRAME octets décompressés au plus :
+ *   en-tête 4 octets gros-boutiste : bit 31 = trame stockée telle quelle
+ *   (incompressible), bits 0-30 = longueur de la charge qui suit
+ *   charge compressée : séquences [jeton][littéraux][distance][longueur]
+ *     jeton : 4 bits de longueur de littéraux, 4 bits de longueur de
+ *     correspondance - 4 ; 15 = suite en octets (255 = continuer) ;
+ *     distance : 2 octets petit-boutiste, dans la trame ; la dernière
+ *     séquence n'a que des littéraux
+ * Une trame ne référence pas les précédentes : le récepteur décompresse au
+ * fil de l'eau avec un tampon d'une trame.
+ */
+
+#define LZ_FRAME 65536
+#define LZ_HDR 4
+#define LZ_RAW 0x80000000u
+#define LZ_SAMPLE_SIZE 16384 // lz_worth : LZ_SAMPLES fenêtres réparties dans le contenu
+#define LZ_SAMPLES 4
+
+// taille maximale du flux pour len octets (trames stockées au pire)
+size_t lz_bound(size_t len);
+
+// une trame : 0 si le résultat ne tient pas dans cap octets
+size_t lz_compress_frame(const uint8_t *in, size_t len, uint8_t *out, size_t cap);
+// -1 si la charge est invalide ou dépasse cap
+ssize_t lz_decompress_frame(const uint8_t *in, size_t len, uint8_t *out, size_t cap);
+
+// une trame avec son en-tête (stockée si incompressible) : len <= LZ_FRAME,
+// out d'au moins LZ_HDR + len octets ; retourne sa taille
+size_t lz_encode_frame(const uint8_t *in, size_t len, uint8_t *out);
+// flux complet dans out (au moins lz_bound(len) octets) ; retourne sa taille
+size_t lz_encode(const uint8_t *in, size_t len, uint8_t *out);
+
+// échantillon (LZ_SAMPLES fenêtres réparties dans le contenu) : 1 si la
+// compression vaut la peine (gain d'au moins 1/8)
+int lz_worth(const uint8_t *in, size_t len);
+
+/* Décodage en flux : morceaux du flux dans l'ordre, out appelé pour chaque
+ * morceau décompressé (trame stockée : transmise telle quelle, sans copie).
+ */
+typedef int (*lz_out_fn)(void *ctx, const uint8_t *data, size_t len);
+
+struct lz_dec
+{
+    uint8_t hdr[LZ_HDR];
+    uint32_t hlen; // octets d'en-tête de la trame en cours
+    uint32_t need; // longueur de sa charge
+    uint32_t have; // ... déjà reçue
+    int raw;
+    uint8_t *buf; // charge compressée puis trame décompressée (alloué au premier besoin)
+};
+
+// 0 = ok, -1 = flux invalide ou allocation impossible, -2 = out a échoué
+int lz_dec_feed(struct lz_dec *d, const uint8_t *in, size_t len, lz_out_fn out, void *ctx);
+// 1 entre deux trames (fin de flux valide)
+int lz_dec_idle(const struct lz_dec *d);
+void lz_dec_free(struct lz_dec *d);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef TFTP_MEMSTORE_H
+#define TFTP_MEMSTORE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Objets en mémoire servis par le serveur (RRQ) sans passer par le disque :
+ * - un nom TFTP -> un contenu immuable ; le remplacer publie une nouvelle
+ *   version, les transferts en cours gardent la leur (compteur de références)
+ * - consulté une fois par requête (verrou lecteur), jamais par paquet : la
+ *   session garde un pointeur sur l'objet et copie les blocs depuis la mémoire
+ * - prioritaire sur un fichier du même nom sous root_dir
+ *
+ * Utilisable depuis un autre thread pendant que le serveur tourne (service de
+ * génération de configurations : memstore_put à chaque rendu).
+ */
+
+struct tftp_memobj
+{
+    char *name;
+    uint8_t *data;
+    size_t len;
+    uint32_t refs; // atomique : store + sessions qui le servent
+    struct tftp_memobj *next; // chaînage dans le store
+    // préchargé depuis root_dir (preload.h) : identité du fichier lu, revue
+    // à chaque RRQ ; src_ino = 0 pour les autres objets
+    uint64_t src_dev;
+    uint64_t src_ino;
+    uint64_t src_mtime; // ns
+    uint8_t locked;     // data verrouillé en RAM (mlock), alloué par pages
+};
+
+struct tftp_memstore
+{
+    pthread_rwlock_t lock;
+    struct tftp_memobj **buckets; // hash (FNV-1a du nom), listes chaînées
+    uint32_t mask;                // nombre de cases - 1 (puissance de 2)
+    uint32_t count;
+};
+
+int memstore_init(struct tftp_memstore *s);
+void memstore_free(struct tftp_memstore *s);
+
+// copie data ; remplace l'objet existant du même nom ; -1 si allocation impossible
+int memstore_put(struct tftp_memstore *s, const char *name, const void *data, size_t len);
+
+// charge un fichier local sous ce nom ; -1 si erreur (perror)
+int memstore_put_file(struct tftp_memstore *s, const char *name, const char *path);
+
+// publie o (le store prend la référence de l'appelant) ; remplace l'objet
+// existant du même nom
+void memstore_publish(struct tftp_memstore *s, struct tftp_memobj *o);
+
+// retire l'objet ; -1 s'il n'existait pas
+int memstore_remove(struct tftp_memstore *s, const char *name);
+// retire o s'il est encore l'objet publié sous son nom ; -1 sinon
+int memstore_drop(struct tftp_memstore *s, struct tftp_memobj *o);
+
+// objet référencé (à rendre avec memobj_release), NULL si absent
+struct tftp_memobj *memstore_get(struct tftp_memstore *s, const char *name);
+
+// objet hors store (contenu copié, une référence), NULL si allocation impossible
+struct tftp_memobj *memobj_new(const char *name, const void *data, size_t len);
+// objet hors store qui reprend data (malloc, libéré avec l'objet) ; NULL si
+// allocation impossible (data reste à l'appelant)
+struct tftp_memobj *memobj_adopt(const char *name, uint8_t *data, size_t len);
+void memobj_release(struct tftp_memobj *o);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef TFTP_NETASCII_H
+#define TFTP_NETASCII_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Mode netascii (RFC 1350 / RFC 764) : fin de ligne CR LF sur le réseau, CR
+ * seul envoyé CR NUL ; côté local, fins de ligne Unix (LF).
+ *
+ * Conversion par morceaux, état porté d'un bloc à l'autre : une paire CR LF /
+ * CR NUL peut être coupée par une frontière de bloc dans les deux sens.
+ *
+ * Les octets ordinaires sont copiés par plages : la recherche du prochain CR /
+ * LF est vectorisée et copie en même temps (AVX2 ou SSE2 selon le processeur,
+ * sinon octet par octet).
+ */
+
+#define NETASCII_NONE (-1) // *pend : aucun octet en attente
+
+// émetteur : où commence un bloc dans le contenu local (bloc ré-encodé depuis
+// là pour une retransmission)
+struct netascii_pos
+{
+    uint64_t src; // offset dans le contenu local
+    int pend;     // second octet d'une paire coupée par le bloc précédent
+};
+
+// encode in (local) vers out (réseau), au plus outlen octets ; *used = octets
+// de in consommés ; *pend : second octet d'une paire coupée par la fin de out,
+// émis en tête de l'appel suivant (NETASCII_NONE au départ)
+size_t netascii_encode(const uint8_t *in, size_t inlen, size_t *used, uint8_t *out, size_t outlen,
+                       int *pend);
+
+// décode in (réseau) vers out (local, au moins inlen + 1 octets) ; *cr : CR
+// en fin de morceau, résolu avec l'octet suivant (0 au départ) ; un CR encore
+// en attente à la fin du transfert est un CR (voir netascii_flush)
+size_t netascii_decode(const uint8_t *in, size_t inlen, uint8_t *out, int *cr);
+
+// fin du transfert : 1 octet (CR en attente) ou 0 écrit dans out
+size_t netascii_flush(uint8_t *out, int *cr);
+
+// implémentation de la recherche : "avx2", "sse2" ou "scalar" ; la forcer
+// (tests, microbench) : -1 si indisponible sur ce processeur
+const char *netascii_impl(void);
+int netascii_set_impl(const char *name);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef TFTP_NETSIM_H
+#define TFTP_NETSIM_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/* Simulateur de réseau en processus, derrière net_sendto / net_recvfrom :
+ * pertes, doublons, délai (avec gigue), réordonnancement des datagrammes et
+ * goulot à file peu profonde, sans netem ni droits root.
+ *
+ * Configuration : variable d'environnement TFTP_NETSIM (lue au premier appel,
+ * donc héritée par le serveur lancé par le bench) ou option -N des binaires.
+ *   TFTP_NETSIM="loss=0.01,rxloss=0.01,dup=0.001,delay=5ms,jitter=2ms,dist=normal,reorder=0.01,seed=42"
+ *   TFTP_NETSIM="rate=100m,queue=32k"
+ *
+ * - loss / rxloss : probabilité de perdre un datagramme émis / reçu
+ * - dup           : probabilité d'émettre un datagramme deux fois
+ * - delay, jitter : délai d'émission, gigue uniforme (dist=uniform, défaut)
+ *                   ou écart-type (dist=normal) ; suffixes us, ms, s
+ * - reorder       : probabilité de retenir un datagramme reorder_delay de plus
+ *                   (1 ms par défaut) pour que les suivants le doublent
+ * - rate, queue   : lien de sortie à rate (bits/s, suffixes k, m, g) précédé
+ *                   d'une file de queue octets (suffixes k, m ; 0 = sans
+ *                   limite) ; datagramme qui ne tient plus dans la file : jeté
+ *                   (commutateur à tampons peu profonds sous une rafale) ;
+ *                   un lien par thread émetteur
+ * - seed          : graine ; chaque thread a son propre générateur, dérivé de
+ *                   la graine, du pid et de son rang (netsim_thread_seed pour
+ *                   imposer un sel fixe et rejouer une séquence)
+ *
+ * Sans configuration, net_sendto / net_recvfrom se réduisent à sendto / recvfrom.
+ */
+
+#define NETSIM_DIST_UNIFORM 0
+#define NETSIM_DIST_NORMAL 1
+
+struct netsim_cfg
+{
+    double loss;
+    double rxloss;
+    double dup;
+    double reorder;
+    uint32_t delay_us;
+    uint32_t jitter_us;
+    uint32_t reorder_delay_us;
+    int dist; // NETSIM_DIST_*
+    uint64_t rate;  // octets/s, 0 = pas de goulot
+    uint64_t queue; // octets
+    uint64_t seed;
+};
+
+int netsim_parse(const char *spec, struct netsim_cfg *cfg);
+int netsim_configure(const char *spec); // parse + active, -1 si spec invalide
+void netsim_thread_seed(uint64_t salt);  // générateur du thread courant
+
+ssize_t net_sendto(int sock, const void *buf, size_t len, int flags,
+                   const struct sockaddr *to, socklen_t tolen);
+// un seul tampon (msg_iov[0]) ; pertes / délais simulés à l'émission : données
+// annexes ignorées, sauf l'heure d'émission SCM_TXTIME (pace.h), respectée
+ssize_t net_sendmsg(int sock, const struct msghdr *msg, int flags);
+ssize_t net_recvfrom(int sock, void *buf, size_t len, int flags,
+                     struct sockaddr *from, socklen_t *fromlen);
+// idem avec données annexes (msg_control)
+ssize_t net_recvmsg(int sock, struct msghdr *msg, int flags);
+
+/* émet les datagrammes retardés arrivés à échéance (thread courant)
+ * retourne le délai en ms jusqu'au prochain, -1 s'il n'y en a aucun */
+int net_flush(void);
+
+/* ferme la socket après avoir émis ses datagrammes encore retenus
+ * (ils étaient "en vol" : on ne les perd pas) */
+int net_close(int sock);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef TFTP_PACE_H
+#define TFTP_PACE_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Espacement des DATA (pacing : -R du serveur pour les RRQ, -R du client
+ * pour les PUT) :
+ * - chaque transfert émet ses DATA au plus à rate (octets/s, en-têtes IP et
+ *   UDP compris) au lieu d'une fenêtre d'un coup : les rafales ne débordent
+ *   plus les files peu profondes des commutateurs d'accès
+ * - SO_TXTIME : chaque DATA part avec son heure d'émission, le noyau le
+ *   retient jusque-là (qdisc fq) ; l'émetteur confie PACE_TXTIME_AHEAD
+ *   datagrammes d'avance, sous la limite par flux de fq (100 par défaut)
+ * - sinon minuterie en espace utilisateur : l'émetteur attend le créneau de
+ *   chaque DATA (epoll_pwait2 / ppoll, à la microseconde)
+ * SO_TXTIME n'a d'effet qu'avec fq sur l'interface de sortie : retenu si
+ * c'est la qdisc par défaut (net.core.default_qdisc) et que le pair n'est
+ * pas sur loopback (noqueue), minuterie sinon.
+ */
+
+#define PACE_HEADER 28       // IPv4 + UDP, comptés dans le débit
+#define PACE_BURST 2         // retard de minuterie rattrapé, en datagrammes
+#define PACE_TXTIME_AHEAD 16 // datagrammes confiés d'avance au noyau (SO_TXTIME)
+
+// "200m", "1g", "500k" ou "64000" : bits/s -> *rate en octets/s ; -1 si invalide
+int pace_parse_rate(const char *s, uint64_t *rate);
+
+// ns entre deux datagrammes de len octets à rate
+uint64_t pace_gap(uint64_t rate, size_t len);
+
+// créneau du prochain datagramme de len octets, au plus tôt *next :
+// 1 s'il part (*at : heure d'émission >= now, *next avancé), 0 s'il faut
+// attendre (*at : heure du réveil) ; txtime : *at peut être dans le futur,
+// le noyau retient le datagramme (SO_TXTIME)
+int pace_take(uint64_t *next, uint64_t rate, size_t len, int txtime, uint64_t now, uint64_t *at);
+
+// 1 si fq est la qdisc par défaut (SO_TXTIME utile hors loopback)
+int pace_txtime_available(void);
+// SO_TXTIME (CLOCK_MONOTONIC) ; -1 (errno) si refusé (noyau < 4.19)
+int pace_txtime_enable(int sock);
+// 1 si le pair est sur loopback (noqueue : SO_TXTIME sans effet)
+int pace_loopback(uint32_t addr);
+// datagramme retenu par le noyau jusqu'à at (ns, CLOCK_MONOTONIC)
+ssize_t pace_sendto(int sock, const void *buf, size_t len, const struct sockaddr_in *to, uint64_t at);
+
+// réveils du serveur : tas d'échéances (due, tag de session), entrées
+// périmées écartées par l'appelant
+struct pace_wait
+{
+    uint64_t due;
+    uint64_t tag;
+};
+
+struct pace_queue
+{
+    struct pace_wait *e;
+    uint32_t n;
+    uint32_t cap; // agrandi à la demande
+};
+
+// -1 si allocation impossible
+int pace_queue_push(struct pace_queue *q, uint64_t due, uint64_t tag);
+// première échéance, UINT64_MAX si vide
+uint64_t pace_queue_next(const struct pace_queue *q);
+// 1, *due et *tag si la première échéance est passée (retirée), 0 sinon
+int pace_queue_pop(struct pace_queue *q, uint64_t now, uint64_t *due, uint64_t *tag);
+void pace_queue_free(struct pace_queue *q);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef TFTP_PRELOAD_H
+#define TFTP_PRELOAD_H
+
+#include "dedup.h"
+#include "memstore.h"
+#include <stdint.h>
+#include <sys/stat.h>
+
+/* Préchargement au démarrage (serveur, -P manifeste) :
+ * - le manifeste liste un nom TFTP par ligne, relatif à root_dir (lignes
+ *   vides et commentaires '#' ignorés) ; plusieurs threads lisent les
+ *   fichiers et les publient comme objets en mémoire (memstore.h) : les
+ *   premiers RRQ après un redémarrage ne touchent pas le disque
+ * - option mlock : contenus verrouillés en RAM ; au-delà de RLIMIT_MEMLOCK
+ *   le reste est chargé sans verrou (compté à part)
+ * - cache cohérent : chaque objet garde l'identité du fichier lu (device,
+ *   inode, date de modification), revue par un stat() à chaque RRQ ; fichier
+ *   remplacé ou modifié depuis : objet retiré, RRQ servi depuis le disque
+ * - liste des plus demandés (-H) : chaque worker compte ses RRQ servis depuis
+ *   root_dir ; à l'arrêt les PRELOAD_HOT_MAX noms les plus demandés sont
+ *   écrits au format manifeste, à donner en -P au démarrage suivant
+ */
+
+#define PRELOAD_DEFAULT_THREADS 4
+#define PRELOAD_HOT_MAX 1024    // noms écrits dans la liste des plus demandés
+#define PRELOAD_HOT_NAMES 65536 // noms distincts comptés par worker (au-delà : ignorés)
+
+struct tftp_preload_stats
+{
+    uint32_t files;  // objets publiés
+    uint32_t failed; // absents, illisibles ou pas des fichiers ordinaires
+    uint64_t bytes;
+    uint64_t locked; // octets verrouillés en RAM
+    uint64_t ns;     // du lancement à la fin du dernier thread
+};
+
+struct tftp_preload;
+
+// lit le manifeste et lance threads threads (0 : PRELOAD_DEFAULT_THREADS) ;
+// dedup : manifestes dédupliqués relus morceau par morceau (peut être NULL) ;
+// NULL (perror) si le manifeste est illisible ; une ligne "preload: ..." est
+// écrite sur stdout quand le dernier fichier est chargé
+struct tftp_preload *preload_start(const char *manifest, const char *root_dir, struct tftp_memstore *objects,
+                                   struct tftp_dedup *dedup, unsigned threads, int lock);
+// 1 quand tous les fichiers sont chargés
+int preload_done(struct tftp_preload *p);
+// attend la fin des threads (cancel : fichiers pas encore commencés
+// abandonnés), bilan dans *st (peut être NULL), libère p
+void preload_finish(struct tftp_preload *p, int cancel, struct tftp_preload_stats *st);
+
+// 1 si l'objet préchargé correspond toujours au fichier décrit par st
+int preload_fresh(const struct tftp_memobj *o, const struct stat *st);
+
+// compteurs de RRQ par nom (un par worker, sans verrou)
+struct preload_hot_entry
+{
+    char *name; // NULL : case libre
+    uint64_t count;
+};
+
+struct preload_hot
+{
+    struct preload_hot_entry *e; // adressage ouvert, alloué au premier nom
+    uint32_t mask;
+    uint32_t count;
+};
+
+// n requêtes de plus pour name ; ignoré si la table est pleine ou allocation impossible
+void preload_hot_add(struct preload_hot *h, const char *name, uint64_t n);
+void preload_hot_free(struct preload_hot *h);
+// compteurs de src ajoutés à dst (listes des workers réunies à l'arrêt)
+void preload_hot_merge(struct preload_hot *dst, const struct preload_hot *src);
+// au plus max noms, du plus au moins demandé, écrits dans path (remplacé par
+// rename) ; nombre de noms écrits, -1 (perror) si erreur
+int preload_hot_write(const char *path, const struct preload_hot *h, uint32_t max);
+
+#endif
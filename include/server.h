@@ -1,17 +1,70 @@
-#ifndef TFTP_SERVER_H
-#define TFTP_SERVER_H
-
-#include <stdint.h>
-
-/* Partie 2 :
- * Serveur TFTP simple :
- * - écoute sur server_port (par défaut 69)
- * - sert les fichiers sous root_dir
- * - 1 transfert à la fois (pas de multi-clients)
- *
- * Retour: 0 si le serveur s'est terminé proprement (en pratique: boucle infinie),
- *         -1 si erreur au démarrage.
- */
-int tftp_server_run(uint16_t server_port, const char *root_dir);
-
-#endif
+#ifndef TFTP_SERVER_H
+#define TFTP_SERVER_H
+
+#include "dedup.h"
+#include "memstore.h"
+#include "vfile.h"
+#include "zcache.h"
+#include <stdint.h>
+
+/* Partie 2 :
+ * Serveur TFTP :
+ * - écoute sur server_port (par défaut 69)
+ * - sert les fichiers sous root_dir, et les objets en mémoire enregistrés
+ *   dans cfg->objects (prioritaires, voir memstore.h), puis les fichiers
+ *   virtuels rendus par client de cfg->vfile (vfile.h)
+ * - RRQ avec l'option compress : contenu compressible servi compressé (lz.h),
+ *   variantes des fichiers gardées dans cfg->zcache (zcache.h)
+ * - WRQ dédupliqués si cfg->dedup : morceaux partagés, fichier en manifeste,
+ *   relu de façon transparente par les RRQ (dedup.h)
+ * - plusieurs transferts simultanés : une boucle epoll par worker, état de
+ *   chaque transfert dans une table de sessions (session.h)
+ * - sockets TID : une par session, ou un pool fixe pré-lié par worker dont les
+ *   paquets sont démultiplexés par adresse client (fd indépendants du nombre
+ *   de sessions)
+ * - redémarrage sans coupure si cfg->handoff_path : sockets et sessions en
+ *   cours passées au processus suivant (handoff.h)
+ * - workers épinglés si cfg->cpus : requêtes dirigées vers le worker du CPU
+ *   qui a reçu le paquet, mémoire sur son nœud NUMA (affinity.h)
+ * - DATA des RRQ espacés à cfg->pace_rate par transfert : SO_TXTIME avec fq,
+ *   minuterie du worker sinon (pace.h)
+ * - préchargement au démarrage si cfg->preload_path : fichiers du manifeste
+ *   chargés en mémoire avant (ou pendant) le service ; temps jusqu'à la
+ *   disponibilité et octets préchargés sur stdout (preload.h)
+ *
+ * Retour: 0 si le serveur s'est terminé proprement (SIGINT/SIGTERM, avec un
+ *         bilan transfers/bytes/syscalls sur stdout), -1 si erreur au démarrage.
+ */
+#define DEFAULT_MAX_SESSIONS 4096
+
+struct tftp_server_config
+{
+    uint16_t port;
+    const char *root_dir;
+    uint32_t max_sessions; // transferts simultanés max (tous workers confondus)
+    uint32_t workers;      // threads, chacun sa socket de requêtes (SO_REUSEPORT)
+    uint32_t pool_sockets; // 0: une socket TID par session ; N: N sockets partagées par worker
+    uint16_t metrics_port; // 0: pas d'export ; sinon HTTP Prometheus sur 127.0.0.1 (metrics.h)
+    const char *trace_path; // NULL: pas de traces ; sinon JSON Chrome écrit à l'arrêt (trace.h)
+    uint32_t trace_every;   // une session tracée sur trace_every (0 ou 1 : toutes)
+    const char *acct_path;  // NULL: pas de comptabilité ; sinon une ligne par transfert (accounting.h)
+    struct tftp_memstore *objects; // NULL: fichiers seulement ; sinon objets servis depuis la mémoire
+    struct tftp_vfile *vfile;      // NULL: pas de fichiers virtuels ; sinon rendus par client (vfile.h)
+    struct tftp_zcache *zcache;    // NULL: RRQ compressés compressés à chaque requête (zcache.h)
+    struct tftp_dedup *dedup;      // NULL: WRQ écrits tels quels ; sinon store dédupliqué (dedup.h)
+    const char *handoff_path;      // NULL: pas de passation ; sinon socket Unix de redémarrage (handoff.h)
+    const char *preload_path;      // NULL: pas de préchargement ; sinon manifeste chargé dans objects (preload.h)
+    uint32_t preload_threads;      // threads du préchargement (0 : PRELOAD_DEFAULT_THREADS)
+    int preload_lock;              // contenus préchargés verrouillés en RAM (mlock)
+    int preload_background;        // 0: requêtes servies après le préchargement ; 1: pendant
+    const char *hot_path;          // NULL: rien ; sinon noms les plus demandés écrits à l'arrêt (preload.h)
+    const char *cpus;              // NULL: workers non épinglés ; "auto" ou liste "0-3,8" (affinity.h)
+    uint32_t busy_poll_us;         // 0: rien ; sinon attente active des sockets et d'epoll (affinity.h)
+    int tx_timestamps;             // horodatage noyau des émissions mesurées (tstamp.h)
+    uint64_t pace_rate;            // octets/s par RRQ, 0 : fenêtres émises d'un coup (pace.h)
+};
+
+int tftp_server_run(uint16_t server_port, const char *root_dir);
+int tftp_server_run_config(const struct tftp_server_config *cfg);
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef TFTP_SESSION_H
+#define TFTP_SESSION_H
+
+#include "accounting.h"
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Table des sessions du serveur (transferts en cours).
+ *
+ * Layout pensé pour la densité (objectif : ~100k transferts simultanés) :
+ * - champs "chauds" (lus/écrits à chaque paquet et à chaque scan des timeouts)
+ *   dans un tableau compact de struct tftp_sess_hot : 64 octets = 1 ligne de cache
+ * - champs "froids" (nom de fichier, stats) dans un tableau parallèle
+ * - index (ip, port) -> session par hash à adressage ouvert (sondage linéaire,
+ *   suppression par décalage arrière, pas de tombstones)
+ *
+ * Aucun buffer de paquet par session : un DATA est reconstruit depuis le fichier
+ * (pread) ou l'objet en mémoire en cas de retransmission, un ACK depuis le
+ * numéro de bloc.
+ *
+ * Mémoire par session (capacité réservée une fois pour toutes à l'init) :
+ *   64 (hot) + 176 (cold) + 4 (pile libre) + 2 * 4 (slots hash, charge <= 50 %)
+ *   = 252 octets, + strlen(filename) + 1 tant que la session est active.
+ * Soit ~25 Mo pour 100k sessions, hors état noyau des sockets / fichiers.
+ */
+
+#define SESS_FREE 0
+#define SESS_RRQ 1 // on envoie DATA, on attend ACK
+#define SESS_WRQ 2 // on attend DATA, on renvoie ACK
+
+#define SESS_F_POOLSOCK 0x1   // sock appartient au pool du worker (ne pas fermer)
+#define SESS_F_OACK 0x2       // OACK envoyé, en attente de ACK(0) / DATA(1)
+#define SESS_F_BLKSIZE 0x4    // options acceptées (rejouées dans l'OACK)
+#define SESS_F_WINDOWSIZE 0x8
+#define SESS_F_TSIZE 0x10
+#define SESS_F_DALLY 0x20     // WRQ terminé : on garde la session un timeout pour
+                              // ré-acquitter le dernier DATA si l'ACK s'est perdu
+#define SESS_F_OFFSET 0x40    // reprise acceptée : DATA(1) porte l'octet cold.offset
+#define SESS_F_RANGE 0x80     // plage demandée (length) : size = fin servie, cold.total = tsize
+#define SESS_F_NETASCII 0x100 // mode netascii (RRQ : blocs encodés à l'envoi, cold.na)
+#define SESS_F_CR 0x200       // WRQ netascii : CR en fin du dernier bloc, pas encore décodé
+#define SESS_F_SUM 0x400      // option checksum : CRC32C en fin de flux (tftp_utils.h)
+#define SESS_F_LZ 0x800       // option compress (RRQ : variante en mémoire obj, sinon cold.zs, lz.h)
+#define SESS_F_TXTIME 0x1000  // RRQ espacé (-R) par le noyau : DATA datés (SO_TXTIME, pace.h)
+
+struct tftp_sess_hot
+{
+    uint32_t peer_addr; // sin_addr.s_addr (ordre réseau)
+    uint16_t peer_port; // sin_port (ordre réseau)
+    uint8_t state;      // SESS_*
+    uint8_t retries;
+    int32_t sock;       // socket TID
+    int32_t fd;         // fichier lu (RRQ) ou écrit (WRQ)
+    uint16_t blksize;
+    uint16_t windowsize;
+    uint32_t next_block; // RRQ: prochain bloc à envoyer ; WRQ: bloc attendu
+    uint32_t acked;      // dernier bloc acquitté (RRQ: par le client, WRQ: par nous)
+    uint32_t last_block; // RRQ: numéro du dernier bloc (taille < blksize)
+    uint64_t deadline;   // échéance du timeout (ns, CLOCK_MONOTONIC)
+    uint64_t size;       // RRQ: taille du fichier ; WRQ: tsize annoncé
+    uint32_t flags;      // SESS_F_*
+    uint32_t rtt_block;  // bloc dont on mesure l'aller-retour (0 = aucun)
+    uint64_t rtt_sent;   // ns, émission de ce bloc (RRQ) / de l'ACK qui l'appelle (WRQ)
+} __attribute__((aligned(64)));
+
+_Static_assert(sizeof(struct tftp_sess_hot) == 64, "tftp_sess_hot doit tenir dans une ligne de cache");
+
+struct tftp_memobj;
+struct netascii_pos;
+struct zcache_stream;
+struct dedup_reader;
+struct dedup_writer;
+
+struct tftp_sess_cold
+{
+    char *filename;
+    struct tftp_memobj *obj; // RRQ servi depuis la mémoire (memstore.h), fd = -1
+    uint64_t start; // ns, début de la session
+    uint64_t bytes; // octets utiles transférés
+    uint32_t retransmits;
+    uint32_t duplicates;
+    uint32_t drops;    // socket propre : datagrammes jetés par le noyau (SO_RXQ_OVFL, cumul)
+    uint32_t trace_id; // 0 = session non tracée (trace.h)
+    uint32_t offcrc;   // WRQ repris : empreinte de notre préfixe (renvoyée dans l'OACK)
+    uint64_t offset;   // reprise : octets du fichier avant DATA(1)
+    uint64_t total;    // RRQ par plage : taille du fichier (hot.size = fin de la plage) ;
+                       // RRQ netascii ou zs : taille du contenu (hot.size : taille
+                       // réseau, inconnue avant le dernier bloc) ; WRQ netascii :
+                       // octets écrits après décodage
+    uint32_t sum;      // option checksum : CRC32C des données déjà émises / reçues
+    union
+    {
+        uint32_t next;   // RRQ : prochain bloc à ajouter à sum (première émission)
+        uint8_t tail[4]; // WRQ : 4 derniers octets reçus (somme si c'est la fin)
+    } sum_at;
+    struct tftp_rtt rtt; // aller-retours mesurés (bilan de fin de transfert)
+    struct tftp_rtt rxq; // attente des datagrammes reçus dans la file (tstamp.h)
+    uint64_t tx_hw;      // horodatage matériel de l'émission mesurée (-X), 0 : aucun
+    uint64_t pace_next;  // -R : créneau du prochain DATA (ns, pace.h)
+    uint64_t pace_wake;  // ... réveil attendu dans la file du worker, 0 : aucun
+    struct netascii_pos *na; // RRQ netascii : début des blocs de la fenêtre dans le
+                             // contenu (anneau de windowsize + 2, indexé par bloc)
+    struct zcache_stream *zs; // RRQ compressé sans variante en mémoire : flux produit
+                              // trame par trame au fil des blocs (zcache.h)
+    union
+    {
+        struct dedup_reader *rd; // RRQ d'un manifeste (dedup.h), fd = -1
+        struct dedup_writer *wr; // WRQ vers le store dédupliqué, fd = -1
+    } dd;
+};
+_Static_assert(sizeof(struct tftp_sess_cold) == 176, "tftp_sess_cold: 176 octets (bilan mémoire ci-dessus)");
+
+struct tftp_sess_table
+{
+    struct tftp_sess_hot *hot;
+    struct tftp_sess_cold *cold;
+    uint32_t *free_stack; // index libres
+    uint32_t nfree;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t high;   // plus grand index jamais utilisé + 1 (borne des scans)
+    uint32_t *slots; // hash : index + 1, 0 = vide
+    uint32_t mask;   // nombre de slots - 1 (puissance de 2)
+};
+
+int sess_table_init(struct tftp_sess_table *t, uint32_t capacity);
+void sess_table_free(struct tftp_sess_table *t);
+
+/* retourne l'index de la session de ce pair, -1 si absente */
+int sess_lookup(const struct tftp_sess_table *t, uint32_t addr, uint16_t port);
+
+/* réserve une session pour ce pair (qui ne doit pas déjà en avoir une)
+ * retourne l'index, -1 si la table est pleine */
+int sess_alloc(struct tftp_sess_table *t, const struct sockaddr_in *peer);
+
+/* libère la session idx (ne ferme ni socket ni fichier) */
+void sess_release(struct tftp_sess_table *t, uint32_t idx);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef TFTP_SOCKBUF_H
+#define TFTP_SOCKBUF_H
+
+#include "tstamp.h"
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Files des sockets UDP (serveur, et socket de transfert du client) :
+ * - taille calculée pour ce qui peut être en vol : la socket de requêtes
+ *   d'un worker peut recevoir une requête par session libre, une socket TID
+ *   une fenêtre (windowsize x blksize) par session qu'elle sert ; chaque
+ *   datagramme coûte au noyau sa charge et ses en-têtes arrondis à la
+ *   puissance de 2 au-dessus (allocation kmalloc), plus le sk_buff : le
+ *   truesize compté dans la file, estimé avec SOCKBUF_OVERHEAD
+ * - SO_*BUFFORCE tenté d'abord (CAP_NET_ADMIN, au-delà de
+ *   net.core.[rw]mem_max), SO_*BUF sinon ; sockets TID agrandies après la
+ *   négociation, seulement au-delà de la taille par défaut
+ * - SO_RXQ_OVFL : chaque datagramme reçu porte le nombre cumulé de ceux que
+ *   le noyau a jetés sur cette socket faute de place ; l'écart entre deux
+ *   lectures distingue une file pleine (réglage local) d'une perte réseau
+ */
+
+#define SOCKBUF_OVERHEAD 768    // en-têtes, skb_shared_info ; sk_buff
+#define SOCKBUF_REQUEST 512     // requête RRQ/WRQ type (nom + options)
+#define SOCKBUF_MAX (16u << 20) // plafond d'une file calculée
+
+// octets de file pour n datagrammes de payload octets (plafonné à SOCKBUF_MAX)
+uint32_t sockbuf_need(uint64_t n, uint32_t payload);
+// file opt (SO_RCVBUF ou SO_SNDBUF) de sock portée à bytes si elle est plus
+// petite ; force : SO_*BUFFORCE essayé d'abord ; taille obtenue (compte du
+// noyau), -1 (errno) si illisible
+int sockbuf_grow(int sock, int opt, uint32_t bytes, int force);
+// taille actuelle de la file opt de sock, -1 (errno) si illisible
+int sockbuf_get(int sock, int opt);
+
+// SO_RXQ_OVFL ; -1 (errno) si refusé
+int sockbuf_drops_enable(int sock);
+// recvfrom avec le compteur SO_RXQ_OVFL : *drops (cumul de la socket) mis à
+// jour si le datagramme le porte, inchangé sinon ; ts (peut être NULL) :
+// horodatage de réception (tstamp.h), remis à zéro s'il est absent
+ssize_t sockbuf_recv(int sock, void *buf, size_t len, struct sockaddr_in *from, uint32_t *drops,
+                     struct tstamp *ts);
+
+#endif
@@ -8,9 +8,12 @@
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include "netsim.h"
 #include "tftp_utils.h"
 
 void die(const char *msg);
 int addr_equal(const struct sockaddr_in *a, const struct sockaddr_in *b);
 ssize_t recvfrom_timeout(int sock, uint8_t *buf, size_t max,
-                         struct sockaddr_in *src, int timeout_ms);
\ No newline at end of file
+                         struct sockaddr_in *src, int timeout_ms);
+int set_nonblock(int sock);
+uint64_t now_ns(void);
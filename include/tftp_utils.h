@@ -1,3 +1,6 @@
+#ifndef TFTP_UTILS_H
+#define TFTP_UTILS_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -15,19 +18,37 @@
 #define OPCODE_DATA 3
 #define OPCODE_ACK 4
 #define OPCODE_ERROR 5
+#define OPCODE_OACK 6
 #define DATA_SIZE 512
+#define MIN_BLKSIZE 8       // RFC 2348
+#define MAX_BLKSIZE 65464   // RFC 2348
+#define MAX_WINDOWSIZE 1024 // RFC 7440 autorise 65535, on borne la rafale
+#define MAX_OPTIONS 8
 #define MAX_RETRIES 3
 #define TIMEOUT_MS 2000
+#define RESUME_CRC_SPAN 65536 // reprise : octets vérifiés juste avant l'offset
 
 typedef struct sockaddr_in sockaddr_in;
 
+// option négociée (RFC 2347) : "nom\0valeur\0"
+struct tftp_opt
+{
+    char name[32];
+    char value[32];
+};
+
 void display_packet(const char *buffer, int size);
 int build_rrq_wrq(uint16_t op_code, unsigned char *buffer, size_t buffer_size, const char *filename);
 char *load_file(char *filename, size_t *data_size);
 void send_data(int sockfd, struct sockaddr_in *addr, unsigned char *data, size_t data_size);
 int init_server_addr(sockaddr_in *server_addr);
+int build_rrq_wrq_opts(uint16_t op_code, unsigned char *buffer, size_t buffer_size,
+                      const char *filename, const char *mode,
+                      const struct tftp_opt *opts, size_t nopts);
+int build_oack(uint8_t *buffer, size_t buffer_size, const struct tftp_opt *opts, size_t nopts);
 int build_data(uint8_t *buffer, size_t buffer_size, uint16_t block_number,
                const uint8_t *data, size_t data_len);
+int build_data_header(uint8_t *buffer, size_t buffer_size, uint16_t block_number);
 int build_ack(unsigned char *buffer, size_t buffer_size, uint16_t block_number);
 int safe_name(const char *name);
 int parse_opcode(const uint8_t *buffer, size_t buffer_size, uint16_t *opcode);
@@ -36,3 +57,71 @@ int build_error(uint8_t *buffer, size_t buffer_size, uint16_t error_code, const
 int parse_rrq_wrq(const uint8_t *buffer, size_t buffer_size,
                   char *filename, size_t fmax,
                   char *mode, size_t mmax);
+int parse_rrq_wrq_opts(const uint8_t *buffer, size_t buffer_size,
+                       char *filename, size_t fmax,
+                       char *mode, size_t mmax,
+                       struct tftp_opt *opts, size_t max_opts, size_t *nopts);
+int parse_oack(const uint8_t *buffer, size_t buffer_size,
+               struct tftp_opt *opts, size_t max_opts, size_t *nopts);
+const char *find_opt(const struct tftp_opt *opts, size_t nopts, const char *name);
+int set_opt(struct tftp_opt *opts, size_t *nopts, size_t max_opts,
+            const char *name, unsigned long value);
+int set_opt_str(struct tftp_opt *opts, size_t *nopts, size_t max_opts,
+                const char *name, const char *value);
+
+/* Reprise d'un transfert interrompu (options "offset" / "offcrc") :
+ * - RRQ : le client envoie offset = octets déjà reçus et, s'il le peut,
+ *   offcrc = resume_crc de son fichier ; le serveur vérifie, arrondit au
+ *   blksize négocié et renvoie l'offset retenu dans l'OACK : DATA(1) porte
+ *   l'octet offset. Option absente de l'OACK = transfert complet.
+ * - WRQ : le client envoie offset = taille de sa source ; le serveur renvoie
+ *   ce qu'il a déjà (arrondi au blksize, au plus offset) avec offcrc de son
+ *   fichier ; le client le compare à sa source, sinon ERROR 8.
+ * L'empreinte couvre les RESUME_CRC_SPAN derniers octets avant l'offset.
+ *
+ * Plage (RRQ, GET découpé en K sessions parallèles) : length = nombre
+ * d'octets voulus à partir de offset ; le serveur renvoie dans l'OACK la
+ * longueur servie depuis l'offset retenu, et tsize reste la taille du fichier.
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len); // crc = 0 au départ, chaînable
+int resume_crc_fd(int fd, uint64_t end, uint32_t *crc);     // -1 si lecture impossible
+
+// instruction crc32 de SSE4.2 si le processeur l'a, sinon table ; forcer
+// "table" / "sse4.2" (tests, microbench) : -1 si indisponible
+const char *crc32c_impl(void);
+int crc32c_set_impl(const char *name);
+
+/* Somme de contrôle de bout en bout (option "checksum", valeur "crc32c", mode
+ * octet) : l'émetteur ajoute à la fin du flux de données le CRC32C (4 octets,
+ * gros-boutiste) des octets de données de la session, calculé bloc par bloc à
+ * la première émission ; le flux fait donc 4 octets de plus (dernier bloc
+ * compris). Le récepteur garde les 4 derniers octets reçus hors du calcul et
+ * du fichier, et les compare au dernier bloc : différents => ERROR 0
+ * "Checksum mismatch" à la place du dernier ACK.
+ * Reprise / plage : la somme couvre les octets servis par la session.
+ */
+#define SUM_LEN 4
+
+// récepteur : n octets du flux, seen = octets du flux reçus avant ; les
+// octets qui sortent des 4 derniers sont des données : ajoutées à *crc et
+// copiées dans out (au moins n octets) ; retourne leur nombre
+size_t sum_rx(uint32_t *crc, uint8_t tail[SUM_LEN], uint64_t seen, const uint8_t *d, size_t n,
+              uint8_t *out);
+// dernier bloc reçu : 1 si la fin du flux (seen octets en tout) est bien crc
+int sum_ok(uint32_t crc, const uint8_t tail[SUM_LEN], uint64_t seen);
+// émetteur : octets de la somme à la position pos du flux (données finies à
+// end), au plus room ; 0 tant que pos < end
+size_t sum_put(uint32_t crc, uint64_t end, uint64_t pos, uint8_t *out, size_t room);
+
+/* Destination d'un transfert vérifié (PUT côté serveur, GET côté client) :
+ * le contenu n'apparaît sous path que si la somme concorde, sinon l'ancien
+ * fichier reste intact. Fichier sans nom (O_TMPFILE) dans le répertoire de
+ * path, lié sous un nom temporaire puis renommé en path à la fin ; O_TMPFILE
+ * impossible (système de fichiers, droits) : path ouvert directement
+ * (O_TRUNC) et retiré en cas d'échec.
+ */
+int sum_dest_open(const char *path);             // O_RDWR ; -1 (errno) si erreur
+int sum_dest_commit(int fd, const char *path);   // contenu publié sous path ; -1 (errno) si erreur
+void sum_dest_discard(int fd, const char *path); // échec : rien du transfert sous path (fd non fermé)
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef TFTP_TRACE_H
+#define TFTP_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Traces par transfert (échantillonnées) :
+ * - 1 session sur N reçoit un identifiant de trace ; les autres ne coûtent
+ *   qu'un test (trace_id == 0) aux points d'instrumentation
+ * - chaque worker écrit ses événements dans son propre anneau (pas de verrou),
+ *   les plus anciens sont écrasés : enregistreur de vol de taille fixe,
+ *   utilisable en production
+ * - à l'arrêt du serveur, export au format Chrome trace-event (JSON) :
+ *   chrome://tracing ou https://ui.perfetto.dev, un processus par worker,
+ *   une ligne par transfert
+ *
+ * Chronologie d'un transfert : requête lue, attente avant prise en charge,
+ * ouverture du fichier, OACK, premier DATA, timeouts et retransmissions,
+ * fin du transfert, fin de session (WRQ : après l'attente du dernier ACK).
+ */
+
+enum trace_type
+{
+    TR_REQUEST,    // a = opcode, b = adresse IPv4 (ordre réseau), c = port
+    TR_QUEUE,      // a = ns entre la lecture de la requête et la prise en charge
+    TR_OPEN,       // a = ns passées dans open/fstat, b = taille du fichier (RRQ)
+    TR_OACK,       // OACK envoyé, a = blksize, b = windowsize
+    TR_FIRST_DATA, // a = ns depuis la requête
+    TR_TIMEOUT,    // a = bloc attendu, b = essai
+    TR_RETRANSMIT, // a = premier bloc renvoyé, b = nombre de paquets
+    TR_DONE,       // transfert réussi
+    TR_END,        // a = durée de la session, b = octets, c = retransmissions
+    TR_TYPES
+};
+
+#define TRACE_NAME_MAX 24 // nom de fichier tronqué (TR_REQUEST)
+#define TRACE_DEFAULT_EVENTS 65536 // par worker, soit 4 Mo
+
+struct trace_ev
+{
+    uint64_t ts; // ns, CLOCK_MONOTONIC
+    uint64_t a, b, c;
+    uint32_t id;
+    uint16_t type;
+    uint16_t pad;
+    char name[TRACE_NAME_MAX];
+};
+
+_Static_assert(sizeof(struct trace_ev) == 64, "trace_ev: 64 octets");
+
+struct tftp_trace
+{
+    struct trace_ev *ev; // anneau de cap événements (puissance de 2)
+    uint32_t cap;
+    uint32_t every;      // 1 session tracée sur every (0 = désactivé)
+    uint32_t countdown;
+    uint32_t next_id;
+    uint64_t written;    // événements écrits depuis le début (écrasés compris)
+};
+
+int trace_init(struct tftp_trace *t, uint32_t cap, uint32_t every); // -1 si allocation impossible
+void trace_free(struct tftp_trace *t);
+
+// identifiant de trace pour une nouvelle session, 0 si non échantillonnée
+static inline uint32_t trace_sample(struct tftp_trace *t)
+{
+    if (!t || t->every == 0)
+        return 0;
+    if (t->countdown > 1)
+    {
+        t->countdown--;
+        return 0;
+    }
+    t->countdown = t->every;
+    return ++t->next_id;
+}
+
+static inline struct trace_ev *trace_push(struct tftp_trace *t, uint32_t id, enum trace_type type,
+                                          uint64_t ts)
+{
+    struct trace_ev *e = &t->ev[t->written++ & (t->cap - 1)];
+    e->ts = ts;
+    e->id = id;
+    e->type = (uint16_t)type;
+    e->a = e->b = e->c = 0;
+    return e;
+}
+
+static inline void trace_event(struct tftp_trace *t, uint32_t id, enum trace_type type,
+                               uint64_t ts, uint64_t a, uint64_t b)
+{
+    struct trace_ev *e = trace_push(t, id, type, ts);
+    e->a = a;
+    e->b = b;
+}
+
+void trace_request(struct tftp_trace *t, uint32_t id, uint64_t ts, uint16_t op,
+                   uint32_t addr, uint16_t port, const char *filename);
+
+// exporte les anneaux de n workers (JSON Chrome trace-event), -1 si erreur
+int trace_write_json(const char *path, const struct tftp_trace *t, uint32_t n);
+
+#endif
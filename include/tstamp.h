@@ -0,0 +1,48 @@
+#ifndef TFTP_TSTAMP_H
+#define TFTP_TSTAMP_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/* Horodatage noyau des datagrammes (SO_TIMESTAMPING), pour les aller-retours :
+ * - réception : chaque datagramme porte l'heure de son arrivée dans le noyau
+ *   (logicielle, et matérielle si la carte réseau est configurée pour) ;
+ *   l'aller-retour ne compte plus l'attente dans la file de la socket ni
+ *   celle de la boucle, mesurée à part (âge du datagramme à son traitement)
+ * - émission (facultative : -X) : le datagramme mesuré demande son heure de
+ *   passage au pilote, relue ensuite dans la file d'erreurs de la socket
+ *   (MSG_ERRQUEUE, signalée par EPOLLERR) : un appel système de plus par
+ *   échantillon
+ * - horodatages logiciels (CLOCK_REALTIME) ramenés à CLOCK_MONOTONIC, l'horloge
+ *   de la boucle ; matériels (horloge de la carte) comparés seulement entre eux
+ * - option refusée ou horodatage absent : horloge monotone lue en espace
+ *   utilisateur à la réception / à l'émission
+ */
+
+struct tstamp
+{
+    uint64_t sw; // ns CLOCK_MONOTONIC, 0 : absent
+    uint64_t hw; // ns horloge de la carte, 0 : absent
+};
+
+// horodatage des réceptions (et report de ceux des émissions demandées) ;
+// -1 (errno) si refusé
+int tstamp_enable(int sock);
+// *ts rempli si cm est un SCM_TIMESTAMPING, inchangé sinon
+void tstamp_cmsg(const struct cmsghdr *cm, struct tstamp *ts);
+// octets de msg_control à prévoir pour un SCM_TIMESTAMPING
+#define TSTAMP_CMSG_SPACE CMSG_SPACE(3 * sizeof(struct timespec))
+
+// sendto qui demande l'heure d'émission de ce datagramme
+ssize_t tstamp_sendto(int sock, const void *buf, size_t len, const struct sockaddr_in *to);
+// une entrée de la file d'erreurs : horodatage d'émission dans *ts (champs
+// présents seulement) ; 1 si lue, 0 si la file était vide
+int tstamp_tx(int sock, struct tstamp *ts);
+
+// rx - tx : horloges de la carte si les deux en ont une, sinon logicielles
+// (0 si rx précède tx)
+uint64_t tstamp_diff(const struct tstamp *tx, const struct tstamp *rx);
+
+#endif
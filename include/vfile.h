@@ -0,0 +1,98 @@
+#ifndef TFTP_VFILE_H
+#define TFTP_VFILE_H
+
+#include "memstore.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Fichiers virtuels générés par client (configurations PXE / GRUB) :
+ * - une règle associe un motif de nom ("pxelinux.cfg/01-*", un seul '*') à un
+ *   gabarit texte ; ${nom} y est remplacé par une variable du client
+ * - variables d'un client : inventaire local, une ligne par client
+ *     # clé              variables
+ *     52-54-00-12-34-56  hostname=node7 role=compute
+ *     10.0.0.8           hostname=node8 role=storage
+ *     default            role=unknown
+ *   clé cherchée : partie du nom couverte par '*', puis IP du client, puis
+ *   "default" ; sans entrée, la règle ne s'applique pas (fichier du disque)
+ * - variables intégrées : ${ip}, ${file} (nom demandé), ${match} (partie '*')
+ *   ; variable inconnue = chaîne vide
+ * - rendu gardé en cache par (version du gabarit, version de l'inventaire,
+ *   fichier, client) : un rendu par client, pas par requête ; gabarits et
+ *   inventaire sont re-vérifiés (stat) au plus une fois par seconde, toute
+ *   modification change la version et invalide les rendus concernés
+ *
+ * Le rendu est servi comme un objet en mémoire (memstore.h) : la session garde
+ * sa référence même si le cache est invalidé pendant le transfert.
+ */
+
+#define VFILE_MAX_RULES 16
+#define VFILE_CACHE_MAX 65536 // rendus gardés au plus (au-delà : rendu à chaque requête)
+
+struct vfile_src // fichier surveillé (gabarit ou inventaire)
+{
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    int64_t mtime_ns;
+    uint32_t version; // change à chaque rechargement
+};
+
+struct vfile_rule
+{
+    char *prefix; // motif coupé autour du '*'
+    char *suffix; // NULL : motif sans '*', nom exact
+    struct vfile_src src;
+    char *tpl; // gabarit chargé (terminé par 0)
+};
+
+struct vfile_inv_entry
+{
+    char *key;
+    char *vars; // "nom=valeur\0nom=valeur\0\0"
+    struct vfile_inv_entry *next;
+};
+
+struct vfile_cached
+{
+    char *key; // "fichier\0ip"
+    size_t key_len;
+    uint32_t tpl_version;
+    uint32_t inv_version;
+    struct tftp_memobj *obj;
+    struct vfile_cached *next;
+};
+
+struct tftp_vfile
+{
+    pthread_mutex_t lock;
+    struct vfile_rule rules[VFILE_MAX_RULES];
+    uint32_t nrules;
+    struct vfile_src inv;
+    struct vfile_inv_entry **inv_buckets; // hash de l'inventaire
+    uint32_t inv_mask;
+    struct vfile_cached **cache;
+    uint32_t cache_mask;
+    uint32_t cached;
+    uint64_t next_check; // ns, prochaine vérification des fichiers sources
+    uint64_t renders;    // statistiques
+    uint64_t hits;
+};
+
+int vfile_init(struct tftp_vfile *v);
+void vfile_free(struct tftp_vfile *v);
+
+// -1 si le gabarit est illisible ou trop de règles (message sur stderr)
+int vfile_add_rule(struct tftp_vfile *v, const char *pattern, const char *template_path);
+int vfile_set_inventory(struct tftp_vfile *v, const char *path);
+
+// 1 si une règle couvre ce nom (sans rendu : WRQ refusé)
+int vfile_match(struct tftp_vfile *v, const char *filename);
+
+// rendu pour ce client (référence à rendre avec memobj_release), NULL si
+// aucune règle ne s'applique
+struct tftp_memobj *vfile_get(struct tftp_vfile *v, const char *filename, uint32_t client_addr);
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef TFTP_ZCACHE_H
+#define TFTP_ZCACHE_H
+
+#include "memstore.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/* Variantes compressées (lz.h) des fichiers servis, pour les RRQ avec
+ * l'option compress :
+ * - jamais de compression d'un fichier entier sur la boucle d'un worker : un
+ *   RRQ sans variante gardée compresse ses trames (LZ_FRAME octets) au fil
+ *   des blocs envoyés (zcache_stream) ; le flux complet qu'il a produit
+ *   devient la variante, servie depuis la mémoire comme un objet (memstore.h)
+ *   à chaque RRQ compressé suivant
+ * - entrée valable tant que le fichier garde le même (dev, inode, taille,
+ *   mtime) ; sinon remplacée par le flux du RRQ suivant
+ * - un fichier jugé incompressible sur échantillon (zcache_worth) est retenu
+ *   comme tel : ni nouvel échantillon ni compression aux requêtes suivantes
+ * - max_bytes pour toutes les entrées (variantes, noms et en-têtes) : la
+ *   place d'une nouvelle variante est prise aux moins récemment servies
+ *   (LRU) qu'aucun transfert ne sert ; entrée d'une ancienne version du
+ *   fichier retirée dès la recherche suivante
+ * - place introuvable, ou fichier au-delà de ZCACHE_MAX_FILE : flux produit à
+ *   chaque requête, fenêtre seulement en mémoire
+ * Partagé par les workers (verrou pris pour la recherche et l'insertion,
+ * jamais pendant la compression).
+ */
+
+#define ZCACHE_MAX_FILE (64ULL << 20) // plus gros fichier dont la variante est gardée
+#define ZCACHE_DEFAULT_MB 256
+
+// version d'un fichier
+struct zcache_key
+{
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    int64_t mtime_ns;
+};
+
+struct zcache_entry
+{
+    char *name;
+    struct zcache_key key;
+    struct tftp_memobj *obj; // NULL : incompressible
+    size_t cost;             // octets comptés dans bytes
+    struct zcache_entry *next;
+    struct zcache_entry *lru_prev; // ordre d'usage, plus récent en tête
+    struct zcache_entry *lru_next;
+};
+
+struct tftp_zcache
+{
+    pthread_mutex_t lock;
+    struct zcache_entry **buckets; // hash du nom
+    uint32_t mask;
+    struct zcache_entry *lru_head; // servie en dernier
+    struct zcache_entry *lru_tail; // première évincée
+    size_t bytes;     // somme des coûts des entrées
+    size_t max_bytes;
+    uint64_t compressed; // statistiques
+    uint64_t hits;
+    uint64_t skipped;    // incompressibles
+    uint64_t evicted;    // entrées retirées pour faire de la place
+};
+
+int zcache_init(struct tftp_zcache *z, size_t max_bytes);
+void zcache_free(struct tftp_zcache *z);
+
+// variante gardée du fichier st : 1 et *o (référence à rendre avec
+// memobj_release), 0 si aucune (z NULL compris), -1 si incompressible
+int zcache_lookup(struct tftp_zcache *z, const char *name, const struct stat *st, struct tftp_memobj **o);
+// fichier st retenu incompressible (z NULL : rien)
+void zcache_skip(struct tftp_zcache *z, const char *name, const struct stat *st);
+
+// lecture du contenu (fichier, objet en mémoire, manifeste dédupliqué) :
+// octets [off, off + len) dans buf, moins en fin de contenu ; -1 si erreur
+typedef ssize_t (*zcache_read_fn)(void *ctx, uint8_t *buf, size_t len, uint64_t off);
+// échantillon du contenu (lz_worth) lu par rd, sans le lire en entier ; 1 si
+// la compression vaut la peine
+int zcache_worth(zcache_read_fn rd, void *ctx, uint64_t size);
+
+/* Flux compressé d'un RRQ, produit trame par trame à la demande : octets
+ * [base, base + len) du flux gardés, trames entières, depuis la plus ancienne
+ * encore utile (retransmissions de la fenêtre) ; flux complet gardé s'il est
+ * destiné au cache.
+ */
+struct zcache_stream
+{
+    struct tftp_zcache *z; // flux complet gardé pour ce cache, NULL : fenêtre seulement
+    struct zcache_key key; // ... sous cette version du fichier
+    uint64_t size;  // taille du contenu
+    uint64_t src;   // prochain octet du contenu à compresser
+    uint64_t sbase; // octet du contenu où commence la trame en tête de buf
+    uint64_t base;  // ... et son offset dans le flux
+    uint8_t *buf;
+    size_t len;
+    size_t cap;
+};
+
+// flux d'un contenu de size octets ; z et st : flux complet gardé pour la
+// variante du fichier st s'il n'est pas trop gros ; NULL si allocation impossible
+struct zcache_stream *zcache_stream_new(struct tftp_zcache *z, const struct stat *st, uint64_t size);
+// flux repris à la trame qui commence à l'octet src du contenu et à base
+// dans le flux (passation, handoff.h), sans cache
+struct zcache_stream *zcache_stream_at(uint64_t size, uint64_t src, uint64_t base);
+// octets [off, off + len) du flux dans out, moins en fin de flux ; trames
+// manquantes compressées depuis le contenu (rd) ; sans cache, trames finies
+// avant from oubliées (off >= from) ; -1 si lecture ou allocation impossible
+ssize_t zcache_stream_read(struct zcache_stream *s, zcache_read_fn rd, void *ctx, uint64_t off, uint8_t *out,
+                           size_t len, uint64_t from);
+// flux complet produit pour le cache : devient la variante du fichier,
+// insérée au cache ; retourne une référence pour la session qui l'a produite
+// (NULL sinon : flux pas encore complet, sans cache ou allocation impossible)
+struct tftp_memobj *zcache_stream_finish(struct zcache_stream *s, const char *name);
+void zcache_stream_free(struct zcache_stream *s);
+
+#endif
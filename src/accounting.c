@@ -0,0 +1,119 @@
+#include "accounting.h"
+#include "tftp_utils.h"
+#include <fcntl.h>
+#include <sys/time.h>
+#include <time.h>
+
+static const char *const result_names[XFER_RESULTS] = {
+    "ok", "timeout", "peer_error", "rejected", "local_error", "shutdown", "checksum",
+};
+
+const char *xfer_result_name(enum tftp_xfer_result r)
+{
+    return (unsigned)r < XFER_RESULTS ? result_names[r] : "unknown";
+}
+
+// nom de fichier entre guillemets, '"' et '\' échappés, contrôles remplacés
+static size_t quote(char *out, size_t size, const char *s)
+{
+    size_t o = 0;
+    if (o + 1 < size)
+        out[o++] = '"';
+    for (; s && *s && o + 3 < size; s++)
+    {
+        unsigned char ch = (unsigned char)*s;
+        if (ch == '"' || ch == '\\')
+            out[o++] = '\\';
+        out[o++] = ch < 0x20 ? '?' : (char)ch;
+    }
+    if (o + 1 < size)
+        out[o++] = '"';
+    out[o < size ? o : size - 1] = 0;
+    return o;
+}
+
+size_t xfer_format(const struct tftp_xfer_stats *s, char *buf, size_t size)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    struct tm tmv;
+    gmtime_r(&tv.tv_sec, &tmv);
+    char when[32];
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", &tmv);
+
+    char ip[INET_ADDRSTRLEN];
+    struct in_addr a;
+    a.s_addr = s->peer_addr;
+    inet_ntop(AF_INET, &a, ip, sizeof(ip));
+
+    char file[600];
+    quote(file, sizeof(file), s->file);
+
+    char tsize[24] = "-";
+    if (s->tsize >= 0)
+        snprintf(tsize, sizeof(tsize), "%lld", (long long)s->tsize);
+
+    double ms = (double)s->duration_ns / 1e6;
+    uint64_t goodput = s->duration_ns ? (uint64_t)((double)s->bytes * 1e9 / (double)s->duration_ns) : 0;
+
+    int n = snprintf(buf, size,
+                     "ts=%s.%03ldZ side=%s dir=%s peer=%s:%u file=%s result=%s bytes=%llu "
+                     "blocks=%u blksize=%u windowsize=%u tsize=%s duration_ms=%.3f goodput_Bps=%llu "
+                     "retransmits=%u duplicates=%u rtt_samples=%u",
+                     when, (long)(tv.tv_usec / 1000), s->side, s->op == OPCODE_RRQ ? "get" : "put",
+                     ip, (unsigned)ntohs(s->peer_port), file, xfer_result_name(s->result),
+                     (unsigned long long)s->bytes, s->blocks, s->blksize, s->windowsize, tsize, ms,
+                     (unsigned long long)goodput, s->retransmits, s->duplicates, s->rtt.samples);
+    if (n < 0)
+        return 0;
+    size_t len = (size_t)n < size ? (size_t)n : size - 1;
+
+    if (s->rtt.samples && len < size)
+    {
+        n = snprintf(buf + len, size - len, " rtt_min_us=%u rtt_avg_us=%llu rtt_max_us=%u",
+                     s->rtt.min_ns / 1000, (unsigned long long)(s->rtt.sum_ns / s->rtt.samples / 1000),
+                     s->rtt.max_ns / 1000);
+        if (n > 0)
+            len += (size_t)n < size - len ? (size_t)n : size - len - 1;
+    }
+    if (s->rxq.samples && len < size)
+    {
+        n = snprintf(buf + len, size - len, " rxq_avg_us=%llu rxq_max_us=%u",
+                     (unsigned long long)(s->rxq.sum_ns / s->rxq.samples / 1000), s->rxq.max_ns / 1000);
+        if (n > 0)
+            len += (size_t)n < size - len ? (size_t)n : size - len - 1;
+    }
+    if (s->offset && len < size)
+    {
+        n = snprintf(buf + len, size - len, " offset=%llu", (unsigned long long)s->offset);
+        if (n > 0)
+            len += (size_t)n < size - len ? (size_t)n : size - len - 1;
+    }
+    if (s->drops && len < size)
+    {
+        n = snprintf(buf + len, size - len, " drops=%u", s->drops);
+        if (n > 0)
+            len += (size_t)n < size - len ? (size_t)n : size - len - 1;
+    }
+    if (len + 1 < size)
+    {
+        buf[len++] = '\n';
+        buf[len] = 0;
+    }
+    return len;
+}
+
+int acct_open(const char *path)
+{
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        perror(path);
+    return fd;
+}
+
+int acct_write(int fd, const struct tftp_xfer_stats *s)
+{
+    char line[1024];
+    size_t len = xfer_format(s, line, sizeof(line));
+    return write(fd, line, len) == (ssize_t)len ? 0 : -1;
+}
@@ -0,0 +1,157 @@
+#define _GNU_SOURCE
+#include "affinity.h"
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+_Static_assert(sizeof(struct affinity_mask) == sizeof(cpu_set_t), "affinity_mask != cpu_set_t");
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+// en-têtes du noyau antérieurs à 6.9
+#ifndef EPIOCSPARAMS
+struct epoll_params
+{
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
+
+#define BUSY_POLL_BUDGET 64 // paquets par passage (valeur du noyau par défaut)
+
+int affinity_parse(const char *spec, int *cpus, int max)
+{
+    int n = 0;
+    if (strcmp(spec, "auto") == 0)
+    {
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof(set), &set) < 0)
+            return -1;
+        for (int c = 0; c < CPU_SETSIZE && n < max; c++)
+        {
+            if (CPU_ISSET(c, &set))
+                cpus[n++] = c;
+        }
+        return n ? n : -1;
+    }
+
+    const char *p = spec;
+    while (*p)
+    {
+        char *end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (end == p || lo < 0 || lo >= AFFINITY_MAX_CPUS)
+            return -1;
+        p = end;
+        if (*p == '-')
+        {
+            hi = strtol(p + 1, &end, 10);
+            if (end == p + 1 || hi < lo || hi >= AFFINITY_MAX_CPUS)
+                return -1;
+            p = end;
+        }
+        for (long c = lo; c <= hi && n < max; c++)
+            cpus[n++] = (int)c;
+        if (*p == ',' && p[1])
+            p++;
+        else if (*p)
+            return -1;
+    }
+    return n ? n : -1;
+}
+
+int affinity_pin(int cpu)
+{
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (r != 0)
+    {
+        errno = r;
+        return -1;
+    }
+    return 0;
+}
+
+int affinity_get(struct affinity_mask *m)
+{
+    int r = pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), (cpu_set_t *)m);
+    if (r != 0)
+    {
+        errno = r;
+        return -1;
+    }
+    return 0;
+}
+
+int affinity_set(const struct affinity_mask *m)
+{
+    int r = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), (const cpu_set_t *)m);
+    if (r != 0)
+    {
+        errno = r;
+        return -1;
+    }
+    return 0;
+}
+
+int affinity_node(int cpu)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *d = opendir(path);
+    if (!d)
+        return -1;
+    int node = -1;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL)
+    {
+        if (strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9')
+        {
+            node = atoi(e->d_name + 4);
+            break;
+        }
+    }
+    closedir(d);
+    return node;
+}
+
+int affinity_steer(int sock, int cpu)
+{
+    return setsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+}
+
+int affinity_busy_poll(int sock, uint32_t usecs)
+{
+    int us = (int)usecs, one = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us)) < 0)
+        return -1;
+    return setsockopt(sock, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+}
+
+int affinity_epoll_busy_poll(int epfd, uint32_t usecs)
+{
+    struct epoll_params p;
+    memset(&p, 0, sizeof(p));
+    p.busy_poll_usecs = usecs;
+    p.busy_poll_budget = BUSY_POLL_BUDGET;
+    p.prefer_busy_poll = 1;
+    return ioctl(epfd, EPIOCSPARAMS, &p);
+}
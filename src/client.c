@@ -1,378 +1,801 @@
-// =============================== client.c ===============================
-// - UDP + timeout(select) + retransmissions
-// - Gestion TID (port session serveur)
-// - RRQ/WRQ/DATA/ACK/ERROR (sans options)
-
-#include "client.h"
-#include "sockets.h"
-#include <stdio.h>
-#include <string.h>
-
-/* ------------------- Builders / Parsers ------------------- */
-
-static void print_error_pkt(const uint8_t *buf, size_t len)
-{
-    if (len < 4)
-    {
-        fprintf(stderr, "TFTP ERROR (short)\n");
-        return;
-    }
-    uint16_t code;
-    memcpy(&code, buf + 2, 2);
-    code = ntohs(code);
-    const char *msg = (const char *)(buf + 4);
-    fprintf(stderr, "TFTP ERROR %u: %.*s\n", code, (int)(len - 4), msg);
-}
-
-/* ------------------- API: GET (RRQ) ------------------- */
-int tftp_client_get(const char *server_ip, uint16_t server_port,
-                    const char *remote_file, const char *local_file)
-{
-    int sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0)
-        die("socket");
-
-    struct sockaddr_in srv;
-    memset(&srv, 0, sizeof(srv));
-    srv.sin_family = AF_INET;
-    srv.sin_port = htons(server_port);
-    if (inet_pton(AF_INET, server_ip, &srv.sin_addr) != 1)
-    {
-        fprintf(stderr, "Bad server IP\n");
-        close(sock);
-        return -1;
-    }
-
-    FILE *out = fopen(local_file, "wb");
-    if (!out)
-    {
-        perror("fopen local");
-        close(sock);
-        return -1;
-    }
-
-    uint8_t rx[4 + DATA_SIZE + 64];
-    uint8_t last_sent[4 + DATA_SIZE + 64];
-    size_t last_len = 0;
-
-    int rrq_len = build_rrq_wrq(OPCODE_RRQ, last_sent, sizeof(last_sent), remote_file);
-    if (rrq_len < 0)
-    {
-        fprintf(stderr, "RRQ build failed\n");
-        fclose(out);
-        close(sock);
-        return -1;
-    }
-
-    if (sendto(sock, last_sent, rrq_len, 0, (struct sockaddr *)&srv, sizeof(srv)) < 0)
-    {
-        perror("sendto RRQ");
-        fclose(out);
-        close(sock);
-        return -1;
-    }
-    last_len = (size_t)rrq_len;
-
-    struct sockaddr_in tid;
-    memset(&tid, 0, sizeof(tid));
-    int tid_known = 0;
-
-    uint16_t expected = 1;
-    int retries = 0;
-
-    for (;;)
-    {
-        struct sockaddr_in src;
-        ssize_t n = recvfrom_timeout(sock, rx, sizeof(rx), &src, TIMEOUT_MS);
-        if (n < 0)
-        {
-            perror("recvfrom");
-            fclose(out);
-            close(sock);
-            return -1;
-        }
-
-        if (n == 0)
-        {
-            if (++retries > MAX_RETRIES)
-            {
-                fprintf(stderr, "GET: timeout (max retries)\n");
-                fclose(out);
-                close(sock);
-                return -1;
-            }
-            const struct sockaddr_in *dst = tid_known ? &tid : &srv;
-            sendto(sock, last_sent, last_len, 0, (struct sockaddr *)dst, sizeof(*dst));
-            continue;
-        }
-
-        if (!tid_known)
-        {
-            tid = src;
-            tid_known = 1;
-        }
-        else if (!addr_equal(&src, &tid))
-            continue; // TID check
-
-        uint16_t op;
-        if (parse_opcode(rx, (size_t)n, &op) < 0)
-            continue;
-
-        if (op == OPCODE_ERROR)
-        {
-            print_error_pkt(rx, (size_t)n);
-            fclose(out);
-            close(sock);
-            return -1;
-        }
-        if (op != OPCODE_DATA)
-            continue;
-
-        uint16_t block;
-        if (parse_block(rx, (size_t)n, &block) < 0)
-            continue;
-
-        size_t data_len = (size_t)n - 4;
-        const uint8_t *data = rx + 4;
-
-        if (block == expected)
-        {
-            if (fwrite(data, 1, data_len, out) != data_len)
-            {
-                perror("fwrite");
-                fclose(out);
-                close(sock);
-                return -1;
-            }
-            int ack_len = build_ack(last_sent, sizeof(last_sent), block);
-            sendto(sock, last_sent, ack_len, 0, (struct sockaddr *)&tid, sizeof(tid));
-            last_len = (size_t)ack_len;
-
-            retries = 0;
-            expected++;
-
-            if (data_len < DATA_SIZE)
-                break; // last block
-        }
-        else if (block == (uint16_t)(expected - 1))
-        {
-            // duplicate DATA -> re-ACK
-            int ack_len = build_ack(last_sent, sizeof(last_sent), block);
-            sendto(sock, last_sent, ack_len, 0, (struct sockaddr *)&tid, sizeof(tid));
-            last_len = (size_t)ack_len;
-        }
-    }
-
-    fclose(out);
-    close(sock);
-    printf("Le fichier a bien été récupéré\n");
-
-    return 0;
-}
-
-/* ------------------- API: PUT (WRQ) ------------------- */
-int tftp_client_put(const char *server_ip, uint16_t server_port,
-                    const char *local_file, const char *remote_file)
-{
-    int sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0)
-        die("socket");
-
-    struct sockaddr_in srv;
-    memset(&srv, 0, sizeof(srv));
-    srv.sin_family = AF_INET;
-    srv.sin_port = htons(server_port);
-    if (inet_pton(AF_INET, server_ip, &srv.sin_addr) != 1)
-    {
-        fprintf(stderr, "Bad server IP\n");
-        close(sock);
-        return -1;
-    }
-
-    FILE *in = fopen(local_file, "rb");
-    if (!in)
-    {
-        perror("fopen local");
-        close(sock);
-        return -1;
-    }
-
-    uint8_t rx[4 + DATA_SIZE + 64];
-    uint8_t last_sent[4 + DATA_SIZE + 64];
-    size_t last_len = 0;
-
-    int wrq_len = build_rrq_wrq(OPCODE_WRQ, last_sent, sizeof(last_sent), remote_file);
-    if (wrq_len < 0)
-    {
-        fprintf(stderr, "WRQ build failed\n");
-        fclose(in);
-        close(sock);
-        return -1;
-    }
-
-    sendto(sock, last_sent, wrq_len, 0, (struct sockaddr *)&srv, sizeof(srv));
-    last_len = (size_t)wrq_len;
-
-    struct sockaddr_in tid;
-    memset(&tid, 0, sizeof(tid));
-    int tid_known = 0;
-    int retries = 0;
-
-    // Wait ACK(0)
-    for (;;)
-    {
-        struct sockaddr_in src;
-        ssize_t n = recvfrom_timeout(sock, rx, sizeof(rx), &src, TIMEOUT_MS);
-        if (n < 0)
-        {
-            perror("recvfrom");
-            fclose(in);
-            close(sock);
-            return -1;
-        }
-
-        if (n == 0)
-        {
-            if (++retries > MAX_RETRIES)
-            {
-                fprintf(stderr, "PUT: timeout waiting ACK(0)\n");
-                fclose(in);
-                close(sock);
-                return -1;
-            }
-            sendto(sock, last_sent, last_len, 0, (struct sockaddr *)&srv, sizeof(srv));
-            continue;
-        }
-
-        if (!tid_known)
-        {
-            tid = src;
-            tid_known = 1;
-        }
-        else if (!addr_equal(&src, &tid))
-            continue;
-
-        uint16_t op;
-        if (parse_opcode(rx, (size_t)n, &op) < 0)
-            continue;
-
-        if (op == OPCODE_ERROR)
-        {
-            print_error_pkt(rx, (size_t)n);
-            fclose(in);
-            close(sock);
-            return -1;
-        }
-        if (op != OPCODE_ACK)
-            continue;
-
-        uint16_t b;
-        if (parse_block(rx, (size_t)n, &b) < 0)
-            continue;
-        if (b == 0)
-            break;
-    }
-
-    uint16_t block = 1;
-    for (;;)
-    {
-        uint8_t data[DATA_SIZE];
-        size_t r = fread(data, 1, DATA_SIZE, in);
-        if (ferror(in))
-        {
-            perror("fread");
-            fclose(in);
-            close(sock);
-            return -1;
-        }
-
-        int dl = build_data(last_sent, sizeof(last_sent), block, data, r);
-        sendto(sock, last_sent, dl, 0, (struct sockaddr *)&tid, sizeof(tid));
-        last_len = (size_t)dl;
-
-        retries = 0;
-        for (;;)
-        {
-            struct sockaddr_in src;
-            ssize_t n = recvfrom_timeout(sock, rx, sizeof(rx), &src, TIMEOUT_MS);
-            if (n < 0)
-            {
-                perror("recvfrom");
-                fclose(in);
-                close(sock);
-                return -1;
-            }
-
-            if (n == 0)
-            {
-                if (++retries > MAX_RETRIES)
-                {
-                    fprintf(stderr, "PUT: timeout waiting ACK(%u)\n", block);
-                    fclose(in);
-                    close(sock);
-                    return -1;
-                }
-                sendto(sock, last_sent, last_len, 0, (struct sockaddr *)&tid, sizeof(tid));
-                continue;
-            }
-
-            if (!addr_equal(&src, &tid))
-                continue;
-
-            uint16_t op;
-            if (parse_opcode(rx, (size_t)n, &op) < 0)
-                continue;
-
-            if (op == OPCODE_ERROR)
-            {
-                print_error_pkt(rx, (size_t)n);
-                fclose(in);
-                close(sock);
-                return -1;
-            }
-            if (op != OPCODE_ACK)
-                continue;
-
-            uint16_t b;
-            if (parse_block(rx, (size_t)n, &b) < 0)
-                continue;
-            if (b == block)
-                break;
-        }
-
-        if (r < DATA_SIZE)
-            break; // last block
-        block++;
-    }
-
-    fclose(in);
-    close(sock);
-    printf("Le fichier a bien été envoyé\n");
-    return 0;
-}
-
-int main(int argc, char **argv)
-{
-    if (argc < 6)
-    {
-        fprintf(stderr,
-                "Usage:\n"
-                "  %s get <server_ip> <port> <remote_file> <local_file>\n"
-                "  %s put <server_ip> <port> <local_file> <remote_file>\n",
-                argv[0], argv[0]);
-        return 1;
-    }
-
-    if (strcmp(argv[1], "get") == 0)
-    {
-        return tftp_client_get(argv[2], atoi(argv[3]), argv[4], argv[5]);
-    }
-
-    if (strcmp(argv[1], "put") == 0)
-    {
-        return tftp_client_put(argv[2], atoi(argv[3]), argv[4], argv[5]);
-    }
-
-    fprintf(stderr, "Unknown command: %s\n", argv[1]);
-    return 1;
-}
\ No newline at end of file
+// =============================== client.c ===============================
+// - API bloquante (get / put) au-dessus de libtftp : poll sur la socket du transfert
+// - fichiers locaux : puits stdio (GET), source fichier de libtftp (PUT)
+// - sans fichier : tampon mémoire ou puits / source de l'appelant
+// - bilan du transfert (accounting.h) si opts->stats est fourni
+// - reprise (opts->resume) : GET repart de la taille du fichier local, PUT de
+//   ce que le serveur a déjà ; refusée par l'une des extrémités => transfert complet
+// - GET par plages (opts->stripes) : K sessions simultanées, pwrite dans un
+//   fichier préalloué
+// - batch : N transferts simultanés dans une seule boucle epoll (manifeste)
+// - PUT espacés (opts->pace_rate) : attentes à la microseconde (ppoll,
+//   epoll_pwait2)
+
+#define _GNU_SOURCE // ppoll
+#include "client.h"
+#include "sockets.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+
+static const struct tftp_client_opts defaults = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL};
+
+static int parse_server(const char *server_ip, uint16_t server_port, struct sockaddr_in *srv)
+{
+    memset(srv, 0, sizeof(*srv));
+    srv->sin_family = AF_INET;
+    srv->sin_port = htons(server_port);
+    if (inet_pton(AF_INET, server_ip, &srv->sin_addr) != 1)
+    {
+        fprintf(stderr, "Bad server IP\n");
+        return -1;
+    }
+    return 0;
+}
+
+// bilan d'un transfert qui n'a pas pu démarrer
+static void stats_failed(struct tftp_xfer_stats *xs, uint16_t op, const char *remote_file,
+                         const struct sockaddr_in *srv)
+{
+    memset(xs, 0, sizeof(*xs));
+    xs->side = "client";
+    xs->file = remote_file;
+    xs->op = op;
+    xs->peer_addr = srv->sin_addr.s_addr;
+    xs->peer_port = srv->sin_port;
+    xs->result = XFER_LOCAL_ERROR;
+    xs->blksize = DATA_SIZE;
+    xs->windowsize = 1;
+    xs->tsize = -1;
+}
+
+static void req_init(struct tftp_xfer_req *req, uint16_t op, const struct sockaddr_in *srv,
+                     const char *remote_file, const struct tftp_client_opts *o)
+{
+    memset(req, 0, sizeof(*req));
+    req->op = op;
+    req->server = *srv;
+    req->remote = remote_file;
+    req->blksize = o->blksize;
+    req->windowsize = o->windowsize;
+    req->netascii = o->netascii;
+    req->checksum = o->checksum;
+    req->compress = o->compress;
+    req->tx_timestamps = o->tx_timestamps;
+    req->pace_rate = o->pace_rate;
+}
+
+// boucle bloquante autour d'une poignée libtftp
+static int run_once(const struct tftp_xfer_req *req, const struct tftp_client_opts *o)
+{
+    const char *what = req->op == OPCODE_RRQ ? "GET" : "PUT";
+    struct tftp_xfer *x = tftp_xfer_start(req);
+    if (!x)
+    {
+        perror(what);
+        if (o->stats)
+            stats_failed(o->stats, req->op, req->remote, &req->server);
+        return -1;
+    }
+
+    while (!tftp_xfer_done(x))
+    {
+        struct pollfd p = {tftp_xfer_fd(x), POLLIN, 0};
+        long us = tftp_xfer_timeout_us(x);
+        struct timespec ts = {us / 1000000, (us % 1000000) * 1000};
+        if (ppoll(&p, 1, us < 0 ? NULL : &ts, NULL) < 0 && errno != EINTR)
+        {
+            perror("ppoll");
+            break;
+        }
+        tftp_xfer_process_events(x);
+    }
+
+    enum tftp_xfer_result r = tftp_xfer_done(x) ? tftp_xfer_result(x) : XFER_LOCAL_ERROR;
+    if (r != XFER_OK)
+        fprintf(stderr, "%s: %s\n", what, tftp_xfer_error(x));
+    if (o->stats)
+    {
+        *o->stats = *tftp_xfer_stats(x);
+        o->stats->file = req->remote; // la copie de la poignée disparaît avec elle
+        o->stats->result = r;
+    }
+    tftp_xfer_free(x);
+    return r == XFER_OK ? 0 : -1;
+}
+
+// reprise refusée de notre côté (OACK incohérent, préfixe du serveur
+// différent) : on recommence une fois en transfert complet
+static int run_blocking(const struct tftp_xfer_req *req, const struct tftp_client_opts *o)
+{
+    struct tftp_xfer_stats xs;
+    struct tftp_client_opts once = *o;
+    if (!once.stats)
+        once.stats = &xs;
+    int ret = run_once(req, &once);
+    if (ret < 0 && req->offset && once.stats->result == XFER_REJECTED)
+    {
+        struct tftp_xfer_req full = *req;
+        full.offset = 0;
+        full.offset_check = 0;
+        ret = run_once(&full, &once);
+    }
+    return ret;
+}
+
+// GET repris depuis un fichier local : offset = sa taille, empreinte de la fin
+static void resume_from_file(struct tftp_xfer_req *req, int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+        return;
+    req->offset = (uint64_t)st.st_size;
+    req->offset_check = resume_crc_fd(fd, req->offset, &req->offset_crc) == 0;
+}
+
+// GET vérifié terminé (ret) : publié sous local, sinon rien du transfert ne
+// reste ; reprise (resumed) : somme différente, fichier ramené au préfixe
+// d'avant, autre échec, blocs gardés pour la reprise suivante ; -1 si la
+// publication échoue
+static int local_sum_end(int fd, const char *local, int ret, const struct tftp_xfer_stats *resumed)
+{
+    if (ret < 0 && resumed)
+        return resumed->result == XFER_CHECKSUM ? ftruncate(fd, (off_t)resumed->offset) : 0;
+    if (ret < 0)
+    {
+        sum_dest_discard(fd, local);
+        return 0;
+    }
+    if (sum_dest_commit(fd, local) < 0)
+    {
+        perror(local);
+        return -1;
+    }
+    return 0;
+}
+
+/* ------------------- API: GET (RRQ) ------------------- */
+
+// puits stdio : les blocs arrivent en ordre, fwrite bufferisé évite un
+// appel système par bloc ; seek seulement si la reprise a été refusée
+struct stdio_sink
+{
+    FILE *f;
+    uint64_t pos;
+};
+
+static int stdio_write(void *ctx, uint64_t off, const uint8_t *data, size_t len)
+{
+    struct stdio_sink *s = ctx;
+    if (off != s->pos && fseeko(s->f, (off_t)off, SEEK_SET) < 0)
+        return -1;
+    s->pos = off + len;
+    return fwrite(data, 1, len, s->f) == len ? 0 : -1;
+}
+
+/* ------------------- API: GET PAR PLAGES ------------------- */
+
+#define STRIPES_MAX 64
+
+struct stripe
+{
+    uint64_t start, end; // plage [start, end) demandée
+    struct tftp_xfer *x;
+};
+
+// bilan d'une plage ajouté au bilan global
+static void stats_merge(struct tftp_xfer_stats *xs, const struct tftp_xfer_stats *s)
+{
+    xs->bytes += s->bytes;
+    xs->blocks += s->blocks;
+    xs->retransmits += s->retransmits;
+    xs->duplicates += s->duplicates;
+    xs->drops += s->drops;
+    rtt_merge(&xs->rtt, &s->rtt);
+    rtt_merge(&xs->rxq, &s->rxq);
+}
+
+// K transferts simultanés (un par plage), poll sur leurs sockets ; chaque plage
+// doit avoir été couverte en entier ; plages alignées sur le blksize accordé à
+// la sonde (o->blksize), redemandé tel quel par chaque plage
+static int run_stripes(const struct sockaddr_in *srv, const char *remote_file, int fd, uint64_t size,
+                       const struct tftp_client_opts *o, struct tftp_xfer_stats *xs)
+{
+    unsigned k = o->stripes > STRIPES_MAX ? STRIPES_MAX : o->stripes;
+    uint64_t blk = o->blksize ? o->blksize : DATA_SIZE;
+    uint64_t chunk = (size + k - 1) / k;
+    chunk += (blk - chunk % blk) % blk; // plages alignées sur les blocs
+
+    struct stat st;
+    int e;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (e = posix_fallocate(fd, 0, (off_t)size)) != 0)
+    {
+        fprintf(stderr, "posix_fallocate: %s\n", strerror(e));
+        return -1;
+    }
+
+    struct stripe s[STRIPES_MAX];
+    unsigned n = 0;
+    int ret = 0;
+    for (uint64_t start = 0; start < size && n < k; start += chunk, n++)
+    {
+        struct tftp_xfer_req req;
+        req_init(&req, OPCODE_RRQ, srv, remote_file, o);
+        tftp_sink_file(&req.sink, fd);
+        s[n].start = start;
+        s[n].end = size - start > chunk ? start + chunk : size;
+        req.offset = start;
+        req.length = s[n].end - start;
+        if ((s[n].x = tftp_xfer_start(&req)) == NULL)
+        {
+            perror("GET stripe");
+            ret = -1;
+            break;
+        }
+    }
+
+    for (unsigned active = n; ret == 0 && active > 0;)
+    {
+        struct pollfd p[STRIPES_MAX];
+        int timeout = -1;
+        for (unsigned i = 0; i < n; i++)
+        {
+            p[i].fd = tftp_xfer_fd(s[i].x); // -1 (terminé) : ignoré par poll
+            p[i].events = POLLIN;
+            int t = tftp_xfer_timeout_ms(s[i].x);
+            if (t >= 0 && (timeout < 0 || t < timeout))
+                timeout = t;
+        }
+        if (poll(p, n, timeout) < 0 && errno != EINTR)
+        {
+            perror("poll");
+            ret = -1;
+            break;
+        }
+        active = 0;
+        for (unsigned i = 0; i < n; i++)
+            active += tftp_xfer_process_events(s[i].x);
+    }
+
+    for (unsigned i = 0; i < n; i++)
+    {
+        const struct tftp_xfer_stats *ss = tftp_xfer_stats(s[i].x);
+        if (ret == 0 && tftp_xfer_result(s[i].x) != XFER_OK)
+        {
+            fprintf(stderr, "GET %s: stripe %u [%llu, %llu) incomplete: %s\n", remote_file, i,
+                    (unsigned long long)s[i].start, (unsigned long long)s[i].end,
+                    tftp_xfer_done(s[i].x) ? tftp_xfer_error(s[i].x) : "not finished");
+            ret = -1;
+        }
+        else if (ret == 0 && (ss->offset > s[i].start || ss->offset + ss->bytes < s[i].end))
+        {
+            fprintf(stderr, "GET %s: stripe %u [%llu, %llu) incomplete: server sent [%llu, %llu)\n", remote_file,
+                    i, (unsigned long long)s[i].start, (unsigned long long)s[i].end,
+                    (unsigned long long)ss->offset, (unsigned long long)(ss->offset + ss->bytes));
+            ret = -1;
+        }
+        stats_merge(xs, ss);
+        tftp_xfer_free(s[i].x);
+    }
+    return ret;
+}
+
+// sonde : 1 octet et tsize ; un serveur sans plages envoie tout le fichier, le
+// transfert est alors déjà fait ; plage acceptée sans tsize : taille inconnue,
+// transfert complet en une session ; checksum : publié si toutes les plages
+// ont leur somme
+static int get_striped(const struct sockaddr_in *srv, const char *remote_file, const char *local_file,
+                       const struct tftp_client_opts *o)
+{
+    int fd = o->checksum ? sum_dest_open(local_file) : open(local_file, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+    {
+        perror("open local");
+        return -1;
+    }
+
+    uint64_t t0 = now_ns();
+    struct tftp_xfer_stats xs;
+    struct tftp_client_opts po = *o;
+    po.stats = &xs;
+    struct tftp_xfer_req req;
+    req_init(&req, OPCODE_RRQ, srv, remote_file, o);
+    tftp_sink_file(&req.sink, fd);
+    req.length = 1;
+    req.tsize = 1;
+    int ret = run_blocking(&req, &po);
+    if (ret == 0 && xs.tsize < 0 && xs.bytes <= req.length)
+    {
+        req.length = 0;
+        if (ftruncate(fd, 0) < 0)
+        {
+            perror("ftruncate local");
+            ret = -1;
+        }
+        else
+            ret = run_blocking(&req, &po);
+        xs.duration_ns = now_ns() - t0;
+    }
+    else if (ret == 0 && xs.tsize > 0 && xs.bytes < (uint64_t)xs.tsize)
+    {
+        struct tftp_client_opts so = *o;
+        so.blksize = xs.blksize; // blksize réduit par le serveur : plages réalignées
+        ret = run_stripes(srv, remote_file, fd, (uint64_t)xs.tsize, &so, &xs);
+        xs.result = ret == 0 ? XFER_OK : XFER_LOCAL_ERROR;
+        xs.duration_ns = now_ns() - t0;
+        xs.offset = 0;
+    }
+    if (o->checksum && local_sum_end(fd, local_file, ret, NULL) < 0)
+        ret = -1;
+    if (close(fd) != 0 && ret == 0)
+    {
+        perror("close local");
+        ret = -1;
+    }
+    if (o->stats)
+        *o->stats = xs;
+    return ret;
+}
+
+int tftp_client_get_opts(const char *server_ip, uint16_t server_port,
+                         const char *remote_file, const char *local_file,
+                         const struct tftp_client_opts *o)
+{
+    if (!o)
+        o = &defaults;
+
+    struct sockaddr_in srv;
+    if (parse_server(server_ip, server_port, &srv) < 0)
+        return -1;
+
+    // reprise : une session après le contenu local ; flux compressé : un seul
+    if (o->stripes > 1 && !o->resume && !o->netascii && !o->compress)
+    {
+        int ret = get_striped(&srv, remote_file, local_file, o);
+        if (ret == 0 && !o->quiet)
+            printf("Le fichier a bien été récupéré\n");
+        return ret;
+    }
+
+    // reprise : fichier gardé (relu pour l'empreinte), les blocs reçus
+    // s'écrivent après ce qu'il contient ; netascii : tailles locale et réseau
+    // différentes, toujours un transfert complet ; checksum : reçu à part,
+    // publié si la somme concorde (tftp_utils.h)
+    int resume = o->resume && !o->netascii;
+    int verified = o->checksum && !o->netascii;
+    int fd = verified && !resume ? sum_dest_open(local_file)
+                                 : open(local_file, (resume ? O_RDWR : O_WRONLY | O_TRUNC) | O_CREAT | O_CLOEXEC, 0666);
+    FILE *out = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!out)
+    {
+        perror("fopen local");
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    struct tftp_xfer_req req;
+    req_init(&req, OPCODE_RRQ, &srv, remote_file, o);
+    if (resume)
+        resume_from_file(&req, fd);
+    struct stdio_sink sink = {out, 0}; // premier bloc : seek à l'offset retenu
+    req.sink.write = stdio_write;
+    req.sink.ctx = &sink;
+
+    struct tftp_xfer_stats xs;
+    struct tftp_client_opts ro = *o;
+    if (!ro.stats)
+        ro.stats = &xs;
+    int ret = run_blocking(&req, &ro);
+    if (fflush(out) != 0 && ret == 0)
+    {
+        perror("fflush local");
+        ret = -1;
+    }
+    // reprise refusée ou fichier distant raccourci : pas de reste de l'ancien contenu
+    if (ret == 0 && resume && ftruncate(fd, (off_t)(ro.stats->offset + ro.stats->bytes)) < 0)
+    {
+        perror("ftruncate local");
+        ret = -1;
+    }
+    if (verified && local_sum_end(fd, local_file, ret, resume ? ro.stats : NULL) < 0)
+        ret = -1;
+    if (fclose(out) != 0 && ret == 0)
+    {
+        perror("fclose local");
+        ret = -1;
+    }
+    if (ret == 0 && !o->quiet)
+        printf("Le fichier a bien été récupéré\n");
+    return ret;
+}
+
+int tftp_client_get(const char *server_ip, uint16_t server_port,
+                    const char *remote_file, const char *local_file)
+{
+    return tftp_client_get_opts(server_ip, server_port, remote_file, local_file, NULL);
+}
+
+/* ------------------- API: PUT (WRQ) ------------------- */
+int tftp_client_put_opts(const char *server_ip, uint16_t server_port,
+                         const char *local_file, const char *remote_file,
+                         const struct tftp_client_opts *o)
+{
+    if (!o)
+        o = &defaults;
+
+    struct sockaddr_in srv;
+    if (parse_server(server_ip, server_port, &srv) < 0)
+        return -1;
+
+    int fd = open(local_file, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        perror("open local");
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    struct tftp_xfer_req req;
+    req_init(&req, OPCODE_WRQ, &srv, remote_file, o);
+    tftp_source_file(&req.source, fd, (uint64_t)st.st_size);
+    if (o->resume)
+        req.offset = (uint64_t)st.st_size; // le serveur dit ce qu'il a déjà
+    int ret = run_blocking(&req, o);
+    close(fd);
+    if (ret == 0 && !o->quiet)
+        printf("Le fichier a bien été envoyé\n");
+    return ret;
+}
+
+int tftp_client_put(const char *server_ip, uint16_t server_port,
+                    const char *local_file, const char *remote_file)
+{
+    return tftp_client_put_opts(server_ip, server_port, local_file, remote_file, NULL);
+}
+
+/* ------------------- API: PUITS / SOURCES ------------------- */
+
+int tftp_client_get_sink(const char *server_ip, uint16_t server_port, const char *remote_file,
+                         const struct tftp_sink *sink, const struct tftp_client_opts *o)
+{
+    if (!o)
+        o = &defaults;
+    struct sockaddr_in srv;
+    if (parse_server(server_ip, server_port, &srv) < 0)
+        return -1;
+
+    struct tftp_xfer_req req;
+    req_init(&req, OPCODE_RRQ, &srv, remote_file, o);
+    req.sink = *sink;
+    return run_blocking(&req, o);
+}
+
+int tftp_client_put_source(const char *server_ip, uint16_t server_port,
+                           const struct tftp_source *source, const char *remote_file,
+                           const struct tftp_client_opts *o)
+{
+    if (!o)
+        o = &defaults;
+    struct sockaddr_in srv;
+    if (parse_server(server_ip, server_port, &srv) < 0)
+        return -1;
+
+    struct tftp_xfer_req req;
+    req_init(&req, OPCODE_WRQ, &srv, remote_file, o);
+    req.source = *source;
+    return run_blocking(&req, o);
+}
+
+int tftp_client_get_mem(const char *server_ip, uint16_t server_port, const char *remote_file,
+                        struct tftp_membuf *out, const struct tftp_client_opts *o)
+{
+    struct tftp_sink sink;
+    tftp_sink_mem(&sink, out);
+    out->len = 0; // contenu précédent écrasé, capacité conservée
+    return tftp_client_get_sink(server_ip, server_port, remote_file, &sink, o);
+}
+
+int tftp_client_put_mem(const char *server_ip, uint16_t server_port, const void *data, size_t len,
+                        const char *remote_file, const struct tftp_client_opts *o)
+{
+    struct tftp_membuf m;
+    memset(&m, 0, sizeof(m));
+    m.data = (uint8_t *)data;
+    m.len = len;
+    struct tftp_source source;
+    tftp_source_mem(&source, &m);
+    return tftp_client_put_source(server_ip, server_port, &source, remote_file, o);
+}
+
+/* ------------------- API: BATCH ------------------- */
+
+#define BATCH_MAX_EVENTS 64
+
+// transfert en cours dans la boucle batch : une poignée libtftp et le fichier local
+struct batch_slot
+{
+    struct tftp_batch_item *it;
+    struct tftp_xfer *x; // NULL = emplacement libre
+    int fd;
+    int quiet;
+    int resume;   // GET repris : fichier local tronqué à la fin
+    int verified; // GET vérifié (checksum) : publié ou retiré à la fin
+};
+
+// on_done : bilan de l'élément, poignée libérée, emplacement rendu
+static void batch_done(struct tftp_xfer *x, void *user)
+{
+    struct batch_slot *s = user;
+    struct tftp_batch_item *it = s->it;
+    it->stats = *tftp_xfer_stats(x);
+    it->stats.file = it->remote;
+    it->ret = it->stats.result == XFER_OK ? 0 : -1;
+    if (it->ret == 0 && s->resume && ftruncate(s->fd, (off_t)(it->stats.offset + it->stats.bytes)) < 0)
+    {
+        perror(it->local);
+        it->ret = -1;
+    }
+    if (s->verified && local_sum_end(s->fd, it->local, it->ret, s->resume ? &it->stats : NULL) < 0)
+        it->ret = -1;
+    if (it->ret < 0)
+        fprintf(stderr, "%s %s: %s\n", it->put ? "PUT" : "GET", it->remote, tftp_xfer_error(x));
+    if (!s->quiet)
+    {
+        char line[1024];
+        xfer_format(&it->stats, line, sizeof(line));
+        fputs(line, stdout);
+    }
+    tftp_xfer_free(x);
+    close(s->fd);
+    s->x = NULL;
+    s->fd = -1;
+}
+
+static void batch_start(struct batch_slot *s, struct tftp_batch_item *it, int epfd,
+                        const struct sockaddr_in *srv, const struct tftp_client_opts *o)
+{
+    s->it = it;
+    s->x = NULL;
+    s->quiet = o->quiet;
+    s->resume = o->resume && !o->netascii && !it->put;
+    s->verified = o->checksum && !o->netascii && !it->put;
+    it->ret = -1;
+    stats_failed(&it->stats, it->put ? OPCODE_WRQ : OPCODE_RRQ, it->remote, srv);
+
+    struct tftp_xfer_req req;
+    req_init(&req, it->put ? OPCODE_WRQ : OPCODE_RRQ, srv, it->remote, o);
+    req.on_done = batch_done;
+    req.user = s;
+
+    struct stat st;
+    if (it->put)
+        s->fd = open(it->local, O_RDONLY | O_CLOEXEC);
+    else if (s->verified && !s->resume)
+        s->fd = sum_dest_open(it->local);
+    else
+        s->fd = open(it->local, (s->resume ? O_RDWR : O_WRONLY | O_TRUNC) | O_CREAT | O_CLOEXEC, 0666);
+    if (s->fd < 0 || (it->put && fstat(s->fd, &st) < 0))
+    {
+        perror(it->local);
+        goto fail;
+    }
+    if (it->put)
+        tftp_source_file(&req.source, s->fd, (uint64_t)st.st_size);
+    else
+        tftp_sink_file(&req.sink, s->fd);
+    if (o->resume && it->put)
+        req.offset = (uint64_t)st.st_size;
+    else if (s->resume)
+        resume_from_file(&req, s->fd);
+
+    s->x = tftp_xfer_start(&req);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = s;
+    if (!s->x || epoll_ctl(epfd, EPOLL_CTL_ADD, tftp_xfer_fd(s->x), &ev) < 0)
+    {
+        perror("batch socket");
+        goto fail;
+    }
+    return;
+
+fail:
+    if (!o->quiet)
+    {
+        char line[1024];
+        xfer_format(&it->stats, line, sizeof(line));
+        fputs(line, stdout);
+    }
+    tftp_xfer_free(s->x);
+    if (s->fd >= 0)
+        close(s->fd);
+    s->x = NULL;
+    s->fd = -1;
+}
+
+int tftp_client_batch(const char *server_ip, uint16_t server_port,
+                      struct tftp_batch_item *items, size_t n, unsigned concurrency,
+                      const struct tftp_client_opts *o)
+{
+    if (!o)
+        o = &defaults;
+    if (concurrency == 0)
+        concurrency = 1;
+    if (concurrency > n)
+        concurrency = n ? (unsigned)n : 1;
+
+    struct sockaddr_in srv;
+    if (parse_server(server_ip, server_port, &srv) < 0)
+        return -1;
+    struct batch_slot *slots = calloc(concurrency, sizeof(*slots));
+    if (!slots)
+    {
+        fprintf(stderr, "Erreur: allocation batch\n");
+        return -1;
+    }
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+    {
+        perror("epoll_create1");
+        free(slots);
+        return -1;
+    }
+    for (unsigned k = 0; k < concurrency; k++)
+        slots[k].fd = -1;
+
+    size_t next_item = 0;
+    for (;;)
+    {
+        // emplacements libres -> transferts suivants du manifeste
+        unsigned active = 0;
+        long us = -1;
+        for (unsigned k = 0; k < concurrency; k++)
+        {
+            struct batch_slot *s = &slots[k];
+            while (!s->x && next_item < n)
+                batch_start(s, &items[next_item++], epfd, &srv, o);
+            if (s->x)
+            {
+                active++;
+                long t = tftp_xfer_timeout_us(s->x);
+                if (us < 0 || t < us)
+                    us = t;
+            }
+        }
+        if (active == 0)
+            break;
+
+        // PUT espacés : créneaux plus fins que la ms (noyau 5.11+)
+        struct epoll_event evs[BATCH_MAX_EVENTS];
+        int nev = -1;
+        if (o->pace_rate && us >= 0)
+        {
+            struct timespec ts = {us / 1000000, (us % 1000000) * 1000};
+            nev = epoll_pwait2(epfd, evs, BATCH_MAX_EVENTS, &ts, NULL);
+        }
+        if (!o->pace_rate || us < 0 || (nev < 0 && errno == ENOSYS))
+            nev = epoll_wait(epfd, evs, BATCH_MAX_EVENTS, us < 0 ? -1 : (int)((us + 999) / 1000));
+        if (nev < 0 && errno != EINTR)
+        {
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < nev; i++)
+        {
+            struct batch_slot *s = evs[i].data.ptr;
+            if (s->x)
+                tftp_xfer_process_events(s->x);
+        }
+        for (unsigned k = 0; k < concurrency; k++)
+        {
+            if (slots[k].x && tftp_xfer_timeout_us(slots[k].x) == 0)
+                tftp_xfer_process_events(slots[k].x);
+        }
+    }
+
+    // sortie sur erreur : transferts en cours abandonnés
+    for (unsigned k = 0; k < concurrency; k++)
+    {
+        if (slots[k].x)
+        {
+            tftp_xfer_free(slots[k].x);
+            close(slots[k].fd);
+        }
+    }
+    close(epfd);
+    free(slots);
+
+    int failed = 0;
+    for (size_t i = 0; i < n; i++)
+        failed += i >= next_item || items[i].ret != 0;
+    return failed;
+}
+
+/* ------------------- Manifeste ------------------- */
+
+int tftp_manifest_load(const char *path, struct tftp_batch_item **items, size_t *n)
+{
+    *items = NULL;
+    *n = 0;
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    size_t cap = 0;
+    char line[2048];
+    int lineno = 0;
+    int ret = 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        lineno++;
+        char *save = NULL;
+        char *cmd = strtok_r(line, " \t\r\n", &save);
+        if (!cmd || cmd[0] == '#')
+            continue;
+        char *a = strtok_r(NULL, " \t\r\n", &save);
+        char *c = strtok_r(NULL, " \t\r\n", &save);
+        int put = strcmp(cmd, "put") == 0;
+        if ((!put && strcmp(cmd, "get") != 0) || !a || !c || strtok_r(NULL, " \t\r\n", &save))
+        {
+            fprintf(stderr, "%s:%d: attendu 'get <distant> <local>' ou 'put <local> <distant>'\n", path, lineno);
+            ret = -1;
+            break;
+        }
+
+        if (*n == cap)
+        {
+            size_t ncap = cap ? cap * 2 : 64;
+            struct tftp_batch_item *grown = realloc(*items, ncap * sizeof(**items));
+            if (!grown)
+            {
+                fprintf(stderr, "Erreur: allocation du manifeste\n");
+                ret = -1;
+                break;
+            }
+            *items = grown;
+            cap = ncap;
+        }
+        struct tftp_batch_item *it = &(*items)[*n];
+        memset(it, 0, sizeof(*it));
+        it->put = put;
+        it->local = strdup(put ? a : c);
+        it->remote = strdup(put ? c : a);
+        it->ret = -1;
+        (*n)++;
+        if (!it->local || !it->remote)
+        {
+            fprintf(stderr, "Erreur: allocation du manifeste\n");
+            ret = -1;
+            break;
+        }
+    }
+    fclose(f);
+
+    if (ret < 0)
+    {
+        tftp_manifest_free(*items, *n);
+        *items = NULL;
+        *n = 0;
+    }
+    return ret;
+}
+
+void tftp_manifest_free(struct tftp_batch_item *items, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        free(items[i].local);
+        free(items[i].remote);
+    }
+    free(items);
+}
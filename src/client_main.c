@@ -0,0 +1,231 @@
+// ============================ client_main.c =============================
+// Point d'entrée du client en ligne de commande (la logique est dans client.c)
+
+#include "client.h"
+#include "netsim.h"
+#include "pace.h"
+#include "sockets.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_BATCH_CONCURRENCY 8
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage:\n"
+            "  %s [-b blksize] [-w windowsize] [-N netsim] [--stats] [-X] [-a] [-C] [-z] [-r] [-k stripes] get <server_ip> <port> <remote_file> <local_file>\n"
+            "  %s [-b blksize] [-w windowsize] [-N netsim] [--stats] [-X] [-R rate] [-a] [-C] [-r] put <server_ip> <port> <local_file> <remote_file>\n"
+            "  %s [-b blksize] [-w windowsize] [-N netsim] [-c concurrency] [-R rate] [-a] [-C] [-z] [-r] batch <server_ip> <port> <manifest>\n"
+            "  --stats  bilan du transfert sur stdout (octets, durée, débit, retransmissions, RTT)\n"
+            "  -X, --tx-timestamps  RTT daté aussi à l'émission par le noyau (réception toujours datée)\n"
+            "  -R R, --rate R  put : DATA espacés à R bits/s (ex. 200m, 1g) au lieu de fenêtres\n"
+            "                d'un coup ; SO_TXTIME si fq est la qdisc par défaut (voir pace.h)\n"
+            "  -a, --netascii  mode netascii : fins de ligne CR LF sur le réseau, LF en local\n"
+            "  -C, --checksum  somme CRC32C de bout en bout vérifiée par le destinataire\n"
+            "  -z, --compress  get : contenu compressé sur le réseau si le serveur le juge utile\n"
+            "  -r, --resume  reprise : get complète le fichier local, put complète le fichier distant\n"
+            "                (transfert complet si le serveur ne la gère pas ou si le début diffère)\n"
+            "  -k N, --stripes N  get : N sessions parallèles, une plage d'octets chacune\n"
+            "                (une seule si le serveur ne gère pas les plages)\n"
+            "  -c N     batch : transferts simultanés (défaut %u)\n"
+            "  manifest : une ligne par transfert, 'get <remote> <local>' ou 'put <local> <remote>'\n"
+            "  local_file '-' : données sur stdout (get) ou lues sur stdin (put)\n",
+            prog, prog, prog, DEFAULT_BATCH_CONCURRENCY);
+}
+
+// "-" : données écrites sur stdout (get) ou lues sur stdin (put), sans fichier
+static int stdout_write(void *ctx, uint64_t off, const uint8_t *data, size_t len)
+{
+    (void)ctx;
+    (void)off;
+    return fwrite(data, 1, len, stdout) == len ? 0 : -1;
+}
+
+static int get_to_stdout(const char *server_ip, uint16_t port, const char *remote,
+                         const struct tftp_client_opts *opts)
+{
+    struct tftp_sink sink = {stdout_write, NULL};
+    int ret = tftp_client_get_sink(server_ip, port, remote, &sink, opts);
+    if (fflush(stdout) != 0)
+        ret = -1;
+    return ret;
+}
+
+// stdin ne se relit pas : chargé en mémoire pour les retransmissions
+static int put_from_stdin(const char *server_ip, uint16_t port, const char *remote,
+                          const struct tftp_client_opts *opts)
+{
+    struct tftp_membuf m;
+    memset(&m, 0, sizeof(m));
+    for (;;)
+    {
+        if (m.len == m.cap)
+        {
+            size_t ncap = m.cap ? m.cap * 2 : 65536;
+            uint8_t *grown = realloc(m.data, ncap);
+            if (!grown)
+            {
+                fprintf(stderr, "Erreur: allocation stdin\n");
+                tftp_membuf_free(&m);
+                return -1;
+            }
+            m.data = grown;
+            m.cap = ncap;
+        }
+        size_t r = fread(m.data + m.len, 1, m.cap - m.len, stdin);
+        m.len += r;
+        if (r == 0)
+            break;
+    }
+    int ret = ferror(stdin) ? -1 : tftp_client_put_mem(server_ip, port, m.data, m.len, remote, opts);
+    if (ferror(stdin))
+        perror("stdin");
+    tftp_membuf_free(&m);
+    return ret;
+}
+
+// batch : un bilan par transfert (client.c), puis le total
+static int run_batch(const char *server_ip, uint16_t port, const char *manifest,
+                     unsigned concurrency, const struct tftp_client_opts *opts)
+{
+    struct tftp_batch_item *items;
+    size_t n;
+    if (tftp_manifest_load(manifest, &items, &n) < 0)
+        return 1;
+
+    uint64_t t0 = now_ns();
+    int failed = tftp_client_batch(server_ip, port, items, n, concurrency, opts);
+    double secs = (double)(now_ns() - t0) / 1e9;
+    if (failed < 0)
+    {
+        tftp_manifest_free(items, n);
+        return 1;
+    }
+
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < n; i++)
+        bytes += items[i].ret == 0 ? items[i].stats.bytes : 0;
+    printf("batch: %zu transfers, %zu ok, %d failed, %llu bytes in %.3f s, %.2f MB/s, %.1f transfers/s\n",
+           n, n - (size_t)failed, failed, (unsigned long long)bytes, secs,
+           secs > 0 ? (double)bytes / 1e6 / secs : 0.0, secs > 0 ? (double)n / secs : 0.0);
+    tftp_manifest_free(items, n);
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct tftp_client_opts opts;
+    memset(&opts, 0, sizeof(opts));
+    struct tftp_xfer_stats stats;
+    int want_stats = 0;
+    unsigned concurrency = DEFAULT_BATCH_CONCURRENCY;
+
+    static const struct option long_opts[] = {
+        {"stats", no_argument, NULL, 'S'},
+        {"resume", no_argument, NULL, 'r'},
+        {"netascii", no_argument, NULL, 'a'},
+        {"checksum", no_argument, NULL, 'C'},
+        {"compress", no_argument, NULL, 'z'},
+        {"stripes", required_argument, NULL, 'k'},
+        {"tx-timestamps", no_argument, NULL, 'X'},
+        {"rate", required_argument, NULL, 'R'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "b:w:N:c:rk:aCzXR:", long_opts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            concurrency = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            opts.resume = 1;
+            break;
+        case 'a':
+            opts.netascii = 1;
+            break;
+        case 'C':
+            opts.checksum = 1;
+            break;
+        case 'z':
+            opts.compress = 1;
+            break;
+        case 'X':
+            opts.tx_timestamps = 1;
+            break;
+        case 'R':
+            if (pace_parse_rate(optarg, &opts.pace_rate) < 0)
+            {
+                fprintf(stderr, "Erreur: débit invalide '%s' (ex. 200m, 1g)\n", optarg);
+                return 1;
+            }
+            break;
+        case 'k':
+            opts.stripes = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        case 'S':
+            want_stats = 1;
+            opts.stats = &stats;
+            break;
+        case 'b':
+            opts.blksize = (uint16_t)atoi(optarg);
+            break;
+        case 'w':
+            opts.windowsize = (uint16_t)atoi(optarg);
+            break;
+        case 'N':
+            if (netsim_configure(optarg) < 0)
+                return 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (opts.resume && opts.stripes > 1)
+    {
+        fprintf(stderr, "Erreur: -r et -k ne se combinent pas (reprise en une seule session)\n");
+        return 1;
+    }
+
+    argv += optind - 1;
+    argc -= optind - 1;
+    if (argc == 5 && strcmp(argv[1], "batch") == 0)
+        return run_batch(argv[2], (uint16_t)atoi(argv[3]), argv[4], concurrency, &opts);
+    if (argc < 6)
+    {
+        usage(argv[0 - (optind - 1)]);
+        return 1;
+    }
+
+    int ret;
+    int to_stdout = strcmp(argv[1], "get") == 0 && strcmp(argv[5], "-") == 0;
+    if (to_stdout)
+        ret = get_to_stdout(argv[2], (uint16_t)atoi(argv[3]), argv[4], &opts);
+    else if (strcmp(argv[1], "get") == 0)
+        ret = tftp_client_get_opts(argv[2], atoi(argv[3]), argv[4], argv[5], &opts);
+    else if (strcmp(argv[1], "put") == 0 && strcmp(argv[4], "-") == 0)
+        ret = put_from_stdin(argv[2], (uint16_t)atoi(argv[3]), argv[5], &opts);
+    else if (strcmp(argv[1], "put") == 0)
+        ret = tftp_client_put_opts(argv[2], atoi(argv[3]), argv[4], argv[5], &opts);
+    else
+    {
+        fprintf(stderr, "Unknown command: %s\n", argv[1]);
+        return 1;
+    }
+
+    if (want_stats)
+    {
+        char line[1024];
+        xfer_format(&stats, line, sizeof(line));
+        fputs(line, to_stdout ? stderr : stdout); // stdout porte déjà les données
+    }
+    return ret;
+}
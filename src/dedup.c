@@ -0,0 +1,846 @@
+#include "dedup.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA256_X86 1
+#endif
+
+#define MAGIC "TFTPDEDUP 1 "
+#define CUT_MASK ((((uint64_t)1 << DEDUP_AVG_BITS) - 1) << (64 - DEDUP_AVG_BITS))
+#define GEAR_WINDOW 64                 // octets qui influencent le hash roulant
+#define SCAN_START (DEDUP_MIN_CHUNK - GEAR_WINDOW) // hash identique à un départ en 0 dès MIN
+#define REL_LEN (3 + 2 * SHA256_LEN)   // "xx/" + hexadécimal
+#define MANIFEST_MAX (256U << 20)
+
+/* ---------------- SHA-256 ---------------- */
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static uint32_t ror(uint32_t x, int n)
+{
+    return x >> n | x << (32 - n);
+}
+
+static void sha256_block(uint32_t s[8], const uint8_t *p)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+        uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    s[0] += a;
+    s[1] += b;
+    s[2] += c;
+    s[3] += d;
+    s[4] += e;
+    s[5] += f;
+    s[6] += g;
+    s[7] += h;
+}
+
+#ifdef SHA256_X86
+// extensions SHA (SHA-NI) : 2 tours par instruction sha256rnds2, état
+// réorganisé en ABEF / CDGH ; mots du message étendus par msg1 / msg2
+__attribute__((target("sha,sse4.1"))) static void sha256_blocks_ni(uint32_t s[8], const uint8_t *p, size_t n)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i t = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&s[0]), 0xB1); // CDAB
+    __m128i s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&s[4]), 0x1B); // EFGH
+    __m128i s0 = _mm_alignr_epi8(t, s1, 8);                                         // ABEF
+    s1 = _mm_blend_epi16(s1, t, 0xF0);                                              // CDGH
+
+    for (; n > 0; n--, p += 64)
+    {
+        __m128i abef = s0, cdgh = s1, m[4];
+        for (int g = 0; g < 16; g++) // 4 tours par groupe
+        {
+            if (g < 4)
+                m[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 16 * g)), bswap);
+            __m128i cur = m[g & 3];
+            __m128i msg = _mm_add_epi32(cur, _mm_loadu_si128((const __m128i *)&K[4 * g]));
+            s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+            if (g >= 3 && g <= 14)
+            {
+                __m128i w = _mm_add_epi32(m[(g + 1) & 3], _mm_alignr_epi8(cur, m[(g + 3) & 3], 4));
+                m[(g + 1) & 3] = _mm_sha256msg2_epu32(w, cur);
+            }
+            s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(msg, 0x0E));
+            if (g >= 1 && g <= 12)
+                m[(g + 3) & 3] = _mm_sha256msg1_epu32(m[(g + 3) & 3], cur);
+        }
+        s0 = _mm_add_epi32(s0, abef);
+        s1 = _mm_add_epi32(s1, cdgh);
+    }
+
+    t = _mm_shuffle_epi32(s0, 0x1B);  // FEBA
+    s1 = _mm_shuffle_epi32(s1, 0xB1); // DCHG
+    _mm_storeu_si128((__m128i *)&s[0], _mm_blend_epi16(t, s1, 0xF0)); // DCBA
+    _mm_storeu_si128((__m128i *)&s[4], _mm_alignr_epi8(s1, t, 8));    // HGFE
+}
+
+static int cpu_has_sha(void)
+{
+    unsigned a, b, c, d;
+    return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b >> 29 & 1);
+}
+#endif
+
+static int sha_hw = -1; // -1 : pas encore choisi (atomique : workers du serveur)
+
+static int sha256_use_hw(void)
+{
+    int hw = __atomic_load_n(&sha_hw, __ATOMIC_RELAXED);
+    if (hw < 0)
+    {
+#ifdef SHA256_X86
+        hw = cpu_has_sha();
+#else
+        hw = 0;
+#endif
+        __atomic_store_n(&sha_hw, hw, __ATOMIC_RELAXED);
+    }
+    return hw;
+}
+
+static void sha256_blocks(uint32_t s[8], const uint8_t *p, size_t n)
+{
+#ifdef SHA256_X86
+    if (sha256_use_hw())
+    {
+        sha256_blocks_ni(s, p, n);
+        return;
+    }
+#endif
+    for (; n > 0; n--, p += 64)
+        sha256_block(s, p);
+}
+
+const char *sha256_impl(void)
+{
+    return sha256_use_hw() ? "sha-ni" : "scalar";
+}
+
+int sha256_set_impl(const char *name)
+{
+    int hw;
+    if (strcmp(name, "scalar") == 0)
+        hw = 0;
+    else if (strcmp(name, "sha-ni") == 0)
+    {
+#ifdef SHA256_X86
+        if (!cpu_has_sha())
+            return -1;
+        hw = 1;
+#else
+        return -1;
+#endif
+    }
+    else
+        return -1;
+    __atomic_store_n(&sha_hw, hw, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void sha256(const void *data, size_t len, uint8_t out[SHA256_LEN])
+{
+    uint32_t s[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    const uint8_t *p = data;
+    size_t n = len % 64;
+    sha256_blocks(s, p, len / 64);
+    p += len - n;
+
+    // bourrage : 0x80, zéros, longueur en bits gros-boutiste (1 ou 2 blocs)
+    uint8_t tail[128];
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, p, n);
+    tail[n] = 0x80;
+    size_t tl = n < 56 ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++)
+        tail[tl - 1 - i] = (uint8_t)(bits >> (8 * i));
+    sha256_blocks(s, tail, tl / 64);
+    for (int i = 0; i < 8; i++)
+    {
+        out[4 * i] = (uint8_t)(s[i] >> 24);
+        out[4 * i + 1] = (uint8_t)(s[i] >> 16);
+        out[4 * i + 2] = (uint8_t)(s[i] >> 8);
+        out[4 * i + 3] = (uint8_t)s[i];
+    }
+}
+
+/* ---------------- Découpage ---------------- */
+
+// table du hash gear : fixe (splitmix64, graine constante), les frontières
+// des morceaux déjà stockés en dépendent
+static uint64_t gear[256];
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+static void gear_init(void)
+{
+    uint64_t x = 0x7466747064656475ULL;
+    for (int i = 0; i < 256; i++)
+    {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+// frontière dans p[0, len) en reprenant à *scan avec le hash *h ; 0 si
+// aucune avant len (état gardé pour l'appel suivant), DEDUP_MAX_CHUNK au plus
+static size_t cut_scan(const uint8_t *p, size_t len, size_t *scan, uint64_t *h)
+{
+    size_t end = len < DEDUP_MAX_CHUNK ? len : DEDUP_MAX_CHUNK;
+    uint64_t x = *h;
+    size_t i = *scan;
+    for (; i < end; i++)
+    {
+        x = (x << 1) + gear[p[i]];
+        if (i + 1 >= DEDUP_MIN_CHUNK && !(x & CUT_MASK))
+            return i + 1;
+    }
+    if (i > *scan)
+    {
+        *scan = i;
+        *h = x;
+    }
+    return end == DEDUP_MAX_CHUNK ? DEDUP_MAX_CHUNK : 0;
+}
+
+size_t dedup_cut(const uint8_t *data, size_t len)
+{
+    pthread_once(&gear_once, gear_init);
+    size_t scan = SCAN_START;
+    uint64_t h = 0;
+    size_t cut = cut_scan(data, len, &scan, &h);
+    return cut ? cut : len;
+}
+
+/* ---------------- Store ---------------- */
+
+static uint64_t tmp_seq; // noms temporaires uniques dans le processus
+
+static void rel_path(char rel[REL_LEN + 1], const uint8_t hash[SHA256_LEN])
+{
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < SHA256_LEN; i++)
+    {
+        rel[3 + 2 * i] = hex[hash[i] >> 4];
+        rel[3 + 2 * i + 1] = hex[hash[i] & 15];
+    }
+    rel[0] = rel[3];
+    rel[1] = rel[4];
+    rel[2] = '/';
+    rel[REL_LEN] = '\0';
+}
+
+static int write_all(int fd, const uint8_t *p, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t r = write(fd, p, len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            return -1;
+        p += r;
+        len -= (size_t)r;
+    }
+    return 0;
+}
+
+int dedup_init(struct tftp_dedup *d, const char *root_dir)
+{
+    memset(d, 0, sizeof(*d));
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", root_dir, DEDUP_DIR);
+    if (mkdir(path, 0755) < 0 && errno != EEXIST)
+        return -1;
+    d->dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (d->dirfd < 0)
+        return -1;
+    for (int i = 0; i < 256; i++)
+    {
+        char sub[3];
+        snprintf(sub, sizeof(sub), "%02x", i);
+        if (mkdirat(d->dirfd, sub, 0755) < 0 && errno != EEXIST)
+        {
+            close(d->dirfd);
+            d->dirfd = -1;
+            return -1;
+        }
+    }
+    pthread_once(&gear_once, gear_init);
+    return 0;
+}
+
+void dedup_free(struct tftp_dedup *d)
+{
+    if (d->dirfd >= 0)
+        close(d->dirfd);
+    d->dirfd = -1;
+}
+
+int dedup_reserved(const char *name)
+{
+    for (;;)
+    {
+        if (name[0] == '/')
+            name++;
+        else if (name[0] == '.' && name[1] == '/')
+            name += 2;
+        else
+            break;
+    }
+    size_t n = strlen(DEDUP_DIR);
+    return strncmp(name, DEDUP_DIR, n) == 0 && (name[n] == '\0' || name[n] == '/');
+}
+
+/* ---------------- Dépôt ---------------- */
+
+struct dedup_entry
+{
+    uint32_t len;
+    uint8_t hash[SHA256_LEN];
+};
+
+struct dedup_writer
+{
+    struct tftp_dedup *d;
+    char *path;
+    char *tmp; // manifeste en cours, renommé en path au commit
+    int fd;
+    uint8_t *buf; // morceau en cours (DEDUP_MAX_CHUNK)
+    size_t have;
+    size_t scan; // découpage repris à buf[scan] avec le hash h
+    uint64_t h;
+    uint64_t size;
+    struct dedup_entry *ents;
+    size_t n, cap;
+};
+
+struct dedup_writer *dedup_writer_new(struct tftp_dedup *d, const char *path)
+{
+    struct dedup_writer *wr = calloc(1, sizeof(*wr));
+    if (!wr)
+        return NULL;
+    wr->d = d;
+    wr->fd = -1;
+    wr->scan = SCAN_START;
+    size_t tl = strlen(path) + 48;
+    wr->path = strdup(path);
+    wr->tmp = malloc(tl);
+    wr->buf = malloc(DEDUP_MAX_CHUNK);
+    if (wr->path && wr->tmp && wr->buf)
+    {
+        snprintf(wr->tmp, tl, "%s.dedup.%d.%llu", path, (int)getpid(),
+                 (unsigned long long)__atomic_add_fetch(&tmp_seq, 1, __ATOMIC_RELAXED));
+        wr->fd = open(wr->tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    }
+    if (wr->fd < 0)
+    {
+        int e = errno;
+        free(wr->path);
+        free(wr->tmp);
+        free(wr->buf);
+        free(wr);
+        errno = e;
+        return NULL;
+    }
+    return wr;
+}
+
+// morceau rangé sous son empreinte s'il n'y est pas déjà, ajouté au manifeste
+static int store_chunk(struct dedup_writer *wr, const uint8_t *p, size_t len)
+{
+    struct tftp_dedup *d = wr->d;
+    if (wr->n == wr->cap)
+    {
+        size_t cap = wr->cap ? 2 * wr->cap : 64;
+        struct dedup_entry *e = realloc(wr->ents, cap * sizeof(*e));
+        if (!e)
+            return -1;
+        wr->ents = e;
+        wr->cap = cap;
+    }
+    struct dedup_entry *e = &wr->ents[wr->n];
+    e->len = (uint32_t)len;
+    sha256(p, len, e->hash);
+
+    char rel[REL_LEN + 1];
+    rel_path(rel, e->hash);
+    struct stat st;
+    if (fstatat(d->dirfd, rel, &st, 0) == 0)
+        __atomic_add_fetch(&d->chunks_dup, 1, __ATOMIC_RELAXED);
+    else if (errno != ENOENT)
+        return -1;
+    else
+    {
+        // écrit à côté puis renommé : jamais de morceau partiel sous son empreinte
+        char tmp[REL_LEN + 48];
+        snprintf(tmp, sizeof(tmp), "%s.%d.%llu", rel, (int)getpid(),
+                 (unsigned long long)__atomic_add_fetch(&tmp_seq, 1, __ATOMIC_RELAXED));
+        int fd = openat(d->dirfd, tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return -1;
+        int r = write_all(fd, p, len);
+        if (close(fd) < 0)
+            r = -1;
+        if (r == 0)
+            r = renameat(d->dirfd, tmp, d->dirfd, rel);
+        if (r < 0)
+        {
+            int err = errno;
+            unlinkat(d->dirfd, tmp, 0);
+            errno = err;
+            return -1;
+        }
+        __atomic_add_fetch(&d->chunks_new, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&d->bytes_stored, len, __ATOMIC_RELAXED);
+    }
+    wr->n++;
+    wr->size += len;
+    return 0;
+}
+
+int dedup_write(struct dedup_writer *wr, const uint8_t *data, size_t len)
+{
+    while (len > 0)
+    {
+        size_t n = DEDUP_MAX_CHUNK - wr->have < len ? DEDUP_MAX_CHUNK - wr->have : len;
+        memcpy(wr->buf + wr->have, data, n);
+        wr->have += n;
+        data += n;
+        len -= n;
+
+        size_t cut;
+        while ((cut = cut_scan(wr->buf, wr->have, &wr->scan, &wr->h)) != 0)
+        {
+            if (store_chunk(wr, wr->buf, cut) < 0)
+                return -1;
+            wr->have -= cut;
+            memmove(wr->buf, wr->buf + cut, wr->have);
+            wr->scan = SCAN_START;
+            wr->h = 0;
+        }
+    }
+    return 0;
+}
+
+static void writer_free(struct dedup_writer *wr)
+{
+    if (wr->fd >= 0)
+        close(wr->fd);
+    free(wr->path);
+    free(wr->tmp);
+    free(wr->buf);
+    free(wr->ents);
+    free(wr);
+}
+
+int dedup_commit(struct dedup_writer *wr)
+{
+    if (wr->have && store_chunk(wr, wr->buf, wr->have) < 0)
+    {
+        dedup_abort(wr);
+        return -1;
+    }
+
+    size_t cap = 64 + wr->n * (12 + 2 * SHA256_LEN);
+    char *m = malloc(cap);
+    if (!m)
+    {
+        dedup_abort(wr);
+        return -1;
+    }
+    size_t pos = (size_t)snprintf(m, cap, MAGIC "%llu %zu\n", (unsigned long long)wr->size, wr->n);
+    for (size_t i = 0; i < wr->n; i++)
+    {
+        char rel[REL_LEN + 1];
+        rel_path(rel, wr->ents[i].hash);
+        pos += (size_t)snprintf(m + pos, cap - pos, "%u %s\n", wr->ents[i].len, rel + 3);
+    }
+    int r = write_all(wr->fd, (const uint8_t *)m, pos);
+    free(m);
+    if (close(wr->fd) < 0)
+        r = -1;
+    wr->fd = -1;
+    if (r == 0)
+        r = rename(wr->tmp, wr->path);
+    if (r < 0)
+    {
+        dedup_abort(wr);
+        return -1;
+    }
+    __atomic_add_fetch(&wr->d->files, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&wr->d->bytes_in, wr->size, __ATOMIC_RELAXED);
+    writer_free(wr);
+    return 0;
+}
+
+void dedup_abort(struct dedup_writer *wr)
+{
+    if (!wr)
+        return;
+    int e = errno;
+    unlink(wr->tmp);
+    writer_free(wr);
+    errno = e;
+}
+
+/* ---------------- Relecture ---------------- */
+
+struct dedup_reader
+{
+    struct tftp_dedup *d;
+    uint64_t size;
+    size_t n;
+    uint64_t *end; // fin (exclue) de chaque morceau dans le fichier
+    uint8_t (*hash)[SHA256_LEN];
+    size_t cur; // morceau ouvert dans fd
+    int fd;
+};
+
+static int unhex(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    return -1;
+}
+
+static int parse_manifest(struct dedup_reader *rd, const char *m, const char *mend)
+{
+    char *p;
+    unsigned long long size = strtoull(m + strlen(MAGIC), &p, 10);
+    unsigned long long n = strtoull(p, &p, 10);
+    if (*p++ != '\n' || n > (size_t)(mend - p) / (3 + 2 * SHA256_LEN))
+        return -1;
+    rd->size = size;
+    rd->n = (size_t)n;
+    rd->end = malloc((rd->n + 1) * sizeof(*rd->end));
+    rd->hash = malloc((rd->n + 1) * sizeof(*rd->hash));
+    if (!rd->end || !rd->hash)
+        return -1;
+    uint64_t off = 0;
+    for (size_t i = 0; i < rd->n; i++)
+    {
+        unsigned long len = strtoul(p, &p, 10);
+        if (len == 0 || len > DEDUP_MAX_CHUNK || *p++ != ' ' || mend - p < 2 * SHA256_LEN + 1)
+            return -1;
+        for (int k = 0; k < SHA256_LEN; k++)
+        {
+            int hi = unhex(p[2 * k]), lo = unhex(p[2 * k + 1]);
+            if (hi < 0 || lo < 0)
+                return -1;
+            rd->hash[i][k] = (uint8_t)(hi << 4 | lo);
+        }
+        p += 2 * SHA256_LEN;
+        if (*p++ != '\n')
+            return -1;
+        off += len;
+        rd->end[i] = off;
+    }
+    return off == rd->size ? 0 : -1;
+}
+
+int dedup_open(struct tftp_dedup *d, int fd, struct dedup_reader **out)
+{
+    char head[sizeof(MAGIC) - 1];
+    struct stat st;
+    if (pread(fd, head, sizeof(head), 0) != (ssize_t)sizeof(head) || memcmp(head, MAGIC, sizeof(head)) != 0)
+        return 0;
+    if (fstat(fd, &st) < 0)
+        return -1;
+    if ((uint64_t)st.st_size > MANIFEST_MAX)
+    {
+        errno = EFBIG;
+        return -1;
+    }
+
+    size_t len = (size_t)st.st_size;
+    char *m = malloc(len + 1);
+    struct dedup_reader *rd = calloc(1, sizeof(*rd));
+    int r = -1;
+    if (m && rd && pread(fd, m, len, 0) == (ssize_t)len)
+    {
+        m[len] = '\0';
+        rd->d = d;
+        rd->fd = -1;
+        r = parse_manifest(rd, m, m + len);
+        if (r < 0)
+            errno = EINVAL;
+    }
+    free(m);
+    if (r < 0)
+    {
+        dedup_close(rd);
+        return -1;
+    }
+    *out = rd;
+    return 1;
+}
+
+uint64_t dedup_size(const struct dedup_reader *rd)
+{
+    return rd->size;
+}
+
+// morceau qui contient l'octet off (off < size) : le courant ou le suivant
+// en lecture séquentielle, sinon recherche dichotomique
+static size_t find_chunk(const struct dedup_reader *rd, uint64_t off)
+{
+    size_t c = rd->cur;
+    if (c < rd->n && off < rd->end[c] && (c == 0 || off >= rd->end[c - 1]))
+        return c;
+    if (c + 1 < rd->n && off < rd->end[c + 1] && off >= rd->end[c])
+        return c + 1;
+    size_t lo = 0, hi = rd->n - 1;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (rd->end[mid] > off)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+static int open_chunk(struct dedup_reader *rd, size_t i)
+{
+    if (rd->fd >= 0)
+        close(rd->fd);
+    rd->fd = -1;
+    char rel[REL_LEN + 1];
+    rel_path(rel, rd->hash[i]);
+    int fd = openat(rd->d->dirfd, rel, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || (uint64_t)st.st_size != rd->end[i] - (i ? rd->end[i - 1] : 0))
+    {
+        close(fd);
+        errno = EIO;
+        return -1;
+    }
+    rd->fd = fd;
+    rd->cur = i;
+    return 0;
+}
+
+ssize_t dedup_pread(struct dedup_reader *rd, uint8_t *buf, size_t len, uint64_t off)
+{
+    size_t done = 0;
+    while (done < len && off < rd->size)
+    {
+        size_t i = find_chunk(rd, off);
+        if ((i != rd->cur || rd->fd < 0) && open_chunk(rd, i) < 0)
+            return -1;
+        uint64_t start = i ? rd->end[i - 1] : 0;
+        size_t n = rd->end[i] - off < len - done ? (size_t)(rd->end[i] - off) : len - done;
+        if (pread(rd->fd, buf + done, n, (off_t)(off - start)) != (ssize_t)n)
+        {
+            errno = EIO;
+            return -1;
+        }
+        done += n;
+        off += n;
+    }
+    return (ssize_t)done;
+}
+
+void dedup_close(struct dedup_reader *rd)
+{
+    if (!rd)
+        return;
+    if (rd->fd >= 0)
+        close(rd->fd);
+    free(rd->end);
+    free(rd->hash);
+    free(rd);
+}
+
+/* ---------------- Passation à un autre processus ---------------- */
+
+struct writer_state
+{
+    uint64_t size;
+    uint64_t n;
+    uint64_t h;
+    uint32_t have;
+    uint32_t scan;
+    uint32_t path_len; // '\0' compris
+    uint32_t tmp_len;
+};
+
+struct reader_state
+{
+    uint64_t size;
+    uint64_t n;
+};
+
+uint8_t *dedup_writer_save(const struct dedup_writer *wr, size_t *len)
+{
+    struct writer_state s;
+    memset(&s, 0, sizeof(s));
+    s.size = wr->size;
+    s.n = wr->n;
+    s.h = wr->h;
+    s.have = (uint32_t)wr->have;
+    s.scan = (uint32_t)wr->scan;
+    s.path_len = (uint32_t)strlen(wr->path) + 1;
+    s.tmp_len = (uint32_t)strlen(wr->tmp) + 1;
+    size_t total = sizeof(s) + s.path_len + s.tmp_len + wr->n * sizeof(*wr->ents) + wr->have;
+    uint8_t *b = malloc(total), *p = b;
+    if (!b)
+        return NULL;
+    memcpy(p, &s, sizeof(s));
+    p += sizeof(s);
+    memcpy(p, wr->path, s.path_len);
+    p += s.path_len;
+    memcpy(p, wr->tmp, s.tmp_len);
+    p += s.tmp_len;
+    memcpy(p, wr->ents, wr->n * sizeof(*wr->ents));
+    p += wr->n * sizeof(*wr->ents);
+    memcpy(p, wr->buf, wr->have);
+    *len = total;
+    return b;
+}
+
+int dedup_writer_fd(const struct dedup_writer *wr)
+{
+    return wr->fd;
+}
+
+struct dedup_writer *dedup_writer_load(struct tftp_dedup *d, const uint8_t *blob, size_t len, int fd)
+{
+    struct writer_state s;
+    if (len < sizeof(s))
+        return NULL;
+    memcpy(&s, blob, sizeof(s));
+    const uint8_t *p = blob + sizeof(s);
+    size_t rest = len - sizeof(s);
+    if (s.have > DEDUP_MAX_CHUNK || s.scan > DEDUP_MAX_CHUNK || s.path_len == 0 || s.tmp_len == 0 ||
+        s.n > rest / sizeof(struct dedup_entry) ||
+        rest != s.path_len + s.tmp_len + s.n * sizeof(struct dedup_entry) + s.have ||
+        p[s.path_len - 1] != '\0' || p[s.path_len + s.tmp_len - 1] != '\0')
+        return NULL;
+
+    struct dedup_writer *wr = calloc(1, sizeof(*wr));
+    if (!wr)
+        return NULL;
+    wr->d = d;
+    wr->fd = -1;
+    wr->path = strdup((const char *)p);
+    wr->tmp = strdup((const char *)p + s.path_len);
+    wr->buf = malloc(DEDUP_MAX_CHUNK);
+    wr->cap = s.n ? (size_t)s.n : 64;
+    wr->ents = malloc(wr->cap * sizeof(*wr->ents));
+    if (!wr->path || !wr->tmp || !wr->buf || !wr->ents)
+    {
+        writer_free(wr);
+        return NULL;
+    }
+    p += s.path_len + s.tmp_len;
+    memcpy(wr->ents, p, s.n * sizeof(*wr->ents));
+    p += s.n * sizeof(*wr->ents);
+    memcpy(wr->buf, p, s.have);
+    wr->n = (size_t)s.n;
+    wr->have = s.have;
+    wr->scan = s.scan;
+    wr->h = s.h;
+    wr->size = s.size;
+    wr->fd = fd;
+    return wr;
+}
+
+void dedup_writer_drop(struct dedup_writer *wr)
+{
+    if (wr)
+        writer_free(wr);
+}
+
+uint8_t *dedup_reader_save(const struct dedup_reader *rd, size_t *len)
+{
+    struct reader_state s = {rd->size, rd->n};
+    size_t total = sizeof(s) + rd->n * (sizeof(*rd->end) + sizeof(*rd->hash));
+    uint8_t *b = malloc(total);
+    if (!b)
+        return NULL;
+    memcpy(b, &s, sizeof(s));
+    memcpy(b + sizeof(s), rd->end, rd->n * sizeof(*rd->end));
+    memcpy(b + sizeof(s) + rd->n * sizeof(*rd->end), rd->hash, rd->n * sizeof(*rd->hash));
+    *len = total;
+    return b;
+}
+
+struct dedup_reader *dedup_reader_load(struct tftp_dedup *d, const uint8_t *blob, size_t len)
+{
+    struct reader_state s;
+    if (len < sizeof(s))
+        return NULL;
+    memcpy(&s, blob, sizeof(s));
+    size_t per = sizeof(uint64_t) + SHA256_LEN;
+    if (s.n > (len - sizeof(s)) / per || len - sizeof(s) != s.n * per)
+        return NULL;
+
+    struct dedup_reader *rd = calloc(1, sizeof(*rd));
+    if (!rd)
+        return NULL;
+    rd->d = d;
+    rd->fd = -1;
+    rd->size = s.size;
+    rd->n = (size_t)s.n;
+    rd->end = malloc((rd->n + 1) * sizeof(*rd->end));
+    rd->hash = malloc((rd->n + 1) * sizeof(*rd->hash));
+    if (!rd->end || !rd->hash)
+    {
+        dedup_close(rd);
+        return NULL;
+    }
+    memcpy(rd->end, blob + sizeof(s), rd->n * sizeof(*rd->end));
+    memcpy(rd->hash, blob + sizeof(s) + rd->n * sizeof(*rd->end), rd->n * sizeof(*rd->hash));
+    if (rd->n ? rd->end[rd->n - 1] != rd->size : rd->size != 0)
+    {
+        dedup_close(rd);
+        return NULL;
+    }
+    return rd;
+}
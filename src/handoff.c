@@ -0,0 +1,330 @@
+#define _GNU_SOURCE // struct ucred (SO_PEERCRED)
+#include "handoff.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define HANDOFF_MAGIC 0x48544654u // "TFTH"
+
+static int unix_addr(struct sockaddr_un *a, const char *path)
+{
+    memset(a, 0, sizeof(*a));
+    a->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(a->sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(a->sun_path, path);
+    return 0;
+}
+
+int handoff_listen(const char *path)
+{
+    struct sockaddr_un a;
+    if (unix_addr(&a, path) < 0)
+        return -1;
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s < 0)
+        return -1;
+    unlink(path); // socket du processus précédent (remplacé ou mort)
+    // propriétaire seulement, avant listen() : aucune connexion entre les deux
+    if (bind(s, (struct sockaddr *)&a, sizeof(a)) < 0 || chmod(path, 0600) < 0 || listen(s, 1) < 0)
+    {
+        int e = errno;
+        close(s);
+        errno = e;
+        return -1;
+    }
+    return s;
+}
+
+int handoff_connect(const char *path)
+{
+    struct sockaddr_un a;
+    if (unix_addr(&a, path) < 0)
+        return -1;
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s < 0)
+        return -1;
+    if (connect(s, (struct sockaddr *)&a, sizeof(a)) < 0)
+    {
+        int e = errno;
+        close(s);
+        errno = e;
+        return -1;
+    }
+    return s;
+}
+
+// exécutable d'un processus (lien /proc/<pid>/exe), sans le " (deleted)"
+// d'un binaire remplacé depuis son lancement : mise à jour au même chemin
+static int exe_path(const char *link, char *buf, size_t cap)
+{
+    ssize_t n = readlink(link, buf, cap - 1);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    static const char deleted[] = " (deleted)";
+    size_t d = sizeof(deleted) - 1;
+    if ((size_t)n > d && strcmp(buf + n - d, deleted) == 0)
+        buf[n - d] = '\0';
+    return 0;
+}
+
+int handoff_peer_check(int sock, pid_t *pid, uid_t *uid)
+{
+    struct ucred cr;
+    socklen_t len = sizeof(cr);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cr, &len) < 0)
+        return -1;
+    *pid = cr.pid;
+    *uid = cr.uid;
+    if (cr.uid != getuid())
+    {
+        errno = EACCES;
+        return -1;
+    }
+    char link[32], peer[PATH_MAX], self[PATH_MAX];
+    snprintf(link, sizeof(link), "/proc/%d/exe", (int)cr.pid);
+    if (exe_path(link, peer, sizeof(peer)) < 0 || exe_path("/proc/self/exe", self, sizeof(self)) < 0)
+        return -1;
+    if (strcmp(peer, self) != 0)
+    {
+        errno = EACCES;
+        return -1;
+    }
+    return 0;
+}
+
+// l'autre processus peut mourir ou se bloquer : aucune attente sans limite
+static void set_timeouts(int sock)
+{
+    struct timeval tv;
+    tv.tv_sec = HANDOFF_TIMEOUT_MS / 1000;
+    tv.tv_usec = (HANDOFF_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static int send_all(int sock, const uint8_t *p, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t r = send(sock, p, len, MSG_NOSIGNAL);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        p += r;
+        len -= (size_t)r;
+    }
+    return 0;
+}
+
+static int recv_all(int sock, uint8_t *p, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t r = recv(sock, p, len, MSG_WAITALL);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r == 0)
+            errno = ECONNRESET;
+        if (r <= 0)
+            return -1;
+        p += r;
+        len -= (size_t)r;
+    }
+    return 0;
+}
+
+int handoff_send(int sock, uint16_t type, const void *data, size_t len, const int *fds, size_t nfds)
+{
+    if (nfds > HANDOFF_MAX_FDS || len > HANDOFF_MAX_FRAME)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    set_timeouts(sock);
+
+    struct handoff_hdr hdr;
+    hdr.magic = HANDOFF_MAGIC;
+    hdr.version = HANDOFF_VERSION;
+    hdr.type = type;
+    hdr.len = (uint32_t)len;
+    hdr.nfds = (uint32_t)nfds;
+
+    union
+    {
+        struct cmsghdr h;
+        char buf[CMSG_SPACE(HANDOFF_MAX_FDS * sizeof(int))];
+    } ctl;
+    struct iovec iov = {&hdr, sizeof(hdr)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds)
+    {
+        memset(&ctl, 0, sizeof(ctl));
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cm), fds, nfds * sizeof(int));
+    }
+
+    ssize_t r;
+    do
+        r = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    while (r < 0 && errno == EINTR);
+    if (r <= 0)
+        return -1;
+    // fd partis avec le premier octet ; reste de l'en-tête puis charge
+    if (send_all(sock, (const uint8_t *)&hdr + r, sizeof(hdr) - (size_t)r) < 0)
+        return -1;
+    return send_all(sock, data, len);
+}
+
+int handoff_recv(int sock, struct handoff_frame *f)
+{
+    memset(f, 0, sizeof(*f));
+    set_timeouts(sock);
+
+    struct handoff_hdr hdr;
+    union
+    {
+        struct cmsghdr h;
+        char buf[CMSG_SPACE(HANDOFF_MAX_FDS * sizeof(int))];
+    } ctl;
+    struct iovec iov = {&hdr, sizeof(hdr)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+
+    ssize_t r;
+    do
+        r = recvmsg(sock, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    while (r < 0 && errno == EINTR);
+    if (r == 0)
+        errno = ECONNRESET;
+    if (r <= 0)
+        return -1;
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+    {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t n = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < n && f->nfds < HANDOFF_MAX_FDS; i++)
+            memcpy(&f->fds[f->nfds++], CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+    }
+
+    if (recv_all(sock, (uint8_t *)&hdr + r, sizeof(hdr) - (size_t)r) < 0 || (msg.msg_flags & MSG_CTRUNC) ||
+        hdr.magic != HANDOFF_MAGIC || hdr.version != HANDOFF_VERSION || hdr.nfds != f->nfds ||
+        hdr.len > HANDOFF_MAX_FRAME)
+        goto fail;
+    f->type = hdr.type;
+    f->len = hdr.len;
+    if (f->len)
+    {
+        if ((f->data = malloc(f->len)) == NULL || recv_all(sock, f->data, f->len) < 0)
+            goto fail;
+    }
+    return 0;
+
+fail:
+    if (errno == 0)
+        errno = EPROTO;
+    handoff_frame_free(f);
+    return -1;
+}
+
+void handoff_frame_free(struct handoff_frame *f)
+{
+    int e = errno;
+    for (size_t i = 0; i < f->nfds; i++)
+    {
+        if (f->fds[i] >= 0)
+            close(f->fds[i]);
+    }
+    f->nfds = 0;
+    free(f->data);
+    f->data = NULL;
+    f->len = 0;
+    errno = e;
+}
+
+int handoff_buf_put(struct handoff_buf *b, const void *data, size_t len)
+{
+    if (b->len + len > b->cap)
+    {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + len)
+            cap *= 2;
+        uint8_t *p = realloc(b->data, cap);
+        if (!p)
+            return -1;
+        b->data = p;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+void handoff_buf_free(struct handoff_buf *b)
+{
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+int handoff_sess_put(struct handoff_buf *b, struct handoff_sess *rec, const char *name,
+                     const void *blob, size_t blob_len)
+{
+    if (!name)
+        name = "";
+    size_t nl = strlen(name) + 1;
+    if (nl > UINT16_MAX || blob_len > UINT32_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    rec->name_len = (uint16_t)nl;
+    rec->blob_len = (uint32_t)blob_len;
+    if (handoff_buf_put(b, rec, sizeof(*rec)) < 0 || handoff_buf_put(b, name, nl) < 0)
+        return -1;
+    return blob_len ? handoff_buf_put(b, blob, blob_len) : 0;
+}
+
+int handoff_sess_next(const struct handoff_frame *f, size_t *pos, struct handoff_sess *rec,
+                      const char **name, const uint8_t **blob)
+{
+    if (*pos == f->len)
+        return 0;
+    if (f->len - *pos < sizeof(*rec))
+        return -1;
+    memcpy(rec, f->data + *pos, sizeof(*rec));
+    size_t rest = f->len - *pos - sizeof(*rec);
+    if (rec->name_len == 0 || rec->name_len > rest || rec->blob_len > rest - rec->name_len)
+        return -1;
+    *name = (const char *)f->data + *pos + sizeof(*rec);
+    if ((*name)[rec->name_len - 1] != '\0')
+        return -1;
+    *blob = f->data + *pos + sizeof(*rec) + rec->name_len;
+    *pos += sizeof(*rec) + rec->name_len + rec->blob_len;
+    return 1;
+}
@@ -0,0 +1,935 @@
+// =============================== libtftp.c ===============================
+// - client TFTP non bloquant : une poignée par transfert, boucle d'événements externe
+// - TID, options blksize / windowsize (OACK), fenêtre glissante go-back-N
+// - reprise d'un transfert interrompu (offset / offcrc), plages (offset / length)
+// - mode netascii : décodage à la réception, encodage à l'envoi (netascii.h)
+// - somme de contrôle CRC32C de bout en bout (option checksum, tftp_utils.h)
+// - GET compressé (option compress, lz.h) : décompression en flux vers le puits
+// - RTT (règle de Karn), retransmissions, doublons : bilan accounting.h
+// - PUT espacé (pace_rate, pace.h) : SO_TXTIME avec fq, créneaux sinon
+// - puits / sources : fichier (pread / pwrite), mémoire, fonctions de l'appelant
+
+#include "libtftp.h"
+#include "lz.h"
+#include "netascii.h"
+#include "pace.h"
+#include "sockbuf.h"
+#include "sockets.h"
+#include "tstamp.h"
+#include <stdarg.h>
+
+#define XFER_TIMEOUT_NS ((uint64_t)TIMEOUT_MS * 1000000ULL)
+
+struct tftp_xfer
+{
+    int sock; // -1 une fois terminé
+    int done;
+    uint16_t op;
+    uint16_t want_blksize;    // options demandées (0 = absente)
+    uint16_t want_windowsize;
+    uint64_t want_offset;     // reprise demandée (0 = non)
+    int want_crc;             // GET : offcrc envoyé
+    uint32_t offset_crc;
+    uint64_t base;            // offset retenu : octet porté par DATA(1)
+    uint64_t want_length;     // plage demandée (0 = jusqu'à la fin)
+    int want_tsize;
+    int netascii;
+    int cr;                   // GET netascii : CR en fin du dernier bloc
+    uint64_t wpos;            // GET netascii / compressé : octets décodés écrits dans le puits
+    struct netascii_pos *na;  // PUT netascii : position des blocs de la fenêtre
+    uint32_t nna;             // (anneau indexé par numéro de bloc)
+    int want_sum;             // option checksum demandée
+    int sum;                  // ... et acceptée : somme en fin de flux
+    uint32_t crc;             // CRC32C des données reçues / émises
+    uint8_t tail[SUM_LEN];    // GET : 4 derniers octets reçus (somme candidate)
+    int want_lz;              // GET : option compress demandée
+    int lz;                   // ... et acceptée : flux décodé par lz_dec
+    struct lz_dec lz_dec;
+    uint16_t blksize;         // valeurs en vigueur
+    uint16_t windowsize;
+    int retries;
+    struct sockaddr_in srv;
+    struct sockaddr_in tid;
+    int tid_known;
+    uint64_t deadline; // ns, échéance du timeout (repoussée seulement sur progrès)
+    uint64_t start;
+    uint32_t expected;   // GET : prochain bloc attendu
+    uint32_t acked;      // GET : dernier bloc acquitté ; PUT : base de la fenêtre
+    uint32_t next;       // PUT : prochain bloc à envoyer, 0 = attente de ACK(0) / OACK
+    uint32_t last_block; // PUT : connu dès que la taille l'est
+    uint32_t sent_max;   // PUT : plus haut bloc déjà émis (Karn)
+    uint32_t rtt_block;  // PUT : bloc dont on attend l'ACK (0 = aucun)
+    uint64_t rtt_sent;   // émission mesurée (0 = pas de mesure en cours)
+    uint64_t tx_hw;      // son horodatage matériel (tx_stamps), 0 = aucun
+    int tx_stamps;       // émissions mesurées datées par le noyau
+    int stamp_next;      // ... le prochain envoi le demande
+    struct tstamp rx;    // arrivée du datagramme en cours (noyau, sinon lecture)
+    uint64_t pace_rate;  // PUT : octets/s, 0 = fenêtre d'un coup (pace.h)
+    uint64_t pace_next;  // créneau du prochain DATA
+    uint64_t pace_wake;  // DATA en attente de leur créneau : réveil (0 = aucun)
+    uint64_t send_at;    // SO_TXTIME : heure d'émission du prochain envoi (0 = tout de suite)
+    int txtime;          // DATA datés, retenus par le noyau (fq)
+    uint64_t size;       // PUT : taille de la source
+    struct tftp_sink sink;
+    struct tftp_source source;
+    tftp_done_cb on_done;
+    void *user;
+    struct tftp_xfer_stats stats;
+    char err[128];
+    char remote[];
+};
+
+// tampon de réception partagé par tous les transferts du thread
+static __thread uint8_t rx[4 + MAX_BLKSIZE + 64];
+
+/* ------------------- Puits / sources ------------------- */
+
+static int file_write(void *ctx, uint64_t off, const uint8_t *data, size_t len)
+{
+    int fd = (int)(intptr_t)ctx;
+    while (len > 0)
+    {
+        ssize_t w = pwrite(fd, data, len, (off_t)off);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return -1;
+        data += w;
+        len -= (size_t)w;
+        off += (uint64_t)w;
+    }
+    return 0;
+}
+
+static ssize_t file_read(void *ctx, uint64_t off, uint8_t *buf, size_t len)
+{
+    int fd = (int)(intptr_t)ctx;
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t r = pread(fd, buf + got, len - got, (off_t)(off + got));
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            return -1;
+        if (r == 0)
+            break; // fin de fichier
+        got += (size_t)r;
+    }
+    return (ssize_t)got;
+}
+
+static int mem_write(void *ctx, uint64_t off, const uint8_t *data, size_t len)
+{
+    struct tftp_membuf *m = ctx;
+    uint64_t end = off + len;
+    if (end > SIZE_MAX || (m->max && end > m->max))
+        return -1;
+    if (end > m->cap)
+    {
+        size_t ncap = m->cap ? m->cap : 4096;
+        while (ncap < end)
+            ncap *= 2;
+        if (m->max && ncap > m->max)
+            ncap = m->max;
+        uint8_t *grown = realloc(m->data, ncap);
+        if (!grown)
+            return -1;
+        m->data = grown;
+        m->cap = ncap;
+    }
+    memcpy(m->data + off, data, len);
+    if (end > m->len)
+        m->len = (size_t)end;
+    return 0;
+}
+
+static ssize_t mem_read(void *ctx, uint64_t off, uint8_t *buf, size_t len)
+{
+    const struct tftp_membuf *m = ctx;
+    if (off >= m->len)
+        return 0;
+    size_t n = m->len - (size_t)off < len ? m->len - (size_t)off : len;
+    memcpy(buf, m->data + off, n);
+    return (ssize_t)n;
+}
+
+void tftp_sink_file(struct tftp_sink *s, int fd)
+{
+    s->write = file_write;
+    s->ctx = (void *)(intptr_t)fd;
+}
+
+void tftp_source_file(struct tftp_source *s, int fd, uint64_t size)
+{
+    s->read = file_read;
+    s->ctx = (void *)(intptr_t)fd;
+    s->size = size;
+}
+
+void tftp_sink_mem(struct tftp_sink *s, struct tftp_membuf *m)
+{
+    s->write = mem_write;
+    s->ctx = m;
+}
+
+void tftp_source_mem(struct tftp_source *s, const struct tftp_membuf *m)
+{
+    s->read = mem_read;
+    s->ctx = (void *)m;
+    s->size = m->len;
+}
+
+void tftp_membuf_free(struct tftp_membuf *m)
+{
+    free(m->data);
+    m->data = NULL;
+    m->len = m->cap = 0;
+}
+
+/* ------------------- Paquets ------------------- */
+
+static void set_error(struct tftp_xfer *x, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(x->err, sizeof(x->err), fmt, ap);
+    va_end(ap);
+}
+
+// RRQ/WRQ avec les options demandées (aucune => paquet RFC 1350)
+static int build_request(const struct tftp_xfer *x, uint8_t *buf, size_t size)
+{
+    struct tftp_opt opts[MAX_OPTIONS];
+    size_t nopts = 0;
+    if (x->want_blksize)
+        set_opt(opts, &nopts, MAX_OPTIONS, "blksize", x->want_blksize);
+    if (x->want_windowsize)
+        set_opt(opts, &nopts, MAX_OPTIONS, "windowsize", x->want_windowsize);
+    if (x->want_offset)
+        set_opt(opts, &nopts, MAX_OPTIONS, "offset", (unsigned long)x->want_offset);
+    if (x->want_crc)
+        set_opt(opts, &nopts, MAX_OPTIONS, "offcrc", x->offset_crc);
+    if (x->want_length)
+        set_opt(opts, &nopts, MAX_OPTIONS, "length", (unsigned long)x->want_length);
+    if (x->want_tsize)
+        set_opt(opts, &nopts, MAX_OPTIONS, "tsize", 0);
+    if (x->want_sum)
+        set_opt_str(opts, &nopts, MAX_OPTIONS, "checksum", "crc32c");
+    if (x->want_lz)
+        set_opt_str(opts, &nopts, MAX_OPTIONS, "compress", "lz");
+    return build_rrq_wrq_opts(x->op, buf, size, x->remote, x->netascii ? "netascii" : "octet", opts,
+                              nopts);
+}
+
+// PUT repris : le préfixe gardé par le serveur doit être celui de la source
+static int source_crc(struct tftp_xfer *x, uint64_t end, uint32_t *crc)
+{
+    uint8_t buf[4096];
+    uint64_t off = end > RESUME_CRC_SPAN ? end - RESUME_CRC_SPAN : 0;
+    *crc = 0;
+    while (off < end)
+    {
+        size_t want = end - off > sizeof(buf) ? sizeof(buf) : (size_t)(end - off);
+        ssize_t r = x->source.read(x->source.ctx, off, buf, want);
+        if (r != (ssize_t)want)
+            return -1;
+        *crc = crc32c(*crc, buf, want);
+        off += want;
+    }
+    return 0;
+}
+
+// applique l'OACK du serveur ; -1 si une valeur dépasse ce qu'on a demandé
+// ou si le préfixe repris diffère (message dans x->err)
+static int apply_oack(struct tftp_xfer *x, const uint8_t *pkt, size_t n)
+{
+    struct tftp_opt opts[MAX_OPTIONS];
+    size_t nopts;
+    set_error(x, "bad OACK");
+    if (parse_oack(pkt, n, opts, MAX_OPTIONS, &nopts) < 0)
+        return -1;
+
+    const char *v;
+    if ((v = find_opt(opts, nopts, "blksize")) != NULL)
+    {
+        unsigned long b = strtoul(v, NULL, 10);
+        if (!x->want_blksize || b < MIN_BLKSIZE || b > x->want_blksize)
+            return -1;
+        x->blksize = (uint16_t)b;
+    }
+    if ((v = find_opt(opts, nopts, "windowsize")) != NULL)
+    {
+        unsigned long ws = strtoul(v, NULL, 10);
+        if (!x->want_windowsize || ws < 1 || ws > x->want_windowsize)
+            return -1;
+        x->windowsize = (uint16_t)ws;
+    }
+    if ((v = find_opt(opts, nopts, "offset")) != NULL)
+    {
+        uint64_t off = strtoull(v, NULL, 10);
+        if (!x->want_offset || off > x->want_offset || off % x->blksize)
+            return -1;
+        if (x->op == OPCODE_WRQ)
+        {
+            uint32_t crc;
+            const char *c = find_opt(opts, nopts, "offcrc");
+            if (!c || source_crc(x, off, &crc) < 0 || crc != (uint32_t)strtoul(c, NULL, 10))
+            {
+                set_error(x, "resume rejected: server prefix differs from source");
+                return -1;
+            }
+        }
+        x->base = off;
+        x->stats.offset = off;
+    }
+    if ((v = find_opt(opts, nopts, "tsize")) != NULL && x->want_tsize)
+        x->stats.tsize = (int64_t)strtoull(v, NULL, 10);
+    if ((v = find_opt(opts, nopts, "checksum")) != NULL)
+    {
+        if (!x->want_sum || strcasecmp(v, "crc32c") != 0)
+            return -1;
+        x->sum = 1;
+    }
+    if ((v = find_opt(opts, nopts, "compress")) != NULL)
+    {
+        if (!x->want_lz || strcasecmp(v, "lz") != 0)
+            return -1;
+        x->lz = 1;
+    }
+    x->err[0] = 0;
+    x->stats.blksize = x->blksize;
+    x->stats.windowsize = x->windowsize;
+    // fenêtre en vol : DATA reçus (get) ou envoyés (put) d'un coup ; plus
+    // l'horodatage d'émission en attente dans la file d'erreurs, compté sur
+    // la même réserve que la réception
+    sockbuf_grow(x->sock, x->op == OPCODE_RRQ ? SO_RCVBUF : SO_SNDBUF,
+                 sockbuf_need((uint64_t)x->windowsize + (uint64_t)x->tx_stamps, (uint32_t)x->blksize + 4), 1);
+    return 0;
+}
+
+static void finish(struct tftp_xfer *x, enum tftp_xfer_result r)
+{
+    x->stats.result = r;
+    x->stats.duration_ns = now_ns() - x->start;
+    if (x->sock >= 0)
+        net_close(x->sock); // la fermeture la retire aussi des epoll
+    x->sock = -1;
+    x->done = 1;
+}
+
+static void send_error_pkt(struct tftp_xfer *x, uint16_t code, const char *msg)
+{
+    uint8_t e[128];
+    int el = build_error(e, sizeof(e), code, msg);
+    if (el > 0)
+        net_sendto(x->sock, e, (size_t)el, 0, (struct sockaddr *)&x->tid, sizeof(x->tid));
+}
+
+// envoi, retenu par le noyau jusqu'à send_at (pacing), sinon horodaté par
+// le noyau si une mesure vient de commencer
+static ssize_t send_pkt(struct tftp_xfer *x, const void *buf, size_t len, const struct sockaddr_in *to)
+{
+    if (x->send_at)
+    {
+        uint64_t at = x->send_at;
+        x->send_at = 0;
+        x->stamp_next = 0; // la mesure part de at
+        return pace_sendto(x->sock, buf, len, to, at);
+    }
+    if (x->stamp_next)
+    {
+        x->stamp_next = 0;
+        return tstamp_sendto(x->sock, buf, len, to);
+    }
+    return net_sendto(x->sock, buf, len, 0, (const struct sockaddr *)to, sizeof(*to));
+}
+
+// mesure d'aller-retour sur le prochain envoi : heure lue maintenant, puis
+// celle du noyau (tx_stamps)
+static void rtt_start(struct tftp_xfer *x)
+{
+    x->rtt_sent = now_ns();
+    x->tx_hw = 0;
+    x->stamp_next = x->tx_stamps;
+}
+
+// fin de la mesure : arrivée du datagramme en cours moins émission mesurée
+static uint64_t rtt_end(const struct tftp_xfer *x)
+{
+    struct tstamp tx = {x->rtt_sent, x->tx_hw};
+    return tstamp_diff(&tx, &x->rx);
+}
+
+static void send_ack(struct tftp_xfer *x, uint32_t block)
+{
+    uint8_t ack[4];
+    build_ack(ack, sizeof(ack), (uint16_t)block);
+    send_pkt(x, ack, sizeof(ack), &x->tid);
+}
+
+static int send_request(struct tftp_xfer *x)
+{
+    uint8_t req[1024];
+    int len = build_request(x, req, sizeof(req));
+    if (len < 0)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (send_pkt(x, req, (size_t)len, &x->srv) < 0 &&
+        errno != EAGAIN && errno != EWOULDBLOCK)
+        return -1;
+    return 0;
+}
+
+/* ------------------- Machine d'états ------------------- */
+
+// PUT netascii : bloc x->next encodé depuis sa position dans la source ; un
+// octet local donne au moins un octet réseau, blksize octets lus suffisent
+static ssize_t put_read_netascii(struct tftp_xfer *x, uint8_t *out)
+{
+    uint8_t raw[MAX_BLKSIZE];
+    struct netascii_pos p = x->na[x->next % x->nna];
+    ssize_t r = x->source.read(x->source.ctx, p.src, raw, x->blksize);
+    if (r < 0)
+        return -1;
+    size_t used;
+    size_t n = netascii_encode(raw, (size_t)r, &used, out, x->blksize, &p.pend);
+    p.src += used;
+    x->na[(x->next + 1) % x->nna] = p;
+    return (ssize_t)n;
+}
+
+// PUT : envoie tout ce que la fenêtre autorise, DATA relu depuis la source ;
+// checksum : bloc ajouté au CRC à sa première émission (dans l'ordre), somme
+// derrière les dernières données, éventuellement à cheval sur deux blocs
+// créneau du prochain DATA (pace_rate) ; 0 : attente jusqu'à pace_wake
+static int put_pace(struct tftp_xfer *x)
+{
+    uint64_t now = now_ns(), at;
+    if (!pace_take(&x->pace_next, x->pace_rate, 4u + x->blksize, x->txtime, now, &at))
+    {
+        x->pace_wake = at;
+        return 0;
+    }
+    x->send_at = at > now ? at : 0;
+    return 1;
+}
+
+static int put_fill(struct tftp_xfer *x)
+{
+    uint8_t pkt[4 + MAX_BLKSIZE];
+    while (x->next <= x->last_block && x->next - x->acked <= x->windowsize)
+    {
+        if (x->pace_rate && !put_pace(x))
+            return 0;
+        uint64_t off = x->base + (uint64_t)(x->next - 1) * x->blksize;
+        size_t want = 0;
+        if (off < x->size)
+            want = x->size - off > x->blksize ? x->blksize : (size_t)(x->size - off);
+
+        ssize_t r = x->na ? put_read_netascii(x, pkt + 4)
+                    : want ? x->source.read(x->source.ctx, off, pkt + 4, want) : 0;
+        if (r < 0 || (x->size != TFTP_SIZE_UNKNOWN && (size_t)r != want))
+        {
+            set_error(x, "source read failed at offset %llu", (unsigned long long)off);
+            finish(x, XFER_LOCAL_ERROR);
+            return -1;
+        }
+        if ((size_t)r < x->blksize && x->size == TFTP_SIZE_UNKNOWN)
+            x->size = off + (uint64_t)r; // taille découverte pour une source en flux
+        size_t len = (size_t)r;
+        if (x->sum)
+        {
+            if (x->next > x->sent_max)
+                x->crc = crc32c(x->crc, pkt + 4, len);
+            len += sum_put(x->crc, x->size, off + len, pkt + 4 + len, x->blksize - len);
+        }
+        if (len < x->blksize)
+            x->last_block = x->next; // bloc court : c'est le dernier
+        build_data_header(pkt, sizeof(pkt), (uint16_t)x->next);
+        if (x->next > x->sent_max) // première émission de ce bloc
+        {
+            x->sent_max = x->next;
+            if (x->rtt_block == 0)
+            {
+                x->rtt_block = x->next;
+                rtt_start(x);
+                if (x->send_at)
+                    x->rtt_sent = x->send_at; // émission différée par le noyau
+            }
+        }
+        send_pkt(x, pkt, 4 + len, &x->tid);
+        x->send_at = 0;
+        x->next++;
+    }
+    return 0;
+}
+
+// GET compressé : une trame décompressée, à la suite de la précédente
+static int lz_out(void *ctx, const uint8_t *data, size_t len)
+{
+    struct tftp_xfer *x = ctx;
+    if (x->sink.write(x->sink.ctx, x->wpos, data, len) < 0)
+        return -1;
+    x->wpos += len;
+    return 0;
+}
+
+static void get_packet(struct tftp_xfer *x, uint16_t op, const uint8_t *pkt, size_t n, uint64_t now)
+{
+    struct tftp_xfer_stats *xs = &x->stats;
+
+    if (op == OPCODE_OACK && x->expected == 1)
+    {
+        if (apply_oack(x, pkt, n) < 0)
+        {
+            send_error_pkt(x, 8, "Bad option value");
+            finish(x, XFER_REJECTED);
+            return;
+        }
+        if (x->rtt_sent)
+            rtt_start(x);
+        send_ack(x, 0); // options acceptées
+        x->retries = 0;
+        x->deadline = now + XFER_TIMEOUT_NS;
+        return;
+    }
+    uint16_t block;
+    if (op != OPCODE_DATA || parse_block(pkt, n, &block) < 0 || n - 4 > x->blksize)
+        return;
+    size_t data_len = n - 4;
+
+    if (block == (uint16_t)x->expected)
+    {
+        int last = data_len < x->blksize;
+        uint64_t off = x->base + (uint64_t)(x->expected - 1) * x->blksize;
+        const uint8_t *data = pkt + 4;
+        size_t len = data_len;
+        uint8_t text[MAX_BLKSIZE + 1];
+        uint64_t seen = (uint64_t)(x->expected - 1) * x->blksize; // blocs précédents : pleins
+        if (x->sum)
+        {
+            // somme possible dans les 4 derniers octets : gardés hors du puits
+            len = sum_rx(&x->crc, x->tail, seen, data, data_len, text);
+            data = text;
+            off = x->base + (seen > SUM_LEN ? seen - SUM_LEN : 0);
+        }
+        else if (x->netascii)
+        {
+            len = netascii_decode(data, data_len, text, &x->cr);
+            if (last)
+                len += netascii_flush(text + len, &x->cr);
+            data = text;
+            off = x->wpos;
+            x->wpos += len;
+        }
+        int wr = 0; // -1 : flux compressé invalide, -2 : puits en échec
+        if (x->lz)
+        {
+            wr = lz_dec_feed(&x->lz_dec, data, len, lz_out, x);
+            if (wr == 0 && last && !lz_dec_idle(&x->lz_dec))
+                wr = -1; // flux coupé au milieu d'une trame
+            off = x->wpos;
+        }
+        else if (len && x->sink.write(x->sink.ctx, off, data, len) < 0)
+            wr = -2;
+        if (wr == -1)
+        {
+            send_error_pkt(x, 0, "Bad compressed data");
+            set_error(x, "bad compressed data in block %u", (unsigned)x->expected);
+            finish(x, XFER_LOCAL_ERROR);
+            return;
+        }
+        if (wr == -2)
+        {
+            send_error_pkt(x, 3, "Disk full or allocation exceeded");
+            set_error(x, "sink write failed at offset %llu", (unsigned long long)off);
+            finish(x, XFER_LOCAL_ERROR);
+            return;
+        }
+        x->retries = 0;
+        x->expected++;
+        x->deadline = now + XFER_TIMEOUT_NS;
+        xs->bytes += x->sum ? len : data_len;
+        xs->blocks++;
+        if (x->rtt_sent)
+        {
+            rtt_add(&xs->rtt, rtt_end(x));
+            x->rtt_sent = 0;
+        }
+
+        if (last && x->sum && !sum_ok(x->crc, x->tail, seen + data_len))
+        {
+            send_error_pkt(x, 0, "Checksum mismatch"); // à la place du dernier ACK
+            set_error(x, "checksum mismatch");
+            finish(x, XFER_CHECKSUM);
+            return;
+        }
+
+        // un ACK par fenêtre (RFC 7440), et toujours pour le dernier bloc
+        if (last || x->expected - 1 - x->acked >= x->windowsize)
+        {
+            x->acked = x->expected - 1;
+            rtt_start(x);
+            send_ack(x, x->acked);
+        }
+        if (last)
+            finish(x, XFER_OK);
+        return;
+    }
+
+    xs->duplicates++; // doublon ou hors fenêtre
+    if (block == (uint16_t)(x->expected - 1))
+    {
+        send_ack(x, block); // DATA dupliqué -> re-ACK
+        x->acked = x->expected - 1;
+        x->rtt_sent = 0;
+    }
+    else if ((uint16_t)(block - (uint16_t)x->expected) < 0x8000 && x->acked != x->expected - 1)
+    {
+        // trou dans la fenêtre : on acquitte une fois le dernier bloc en ordre
+        x->acked = x->expected - 1;
+        send_ack(x, x->acked);
+        x->rtt_sent = 0;
+    }
+}
+
+static void put_packet(struct tftp_xfer *x, uint16_t op, const uint8_t *pkt, size_t n, uint64_t now)
+{
+    struct tftp_xfer_stats *xs = &x->stats;
+    uint16_t ackb;
+
+    if (x->next == 0)
+    {
+        // réponse au WRQ : OACK, ou ACK(0) si le serveur ignore les options
+        if (op == OPCODE_OACK)
+        {
+            if (apply_oack(x, pkt, n) < 0)
+            {
+                send_error_pkt(x, 8, "Bad option value");
+                finish(x, XFER_REJECTED);
+                return;
+            }
+        }
+        else if (op != OPCODE_ACK || parse_block(pkt, n, &ackb) < 0 || ackb != 0)
+            return;
+        if (x->size != TFTP_SIZE_UNKNOWN)
+            x->last_block = (uint32_t)((x->size - x->base + (x->sum ? SUM_LEN : 0)) / x->blksize) + 1;
+        x->next = 1;
+        x->retries = 0;
+        x->deadline = now + XFER_TIMEOUT_NS;
+        put_fill(x);
+        return;
+    }
+
+    if (op != OPCODE_ACK || parse_block(pkt, n, &ackb) < 0)
+        return;
+
+    // numéro 16 bits replacé dans le compteur 32 bits
+    uint16_t delta = (uint16_t)(ackb - (uint16_t)x->acked);
+    if (delta == 0 || x->acked + delta >= x->next)
+    {
+        xs->duplicates++; // ACK dupliqué
+        return;
+    }
+    x->acked += delta;
+    x->retries = 0;
+    x->deadline = now + XFER_TIMEOUT_NS;
+    xs->blocks = x->acked;
+    uint64_t sent = (uint64_t)x->acked * x->blksize;
+    xs->bytes = sent < x->size - x->base ? sent : x->size - x->base;
+    if (x->rtt_block && x->acked >= x->rtt_block)
+    {
+        rtt_add(&xs->rtt, rtt_end(x));
+        x->rtt_block = 0;
+    }
+
+    if (x->acked == x->last_block)
+    {
+        finish(x, XFER_OK);
+        return;
+    }
+    if (x->acked + 1 < x->next)
+    {
+        xs->retransmits += x->next - x->acked - 1;
+        x->rtt_block = 0;
+        x->next = x->acked + 1; // ACK au milieu de la fenêtre : perte, go-back-N
+    }
+    put_fill(x);
+}
+
+static void readable(struct tftp_xfer *x, uint64_t now)
+{
+    // horodatages d'émission : pas de masque d'événements ici, la file
+    // d'erreurs est vidée à chaque réveil ; retenus s'ils suivent le début
+    // de la mesure en cours (sinon d'une mesure abandonnée)
+    struct tstamp tx = {0, 0};
+    while (x->tx_stamps && tstamp_tx(x->sock, &tx))
+    {
+        int measuring = x->op == OPCODE_RRQ ? x->rtt_sent != 0 : x->rtt_block != 0;
+        if (measuring && tx.sw >= x->rtt_sent)
+            x->rtt_sent = tx.sw;
+        if (measuring && tx.hw)
+            x->tx_hw = tx.hw;
+        tx.sw = tx.hw = 0;
+    }
+
+    while (!x->done)
+    {
+        struct sockaddr_in src;
+        ssize_t n = sockbuf_recv(x->sock, rx, sizeof(rx), &src, &x->stats.drops, &x->rx);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                set_error(x, "recvfrom: %s", strerror(errno));
+                finish(x, XFER_LOCAL_ERROR);
+            }
+            return;
+        }
+
+        if (!x->tid_known)
+        {
+            x->tid = src;
+            x->tid_known = 1;
+            x->stats.peer_port = src.sin_port;
+        }
+        else if (!addr_equal(&src, &x->tid))
+            continue; // TID check
+
+        uint64_t at = now_ns();
+        if (x->rx.sw)
+            rtt_add(&x->stats.rxq, at > x->rx.sw ? at - x->rx.sw : 0);
+        else
+            x->rx.sw = at;
+
+        uint16_t op;
+        if (parse_opcode(rx, (size_t)n, &op) < 0)
+            continue;
+        if (op == OPCODE_ERROR)
+        {
+            uint16_t code = 0;
+            if (n >= 4)
+                code = (uint16_t)(rx[2] << 8 | rx[3]);
+            set_error(x, "TFTP ERROR %u: %.*s", code, n > 4 ? (int)(n - 4) : 0, (const char *)rx + 4);
+            finish(x, XFER_PEER_ERROR);
+            return;
+        }
+
+        if (x->op == OPCODE_WRQ)
+            put_packet(x, op, rx, (size_t)n, now);
+        else
+            get_packet(x, op, rx, (size_t)n, now);
+    }
+}
+
+static void expire(struct tftp_xfer *x, uint64_t now)
+{
+    struct tftp_xfer_stats *xs = &x->stats;
+    if (++x->retries > MAX_RETRIES)
+    {
+        set_error(x, "timeout (max retries)");
+        finish(x, XFER_TIMEOUT);
+        return;
+    }
+    x->deadline = now + XFER_TIMEOUT_NS;
+
+    if (!x->tid_known || (x->op == OPCODE_WRQ && x->next == 0))
+    {
+        xs->retransmits++;
+        send_request(x); // requête (ou WRQ) sans réponse
+    }
+    else if (x->op == OPCODE_RRQ)
+    {
+        // fenêtre incomplète : on acquitte ce qu'on a, le serveur repart de là
+        xs->retransmits++;
+        x->rtt_sent = 0;
+        x->acked = x->expected - 1;
+        send_ack(x, x->acked);
+    }
+    else
+    {
+        xs->retransmits += x->next - x->acked - 1;
+        x->rtt_block = 0;       // Karn : pas d'échantillon sur un bloc renvoyé
+        x->next = x->acked + 1; // on renvoie toute la fenêtre
+        put_fill(x);
+    }
+}
+
+/* ------------------- API ------------------- */
+
+struct tftp_xfer *tftp_xfer_start(const struct tftp_xfer_req *req)
+{
+    if (!req->remote || (req->op != OPCODE_RRQ && req->op != OPCODE_WRQ) ||
+        (req->op == OPCODE_RRQ && !req->sink.write) || (req->op == OPCODE_WRQ && !req->source.read))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t rl = strlen(req->remote);
+    struct tftp_xfer *x = calloc(1, sizeof(*x) + rl + 1);
+    if (!x)
+        return NULL;
+    memcpy(x->remote, req->remote, rl + 1);
+    x->op = req->op;
+    x->srv = req->server;
+    x->want_blksize = req->blksize;
+    x->want_windowsize = req->windowsize;
+    x->netascii = req->netascii != 0;
+    // PUT : reprise seulement si la taille de la source est connue ; netascii :
+    // offsets locaux et réseau différents, ni reprise ni plage
+    if (!x->netascii && (req->op == OPCODE_RRQ || req->source.size != TFTP_SIZE_UNKNOWN))
+        x->want_offset = req->offset;
+    x->want_crc = x->want_offset && req->op == OPCODE_RRQ && req->offset_check;
+    x->offset_crc = req->offset_crc;
+    x->want_length = req->op == OPCODE_RRQ && !x->netascii ? req->length : 0;
+    x->want_tsize = req->op == OPCODE_RRQ && req->tsize;
+    x->want_sum = req->checksum && !x->netascii;
+    x->want_lz = req->op == OPCODE_RRQ && req->compress && !x->netascii && !x->want_offset && !x->want_length;
+    x->blksize = DATA_SIZE;
+    x->windowsize = 1;
+    x->expected = 1;
+    x->last_block = UINT32_MAX;
+    x->sink = req->sink;
+    x->source = req->source;
+    x->size = req->op == OPCODE_WRQ ? req->source.size : 0;
+    if (x->netascii && req->op == OPCODE_WRQ)
+    {
+        // taille réseau inconnue avant la fin : traitée comme une source en flux
+        x->size = TFTP_SIZE_UNKNOWN;
+        x->nna = (uint32_t)(req->windowsize ? req->windowsize : 1) + 2;
+        x->na = calloc(x->nna, sizeof(*x->na));
+        if (!x->na)
+        {
+            free(x);
+            return NULL;
+        }
+        x->na[1 % x->nna].pend = NETASCII_NONE;
+    }
+    x->on_done = req->on_done;
+    x->user = req->user;
+    x->start = now_ns();
+    x->rtt_sent = x->start; // GET : requête -> premier DATA
+    x->deadline = x->start + XFER_TIMEOUT_NS;
+
+    struct tftp_xfer_stats *xs = &x->stats;
+    xs->side = "client";
+    xs->file = x->remote;
+    xs->op = x->op;
+    xs->peer_addr = x->srv.sin_addr.s_addr;
+    xs->peer_port = x->srv.sin_port;
+    xs->result = XFER_LOCAL_ERROR;
+    xs->blksize = DATA_SIZE;
+    xs->windowsize = 1;
+    xs->tsize = -1;
+
+    x->sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (x->sock >= 0)
+    {
+        sockbuf_drops_enable(x->sock); // pertes dans notre file : stats.drops
+        x->tx_stamps = tstamp_enable(x->sock) == 0 && req->tx_timestamps;
+        x->pace_rate = req->op == OPCODE_WRQ ? req->pace_rate : 0;
+        x->txtime = x->pace_rate && pace_txtime_available() && !pace_loopback(x->srv.sin_addr.s_addr) &&
+                    pace_txtime_enable(x->sock) == 0;
+    }
+    if (x->sock < 0 || send_request(x) < 0)
+    {
+        int e = errno;
+        if (x->sock >= 0)
+            net_close(x->sock);
+        free(x->na);
+        free(x);
+        errno = e;
+        return NULL;
+    }
+    return x;
+}
+
+int tftp_xfer_fd(const struct tftp_xfer *x)
+{
+    return x->sock;
+}
+
+long tftp_xfer_timeout_us(struct tftp_xfer *x)
+{
+    if (x->done)
+        return -1;
+    uint64_t now = now_ns();
+    uint64_t due = x->pace_wake && x->pace_wake < x->deadline ? x->pace_wake : x->deadline;
+    long us = due <= now ? 0 : (long)((due - now + 999) / 1000ULL);
+    int held = net_flush(); // datagrammes retardés par netsim
+    if (held >= 0 && (long)held * 1000 < us)
+        us = (long)held * 1000;
+    return us;
+}
+
+int tftp_xfer_timeout_ms(struct tftp_xfer *x)
+{
+    long us = tftp_xfer_timeout_us(x);
+    return us < 0 ? -1 : (int)((us + 999) / 1000);
+}
+
+int tftp_xfer_process_events(struct tftp_xfer *x)
+{
+    if (x->done)
+        return 0;
+    net_flush();
+    uint64_t now = now_ns();
+    readable(x, now);
+    if (!x->done && x->pace_wake && x->pace_wake <= now)
+    {
+        uint32_t sent = x->next;
+        x->pace_wake = 0;
+        put_fill(x);
+        if (x->next != sent)
+            x->deadline = now + XFER_TIMEOUT_NS; // délai compté depuis le dernier DATA
+    }
+    if (!x->done && x->deadline <= now)
+        expire(x, now);
+    if (!x->done)
+        return 1;
+
+    // dernier accès à x : le callback peut le libérer
+    if (x->on_done)
+        x->on_done(x, x->user);
+    return 0;
+}
+
+int tftp_xfer_done(const struct tftp_xfer *x)
+{
+    return x->done;
+}
+
+enum tftp_xfer_result tftp_xfer_result(const struct tftp_xfer *x)
+{
+    return x->stats.result;
+}
+
+const struct tftp_xfer_stats *tftp_xfer_stats(const struct tftp_xfer *x)
+{
+    return &x->stats;
+}
+
+const char *tftp_xfer_error(const struct tftp_xfer *x)
+{
+    return x->err;
+}
+
+void *tftp_xfer_user(const struct tftp_xfer *x)
+{
+    return x->user;
+}
+
+void tftp_xfer_free(struct tftp_xfer *x)
+{
+    if (!x)
+        return;
+    if (x->sock >= 0)
+        net_close(x->sock);
+    lz_dec_free(&x->lz_dec);
+    free(x->na);
+    free(x);
+}
@@ -0,0 +1,306 @@
+#include "log.h"
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#define LOG_RING_SIZE 4096 // enregistrements par thread (puissance de 2)
+#define LOG_MAX_THREADS 64
+#define LOG_IDLE_NS 5000000 // 5 ms de pause quand tous les anneaux sont vides
+#define LOG_LINE_MAX 512
+
+struct log_rec
+{
+    uint64_t ts; // ns, CLOCK_REALTIME
+    const char *fmt;
+    uint64_t args[LOG_MAX_ARGS];
+    uint8_t level;
+    uint8_t nargs;
+    char str[LOG_STR_MAX];
+};
+
+_Static_assert(sizeof(struct log_rec) == 96, "log_rec: 96 octets");
+
+// anneau SPSC : le thread propriétaire produit, le thread de fond consomme
+struct log_ring
+{
+    uint64_t head __attribute__((aligned(64))); // écrit par le producteur
+    uint64_t dropped;
+    uint64_t tail __attribute__((aligned(64))); // écrit par le consommateur
+    struct log_rec recs[LOG_RING_SIZE];
+};
+
+int log_level = LOG_INFO;
+
+static struct log_ring *rings[LOG_MAX_THREADS];
+static uint32_t nrings; // publié avec release, lu avec acquire
+static pthread_mutex_t reg_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct log_ring *my_ring;
+static __thread int my_ring_failed;
+
+static pthread_t flusher;
+static volatile int async_on = 0;
+static volatile int stop_flusher = 0;
+
+static const char *const level_names[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+
+/* --------------- Formatage --------------- */
+
+size_t log_format(char *out, size_t size, const char *fmt, const char *str,
+                  const uint64_t *args, size_t nargs)
+{
+    size_t o = 0, k = 0;
+    if (size == 0)
+        return 0;
+
+    for (const char *p = fmt; *p && o + 1 < size; p++)
+    {
+        if (*p != '%')
+        {
+            out[o++] = *p;
+            continue;
+        }
+        p++;
+        while (*p == 'l' || *p == 'h' || *p == 'z') // tailles ignorées : tout est 64 bits
+            p++;
+        if (*p == 0)
+            break;
+
+        char tmp[64];
+        const char *s = tmp;
+        uint64_t v = k < nargs ? args[k] : 0;
+        switch (*p)
+        {
+        case '%':
+            s = "%";
+            break;
+        case 's':
+            s = str ? str : "(null)";
+            break;
+        case 'd':
+        case 'i':
+            snprintf(tmp, sizeof(tmp), "%lld", (long long)(int64_t)v);
+            k++;
+            break;
+        case 'u':
+            snprintf(tmp, sizeof(tmp), "%llu", (unsigned long long)v);
+            k++;
+            break;
+        case 'x':
+            snprintf(tmp, sizeof(tmp), "%llx", (unsigned long long)v);
+            k++;
+            break;
+        case 'I':
+        {
+            struct in_addr a;
+            a.s_addr = (uint32_t)v;
+            inet_ntop(AF_INET, &a, tmp, sizeof(tmp));
+            k++;
+            break;
+        }
+        default:
+            snprintf(tmp, sizeof(tmp), "%%%c", *p);
+            break;
+        }
+        size_t n = strlen(s);
+        if (n > size - 1 - o)
+            n = size - 1 - o;
+        memcpy(out + o, s, n);
+        o += n;
+    }
+    out[o] = 0;
+    return o;
+}
+
+static void emit(const struct log_rec *r)
+{
+    char msg[LOG_LINE_MAX];
+    log_format(msg, sizeof(msg), r->fmt, r->str, r->args, r->nargs);
+
+    time_t sec = (time_t)(r->ts / 1000000000ULL);
+    struct tm tmv;
+    localtime_r(&sec, &tmv);
+    char when[32];
+    strftime(when, sizeof(when), "%H:%M:%S", &tmv);
+
+    FILE *f = r->level <= LOG_WARN ? stderr : stdout;
+    fprintf(f, "%s.%06u %-5s %s\n", when, (unsigned)(r->ts % 1000000000ULL / 1000),
+            level_names[r->level], msg);
+}
+
+static void fill_rec(struct log_rec *r, int level, const char *fmt, const char *str,
+                     const uint64_t *args, size_t nargs)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    r->ts = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    r->fmt = fmt;
+    r->level = (uint8_t)level;
+    r->nargs = (uint8_t)(nargs > LOG_MAX_ARGS ? LOG_MAX_ARGS : nargs);
+    memcpy(r->args, args, r->nargs * sizeof(uint64_t));
+    if (str)
+    {
+        size_t n = strnlen(str, LOG_STR_MAX - 1);
+        memcpy(r->str, str, n);
+        r->str[n] = 0;
+    }
+    else
+        r->str[0] = 0;
+}
+
+/* --------------- Anneaux --------------- */
+
+static struct log_ring *ring_register(void)
+{
+    if (my_ring_failed)
+        return NULL;
+    struct log_ring *r = aligned_alloc(64, sizeof(struct log_ring));
+    if (!r)
+    {
+        my_ring_failed = 1;
+        return NULL;
+    }
+    memset(r, 0, sizeof(*r));
+
+    pthread_mutex_lock(&reg_lock);
+    uint32_t n = nrings;
+    if (n < LOG_MAX_THREADS)
+    {
+        rings[n] = r;
+        __atomic_store_n(&nrings, n + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&reg_lock);
+
+    if (n >= LOG_MAX_THREADS)
+    {
+        free(r);
+        my_ring_failed = 1; // trop de threads : ce thread journalise en direct
+        return NULL;
+    }
+    return r;
+}
+
+void log_write(int level, const char *fmt, const char *str, const uint64_t *args, size_t nargs)
+{
+    if (!async_on)
+    {
+        struct log_rec r;
+        fill_rec(&r, level, fmt, str, args, nargs);
+        emit(&r);
+        return;
+    }
+
+    struct log_ring *ring = my_ring;
+    if (!ring && !(ring = my_ring = ring_register()))
+    {
+        struct log_rec r;
+        fill_rec(&r, level, fmt, str, args, nargs);
+        emit(&r);
+        return;
+    }
+
+    uint64_t h = ring->head;
+    uint64_t t = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (h - t >= LOG_RING_SIZE)
+    {
+        // plein : on perd l'enregistrement plutôt que de bloquer la boucle réseau
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    fill_rec(&ring->recs[h & (LOG_RING_SIZE - 1)], level, fmt, str, args, nargs);
+    __atomic_store_n(&ring->head, h + 1, __ATOMIC_RELEASE);
+}
+
+// vide tous les anneaux, retourne le nombre d'enregistrements écrits
+static size_t drain(void)
+{
+    size_t done = 0;
+    uint32_t n = __atomic_load_n(&nrings, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        struct log_ring *r = rings[i];
+        uint64_t t = r->tail;
+        uint64_t h = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        for (; t != h; t++, done++)
+            emit(&r->recs[t & (LOG_RING_SIZE - 1)]);
+        __atomic_store_n(&r->tail, t, __ATOMIC_RELEASE);
+    }
+    if (done)
+    {
+        fflush(stdout);
+        fflush(stderr);
+    }
+    return done;
+}
+
+static void *flusher_loop(void *arg)
+{
+    (void)arg;
+    struct timespec idle = {0, LOG_IDLE_NS};
+    while (!stop_flusher)
+    {
+        if (drain() == 0)
+            nanosleep(&idle, NULL);
+    }
+    drain();
+    return NULL;
+}
+
+/* --------------- API --------------- */
+
+int log_parse_level(const char *name)
+{
+    for (int l = LOG_ERROR; l <= LOG_DEBUG; l++)
+    {
+        if (strcasecmp(name, level_names[l]) == 0)
+            return l;
+    }
+    if (name[0] >= '0' && name[0] <= '3' && name[1] == 0)
+        return name[0] - '0';
+    return -1;
+}
+
+void log_set_level(int level)
+{
+    log_level = level;
+}
+
+int log_start(void)
+{
+    if (async_on)
+        return 0;
+    stop_flusher = 0;
+    if (pthread_create(&flusher, NULL, flusher_loop, NULL) != 0)
+    {
+        fprintf(stderr, "Erreur: pthread_create (log)\n");
+        return -1;
+    }
+    async_on = 1;
+    return 0;
+}
+
+void log_stop(void)
+{
+    if (!async_on)
+        return;
+    stop_flusher = 1;
+    pthread_join(flusher, NULL);
+    async_on = 0; // les appels suivants repassent en direct
+
+    uint64_t lost = log_dropped();
+    if (lost)
+        fprintf(stderr, "log: %llu enregistrements perdus (anneau plein)\n", (unsigned long long)lost);
+    fflush(stdout);
+}
+
+uint64_t log_dropped(void)
+{
+    uint64_t total = 0;
+    uint32_t n = __atomic_load_n(&nrings, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < n; i++)
+        total += __atomic_load_n(&rings[i]->dropped, __ATOMIC_RELAXED);
+    return total;
+}
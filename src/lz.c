@@ -0,0 +1,293 @@
+#include "lz.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_LOG 12
+#define MIN_MATCH 4
+#define LAST_LITERALS 5 // fin de trame toujours en littéraux
+#define MFLIMIT 12      // pas de correspondance qui commence après end - MFLIMIT
+#define MAX_DIST 65535
+
+static uint32_t rd32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t rd64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash4(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - HASH_LOG);
+}
+
+static void wr32be(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+// longueur de la partie commune de p et q, sans dépasser limit
+static size_t match_len(const uint8_t *p, const uint8_t *q, const uint8_t *limit)
+{
+    const uint8_t *start = p;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (p + 8 <= limit)
+    {
+        uint64_t x = rd64(p) ^ rd64(q);
+        if (x)
+            return (size_t)(p - start) + ((size_t)__builtin_ctzll(x) >> 3);
+        p += 8;
+        q += 8;
+    }
+#endif
+    while (p < limit && *p == *q)
+    {
+        p++;
+        q++;
+    }
+    return (size_t)(p - start);
+}
+
+static uint8_t *put_len(uint8_t *op, size_t n)
+{
+    for (; n >= 255; n -= 255)
+        *op++ = 255;
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+/* ---------------- Trame ---------------- */
+
+size_t lz_bound(size_t len)
+{
+    return len + LZ_HDR * ((len + LZ_FRAME - 1) / LZ_FRAME);
+}
+
+// une séquence : littéraux [anchor, anchor + lit), puis correspondance de
+// mlen octets à distance off (mlen = 0 : dernière séquence) ; NULL si hors de out
+static uint8_t *emit(uint8_t *op, const uint8_t *oend, const uint8_t *anchor, size_t lit, size_t off,
+                     size_t mlen)
+{
+    size_t worst = 1 + lit / 255 + 1 + lit + (mlen ? 2 + (mlen - MIN_MATCH) / 255 + 1 : 0);
+    if ((size_t)(oend - op) < worst)
+        return NULL;
+    size_t ml = mlen ? mlen - MIN_MATCH : 0;
+    *op++ = (uint8_t)((lit < 15 ? lit : 15) << 4 | (ml < 15 ? ml : 15));
+    if (lit >= 15)
+        op = put_len(op, lit - 15);
+    memcpy(op, anchor, lit);
+    op += lit;
+    if (mlen)
+    {
+        *op++ = (uint8_t)off;
+        *op++ = (uint8_t)(off >> 8);
+        if (ml >= 15)
+            op = put_len(op, ml - 15);
+    }
+    return op;
+}
+
+size_t lz_compress_frame(const uint8_t *in, size_t len, uint8_t *out, size_t cap)
+{
+    uint32_t table[1 << HASH_LOG]; // position + 1 du dernier mot de 4 octets vu (0 = aucun)
+    const uint8_t *ip = in, *anchor = in, *end = in + len;
+    uint8_t *op = out, *oend = out + cap;
+
+    if (len > MFLIMIT)
+    {
+        memset(table, 0, sizeof(table));
+        const uint8_t *mlimit = end - MFLIMIT;
+        const uint8_t *match_limit = end - LAST_LITERALS;
+        while (ip <= mlimit)
+        {
+            uint32_t h = hash4(rd32(ip));
+            uint32_t cand = table[h];
+            table[h] = (uint32_t)(ip - in) + 1;
+            const uint8_t *ref = in + cand - 1;
+            if (!cand || ip - ref > MAX_DIST || rd32(ref) != rd32(ip))
+            {
+                ip += 1 + ((size_t)(ip - anchor) >> 6); // accélère dans les zones sans répétition
+                continue;
+            }
+            while (ip > anchor && ref > in && ip[-1] == ref[-1])
+            {
+                ip--;
+                ref--;
+            }
+            size_t mlen = MIN_MATCH + match_len(ip + MIN_MATCH, ref + MIN_MATCH, match_limit);
+            op = emit(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), mlen);
+            if (!op)
+                return 0;
+            ip += mlen;
+            anchor = ip;
+            if (ip <= mlimit)
+                table[hash4(rd32(ip - 2))] = (uint32_t)(ip - 2 - in) + 1;
+        }
+    }
+    op = emit(op, oend, anchor, (size_t)(end - anchor), 0, 0);
+    return op ? (size_t)(op - out) : 0;
+}
+
+static int read_len(const uint8_t **ip, const uint8_t *iend, size_t *n)
+{
+    uint8_t b;
+    do
+    {
+        if (*ip >= iend)
+            return -1;
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return 0;
+}
+
+ssize_t lz_decompress_frame(const uint8_t *in, size_t len, uint8_t *out, size_t cap)
+{
+    const uint8_t *ip = in, *iend = in + len;
+    uint8_t *op = out, *oend = out + cap;
+    while (ip < iend)
+    {
+        unsigned token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && read_len(&ip, iend, &lit) < 0)
+            return -1;
+        if ((size_t)(iend - ip) < lit || (size_t)(oend - op) < lit)
+            return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend)
+            break; // dernière séquence : littéraux seuls
+
+        if (iend - ip < 2)
+            return -1;
+        size_t off = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t mlen = token & 15;
+        if (mlen == 15 && read_len(&ip, iend, &mlen) < 0)
+            return -1;
+        mlen += MIN_MATCH;
+        if (off == 0 || off > (size_t)(op - out) || (size_t)(oend - op) < mlen)
+            return -1;
+        const uint8_t *ref = op - off;
+        size_t i = 0;
+        if (off >= 8)
+            for (; i + off <= mlen; i += off) // recouvrement : le motif de off octets se répète
+                memcpy(op + i, ref + i, off);
+        if (off >= mlen - i)
+            memcpy(op + i, ref + i, mlen - i);
+        else
+            for (; i < mlen; i++)
+                op[i] = ref[i];
+        op += mlen;
+    }
+    return (ssize_t)(op - out);
+}
+
+/* ---------------- Flux ---------------- */
+
+size_t lz_encode_frame(const uint8_t *in, size_t len, uint8_t *out)
+{
+    // compressée seulement si plus courte (charge < LZ_FRAME, voir lz_dec_feed)
+    size_t c = lz_compress_frame(in, len, out + LZ_HDR, len - 1);
+    if (c)
+        wr32be(out, (uint32_t)c);
+    else
+    {
+        memcpy(out + LZ_HDR, in, len);
+        wr32be(out, LZ_RAW | (uint32_t)len);
+        c = len;
+    }
+    return LZ_HDR + c;
+}
+
+size_t lz_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += LZ_FRAME)
+        o += lz_encode_frame(in + i, len - i < LZ_FRAME ? len - i : LZ_FRAME, out + o);
+    return o;
+}
+
+int lz_worth(const uint8_t *in, size_t len)
+{
+    uint8_t tmp[LZ_SAMPLE_SIZE];
+    size_t raw = 0, packed = 0;
+    size_t step = len > LZ_SAMPLE_SIZE ? (len - LZ_SAMPLE_SIZE) / (LZ_SAMPLES - 1) : 0;
+    for (int s = 0; s < LZ_SAMPLES && raw < len; s++)
+    {
+        size_t n = len < LZ_SAMPLE_SIZE ? len : LZ_SAMPLE_SIZE;
+        size_t c = lz_compress_frame(in + (size_t)s * step, n, tmp, n);
+        raw += n;
+        packed += c ? c : n;
+    }
+    return raw > 0 && packed * 8 <= raw * 7;
+}
+
+int lz_dec_feed(struct lz_dec *d, const uint8_t *in, size_t len, lz_out_fn out, void *ctx)
+{
+    while (len > 0)
+    {
+        if (d->hlen < LZ_HDR)
+        {
+            d->hdr[d->hlen++] = *in++;
+            len--;
+            if (d->hlen < LZ_HDR)
+                continue;
+            uint32_t h = (uint32_t)d->hdr[0] << 24 | (uint32_t)d->hdr[1] << 16 | (uint32_t)d->hdr[2] << 8 | d->hdr[3];
+            d->raw = (h & LZ_RAW) != 0;
+            d->need = h & ~LZ_RAW;
+            d->have = 0;
+            if (d->need == 0 || d->need > LZ_FRAME || (!d->raw && d->need == LZ_FRAME))
+                return -1;
+            if (!d->raw && !d->buf && (d->buf = malloc(2 * LZ_FRAME)) == NULL)
+                return -1;
+            continue;
+        }
+
+        size_t n = d->need - d->have < len ? d->need - d->have : len;
+        if (d->raw)
+        {
+            if (out(ctx, in, n) < 0)
+                return -2;
+        }
+        else
+            memcpy(d->buf + d->have, in, n);
+        d->have += (uint32_t)n;
+        in += n;
+        len -= n;
+        if (d->have < d->need)
+            continue;
+
+        d->hlen = 0;
+        if (!d->raw)
+        {
+            ssize_t p = lz_decompress_frame(d->buf, d->need, d->buf + LZ_FRAME, LZ_FRAME);
+            if (p < 0)
+                return -1;
+            if (p > 0 && out(ctx, d->buf + LZ_FRAME, (size_t)p) < 0)
+                return -2;
+        }
+    }
+    return 0;
+}
+
+int lz_dec_idle(const struct lz_dec *d)
+{
+    return d->hlen == 0;
+}
+
+void lz_dec_free(struct lz_dec *d)
+{
+    free(d->buf);
+    d->buf = NULL;
+}
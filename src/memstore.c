@@ -0,0 +1,252 @@
+#include "memstore.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MEMSTORE_MIN_BUCKETS 64
+
+static uint32_t name_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+    for (; *name; name++)
+    {
+        h ^= (uint8_t)*name;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int memstore_init(struct tftp_memstore *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->buckets = calloc(MEMSTORE_MIN_BUCKETS, sizeof(*s->buckets));
+    if (!s->buckets)
+        return -1;
+    s->mask = MEMSTORE_MIN_BUCKETS - 1;
+    if (pthread_rwlock_init(&s->lock, NULL) != 0)
+    {
+        free(s->buckets);
+        s->buckets = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void memobj_release(struct tftp_memobj *o)
+{
+    if (!o || __atomic_sub_fetch(&o->refs, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+    if (o->locked)
+        munlock(o->data, o->len);
+    free(o->name);
+    free(o->data);
+    free(o);
+}
+
+void memstore_free(struct tftp_memstore *s)
+{
+    if (!s->buckets)
+        return;
+    for (uint32_t b = 0; b <= s->mask; b++)
+    {
+        struct tftp_memobj *o = s->buckets[b];
+        while (o)
+        {
+            struct tftp_memobj *next = o->next;
+            memobj_release(o);
+            o = next;
+        }
+    }
+    free(s->buckets);
+    s->buckets = NULL;
+    pthread_rwlock_destroy(&s->lock);
+}
+
+// double le nombre de cases quand la charge dépasse 1 (verrou écrivain tenu)
+static void grow(struct tftp_memstore *s)
+{
+    uint32_t nb = (s->mask + 1) * 2;
+    struct tftp_memobj **nbk = calloc(nb, sizeof(*nbk));
+    if (!nbk)
+        return; // on garde l'ancienne table, chaînes plus longues
+    for (uint32_t b = 0; b <= s->mask; b++)
+    {
+        struct tftp_memobj *o = s->buckets[b];
+        while (o)
+        {
+            struct tftp_memobj *next = o->next;
+            uint32_t k = name_hash(o->name) & (nb - 1);
+            o->next = nbk[k];
+            nbk[k] = o;
+            o = next;
+        }
+    }
+    free(s->buckets);
+    s->buckets = nbk;
+    s->mask = nb - 1;
+}
+
+struct tftp_memobj *memobj_new(const char *name, const void *data, size_t len)
+{
+    struct tftp_memobj *o = calloc(1, sizeof(*o));
+    if (!o)
+        return NULL;
+    o->name = strdup(name);
+    o->data = malloc(len ? len : 1);
+    if (!o->name || !o->data)
+    {
+        free(o->name);
+        free(o->data);
+        free(o);
+        return NULL;
+    }
+    memcpy(o->data, data, len);
+    o->len = len;
+    o->refs = 1;
+    return o;
+}
+
+struct tftp_memobj *memobj_adopt(const char *name, uint8_t *data, size_t len)
+{
+    struct tftp_memobj *o = calloc(1, sizeof(*o));
+    if (!o || (o->name = strdup(name)) == NULL)
+    {
+        free(o);
+        return NULL;
+    }
+    o->data = data;
+    o->len = len;
+    o->refs = 1;
+    return o;
+}
+
+int memstore_put(struct tftp_memstore *s, const char *name, const void *data, size_t len)
+{
+    struct tftp_memobj *o = memobj_new(name, data, len); // référence du store
+    if (!o)
+        return -1;
+    memstore_publish(s, o);
+    return 0;
+}
+
+void memstore_publish(struct tftp_memstore *s, struct tftp_memobj *o)
+{
+    const char *name = o->name;
+    pthread_rwlock_wrlock(&s->lock);
+    struct tftp_memobj **pp = &s->buckets[name_hash(name) & s->mask];
+    while (*pp && strcmp((*pp)->name, name) != 0)
+        pp = &(*pp)->next;
+    struct tftp_memobj *old = *pp;
+    if (old)
+    {
+        o->next = old->next;
+        *pp = o;
+    }
+    else
+    {
+        o->next = *pp;
+        *pp = o;
+        if (++s->count > s->mask + 1)
+            grow(s);
+    }
+    pthread_rwlock_unlock(&s->lock);
+
+    memobj_release(old); // libéré quand le dernier transfert qui le sert se termine
+}
+
+int memstore_put_file(struct tftp_memstore *s, const char *name, const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    size_t len = (size_t)st.st_size;
+    uint8_t *buf = malloc(len ? len : 1);
+    size_t got = 0;
+    while (buf && got < len)
+    {
+        ssize_t r = read(fd, buf + got, len - got);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        got += (size_t)r;
+    }
+    close(fd);
+    if (!buf || got != len)
+    {
+        fprintf(stderr, "%s: lecture incomplète\n", path);
+        free(buf);
+        return -1;
+    }
+    struct tftp_memobj *o = memobj_adopt(name, buf, len); // sans seconde copie
+    if (!o)
+    {
+        free(buf);
+        return -1;
+    }
+    memstore_publish(s, o);
+    return 0;
+}
+
+int memstore_remove(struct tftp_memstore *s, const char *name)
+{
+    pthread_rwlock_wrlock(&s->lock);
+    struct tftp_memobj **pp = &s->buckets[name_hash(name) & s->mask];
+    while (*pp && strcmp((*pp)->name, name) != 0)
+        pp = &(*pp)->next;
+    struct tftp_memobj *o = *pp;
+    if (o)
+    {
+        *pp = o->next;
+        s->count--;
+    }
+    pthread_rwlock_unlock(&s->lock);
+
+    if (!o)
+        return -1;
+    memobj_release(o);
+    return 0;
+}
+
+int memstore_drop(struct tftp_memstore *s, struct tftp_memobj *o)
+{
+    pthread_rwlock_wrlock(&s->lock);
+    struct tftp_memobj **pp = &s->buckets[name_hash(o->name) & s->mask];
+    while (*pp && *pp != o)
+        pp = &(*pp)->next;
+    int found = *pp != NULL;
+    if (found)
+    {
+        *pp = o->next;
+        s->count--;
+    }
+    pthread_rwlock_unlock(&s->lock);
+
+    if (!found)
+        return -1;
+    memobj_release(o); // référence du store
+    return 0;
+}
+
+struct tftp_memobj *memstore_get(struct tftp_memstore *s, const char *name)
+{
+    pthread_rwlock_rdlock(&s->lock);
+    struct tftp_memobj *o = s->buckets[name_hash(name) & s->mask];
+    while (o && strcmp(o->name, name) != 0)
+        o = o->next;
+    if (o)
+        __atomic_add_fetch(&o->refs, 1, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&s->lock);
+    return o;
+}
@@ -0,0 +1,345 @@
+#include "metrics.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define RENDER_SIZE (256 * 1024)
+#define HTTP_POLL_MS 200
+#define HIST_EXPORT_MIN_EXP 10 // premières bornes exportées : 2^10 ns ~ 1 us
+
+/* --------------- Histogrammes --------------- */
+
+uint64_t hist_bucket_upper(unsigned idx)
+{
+    if (idx < HIST_SUB)
+        return idx + 1;
+    unsigned e = idx / HIST_SUB + HIST_SUB_BITS - 1;
+    uint64_t sub = idx % HIST_SUB;
+    return (HIST_SUB + sub + 1) << (e - HIST_SUB_BITS);
+}
+
+static uint64_t hist_bucket_mid(unsigned idx)
+{
+    if (idx < HIST_SUB)
+        return idx;
+    unsigned e = idx / HIST_SUB + HIST_SUB_BITS - 1;
+    uint64_t width = 1ULL << (e - HIST_SUB_BITS);
+    return hist_bucket_upper(idx) - width / 2;
+}
+
+uint64_t hist_quantile(const struct tftp_hist *h, double q)
+{
+    if (h->count == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(q * (double)h->count);
+    if (rank >= h->count)
+        rank = h->count - 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += h->buckets[i];
+        if (seen > rank)
+            return hist_bucket_mid(i);
+    }
+    return hist_bucket_mid(HIST_BUCKETS - 1);
+}
+
+/* --------------- Agrégation --------------- */
+
+struct tftp_metrics *metrics_alloc(uint32_t n)
+{
+    size_t bytes = (size_t)n * sizeof(struct tftp_metrics);
+    struct tftp_metrics *m = aligned_alloc(64, bytes);
+    if (m)
+        memset(m, 0, bytes);
+    return m;
+}
+
+void metrics_free(struct tftp_metrics *m)
+{
+    free(m);
+}
+
+#define LOAD(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+
+void metrics_sum(const struct tftp_metrics *m, uint32_t n, struct tftp_metrics *out)
+{
+    memset(out, 0, sizeof(*out));
+    for (uint32_t w = 0; w < n; w++)
+    {
+        for (int k = 0; k < M_COUNTERS; k++)
+            out->c[k] += LOAD(&m[w].c[k]);
+        for (int k = 0; k < H_COUNT; k++)
+        {
+            const struct tftp_hist *src = &m[w].h[k];
+            struct tftp_hist *dst = &out->h[k];
+            dst->count += LOAD(&src->count);
+            dst->sum += LOAD(&src->sum);
+            for (unsigned b = 0; b < HIST_BUCKETS; b++)
+                dst->buckets[b] += LOAD(&src->buckets[b]);
+        }
+    }
+}
+
+/* --------------- Format Prometheus --------------- */
+
+struct out
+{
+    char *buf;
+    size_t size;
+    size_t len;
+};
+
+static void put(struct out *o, const char *fmt, ...)
+{
+    if (o->len >= o->size)
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    int r = vsnprintf(o->buf + o->len, o->size - o->len, fmt, ap);
+    va_end(ap);
+    if (r > 0)
+        o->len += (size_t)r;
+    if (o->len > o->size)
+        o->len = o->size;
+}
+
+static void put_counter(struct out *o, const char *name, const char *help, uint64_t v)
+{
+    put(o, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name,
+        (unsigned long long)v);
+}
+
+static const char *const hist_names[H_COUNT] = {
+    "tftp_transfer_duration_seconds",
+    "tftp_time_to_first_byte_seconds",
+    "tftp_block_rtt_seconds",
+    "tftp_rx_queue_seconds",
+};
+static const char *const hist_help[H_COUNT] = {
+    "Duree des transferts reussis",
+    "Requete jusqu'au premier DATA emis (RRQ) ou recu (WRQ)",
+    "Emission d'un bloc jusqu'a son acquittement",
+    "Arrivee d'un datagramme dans le noyau jusqu'a son traitement",
+};
+
+static void put_hist(struct out *o, int id, const struct tftp_hist *h)
+{
+    const char *name = hist_names[id];
+    put(o, "# HELP %s %s\n# TYPE %s histogram\n", name, hist_help[id], name);
+
+    // bornes exportées : une par puissance de 2 (les classes fines restent
+    // disponibles via les quantiles ci-dessous)
+    uint64_t cum = 0;
+    unsigned b = 0;
+    for (unsigned e = HIST_EXPORT_MIN_EXP; e <= HIST_MAX_EXP; e++)
+    {
+        uint64_t edge = 1ULL << e;
+        while (b < HIST_BUCKETS && hist_bucket_upper(b) <= edge)
+            cum += h->buckets[b++];
+        put(o, "%s_bucket{le=\"%.9g\"} %llu\n", name, (double)edge / 1e9, (unsigned long long)cum);
+    }
+    put(o, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)h->count);
+    put(o, "%s_sum %.9f\n%s_count %llu\n", name, (double)h->sum / 1e9, name,
+        (unsigned long long)h->count);
+}
+
+size_t metrics_render(const struct tftp_metrics *m, uint32_t n, char *buf, size_t size)
+{
+    struct tftp_metrics *s = malloc(sizeof(*s));
+    if (!s)
+        return 0;
+    metrics_sum(m, n, s);
+
+    struct out o = {buf, size, 0};
+    put(&o, "# HELP tftp_requests_total Requetes recues sur le port d'ecoute\n"
+            "# TYPE tftp_requests_total counter\n");
+    put(&o, "tftp_requests_total{opcode=\"RRQ\"} %llu\n", (unsigned long long)s->c[M_REQ_RRQ]);
+    put(&o, "tftp_requests_total{opcode=\"WRQ\"} %llu\n", (unsigned long long)s->c[M_REQ_WRQ]);
+    put(&o, "tftp_requests_total{opcode=\"other\"} %llu\n", (unsigned long long)s->c[M_REQ_OTHER]);
+
+    put(&o, "# HELP tftp_errors_sent_total Paquets ERROR envoyes, par code\n"
+            "# TYPE tftp_errors_sent_total counter\n");
+    for (int k = 0; k <= 8; k++)
+        put(&o, "tftp_errors_sent_total{code=\"%d\"} %llu\n", k,
+            (unsigned long long)s->c[M_ERR_SENT_0 + k]);
+
+    put_counter(&o, "tftp_errors_received_total", "Paquets ERROR recus des clients", s->c[M_ERR_RECV]);
+    put_counter(&o, "tftp_rx_packets_total", "Datagrammes recus", s->c[M_RX_PACKETS]);
+    put_counter(&o, "tftp_rx_bytes_total", "Octets recus (datagrammes entiers)", s->c[M_RX_BYTES]);
+    put_counter(&o, "tftp_tx_packets_total", "Datagrammes envoyes", s->c[M_TX_PACKETS]);
+    put_counter(&o, "tftp_tx_bytes_total", "Octets envoyes (datagrammes entiers)", s->c[M_TX_BYTES]);
+    put_counter(&o, "tftp_retransmits_total", "Paquets retransmis", s->c[M_RETRANSMITS]);
+    put_counter(&o, "tftp_timeouts_total", "Timeouts de session", s->c[M_TIMEOUTS]);
+    put_counter(&o, "tftp_duplicates_total", "DATA/ACK dupliques ou hors fenetre", s->c[M_DUPLICATES]);
+    put(&o, "# HELP tftp_socket_drops_total Datagrammes jetes par le noyau, file de reception pleine\n"
+            "# TYPE tftp_socket_drops_total counter\n");
+    put(&o, "tftp_socket_drops_total{socket=\"request\"} %llu\n", (unsigned long long)s->c[M_DROPS_REQUEST]);
+    put(&o, "tftp_socket_drops_total{socket=\"tid\"} %llu\n", (unsigned long long)s->c[M_DROPS_TID]);
+    put_counter(&o, "tftp_sessions_started_total", "Sessions ouvertes", s->c[M_SESSIONS_STARTED]);
+    put_counter(&o, "tftp_sessions_ended_total", "Sessions fermees", s->c[M_SESSIONS_ENDED]);
+    put_counter(&o, "tftp_transfers_completed_total", "Transferts menes a terme", s->c[M_TRANSFERS_OK]);
+    put(&o, "# HELP tftp_sessions_active Sessions en cours\n# TYPE tftp_sessions_active gauge\n"
+            "tftp_sessions_active %lld\n",
+        (long long)(s->c[M_SESSIONS_STARTED] - s->c[M_SESSIONS_ENDED]));
+
+    for (int k = 0; k < H_COUNT; k++)
+        put_hist(&o, k, &s->h[k]);
+
+    static const double qs[] = {0.5, 0.9, 0.99, 0.999};
+    put(&o, "# HELP tftp_latency_quantile_seconds Quantiles des histogrammes (precision 6%%)\n"
+            "# TYPE tftp_latency_quantile_seconds gauge\n");
+    for (int k = 0; k < H_COUNT; k++)
+    {
+        for (size_t q = 0; q < sizeof(qs) / sizeof(qs[0]); q++)
+            put(&o, "tftp_latency_quantile_seconds{hist=\"%s\",quantile=\"%g\"} %.9f\n",
+                hist_names[k], qs[q], (double)hist_quantile(&s->h[k], qs[q]) / 1e9);
+    }
+
+    free(s);
+    return o.len;
+}
+
+/* --------------- Exporteur HTTP --------------- */
+
+static struct
+{
+    pthread_t thread;
+    int sock;
+    volatile int stop;
+    const struct tftp_metrics *m;
+    uint32_t n;
+    char *buf;
+} exporter = {.sock = -1};
+
+// MSG_NOSIGNAL : un client qui ferme (RST) ne doit pas tuer le serveur par SIGPIPE
+static void write_all(int fd, const char *p, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t w = send(fd, p, len, MSG_NOSIGNAL);
+        if (w <= 0)
+        {
+            if (w < 0 && errno == EINTR)
+                continue;
+            return;
+        }
+        p += w;
+        len -= (size_t)w;
+    }
+}
+
+static void serve_one(int fd)
+{
+    struct timeval tv = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)); // client qui ne lit pas
+
+    char req[1024];
+    ssize_t r = read(fd, req, sizeof(req) - 1);
+    if (r <= 0)
+        return;
+    req[r] = 0;
+
+    char head[160];
+    if (strncmp(req, "GET /metrics", 12) == 0 || strncmp(req, "GET / ", 6) == 0)
+    {
+        size_t len = metrics_render(exporter.m, exporter.n, exporter.buf, RENDER_SIZE);
+        int hl = snprintf(head, sizeof(head),
+                          "HTTP/1.0 200 OK\r\n"
+                          "Content-Type: text/plain; version=0.0.4\r\n"
+                          "Content-Length: %zu\r\n\r\n",
+                          len);
+        write_all(fd, head, (size_t)hl);
+        write_all(fd, exporter.buf, len);
+    }
+    else
+    {
+        const char *nf = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        write_all(fd, nf, strlen(nf));
+    }
+}
+
+static void *exporter_loop(void *arg)
+{
+    (void)arg;
+    struct pollfd pfd = {exporter.sock, POLLIN, 0};
+    while (!exporter.stop)
+    {
+        int r = poll(&pfd, 1, HTTP_POLL_MS);
+        if (r <= 0)
+            continue;
+        int fd = accept(exporter.sock, NULL, NULL);
+        if (fd < 0)
+            continue;
+        serve_one(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+int metrics_server_start(uint16_t port, const struct tftp_metrics *m, uint32_t n)
+{
+    exporter.buf = malloc(RENDER_SIZE);
+    if (!exporter.buf)
+        return -1;
+    exporter.m = m;
+    exporter.n = n;
+    exporter.stop = 0;
+
+    exporter.sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (exporter.sock < 0)
+    {
+        perror("socket metrics");
+        goto fail;
+    }
+    int one = 1;
+    setsockopt(exporter.sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    // localhost uniquement : pas d'authentification sur cette interface
+    struct sockaddr_in a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    a.sin_port = htons(port);
+    if (bind(exporter.sock, (struct sockaddr *)&a, sizeof(a)) < 0 || listen(exporter.sock, 16) < 0)
+    {
+        perror("bind metrics");
+        goto fail;
+    }
+    if (pthread_create(&exporter.thread, NULL, exporter_loop, NULL) != 0)
+    {
+        fprintf(stderr, "Erreur: pthread_create (metrics)\n");
+        goto fail;
+    }
+    return 0;
+
+fail:
+    if (exporter.sock >= 0)
+        close(exporter.sock);
+    exporter.sock = -1;
+    free(exporter.buf);
+    exporter.buf = NULL;
+    return -1;
+}
+
+void metrics_server_stop(void)
+{
+    if (exporter.sock < 0)
+        return;
+    exporter.stop = 1;
+    pthread_join(exporter.thread, NULL);
+    close(exporter.sock);
+    exporter.sock = -1;
+    free(exporter.buf);
+    exporter.buf = NULL;
+}
@@ -0,0 +1,191 @@
+#include "netascii.h"
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define NETASCII_X86 1
+#endif
+
+enum
+{
+    IMPL_UNSET,
+    IMPL_SCALAR,
+    IMPL_SSE2,
+    IMPL_AVX2,
+};
+
+static const char *const impl_names[] = {"", "scalar", "sse2", "avx2"};
+static int impl; // IMPL_* ; choisi au premier appel (atomique : workers du serveur)
+
+/* ---------------- Copie jusqu'au prochain CR / LF ---------------- */
+
+// copie src vers dst jusqu'au premier CR (ou LF si lf), au plus len octets ;
+// retourne la longueur copiée. Les versions vectorielles écrivent le bloc de
+// 16 / 32 octets entier avant de tester le masque : dst peut recevoir des
+// octets au-delà du retour, jamais au-delà de len.
+static size_t copy_scalar(uint8_t *dst, const uint8_t *src, size_t len, int lf)
+{
+    size_t i = 0;
+    for (; i < len && src[i] != '\r' && !(lf && src[i] == '\n'); i++)
+        dst[i] = src[i];
+    return i;
+}
+
+#ifdef NETASCII_X86
+static size_t copy_sse2(uint8_t *dst, const uint8_t *src, size_t len, int lf)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i nl = _mm_set1_epi8(lf ? '\n' : '\r');
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+        int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, nl)));
+        if (m)
+            return i + (size_t)__builtin_ctz((unsigned)m);
+    }
+    return i + copy_scalar(dst + i, src + i, len - i, lf);
+}
+
+__attribute__((target("avx2"))) static size_t copy_avx2(uint8_t *dst, const uint8_t *src, size_t len, int lf)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i nl = _mm256_set1_epi8(lf ? '\n' : '\r');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+        unsigned m = (unsigned)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, nl)));
+        if (m)
+            return i + (size_t)__builtin_ctz(m);
+    }
+    return i + copy_sse2(dst + i, src + i, len - i, lf);
+}
+#endif
+
+static int impl_get(void)
+{
+    int i = __atomic_load_n(&impl, __ATOMIC_RELAXED);
+    if (i != IMPL_UNSET)
+        return i;
+#ifdef NETASCII_X86
+    i = __builtin_cpu_supports("avx2") ? IMPL_AVX2 : IMPL_SSE2;
+#else
+    i = IMPL_SCALAR;
+#endif
+    __atomic_store_n(&impl, i, __ATOMIC_RELAXED);
+    return i;
+}
+
+static size_t copy_run(uint8_t *dst, const uint8_t *src, size_t len, int lf)
+{
+    switch (impl_get())
+    {
+#ifdef NETASCII_X86
+    case IMPL_AVX2:
+        return copy_avx2(dst, src, len, lf);
+    case IMPL_SSE2:
+        return copy_sse2(dst, src, len, lf);
+#endif
+    default:
+        return copy_scalar(dst, src, len, lf);
+    }
+}
+
+const char *netascii_impl(void)
+{
+    return impl_names[impl_get()];
+}
+
+int netascii_set_impl(const char *name)
+{
+    for (int i = IMPL_SCALAR; i <= IMPL_AVX2; i++)
+    {
+        if (strcmp(name, impl_names[i]) != 0)
+            continue;
+#ifdef NETASCII_X86
+        if (i == IMPL_AVX2 && !__builtin_cpu_supports("avx2"))
+            return -1;
+#else
+        if (i != IMPL_SCALAR)
+            return -1;
+#endif
+        __atomic_store_n(&impl, i, __ATOMIC_RELAXED);
+        return 0;
+    }
+    return -1;
+}
+
+/* ---------------- Conversion ---------------- */
+
+size_t netascii_encode(const uint8_t *in, size_t inlen, size_t *used, uint8_t *out, size_t outlen,
+                       int *pend)
+{
+    size_t i = 0, o = 0;
+    if (*pend != NETASCII_NONE && outlen > 0)
+    {
+        out[o++] = (uint8_t)*pend;
+        *pend = NETASCII_NONE;
+    }
+    while (i < inlen && o < outlen)
+    {
+        size_t room = inlen - i < outlen - o ? inlen - i : outlen - o;
+        size_t run = copy_run(out + o, in + i, room, 1);
+        i += run;
+        o += run;
+        if (run == room)
+            break;
+        // LF -> CR LF, CR -> CR NUL ; second octet reporté si out est plein
+        uint8_t second = in[i++] == '\n' ? '\n' : '\0';
+        out[o++] = '\r';
+        if (o < outlen)
+            out[o++] = second;
+        else
+            *pend = second;
+    }
+    *used = i;
+    return o;
+}
+
+size_t netascii_decode(const uint8_t *in, size_t inlen, uint8_t *out, int *cr)
+{
+    size_t i = 0, o = 0;
+    if (*cr && inlen > 0)
+    {
+        *cr = 0;
+        if (in[0] == '\n' || in[0] == '\0')
+            i = 1;
+        out[o++] = in[0] == '\n' ? '\n' : '\r';
+    }
+    while (i < inlen)
+    {
+        size_t run = copy_run(out + o, in + i, inlen - i, 0);
+        i += run;
+        o += run;
+        if (i == inlen)
+            break;
+        if (++i == inlen)
+        {
+            *cr = 1; // paire coupée : résolue par le morceau suivant
+            break;
+        }
+        // CR LF -> LF, CR NUL -> CR ; CR suivi d'autre chose (non conforme) gardé
+        if (in[i] == '\n' || in[i] == '\0')
+            out[o++] = in[i++] == '\n' ? '\n' : '\r';
+        else
+            out[o++] = '\r';
+    }
+    return o;
+}
+
+size_t netascii_flush(uint8_t *out, int *cr)
+{
+    if (!*cr)
+        return 0;
+    *cr = 0;
+    out[0] = '\r';
+    return 1;
+}
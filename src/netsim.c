@@ -0,0 +1,436 @@
+#include "netsim.h"
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NETSIM_MAX_PENDING 4096
+
+// datagramme retenu (délai / réordonnancement)
+struct pending
+{
+    uint64_t due; // ns, CLOCK_MONOTONIC
+    uint64_t seq; // ordre d'émission à échéance égale
+    int sock;
+    socklen_t tolen;
+    struct sockaddr_storage to;
+    size_t len;
+    uint8_t *data;
+};
+
+struct netsim_state
+{
+    int seeded;
+    uint64_t rng;
+    uint64_t seq;
+    struct pending *heap; // tas binaire sur (due, seq)
+    size_t n;
+    uint64_t link_free; // ns, fin d'émission du dernier datagramme sur le goulot (rate)
+};
+
+static struct netsim_cfg g_cfg;
+static int g_enabled = 0;
+static pthread_once_t g_env_once = PTHREAD_ONCE_INIT;
+static uint64_t g_thread_counter = 0;
+static __thread struct netsim_state st;
+
+/* --------------- Aléatoire déterministe --------------- */
+
+static uint64_t splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void netsim_thread_seed(uint64_t salt)
+{
+    uint64_t x = g_cfg.seed ^ (salt * 0xd1342543de82ef95ULL);
+    st.rng = splitmix64(&x) | 1;
+    st.seeded = 1;
+}
+
+// xorshift64* -> double uniforme dans [0, 1)
+static double rnd(void)
+{
+    // le pid sépare client et serveur : avec le même flux, leurs pertes
+    // seraient corrélées (les retransmissions perdues en même temps)
+    if (!st.seeded)
+        netsim_thread_seed(((uint64_t)getpid() << 32) |
+                           __atomic_fetch_add(&g_thread_counter, 1, __ATOMIC_RELAXED));
+    st.rng ^= st.rng >> 12;
+    st.rng ^= st.rng << 25;
+    st.rng ^= st.rng >> 27;
+    return (double)((st.rng * 0x2545f4914f6cdd1dULL) >> 11) * 0x1.0p-53;
+}
+
+static uint64_t delay_ns(void)
+{
+    double us = g_cfg.delay_us;
+    if (g_cfg.jitter_us)
+    {
+        if (g_cfg.dist == NETSIM_DIST_NORMAL)
+        {
+            // Box-Muller
+            double u1 = rnd(), u2 = rnd();
+            if (u1 < 1e-12)
+                u1 = 1e-12;
+            us += g_cfg.jitter_us * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+        }
+        else
+            us += g_cfg.jitter_us * (2.0 * rnd() - 1.0);
+    }
+    return us > 0 ? (uint64_t)(us * 1000.0) : 0;
+}
+
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* --------------- Configuration --------------- */
+
+static int parse_duration_us(const char *v, uint32_t *out)
+{
+    char *end;
+    double x = strtod(v, &end);
+    if (end == v || x < 0)
+        return -1;
+    if (strcmp(end, "us") == 0)
+        ;
+    else if (*end == 0 || strcmp(end, "ms") == 0)
+        x *= 1000.0;
+    else if (strcmp(end, "s") == 0)
+        x *= 1000000.0;
+    else
+        return -1;
+    *out = (uint32_t)x;
+    return 0;
+}
+
+// suffixes k, m, g (puissances de 10)
+static int parse_count(const char *v, double *out)
+{
+    char *end;
+    double x = strtod(v, &end);
+    if (end == v || x < 0)
+        return -1;
+    if (*end == 'k')
+        x *= 1e3;
+    else if (*end == 'm')
+        x *= 1e6;
+    else if (*end == 'g')
+        x *= 1e9;
+    else if (*end)
+        return -1;
+    if (*end && end[1])
+        return -1;
+    *out = x;
+    return 0;
+}
+
+static int parse_prob(const char *v, double *out)
+{
+    char *end;
+    double x = strtod(v, &end);
+    if (end == v || *end != 0 || x < 0 || x > 1)
+        return -1;
+    *out = x;
+    return 0;
+}
+
+int netsim_parse(const char *spec, struct netsim_cfg *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->reorder_delay_us = 1000;
+    cfg->seed = 1;
+
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    char *save = NULL;
+    for (char *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+        char *eq = strchr(tok, '=');
+        if (!eq)
+            return -1;
+        *eq = 0;
+        const char *k = tok, *v = eq + 1;
+        int r;
+        if (strcmp(k, "loss") == 0)
+            r = parse_prob(v, &cfg->loss);
+        else if (strcmp(k, "rxloss") == 0)
+            r = parse_prob(v, &cfg->rxloss);
+        else if (strcmp(k, "dup") == 0)
+            r = parse_prob(v, &cfg->dup);
+        else if (strcmp(k, "reorder") == 0)
+            r = parse_prob(v, &cfg->reorder);
+        else if (strcmp(k, "delay") == 0)
+            r = parse_duration_us(v, &cfg->delay_us);
+        else if (strcmp(k, "jitter") == 0)
+            r = parse_duration_us(v, &cfg->jitter_us);
+        else if (strcmp(k, "reorder_delay") == 0)
+            r = parse_duration_us(v, &cfg->reorder_delay_us);
+        else if (strcmp(k, "rate") == 0 || strcmp(k, "queue") == 0)
+        {
+            double x;
+            r = parse_count(v, &x);
+            if (r == 0 && k[0] == 'r')
+                cfg->rate = (uint64_t)(x / 8); // bits/s -> octets/s
+            else if (r == 0)
+                cfg->queue = (uint64_t)x;
+        }
+        else if (strcmp(k, "dist") == 0)
+        {
+            r = 0;
+            if (strcmp(v, "uniform") == 0)
+                cfg->dist = NETSIM_DIST_UNIFORM;
+            else if (strcmp(v, "normal") == 0)
+                cfg->dist = NETSIM_DIST_NORMAL;
+            else
+                r = -1;
+        }
+        else if (strcmp(k, "seed") == 0)
+        {
+            cfg->seed = strtoull(v, NULL, 10);
+            r = 0;
+        }
+        else
+            r = -1;
+        if (r < 0)
+        {
+            fprintf(stderr, "netsim: paramètre invalide '%s=%s'\n", k, v);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int netsim_configure(const char *spec)
+{
+    struct netsim_cfg cfg;
+    if (netsim_parse(spec, &cfg) < 0)
+        return -1;
+    g_cfg = cfg;
+    g_enabled = 1;
+    return 0;
+}
+
+static void load_env(void)
+{
+    const char *spec = getenv("TFTP_NETSIM");
+    if (spec && *spec && !g_enabled && netsim_configure(spec) < 0)
+        fprintf(stderr, "netsim: TFTP_NETSIM ignorée\n");
+}
+
+static int enabled(void)
+{
+    pthread_once(&g_env_once, load_env);
+    return g_enabled;
+}
+
+/* --------------- File des datagrammes retenus --------------- */
+
+static int before(const struct pending *a, const struct pending *b)
+{
+    return a->due < b->due || (a->due == b->due && a->seq < b->seq);
+}
+
+static void heap_up(size_t i)
+{
+    while (i > 0)
+    {
+        size_t p = (i - 1) / 2;
+        if (!before(&st.heap[i], &st.heap[p]))
+            break;
+        struct pending t = st.heap[i];
+        st.heap[i] = st.heap[p];
+        st.heap[p] = t;
+        i = p;
+    }
+}
+
+static void heap_down(size_t i)
+{
+    for (;;)
+    {
+        size_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < st.n && before(&st.heap[l], &st.heap[m]))
+            m = l;
+        if (r < st.n && before(&st.heap[r], &st.heap[m]))
+            m = r;
+        if (m == i)
+            break;
+        struct pending t = st.heap[i];
+        st.heap[i] = st.heap[m];
+        st.heap[m] = t;
+        i = m;
+    }
+}
+
+static int hold(int sock, const void *buf, size_t len, const struct sockaddr *to,
+                socklen_t tolen, uint64_t due)
+{
+    if (!st.heap)
+    {
+        st.heap = calloc(NETSIM_MAX_PENDING, sizeof(struct pending));
+        if (!st.heap)
+            return -1;
+    }
+    if (st.n >= NETSIM_MAX_PENDING || tolen > sizeof(struct sockaddr_storage))
+        return -1;
+
+    struct pending *p = &st.heap[st.n];
+    p->data = malloc(len ? len : 1);
+    if (!p->data)
+        return -1;
+    memcpy(p->data, buf, len);
+    p->len = len;
+    p->sock = sock;
+    p->tolen = tolen;
+    memcpy(&p->to, to, tolen);
+    p->due = due;
+    p->seq = st.seq++;
+    st.n++;
+    heap_up(st.n - 1);
+    return 0;
+}
+
+static void release_top(void)
+{
+    struct pending p = st.heap[0];
+    st.heap[0] = st.heap[--st.n];
+    heap_down(0);
+    sendto(p.sock, p.data, p.len, 0, (struct sockaddr *)&p.to, p.tolen);
+    free(p.data);
+}
+
+int net_flush(void)
+{
+    if (st.n == 0)
+        return -1;
+    uint64_t now = mono_ns();
+    while (st.n > 0 && st.heap[0].due <= now)
+        release_top();
+    if (st.n == 0)
+        return -1;
+    return (int)((st.heap[0].due - now + 999999) / 1000000);
+}
+
+int net_close(int sock)
+{
+    if (st.n > 0)
+    {
+        // émission anticipée des datagrammes de cette socket, puis re-tas
+        size_t k = 0;
+        for (size_t i = 0; i < st.n; i++)
+        {
+            struct pending *p = &st.heap[i];
+            if (p->sock == sock)
+            {
+                sendto(p->sock, p->data, p->len, 0, (struct sockaddr *)&p->to, p->tolen);
+                free(p->data);
+            }
+            else
+                st.heap[k++] = *p;
+        }
+        st.n = k;
+        for (size_t i = st.n / 2; i-- > 0;)
+            heap_down(i);
+    }
+    return close(sock);
+}
+
+/* --------------- Envoi / réception --------------- */
+
+// goulot : le datagramme entre dans la file à at et part quand le lien a
+// fini les précédents ; heure de sortie du lien, 0 s'il est jeté (file pleine)
+static uint64_t link_enqueue(size_t len, uint64_t at)
+{
+    if (st.link_free > at && g_cfg.queue &&
+        (st.link_free - at) * g_cfg.rate / 1000000000ULL + len > g_cfg.queue)
+        return 0;
+    st.link_free = (st.link_free > at ? st.link_free : at) + (uint64_t)len * 1000000000ULL / g_cfg.rate;
+    return st.link_free;
+}
+
+// at : heure d'émission demandée (SO_TXTIME), 0 = maintenant
+static ssize_t sim_send(int sock, const void *buf, size_t len, int flags,
+                        const struct sockaddr *to, socklen_t tolen, uint64_t at)
+{
+    if (g_cfg.loss > 0 && rnd() < g_cfg.loss)
+        return (ssize_t)len; // perdu "sur le fil" : l'émetteur n'en sait rien
+
+    int copies = (g_cfg.dup > 0 && rnd() < g_cfg.dup) ? 2 : 1;
+    for (int c = 0; c < copies; c++)
+    {
+        uint64_t now = mono_ns(), sent = at > now ? at : now;
+        if (g_cfg.rate && (sent = link_enqueue(len, sent)) == 0)
+            continue; // débordement de la file du goulot
+        uint64_t d = delay_ns() + (sent - now);
+        if (g_cfg.reorder > 0 && rnd() < g_cfg.reorder)
+            d += (uint64_t)g_cfg.reorder_delay_us * 1000ULL;
+
+        if (d == 0 || hold(sock, buf, len, to, tolen, now + d) < 0)
+        {
+            ssize_t r = sendto(sock, buf, len, flags, to, tolen);
+            if (r < 0)
+                return r;
+        }
+    }
+    net_flush();
+    return (ssize_t)len;
+}
+
+ssize_t net_sendto(int sock, const void *buf, size_t len, int flags,
+                   const struct sockaddr *to, socklen_t tolen)
+{
+    if (!enabled())
+        return sendto(sock, buf, len, flags, to, tolen);
+    return sim_send(sock, buf, len, flags, to, tolen, 0);
+}
+
+ssize_t net_sendmsg(int sock, const struct msghdr *msg, int flags)
+{
+    // rien à simuler à l'émission : envoi direct, données annexes comprises
+    if (!enabled() || (g_cfg.loss <= 0 && g_cfg.dup <= 0 && g_cfg.reorder <= 0 && !g_cfg.delay_us &&
+                       !g_cfg.jitter_us && !g_cfg.rate))
+        return sendmsg(sock, msg, flags);
+    uint64_t at = 0;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR((struct msghdr *)msg, cm))
+    {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TXTIME)
+            memcpy(&at, CMSG_DATA(cm), sizeof(at));
+    }
+    return sim_send(sock, msg->msg_iov[0].iov_base, msg->msg_iov[0].iov_len, flags,
+                    (const struct sockaddr *)msg->msg_name, msg->msg_namelen, at);
+}
+
+ssize_t net_recvfrom(int sock, void *buf, size_t len, int flags,
+                     struct sockaddr *from, socklen_t *fromlen)
+{
+    ssize_t n = recvfrom(sock, buf, len, flags, from, fromlen);
+    if (n >= 0 && enabled() && g_cfg.rxloss > 0 && rnd() < g_cfg.rxloss)
+    {
+        errno = EAGAIN; // jeté à la réception : comme si rien n'était arrivé
+        return -1;
+    }
+    return n;
+}
+
+ssize_t net_recvmsg(int sock, struct msghdr *msg, int flags)
+{
+    ssize_t n = recvmsg(sock, msg, flags);
+    if (n >= 0 && enabled() && g_cfg.rxloss > 0 && rnd() < g_cfg.rxloss)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    return n;
+}
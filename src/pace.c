@@ -0,0 +1,177 @@
+#include "pace.h"
+#include "netsim.h"
+#include <arpa/inet.h>
+#include <linux/net_tstamp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// en-têtes de la libc antérieurs à SO_TXTIME
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#endif
+#ifndef SCM_TXTIME
+#define SCM_TXTIME SO_TXTIME
+#endif
+
+int pace_parse_rate(const char *s, uint64_t *rate)
+{
+    char *end;
+    double bits = strtod(s, &end);
+    if (end == s || bits <= 0)
+        return -1;
+    if (*end == 'k' || *end == 'K')
+        bits *= 1e3;
+    else if (*end == 'm' || *end == 'M')
+        bits *= 1e6;
+    else if (*end == 'g' || *end == 'G')
+        bits *= 1e9;
+    else if (*end)
+        return -1;
+    if (*end && end[1])
+        return -1;
+    if (bits < 8)
+        return -1;
+    *rate = (uint64_t)(bits / 8);
+    return 0;
+}
+
+uint64_t pace_gap(uint64_t rate, size_t len)
+{
+    if (rate == 0)
+        return 0;
+    return ((uint64_t)len + PACE_HEADER) * 1000000000ULL / rate;
+}
+
+int pace_take(uint64_t *next, uint64_t rate, size_t len, int txtime, uint64_t now, uint64_t *at)
+{
+    uint64_t gap = pace_gap(rate, len);
+    // réveil en retard d'au plus PACE_BURST créneaux : rattrapé ; au-delà
+    // (attente d'un ACK, transfert au repos) : pas de crédit, sinon chaque
+    // fenêtre repartirait en rafale
+    if (*next + PACE_BURST * gap < now)
+        *next = now;
+    uint64_t ahead = txtime ? PACE_TXTIME_AHEAD * gap : 0;
+    if (*next > now + ahead)
+    {
+        *at = *next - ahead;
+        return 0;
+    }
+    *at = *next > now ? *next : now;
+    *next += gap;
+    return 1;
+}
+
+int pace_txtime_available(void)
+{
+    FILE *f = fopen("/proc/sys/net/core/default_qdisc", "r");
+    if (!f)
+        return 0;
+    char q[32] = "";
+    int ok = fgets(q, sizeof(q), f) && strcmp(q, "fq\n") == 0;
+    fclose(f);
+    return ok;
+}
+
+int pace_txtime_enable(int sock)
+{
+    struct sock_txtime cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.clockid = CLOCK_MONOTONIC; // horloge de fq
+    return setsockopt(sock, SOL_SOCKET, SO_TXTIME, &cfg, sizeof(cfg));
+}
+
+int pace_loopback(uint32_t addr)
+{
+    return (ntohl(addr) >> 24) == 127;
+}
+
+ssize_t pace_sendto(int sock, const void *buf, size_t len, const struct sockaddr_in *to, uint64_t at)
+{
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(uint64_t))];
+        struct cmsghdr align;
+    } ctl;
+    memset(&ctl, 0, sizeof(ctl));
+    struct iovec iov = {.iov_base = (void *)buf, .iov_len = len};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void *)to;
+    msg.msg_namelen = sizeof(*to);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_TXTIME;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+    memcpy(CMSG_DATA(cm), &at, sizeof(at));
+    return net_sendmsg(sock, &msg, 0);
+}
+
+/* ---------------- File des réveils ---------------- */
+
+static void swap(struct pace_wait *a, struct pace_wait *b)
+{
+    struct pace_wait t = *a;
+    *a = *b;
+    *b = t;
+}
+
+int pace_queue_push(struct pace_queue *q, uint64_t due, uint64_t tag)
+{
+    if (q->n == q->cap)
+    {
+        uint32_t cap = q->cap ? q->cap * 2 : 64;
+        struct pace_wait *e = realloc(q->e, cap * sizeof(*e));
+        if (!e)
+            return -1;
+        q->e = e;
+        q->cap = cap;
+    }
+    uint32_t i = q->n++;
+    q->e[i].due = due;
+    q->e[i].tag = tag;
+    while (i > 0 && q->e[(i - 1) / 2].due > q->e[i].due)
+    {
+        swap(&q->e[i], &q->e[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    return 0;
+}
+
+uint64_t pace_queue_next(const struct pace_queue *q)
+{
+    return q->n ? q->e[0].due : UINT64_MAX;
+}
+
+int pace_queue_pop(struct pace_queue *q, uint64_t now, uint64_t *due, uint64_t *tag)
+{
+    if (q->n == 0 || q->e[0].due > now)
+        return 0;
+    *due = q->e[0].due;
+    *tag = q->e[0].tag;
+    q->e[0] = q->e[--q->n];
+    for (uint32_t i = 0;;)
+    {
+        uint32_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < q->n && q->e[l].due < q->e[m].due)
+            m = l;
+        if (r < q->n && q->e[r].due < q->e[m].due)
+            m = r;
+        if (m == i)
+            break;
+        swap(&q->e[i], &q->e[m]);
+        i = m;
+    }
+    return 1;
+}
+
+void pace_queue_free(struct pace_queue *q)
+{
+    free(q->e);
+    memset(q, 0, sizeof(*q));
+}
@@ -0,0 +1,394 @@
+#include "preload.h"
+#include "sockets.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+struct tftp_preload
+{
+    char **names;
+    uint32_t nnames;
+    const char *root_dir;
+    struct tftp_memstore *objects;
+    struct tftp_dedup *dedup;
+    int lock;
+    pthread_t *threads;
+    unsigned nthreads;
+    uint32_t next;    // atomique : prochain nom à charger
+    uint32_t running; // atomique : threads en cours (+ 1 pendant le lancement)
+    int cancel;       // atomique
+    int lock_warned;  // atomique : un seul message si mlock refuse
+    uint64_t start;
+    struct tftp_preload_stats st; // compteurs atomiques
+};
+
+/* ---------------- Manifeste ---------------- */
+
+static int add_name(struct tftp_preload *p, const char *name, uint32_t *cap)
+{
+    if (p->nnames == *cap)
+    {
+        uint32_t ncap = *cap ? *cap * 2 : 64;
+        char **n = realloc(p->names, ncap * sizeof(*n));
+        if (!n)
+            return -1;
+        p->names = n;
+        *cap = ncap;
+    }
+    if ((p->names[p->nnames] = strdup(name)) == NULL)
+        return -1;
+    p->nnames++;
+    return 0;
+}
+
+static int read_manifest(struct tftp_preload *p, const char *manifest)
+{
+    FILE *f = fopen(manifest, "r");
+    if (!f)
+    {
+        perror(manifest);
+        return -1;
+    }
+    char *line = NULL;
+    size_t sz = 0;
+    ssize_t n;
+    uint32_t cap = 0;
+    int ret = 0;
+    while (ret == 0 && (n = getline(&line, &sz, f)) >= 0)
+    {
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r'))
+            line[--n] = 0;
+        if (n == 0 || line[0] == '#')
+            continue;
+        if (add_name(p, line, &cap) < 0)
+        {
+            perror("preload");
+            ret = -1;
+        }
+    }
+    free(line);
+    fclose(f);
+    return ret;
+}
+
+/* ---------------- Chargement ---------------- */
+
+static int read_full(int fd, uint8_t *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t r = pread(fd, buf + got, len - got, (off_t)got);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        got += (size_t)r;
+    }
+    return 0;
+}
+
+// un fichier publié sous name ; -1 s'il n'a pu être chargé
+static int load_one(struct tftp_preload *p, const char *name)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", p->root_dir, name);
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    struct dedup_reader *rd = NULL;
+    uint64_t size = (uint64_t)st.st_size;
+    if (p->dedup)
+    {
+        int r = dedup_open(p->dedup, fd, &rd);
+        if (r < 0)
+        {
+            close(fd);
+            return -1;
+        }
+        if (r)
+            size = dedup_size(rd);
+    }
+
+    // par pages entières : le verrou d'un objet ne touche pas ses voisins
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t cap = ((size_t)size + page) & ~(page - 1);
+    void *mem = NULL;
+    int ok = posix_memalign(&mem, page, cap) == 0;
+    if (ok && rd)
+        ok = dedup_pread(rd, mem, (size_t)size, 0) == (ssize_t)size;
+    else if (ok)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        ok = read_full(fd, mem, (size_t)size) == 0;
+    }
+    dedup_close(rd);
+    close(fd);
+    struct tftp_memobj *o = ok ? memobj_adopt(name, mem, (size_t)size) : NULL;
+    if (!o)
+    {
+        free(mem);
+        return -1;
+    }
+
+    o->src_dev = (uint64_t)st.st_dev;
+    o->src_ino = (uint64_t)st.st_ino;
+    o->src_mtime = (uint64_t)st.st_mtim.tv_sec * 1000000000ull + (uint64_t)st.st_mtim.tv_nsec;
+    if (p->lock && size)
+    {
+        if (mlock(o->data, o->len) == 0)
+        {
+            o->locked = 1;
+            __atomic_add_fetch(&p->st.locked, size, __ATOMIC_RELAXED);
+        }
+        else if (!__atomic_exchange_n(&p->lock_warned, 1, __ATOMIC_RELAXED))
+            fprintf(stderr, "preload: mlock: %s, suite chargée sans verrou\n", strerror(errno));
+    }
+    memstore_publish(p->objects, o);
+    __atomic_add_fetch(&p->st.bytes, size, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static void load_all(struct tftp_preload *p)
+{
+    while (!__atomic_load_n(&p->cancel, __ATOMIC_RELAXED))
+    {
+        uint32_t i = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED);
+        if (i >= p->nnames)
+            break;
+        if (load_one(p, p->names[i]) == 0)
+            __atomic_add_fetch(&p->st.files, 1, __ATOMIC_RELAXED);
+        else
+            __atomic_add_fetch(&p->st.failed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// le dernier thread qui part écrit le bilan
+static void leave(struct tftp_preload *p)
+{
+    uint64_t ns = now_ns() - p->start;
+    if (__atomic_sub_fetch(&p->running, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+    p->st.ns = ns;
+    printf("preload: %u files, %llu bytes (%llu locked), %u failed in %.1f ms%s\n", p->st.files,
+           (unsigned long long)p->st.bytes, (unsigned long long)p->st.locked, p->st.failed, ns / 1e6,
+           __atomic_load_n(&p->cancel, __ATOMIC_RELAXED) ? " (interrupted)" : "");
+    fflush(stdout);
+}
+
+static void *loader(void *arg)
+{
+    struct tftp_preload *p = arg;
+    load_all(p);
+    leave(p);
+    return NULL;
+}
+
+struct tftp_preload *preload_start(const char *manifest, const char *root_dir, struct tftp_memstore *objects,
+                                   struct tftp_dedup *dedup, unsigned threads, int lock)
+{
+    struct tftp_preload *p = calloc(1, sizeof(*p));
+    if (!p)
+    {
+        perror("preload");
+        return NULL;
+    }
+    p->root_dir = root_dir;
+    p->objects = objects;
+    p->dedup = dedup;
+    p->lock = lock;
+    p->start = now_ns();
+    if (read_manifest(p, manifest) < 0)
+    {
+        preload_finish(p, 1, NULL);
+        return NULL;
+    }
+
+    if (threads == 0)
+        threads = PRELOAD_DEFAULT_THREADS;
+    if (threads > p->nnames)
+        threads = p->nnames;
+    p->threads = threads ? calloc(threads, sizeof(pthread_t)) : NULL;
+    p->running = 1; // jeton du lancement : pas de bilan avant la fin de la boucle
+    for (unsigned i = 0; p->threads && i < threads; i++)
+    {
+        __atomic_add_fetch(&p->running, 1, __ATOMIC_RELAXED);
+        if (pthread_create(&p->threads[i], NULL, loader, p) != 0)
+        {
+            __atomic_sub_fetch(&p->running, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        p->nthreads++;
+    }
+    if (p->nthreads == 0)
+        load_all(p); // aucun thread : chargement dans l'appelant
+    leave(p);
+    return p;
+}
+
+int preload_done(struct tftp_preload *p)
+{
+    return __atomic_load_n(&p->running, __ATOMIC_ACQUIRE) == 0;
+}
+
+void preload_finish(struct tftp_preload *p, int cancel, struct tftp_preload_stats *st)
+{
+    if (cancel)
+        __atomic_store_n(&p->cancel, 1, __ATOMIC_RELAXED);
+    for (unsigned i = 0; i < p->nthreads; i++)
+        pthread_join(p->threads[i], NULL);
+    if (st)
+        *st = p->st;
+    for (uint32_t i = 0; i < p->nnames; i++)
+        free(p->names[i]);
+    free(p->names);
+    free(p->threads);
+    free(p);
+}
+
+int preload_fresh(const struct tftp_memobj *o, const struct stat *st)
+{
+    uint64_t mtime = (uint64_t)st->st_mtim.tv_sec * 1000000000ull + (uint64_t)st->st_mtim.tv_nsec;
+    return o->src_dev == (uint64_t)st->st_dev && o->src_ino == (uint64_t)st->st_ino && o->src_mtime == mtime;
+}
+
+/* ---------------- Noms les plus demandés ---------------- */
+
+static uint32_t name_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+    for (; *name; name++)
+    {
+        h ^= (uint8_t)*name;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static struct preload_hot_entry *slot(const struct preload_hot *h, const char *name)
+{
+    uint32_t i = name_hash(name) & h->mask;
+    while (h->e[i].name && strcmp(h->e[i].name, name) != 0)
+        i = (i + 1) & h->mask;
+    return &h->e[i];
+}
+
+static int grow(struct preload_hot *h)
+{
+    uint32_t nb = h->e ? (h->mask + 1) * 2 : 64;
+    struct preload_hot_entry *ne = calloc(nb, sizeof(*ne));
+    if (!ne)
+        return -1;
+    struct preload_hot old = *h;
+    h->e = ne;
+    h->mask = nb - 1;
+    for (uint32_t i = 0; old.e && i <= old.mask; i++)
+    {
+        if (old.e[i].name)
+            *slot(h, old.e[i].name) = old.e[i];
+    }
+    free(old.e);
+    return 0;
+}
+
+void preload_hot_add(struct preload_hot *h, const char *name, uint64_t n)
+{
+    if (!h->e && grow(h) < 0)
+        return;
+    struct preload_hot_entry *e = slot(h, name);
+    if (e->name)
+    {
+        e->count += n;
+        return;
+    }
+    if (h->count >= PRELOAD_HOT_NAMES)
+        return;
+    // charge au plus 1/2 : sondages courts
+    if ((h->count + 1) * 2 > h->mask + 1)
+    {
+        if (grow(h) < 0 && h->count + 1 > h->mask)
+            return;
+        e = slot(h, name);
+    }
+    if ((e->name = strdup(name)) == NULL)
+        return;
+    e->count = n;
+    h->count++;
+}
+
+void preload_hot_free(struct preload_hot *h)
+{
+    for (uint32_t i = 0; h->e && i <= h->mask; i++)
+        free(h->e[i].name);
+    free(h->e);
+    memset(h, 0, sizeof(*h));
+}
+
+static int by_count(const void *a, const void *b)
+{
+    const struct preload_hot_entry *x = *(struct preload_hot_entry *const *)a;
+    const struct preload_hot_entry *y = *(struct preload_hot_entry *const *)b;
+    if (x->count != y->count)
+        return x->count > y->count ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+void preload_hot_merge(struct preload_hot *dst, const struct preload_hot *src)
+{
+    for (uint32_t i = 0; src->e && i <= src->mask; i++)
+    {
+        if (src->e[i].name)
+            preload_hot_add(dst, src->e[i].name, src->e[i].count);
+    }
+}
+
+int preload_hot_write(const char *path, const struct preload_hot *h, uint32_t max)
+{
+    struct preload_hot_entry **order = malloc((h->count ? h->count : 1) * sizeof(*order));
+    if (!order)
+    {
+        perror("preload");
+        return -1;
+    }
+    uint32_t cnt = 0;
+    for (uint32_t i = 0; h->e && i <= h->mask; i++)
+    {
+        // une ligne par nom : ceux que le manifeste ne peut pas relire sont omis
+        const char *name = h->e[i].name;
+        if (name && name[0] != '#' && !strpbrk(name, "\r\n"))
+            order[cnt++] = &h->e[i];
+    }
+    qsort(order, cnt, sizeof(*order), by_count);
+    if (cnt > max)
+        cnt = max;
+
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    int ret = -1;
+    if (f)
+    {
+        fprintf(f, "# noms les plus demandés (tftp_server -H), du plus au moins demandé\n");
+        for (uint32_t i = 0; i < cnt; i++)
+            fprintf(f, "%s\n", order[i]->name);
+        if (fclose(f) == 0 && rename(tmp, path) == 0)
+            ret = (int)cnt;
+        else
+            unlink(tmp);
+    }
+    if (ret < 0)
+        perror(path);
+    free(order);
+    return ret;
+}
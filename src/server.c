@@ -1,343 +1,3084 @@
-// =============================== server.c ===============================
-// Serveur TFTP simple (Partie 2)
-// - écoute UDP sur port 69 (ou autre)
-// - reçoit RRQ/WRQ
-// - crée un socket "session" (TID) sur port éphémère
-// - RRQ: envoie DATA(k) et attend ACK(k) (timeout => retransmission)
-// - WRQ: envoie ACK(0), reçoit DATA(k), renvoie ACK(k) (timeout => retransmission)
-//
-// Important : pas d'options, pas de multi-clients, pas de threads.
-
-#include "server.h"
-#include "sockets.h"
-#include "tftp_utils.h"
-#include <stdio.h>
-/* ---------------------------- RRQ session ---------------------------- */
-static int handle_rrq(int sess_sock, const struct sockaddr_in *client,
-                      const char *root_dir, const char *filename)
-{
-    char path[1024];
-    snprintf(path, sizeof(path), "%s/%s", root_dir, filename);
-
-    FILE *in = fopen(path, "rb");
-    if (!in)
-    {
-        uint8_t e[256];
-        int el = build_error(e, sizeof(e), 1, "File not found");
-        sendto(sess_sock, e, el, 0, (struct sockaddr *)client, sizeof(*client));
-        return -1;
-    }
-
-    uint8_t rx[4 + DATA_SIZE + 64];
-    uint8_t last_sent[4 + DATA_SIZE];
-    size_t last_len = 0;
-
-    uint16_t block = 1;
-
-    for (;;)
-    {
-        uint8_t data[DATA_SIZE];
-        size_t r = fread(data, 1, DATA_SIZE, in);
-        if (ferror(in))
-        {
-            perror("fread");
-            fclose(in);
-            return -1;
-        }
-
-        int dl = build_data(last_sent, sizeof(last_sent), block, data, r);
-        if (dl < 0)
-        {
-            fclose(in);
-            return -1;
-        }
-
-        sendto(sess_sock, last_sent, dl, 0, (struct sockaddr *)client, sizeof(*client));
-        last_len = (size_t)dl;
-
-        int retries = 0;
-        for (;;)
-        {
-            struct sockaddr_in src;
-            ssize_t n = recvfrom_timeout(sess_sock, rx, sizeof(rx), &src, TIMEOUT_MS);
-            if (n < 0)
-            {
-                perror("recvfrom");
-                fclose(in);
-                return -1;
-            }
-
-            if (n == 0)
-            {
-                if (++retries > MAX_RETRIES)
-                {
-                    fprintf(stderr, "RRQ: timeout waiting ACK(%u)\n", block);
-                    fclose(in);
-                    return -1;
-                }
-                // retransmission du dernier DATA(block)
-                sendto(sess_sock, last_sent, last_len, 0, (struct sockaddr *)client, sizeof(*client));
-                continue;
-            }
-
-            // TID check: on n'accepte que l'IP:port du client qui a initié
-            if (!addr_equal(&src, client))
-                continue;
-
-            uint16_t op;
-            if (parse_opcode(rx, (size_t)n, &op) < 0)
-                continue;
-            if (op != OPCODE_ACK)
-                continue;
-
-            uint16_t ackb;
-            if (parse_block(rx, (size_t)n, &ackb) < 0)
-                continue;
-
-            if (ackb == block)
-                break;
-        }
-
-        if (r < DATA_SIZE)
-            break; // dernier bloc
-        block++;
-    }
-
-    fclose(in);
-    return 0;
-}
-
-/* ---------------------------- WRQ session ---------------------------- */
-static int handle_wrq(int sess_sock, const struct sockaddr_in *client,
-                      const char *root_dir, const char *filename)
-{
-    char path[1024];
-    snprintf(path, sizeof(path), "%s/%s", root_dir, filename);
-
-    FILE *out = fopen(path, "wb");
-    if (!out)
-    {
-        uint8_t e[256];
-        int el = build_error(e, sizeof(e), 2, "Access violation");
-        sendto(sess_sock, e, el, 0, (struct sockaddr *)client, sizeof(*client));
-        return -1;
-    }
-
-    uint8_t rx[4 + DATA_SIZE + 64];
-    uint8_t last_sent[64];
-    size_t last_len = 0;
-
-    // ACK(0) = "ok, commence à DATA(1)"
-    int al = build_ack(last_sent, sizeof(last_sent), 0);
-    if (al < 0)
-    {
-        fclose(out);
-        return -1;
-    }
-    sendto(sess_sock, last_sent, al, 0, (struct sockaddr *)client, sizeof(*client));
-    last_len = (size_t)al;
-
-    uint16_t expected = 1;
-    int retries = 0;
-
-    for (;;)
-    {
-        struct sockaddr_in src;
-        ssize_t n = recvfrom_timeout(sess_sock, rx, sizeof(rx), &src, TIMEOUT_MS);
-        if (n < 0)
-        {
-            perror("recvfrom");
-            fclose(out);
-            return -1;
-        }
-
-        if (n == 0)
-        {
-            if (++retries > MAX_RETRIES)
-            {
-                fprintf(stderr, "WRQ: timeout waiting DATA(%u)\n", expected);
-                fclose(out);
-                return -1;
-            }
-            // retransmission du dernier ACK (ACK0 ou ACK(expected-1))
-            sendto(sess_sock, last_sent, last_len, 0, (struct sockaddr *)client, sizeof(*client));
-            continue;
-        }
-
-        if (!addr_equal(&src, client))
-            continue;
-
-        uint16_t op;
-        if (parse_opcode(rx, (size_t)n, &op) < 0)
-            continue;
-        if (op != OPCODE_DATA)
-            continue;
-
-        uint16_t block;
-        if (parse_block(rx, (size_t)n, &block) < 0)
-            continue;
-
-        size_t data_len = (size_t)n - 4;
-        const uint8_t *data = rx + 4;
-
-        if (block == expected)
-        {
-            if (fwrite(data, 1, data_len, out) != data_len)
-            {
-                perror("fwrite");
-                fclose(out);
-                return -1;
-            }
-
-            int ack_len = build_ack(last_sent, sizeof(last_sent), block);
-            sendto(sess_sock, last_sent, ack_len, 0, (struct sockaddr *)client, sizeof(*client));
-            last_len = (size_t)ack_len;
-
-            retries = 0;
-            expected++;
-
-            if (data_len < DATA_SIZE)
-                break; // dernier bloc
-        }
-        else if (block == (uint16_t)(expected - 1))
-        {
-            // doublon => re-ACK sans réécrire
-            int ack_len = build_ack(last_sent, sizeof(last_sent), block);
-            sendto(sess_sock, last_sent, ack_len, 0, (struct sockaddr *)client, sizeof(*client));
-            last_len = (size_t)ack_len;
-        }
-    }
-
-    fclose(out);
-    return 0;
-}
-
-/* ---------------------------- Public API ---------------------------- */
-int tftp_server_run(uint16_t server_port, const char *root_dir)
-{
-    int sock69 = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock69 < 0)
-    {
-        perror("socket");
-        return -1;
-    }
-
-    struct sockaddr_in a;
-    memset(&a, 0, sizeof(a));
-    a.sin_family = AF_INET;
-    a.sin_addr.s_addr = htonl(INADDR_ANY);
-    a.sin_port = htons(server_port);
-
-    if (bind(sock69, (struct sockaddr *)&a, sizeof(a)) < 0)
-    {
-        perror("bind");
-        close(sock69);
-        return -1;
-    }
-
-    printf("TFTP server simple listening on UDP %u, root_dir=%s\n",
-           (unsigned)server_port, root_dir);
-
-    for (;;)
-    {
-        // 1) recevoir une requête RRQ/WRQ sur port serveur (souvent 69)
-        uint8_t buf[1024];
-        struct sockaddr_in client;
-        socklen_t cl = sizeof(client);
-
-        ssize_t n = recvfrom(sock69, buf, sizeof(buf), 0, (struct sockaddr *)&client, &cl);
-        if (n < 0)
-        {
-            perror("recvfrom");
-            continue;
-        }
-
-        display_packet((char *)buf, n);
-
-        uint16_t op;
-        if (parse_opcode(buf, (size_t)n, &op) < 0)
-            continue;
-        if (op != OPCODE_RRQ && op != OPCODE_WRQ)
-            continue;
-
-        char filename[512], mode[64];
-        if (parse_rrq_wrq(buf, (size_t)n, filename, sizeof(filename), mode, sizeof(mode)) < 0)
-        {
-            uint8_t e[256];
-            int el = build_error(e, sizeof(e), 4, "Bad RRQ/WRQ format");
-            sendto(sock69, e, el, 0, (struct sockaddr *)&client, sizeof(client));
-            continue;
-        }
-
-        if (!safe_name(filename))
-        {
-            uint8_t e[256];
-            int el = build_error(e, sizeof(e), 2, "Access violation");
-            sendto(sock69, e, el, 0, (struct sockaddr *)&client, sizeof(client));
-            continue;
-        }
-
-        if (strcasecmp(mode, "octet") != 0)
-        {
-            uint8_t e[256];
-            int el = build_error(e, sizeof(e), 4, "Only octet mode supported");
-            sendto(sock69, e, el, 0, (struct sockaddr *)&client, sizeof(client));
-            continue;
-        }
-
-        // 2) créer socket de session (TID) sur port éphémère
-        int sess = socket(AF_INET, SOCK_DGRAM, 0);
-        if (sess < 0)
-        {
-            perror("socket session");
-            continue;
-        }
-
-        struct sockaddr_in sa;
-        memset(&sa, 0, sizeof(sa));
-        sa.sin_family = AF_INET;
-        sa.sin_addr.s_addr = htonl(INADDR_ANY);
-        sa.sin_port = htons(0); // port éphémère
-        if (bind(sess, (struct sockaddr *)&sa, sizeof(sa)) < 0)
-        {
-            perror("bind session");
-            close(sess);
-            continue;
-        }
-
-        // 3) traiter 1 seul transfert (serveur simple)
-        if (op == OPCODE_RRQ)
-        {
-            printf("RRQ from %s:%u file=%s\n",
-                   inet_ntoa(client.sin_addr), ntohs(client.sin_port), filename);
-            handle_rrq(sess, &client, root_dir, filename);
-        }
-        else
-        {
-            printf("WRQ from %s:%u file=%s\n",
-                   inet_ntoa(client.sin_addr), ntohs(client.sin_port), filename);
-            handle_wrq(sess, &client, root_dir, filename);
-        }
-
-        close(sess);
-    }
-
-    // never reached
-    close(sock69);
-    return 0;
-}
-
-int main(int argc, char **argv)
-{
-    if (argc < 2)
-    {
-        fprintf(stderr, "Usage: %s PORT [root_dir]\n", argv[0]);
-        return 1;
-    }
-    const char *root_dir = ".";
-
-    if (argc >= 3)
-        root_dir = argv[2];
-
-    return tftp_server_run(atoi(argv[1]), root_dir);
-}
\ No newline at end of file
+// =============================== server.c ===============================
+// Serveur TFTP (Partie 2)
+// - écoute UDP sur port 69 (ou autre)
+// - reçoit RRQ/WRQ
+// - crée un socket "session" (TID) sur port éphémère
+// - RRQ: envoie DATA(k) et attend ACK(k) (timeout => retransmission)
+// - WRQ: envoie ACK(0), reçoit DATA(k), renvoie ACK(k) (timeout => retransmission)
+//
+// Multi-clients : une boucle epoll par worker, sockets non bloquantes,
+// l'état de chaque transfert vit dans la table de sessions (session.h) au lieu
+// des variables locales d'une boucle bloquante. Les timeouts sont gérés par un
+// scan périodique du tableau "hot" (compact, donc peu coûteux).
+//
+// Sockets TID : par défaut une socket éphémère créée par transfert ; en mode
+// pool (-s N), N sockets liées au démarrage sont partagées par toutes les
+// sessions du worker et les paquets sont démultiplexés par adresse client.
+//
+// Options : blksize, windowsize, tsize (OACK, RFC 2347), reprise d'un
+// transfert interrompu avec offset / offcrc, plages offset / length pour
+// les GET découpés en sessions parallèles et somme de contrôle de bout en
+// bout checksum=crc32c, calculée au fil des blocs (tftp_utils.h).
+//
+// Modes octet et netascii (netascii.h) : un RRQ netascii est encodé bloc par
+// bloc à l'envoi (début des blocs de la fenêtre gardé pour les
+// retransmissions), un WRQ netascii est décodé bloc par bloc à la réception.
+//
+// Compression (option compress=lz, lz.h) : un RRQ dont le contenu se
+// compresse (échantillon) est servi depuis sa variante compressée en mémoire,
+// gardée par fichier dans le cache zcache.h ; sans variante, ses trames sont
+// compressées au fil des blocs envoyés (le flux complet devient la variante) ;
+// contenu incompressible servi tel quel.
+//
+// Dépôts dédupliqués (-D, dedup.h) : un WRQ est découpé par le contenu, les
+// morceaux nouveaux rangés sous root_dir/.dedup, le fichier devient un
+// manifeste ; un RRQ sur un manifeste relit les morceaux.
+//
+// Métriques (metrics.h) : compteurs et histogrammes par worker, exportés en
+// HTTP (format Prometheus) sur 127.0.0.1 avec -M port.
+//
+// Traces (trace.h) : -T fichier enregistre la chronologie d'une session sur
+// -t N (requête, ouverture, premier DATA, retransmissions, fin), exportée au
+// format Chrome trace-event à l'arrêt.
+//
+// Objets en mémoire (memstore.h) : un RRQ dont le nom est enregistré est servi
+// depuis la mémoire (memcpy, pas de pread) ; -m nom=fichier en précharge.
+//
+// Fichiers virtuels (vfile.h) : -G motif=gabarit rend un gabarit avec les
+// variables du client (inventaire -I), rendu mis en cache et servi comme un
+// objet en mémoire.
+//
+// Comptabilité (accounting.h) : -A fichier ajoute une ligne de bilan par
+// transfert (débit, retransmissions, RTT, cause de fin).
+//
+// Journal (log.h) : les workers n'écrivent que des enregistrements binaires
+// dans un anneau par thread, le formatage et les write() sont faits par le
+// thread de journalisation (niveau avec -L).
+//
+// Redémarrage sans coupure (-U, handoff.h) : un nouveau processus reçoit de
+// l'ancien ses sockets de requêtes et TID avec l'état des sessions, et
+// poursuit les transferts en cours.
+//
+// Pacing (-R, pace.h) : les DATA d'un RRQ partent espacés au débit demandé
+// plutôt qu'une fenêtre d'un coup ; heures d'émission confiées au noyau
+// (SO_TXTIME) avec fq, sinon réveils du worker à la microseconde.
+
+#define _GNU_SOURCE // accept4, memfd_create
+#include "accounting.h"
+#include "affinity.h"
+#include "dedup.h"
+#include "handoff.h"
+#include "log.h"
+#include "memstore.h"
+#include "metrics.h"
+#include "netascii.h"
+#include "pace.h"
+#include "preload.h"
+#include "server.h"
+#include "session.h"
+#include "sockbuf.h"
+#include "sockets.h"
+#include "tftp_utils.h"
+#include "trace.h"
+#include "tstamp.h"
+#include "vfile.h"
+#include "zcache.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LISTEN_TAG UINT64_MAX
+#define HANDOFF_TAG (UINT64_MAX - 1)
+#define WAKE_TAG (UINT64_MAX - 2)
+#define POOL_TAG_HI 0xFFFFFFFEULL
+#define POOL_TAG(k) ((POOL_TAG_HI << 32) | (k))
+#define MAX_EVENTS 256
+#define RECV_BATCH 64 // paquets lus max par socket et par réveil (équité)
+#define TIMEOUT_NS ((uint64_t)TIMEOUT_MS * 1000000ULL)
+#define STOP_POLL_MS 200 // délai max de prise en compte d'un arrêt par les workers
+#define DALLY_TIMEOUTS 2 // fin de WRQ : on ré-acquitte le dernier bloc pendant 2 timeouts
+
+// appels système du chemin de traitement, comptés par thread (rapport d'arrêt)
+static __thread uint64_t nsyscalls;
+#define SYS(call) (nsyscalls++, (call))
+
+// bloc de métriques du worker courant (écrit par ce seul thread)
+static __thread struct tftp_metrics *tm;
+
+// anneau de traces du worker courant, NULL si les traces sont désactivées
+static __thread struct tftp_trace *tt;
+
+// horodatage noyau des émissions mesurées (-X) ; stamp_next : le prochain
+// send_to_peer le demande
+static __thread int tx_stamps;
+static __thread int stamp_next;
+
+// -R : heure d'émission SO_TXTIME du prochain send_to_peer (0 : tout de suite)
+static __thread uint64_t send_at;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+// passation (-U) : connexion d'un nouveau processus acceptée par le worker 0 ;
+// tous les workers sortent de leur boucle sans terminer les sessions, le
+// thread principal passe ensuite leur état (handoff_export)
+static int handoff_requested = 0; // atomique
+static int handoff_lfd = -1;      // socket d'écoute -U
+static int handoff_conn = -1;     // connexion du nouveau processus
+static int wake_fd = -1;          // eventfd dans l'epoll de chaque worker
+
+// un worker = un thread, sa boucle epoll, sa socket de requêtes et sa table
+// de sessions : aucun état partagé entre workers, donc aucun verrou
+struct worker
+{
+    const struct tftp_server_config *cfg;
+    uint32_t id;
+    pthread_t thread;
+    const char *root_dir;
+    int sock69;
+    int epfd;
+    int *pool; // sockets TID partagées (mode démultiplexé), NULL sinon
+    uint32_t npool;
+    uint32_t nassign;   // les nassign premières servent les nouvelles sessions
+                        // (les suivantes : héritées d'un processus précédent)
+    uint32_t next_pool; // round-robin d'attribution
+    struct tftp_sess_table sessions;
+    uint64_t next_scan; // plus petite échéance connue (UINT64_MAX = aucune)
+    struct tftp_metrics *metrics;
+    struct tftp_trace *trace; // NULL sans -T
+    int acct_fd;              // journal de comptabilité partagé (O_APPEND), -1 sans -A
+    struct preload_hot hot;   // RRQ par nom pour -H
+    int cpu;                  // CPU du worker (-c), -1 : non épinglé
+
+    // files des sockets (sockbuf.h)
+    int listen_buf;            // file de réception de sock69 obtenue
+    int def_rcvbuf;            // files par défaut d'une socket TID
+    int def_sndbuf;
+    uint32_t pool_buf;         // file actuelle des sockets du pool (ne fait que croître)
+    uint32_t listen_drops;     // dernier cumul SO_RXQ_OVFL de sock69
+    uint32_t *pool_drops;      // idem, par socket du pool
+    int rx_stamps;             // horodatage noyau des réceptions actif (tstamp.h)
+    struct tstamp rx;          // arrivée du datagramme en cours (noyau, sinon lecture)
+
+    // pacing (-R, pace.h)
+    struct pace_queue paced;   // réveils des RRQ en attente de leur créneau
+    int txtime;                // SO_TXTIME actif sur les sockets TID
+    int pwait2;                // epoll_pwait2 disponible (noyau 5.11+), sinon réveils à la ms
+
+    // compteurs du worker, additionnés à l'arrêt
+    uint64_t transfers;
+    uint64_t bytes;
+    uint64_t syscalls;
+    uint64_t requests;
+    uint64_t cross_cpu; // requêtes reçues sur un autre CPU que celui du worker (-c)
+};
+
+/* ---------------------------- Helpers ---------------------------- */
+
+// data epoll d'une session : (socket << 32) | index, pour ignorer les
+// événements périmés d'une session libérée puis réallouée dans le même lot
+static uint64_t sess_tag(int sock, uint32_t idx)
+{
+    return ((uint64_t)(uint32_t)sock << 32) | idx;
+}
+
+static void send_to_peer(const struct tftp_sess_hot *h, const uint8_t *buf, size_t len)
+{
+    struct sockaddr_in to;
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = h->peer_addr;
+    to.sin_port = h->peer_port;
+    if (send_at)
+    {
+        // pas d'horodatage d'émission demandé : la mesure part de send_at
+        SYS(pace_sendto(h->sock, buf, len, &to, send_at));
+        send_at = 0;
+        stamp_next = 0;
+    }
+    else if (stamp_next)
+    {
+        stamp_next = 0;
+        SYS(tstamp_sendto(h->sock, buf, len, &to));
+    }
+    else
+        SYS(net_sendto(h->sock, buf, len, 0, (struct sockaddr *)&to, sizeof(to)));
+    metric_add(tm, M_TX_PACKETS, 1);
+    metric_add(tm, M_TX_BYTES, len);
+}
+
+static void send_error(int sock, const struct sockaddr_in *client, uint16_t code, const char *msg)
+{
+    uint8_t e[256];
+    int el = build_error(e, sizeof(e), code, msg);
+    if (el > 0)
+    {
+        SYS(net_sendto(sock, e, el, 0, (struct sockaddr *)client, sizeof(*client)));
+        metric_add(tm, M_ERR_SENT_0 + (code <= 8 ? code : 0), 1);
+        metric_add(tm, M_TX_PACKETS, 1);
+        metric_add(tm, M_TX_BYTES, (uint64_t)el);
+    }
+}
+
+static void arm_timer(struct worker *w, struct tftp_sess_hot *h, uint64_t now)
+{
+    h->deadline = now + TIMEOUT_NS;
+    if (h->deadline < w->next_scan)
+        w->next_scan = h->deadline;
+}
+
+// événement de trace, seulement pour les sessions échantillonnées
+static void sess_trace(const struct tftp_sess_cold *c, enum trace_type type, uint64_t ts,
+                       uint64_t a, uint64_t b)
+{
+    if (c->trace_id)
+        trace_event(tt, c->trace_id, type, ts, a, b);
+}
+
+// tsize : taille du fichier, même quand la session n'en sert qu'une plage
+static uint64_t sess_tsize(const struct tftp_sess_hot *h, const struct tftp_sess_cold *c)
+{
+    return (h->flags & SESS_F_RANGE) ? c->total : h->size;
+}
+
+// ligne du journal de comptabilité (-A) pour ce transfert
+static void sess_account(struct worker *w, uint32_t idx, enum tftp_xfer_result result, uint64_t now)
+{
+    const struct tftp_sess_hot *h = &w->sessions.hot[idx];
+    const struct tftp_sess_cold *c = &w->sessions.cold[idx];
+    struct tftp_xfer_stats st;
+    memset(&st, 0, sizeof(st));
+    st.side = "server";
+    st.file = c->filename;
+    st.peer_addr = h->peer_addr;
+    st.peer_port = h->peer_port;
+    st.op = h->state == SESS_RRQ ? OPCODE_RRQ : OPCODE_WRQ;
+    st.result = result;
+    st.bytes = c->bytes;
+    st.blocks = h->state == SESS_RRQ ? h->acked : h->next_block - 1;
+    st.blksize = h->blksize;
+    st.windowsize = h->windowsize;
+    st.tsize = (h->flags & SESS_F_TSIZE) ? (int64_t)sess_tsize(h, c) : -1;
+    st.offset = c->offset;
+    st.duration_ns = now - c->start;
+    st.retransmits = c->retransmits;
+    st.duplicates = c->duplicates;
+    st.drops = c->drops;
+    st.rxq = c->rxq;
+    st.rtt = c->rtt;
+    if (SYS(acct_write(w->acct_fd, &st)) < 0)
+        LOG_ERR("accounting log: %s", strerror(errno));
+}
+
+// fin de session ; un transfert réussi a déjà son bilan (transfer_done)
+static void session_end(struct worker *w, uint32_t idx, enum tftp_xfer_result result)
+{
+    struct tftp_sess_hot *h = &w->sessions.hot[idx];
+    struct tftp_sess_cold *c = &w->sessions.cold[idx];
+    if (result != XFER_OK && w->acct_fd >= 0)
+        sess_account(w, idx, result, now_ns());
+    w->transfers++;
+    w->bytes += c->bytes;
+    metric_add(tm, M_SESSIONS_ENDED, 1);
+    if (c->trace_id)
+    {
+        uint64_t now = now_ns();
+        struct trace_ev *e = trace_push(tt, c->trace_id, TR_END, now);
+        e->a = now - c->start;
+        e->b = c->bytes;
+        e->c = c->retransmits;
+    }
+    if (h->fd >= 0)
+        SYS(close(h->fd));
+    memobj_release(c->obj);
+    c->obj = NULL;
+    free(c->na);
+    c->na = NULL;
+    zcache_stream_free(c->zs);
+    c->zs = NULL;
+    if (h->state == SESS_WRQ)
+        dedup_abort(c->dd.wr); // WRQ en échec : version précédente gardée
+    else
+        dedup_close(c->dd.rd);
+    c->dd.rd = NULL;
+    if (h->sock >= 0 && !(h->flags & SESS_F_POOLSOCK))
+        SYS(net_close(h->sock)); // retire aussi la socket de l'epoll
+    sess_release(&w->sessions, idx);
+}
+
+static void transfer_done(struct worker *w, uint32_t idx, uint64_t now)
+{
+    metric_add(tm, M_TRANSFERS_OK, 1);
+    hist_record(tm, H_TRANSFER, now - w->sessions.cold[idx].start);
+    sess_trace(&w->sessions.cold[idx], TR_DONE, now, 0, 0);
+    if (w->acct_fd >= 0)
+        sess_account(w, idx, XFER_OK, now);
+}
+
+/* ---------------------------- RRQ session ---------------------------- */
+
+// octets [off, off + len) du contenu servi : objet en mémoire, manifeste
+// dédupliqué ou fichier
+static ssize_t rrq_read(struct tftp_sess_hot *h, struct tftp_sess_cold *c, uint8_t *buf, size_t len,
+                        uint64_t off)
+{
+    if (c->obj)
+    {
+        memcpy(buf, c->obj->data + off, len);
+        return (ssize_t)len;
+    }
+    if (c->dd.rd)
+        return dedup_pread(c->dd.rd, buf, len, off);
+    return len ? SYS(pread(h->fd, buf, len, (off_t)off)) : 0;
+}
+
+// RRQ netascii : entrée de l'anneau pour ce bloc
+static struct netascii_pos *na_at(const struct tftp_sess_hot *h, const struct tftp_sess_cold *c, uint32_t block)
+{
+    return &c->na[block % (h->windowsize + 2u)];
+}
+
+// RRQ netascii : bloc encodé depuis son début dans le contenu, début du
+// suivant noté ; un octet local donne au moins un octet réseau, blksize
+// octets lus suffisent ; bloc court : le dernier, taille réseau connue
+static ssize_t rrq_read_netascii(struct tftp_sess_hot *h, struct tftp_sess_cold *c, uint32_t block,
+                                 uint8_t *out)
+{
+    uint8_t raw[MAX_BLKSIZE];
+    struct netascii_pos p = *na_at(h, c, block);
+    size_t want = c->total - p.src > h->blksize ? h->blksize : (size_t)(c->total - p.src);
+    ssize_t r = rrq_read(h, c, raw, want, p.src);
+    if (r < 0 || (size_t)r != want)
+        return -1;
+    size_t used;
+    size_t n = netascii_encode(raw, want, &used, out, h->blksize, &p.pend);
+    p.src += used;
+    *na_at(h, c, block + 1) = p;
+    if (n < h->blksize)
+    {
+        h->last_block = block;
+        h->size = (uint64_t)(block - 1) * h->blksize + n;
+    }
+    return (ssize_t)n;
+}
+
+// source d'un flux compressé : le contenu de la session
+struct rrq_src
+{
+    struct tftp_sess_hot *h;
+    struct tftp_sess_cold *c;
+};
+
+static ssize_t rrq_src_read(void *ctx, uint8_t *buf, size_t len, uint64_t off)
+{
+    struct rrq_src *s = ctx;
+    return rrq_read(s->h, s->c, buf, len, off);
+}
+
+// RRQ compressé sans variante en mémoire : octets du flux, trames compressées
+// quand les blocs qui les portent partent, trames acquittées oubliées ; bloc
+// court : le dernier, taille réseau connue ; flux complet produit pour le
+// cache : la session sert ensuite la variante
+static ssize_t rrq_read_lz(struct tftp_sess_hot *h, struct tftp_sess_cold *c, uint32_t block, uint8_t *out)
+{
+    struct rrq_src src = {h, c};
+    uint64_t off = (uint64_t)(block - 1) * h->blksize;
+    ssize_t n = zcache_stream_read(c->zs, rrq_src_read, &src, off, out, h->blksize, (uint64_t)h->acked * h->blksize);
+    if (n < 0)
+        return -1;
+    if ((size_t)n < h->blksize)
+    {
+        h->last_block = block;
+        h->size = off + (uint64_t)n;
+    }
+    struct tftp_memobj *o = zcache_stream_finish(c->zs, c->filename);
+    if (o)
+    {
+        memobj_release(c->obj);
+        c->obj = o;
+        if (h->fd >= 0)
+            SYS(close(h->fd));
+        h->fd = -1;
+        dedup_close(c->dd.rd);
+        c->dd.rd = NULL;
+        zcache_stream_free(c->zs);
+        c->zs = NULL;
+        h->size = o->len;
+        h->last_block = (uint32_t)(o->len / h->blksize) + 1;
+    }
+    return n;
+}
+
+// (re)construit DATA(block) depuis le fichier ou l'objet en mémoire : pas de
+// copie gardée par session, lecture directement derrière l'en-tête du paquet ;
+// option checksum : bloc ajouté au CRC à sa première émission (les blocs
+// partent d'abord dans l'ordre), somme derrière les dernières données
+static int send_block(struct tftp_sess_hot *h, struct tftp_sess_cold *c, uint32_t block)
+{
+    uint8_t pkt[4 + MAX_BLKSIZE];
+
+    uint64_t off = c->offset + (uint64_t)(block - 1) * h->blksize;
+    size_t want = 0;
+    if (off < h->size)
+        want = (h->size - off > h->blksize) ? h->blksize : (size_t)(h->size - off);
+
+    int enc = c->na || c->zs; // taille réseau connue au dernier bloc
+    ssize_t r = c->na   ? rrq_read_netascii(h, c, block, pkt + 4)
+                : c->zs ? rrq_read_lz(h, c, block, pkt + 4)
+                        : rrq_read(h, c, pkt + 4, want, off);
+    if (r < 0 || (!enc && (size_t)r != want))
+    {
+        LOG_ERR("pread: %s", strerror(errno));
+        return -1;
+    }
+
+    size_t len = (size_t)r;
+    if (h->flags & SESS_F_SUM)
+    {
+        if (block == c->sum_at.next)
+        {
+            c->sum = crc32c(c->sum, pkt + 4, len);
+            c->sum_at.next++;
+        }
+        len += sum_put(c->sum, h->size, off + len, pkt + 4 + len, h->blksize - len);
+    }
+
+    build_data_header(pkt, sizeof(pkt), (uint16_t)block);
+    send_to_peer(h, pkt, 4 + len);
+    return 0;
+}
+
+// OACK reconstruit depuis l'état de la session (retransmission comprise)
+static void send_oack(struct tftp_sess_hot *h, const struct tftp_sess_cold *c)
+{
+    struct tftp_opt opts[MAX_OPTIONS];
+    size_t nopts = 0;
+    if (h->flags & SESS_F_BLKSIZE)
+        set_opt(opts, &nopts, MAX_OPTIONS, "blksize", h->blksize);
+    if (h->flags & SESS_F_WINDOWSIZE)
+        set_opt(opts, &nopts, MAX_OPTIONS, "windowsize", h->windowsize);
+    if (h->flags & SESS_F_TSIZE)
+        set_opt(opts, &nopts, MAX_OPTIONS, "tsize", (unsigned long)sess_tsize(h, c));
+    if (h->flags & SESS_F_OFFSET)
+    {
+        set_opt(opts, &nopts, MAX_OPTIONS, "offset", (unsigned long)c->offset);
+        if (h->state == SESS_WRQ)
+            set_opt(opts, &nopts, MAX_OPTIONS, "offcrc", c->offcrc);
+    }
+    if (h->flags & SESS_F_RANGE)
+        set_opt(opts, &nopts, MAX_OPTIONS, "length", (unsigned long)(h->size - c->offset));
+    if (h->flags & SESS_F_SUM)
+        set_opt_str(opts, &nopts, MAX_OPTIONS, "checksum", "crc32c");
+    if (h->flags & SESS_F_LZ)
+        set_opt_str(opts, &nopts, MAX_OPTIONS, "compress", "lz");
+
+    uint8_t pkt[512];
+    int len = build_oack(pkt, sizeof(pkt), opts, nopts);
+    if (len > 0)
+        send_to_peer(h, pkt, (size_t)len);
+}
+
+// mesure d'aller-retour sur block : émission datée maintenant, puis par le
+// noyau si -X (socket propre : sa file d'erreurs ne sert qu'à cette session)
+static void rtt_start(struct tftp_sess_hot *h, struct tftp_sess_cold *c, uint32_t block)
+{
+    h->rtt_block = block;
+    h->rtt_sent = now_ns();
+    c->tx_hw = 0;
+    stamp_next = tx_stamps && !(h->flags & SESS_F_POOLSOCK);
+}
+
+// fin de la mesure : arrivée du datagramme en cours moins émission mesurée
+static void rtt_sample(const struct worker *w, struct tftp_sess_hot *h, struct tftp_sess_cold *c)
+{
+    struct tstamp tx = {h->rtt_sent, c->tx_hw};
+    uint64_t rtt = tstamp_diff(&tx, &w->rx);
+    hist_record(tm, H_BLOCK_RTT, rtt);
+    rtt_add(&c->rtt, rtt);
+    h->rtt_block = 0;
+}
+
+// -R : créneau du prochain DATA (send_at si le noyau le retient) ; 0 si la
+// session doit attendre, un seul réveil en file à la fois
+static int rrq_pace(struct worker *w, uint32_t idx)
+{
+    struct tftp_sess_hot *h = &w->sessions.hot[idx];
+    struct tftp_sess_cold *c = &w->sessions.cold[idx];
+    uint64_t now = now_ns(), at;
+    if (pace_take(&c->pace_next, w->cfg->pace_rate, 4u + h->blksize, (h->flags & SESS_F_TXTIME) != 0, now, &at))
+    {
+        send_at = at > now ? at : 0;
+        return 1;
+    }
+    if (c->pace_wake)
+        return 0;
+    if (pace_queue_push(&w->paced, at, sess_tag(h->sock, idx)) < 0)
+    {
+        LOG_ERR("pacing: %s", strerror(errno));
+        return 1; // pas de réveil possible : envoi sans attendre
+    }
+    c->pace_wake = at;
+    return 0;
+}
+
+static int rrq_fill_window(struct worker *w, uint32_t idx)
+{
+    struct tftp_sess_hot *h = &w->sessions.hot[idx];
+    struct tftp_sess_cold *c = &w->sessions.cold[idx];
+    while (h->next_block <= h->last_block && h->next_block - h->acked <= h->windowsize)
+    {
+        if (w->cfg->pace_rate && !rrq_pace(w, idx))
+            return 0; // suite au réveil (pace_run)
+        if (h->rtt_block == 0)
+        {
+            rtt_start(h, c, h->next_block); // un échantillon d'aller-retour à la fois
+            if (send_at)
+                h->rtt_sent = send_at; // émission différée par le noyau
+        }
+        int r = send_block(h, c, h->next_block);
+        stamp_next = 0; // pas envoyé si échec
+        send_at = 0;
+        if (r < 0)
+            return -1;
+        h->next_block++;
+    }
+    return 0;
+}
+
+static void rrq_on_ack(struct worker *w, uint32_t idx, uint16_t ackb, uint64_t now)
+{
+    struct tftp_sess_hot *h = &w->sessions.hot[idx];
+    struct tftp_sess_cold *c = &w->sessions.cold[idx];
+
+    if (h->flags & SESS_F_OACK)
+    {
+        // ACK(0) = le client accepte l'OACK, on peut envoyer DATA(1)
+        if (ackb != 0)
+            return;
+        h->flags &= ~SESS_F_OACK;
+        h->retries = 0;
+        if (rrq_fill_window(w, idx) < 0)
+        {
+            session_end(w, idx, XFER_LOCAL_ERROR);
+            return;
+        }
+        hist_record(tm, H_TTFB, now - c->start);
+        sess_trace(c, TR_FIRST_DATA, now, now - c->start, 0);
+        arm_timer(w, h, now);
+        return;
+    }
+
+    // le numéro réseau est sur 16 bits : on le replace dans le compteur 32 bits
+    uint16_t delta = (uint16_t)(ackb - (uint16_t)h->acked);
+    if (delta == 0 || h->acked + delta >= h->next_block)
+    {
+        c->duplicates++; // ACK dupliqué ou hors fenêtre
+        metric_add(tm, M_DUPLICATES, 1);
+        return;
+    }
+
+    h->acked += delta;
+    h->retries = 0;
+    if (h->rtt_block && h->acked >= h->rtt_block)
+        rtt_sample(w, h, c);
+
+    // fenêtre (RFC 7440) : un ACK au milieu de la fenêtre signale une perte,
+    // on repart du bloc qui suit (go-back-N)
+    if (h->acked + 1 < h->next_block)
+    {
+        c->retransmits += h->next_block - 1 - h->acked;
+        metric_add(tm, M_RETRANSMITS, h->next_block - 1 - h->acked);
+        sess_trace(c, TR_RETRANSMIT, now, h->acked + 1, h->next_block - 1 - h->acked);
+        h->next_block = h->acked + 1;
+        h->rtt_block = 0; // Karn : pas d'échantillon sur un bloc renvoyé
+    }
+    uint64_t done = (uint64_t)h->acked * h->blksize;
+    c->bytes = done < h->size - c->offset ? done : h->size - c->offset;
+
+    if (h->acked == h->last_block)
+    {
+        transfer_done(w, idx, now);
+        session_end(w, idx, XFER_OK); // dernier bloc acquitté
+        return;
+    }
+
+    if (rrq_fill_window(w, idx) < 0)
+    {
+        session_end(w, idx, XFER_LOCAL_ERROR);
+        return;
+    }
+    arm_timer(w, h, now);
+}
+
+// -R : RRQ dont le créneau est arrivé ; entrées d'une session terminée ou
+// déjà relancée écartées
+static void pace_run(struct worker *w, uint64_t now)
+{
+    uint64_t due, tag;
+    while (pace_queue_pop(&w->paced, now, &due, &tag))
+    {
+        uint32_t idx = (uint32_t)tag;
+        struct tftp_sess_hot *h = &w->sessions.hot[idx];
+        struct tftp_sess_cold *c = &w->sessions.cold[idx];
+        if (h->state != SESS_RRQ || tag != sess_tag(h->sock, idx) || c->pace_wake != due)
+            continue;
+        c->pace_wake = 0;
+        if (rrq_fill_window(w, idx) < 0)
+        {
+            session_end(w, idx, XFER_LOCAL_ERROR);
+            continue;
+        }
+        arm_timer(w, h, now); // délai compté depuis le dernier DATA
+    }
+}
+
+/* ---------------------------- WRQ session ---------------------------- */
+
+static void wrq_send_ack(struct tftp_sess_hot *h, uint16_t block)
+{
+    uint8_t ack[4];
+    build_ack(ack, sizeof(ack), block);
+    send_to_peer(h, ack, sizeof(ack));
+}
+
+// octets reçus écrits à off dans le fichier, ou ajoutés au dépôt dédupliqué
+// (flux dans l'ordre, off implicite)
+static int wrq_store(struct tftp_sess_hot *h, struct tftp_sess_cold *c, const uint8_t *data, size_t len,
+                     off_t off)
+{
+    if (c->dd.wr)
+        return dedup_write(c->dd.wr, data, len);
+    return len && SYS(pwrite(h->fd, data, len, off)) != (ssize_t)len ? -1 : 0;
+}
+
+// WRQ netascii : bloc décodé puis écrit à la suite de ce qui l'a déjà été
+// (cold.total) ; un CR en fin de bloc attend le premier octet du suivant
+static int wrq_write_netascii(struct tftp_sess_hot *h, struct tftp_sess_cold *c, const uint8_t *data,
+                              size_t len, int last)
+{
+    uint8_t buf[MAX_BLKSIZE + 1];
+    int cr = (h->flags & SESS_F_CR) != 0;
+    size_t n = netascii_decode(data, len, buf, &cr);
+    if (last)
+        n += netascii_flush(buf + n, &cr);
+    h->flags = cr ? h->flags | SESS_F_CR : h->flags & ~SESS_F_CR;
+    if (wrq_store(h, c, buf, n, (off_t)c->total) < 0)
+        return -1;
+    c->total += n;
+    return 0;
+}
+
+// WRQ vérifié (sum_dest_open) : chemin du fichier déposé
+static void wrq_path(const struct worker *w, const struct tftp_sess_cold *c, char *path, size_t cap)
+{
+    snprintf(path, cap, "%s/%s", w->root_dir, c->filename);
+}
+
+// somme différente : rien du dépôt ne reste sous son nom (reprise : fichier
+// ramené au préfixe d'avant ; dédupliqué : manifeste jamais publié)
+static void wrq_sum_discard(const struct worker *w, struct tftp_sess_hot *h, struct tftp_sess_cold *c)
+{
+    if (h->fd < 0)
+        return;
+    char path[1024];
+    wrq_path(w, c, path, sizeof(path));
+    if (h->flags & SESS_F_OFFSET)
+        SYS(ftruncate(h->fd, (off_t)c->offset));
+    else
+        sum_dest_discard(h->fd, path);
+}
+
+static void wrq_on_data(struct worker *w, uint32_t idx, const uint8_t *rx, size_t n, uint64_t now)
+{
+    struct tftp_sess_hot *h = &w->sessions.hot[idx];
+    struct tftp_sess_cold *c = &w->sessions.cold[idx];
+
+    uint16_t block;
+    if (parse_block(rx, n, &block) < 0)
+        return;
+
+    size_t data_len = n - 4;
+    const uint8_t *data = rx + 4;
+
+    if (data_len > h->blksize)
+        return;
+
+    if ((h->flags & SESS_F_DALLY) && block != (uint16_t)(h->next_block - 1))
+        return;
+
+    if (block == (uint16_t)h->next_block)
+    {
+        int last = data_len < h->blksize;
+        uint64_t seen = (uint64_t)(h->next_block - 1) * h->blksize; // blocs précédents : pleins
+        off_t off = (off_t)(c->offset + seen);
+        uint8_t buf[MAX_BLKSIZE];
+        size_t len = data_len;
+        if (h->flags & SESS_F_SUM)
+        {
+            // somme possible dans les 4 derniers octets : gardés hors du fichier
+            len = sum_rx(&c->sum, c->sum_at.tail, seen, data, data_len, buf);
+            data = buf;
+            off = (off_t)(c->offset + (seen > SUM_LEN ? seen - SUM_LEN : 0));
+        }
+        if ((h->flags & SESS_F_NETASCII) ? wrq_write_netascii(h, c, data, data_len, last) < 0
+                                         : wrq_store(h, c, data, len, off) < 0)
+        {
+            LOG_ERR(c->dd.wr ? "dedup write: %s" : "pwrite: %s", strerror(errno));
+            session_end(w, idx, XFER_LOCAL_ERROR);
+            return;
+        }
+        if (last && (h->flags & SESS_F_SUM) && !sum_ok(c->sum, c->sum_at.tail, seen + data_len))
+        {
+            uint8_t e[64];
+            int el = build_error(e, sizeof(e), 0, "Checksum mismatch");
+            send_to_peer(h, e, (size_t)el);
+            LOG_WRN("WRQ %s: checksum mismatch", c->filename);
+            wrq_sum_discard(w, h, c);
+            session_end(w, idx, XFER_CHECKSUM);
+            return;
+        }
+        if (last && (h->flags & SESS_F_SUM) && h->fd >= 0)
+        {
+            // somme vérifiée : fichier publié sous son nom avant le dernier ACK
+            char path[1024];
+            wrq_path(w, c, path, sizeof(path));
+            if (SYS(sum_dest_commit(h->fd, path)) < 0)
+            {
+                LOG_ERR("sum publish: %s", strerror(errno));
+                session_end(w, idx, XFER_LOCAL_ERROR);
+                return;
+            }
+        }
+        if (last && c->dd.wr)
+        {
+            // manifeste publié avant le dernier ACK
+            int r = dedup_commit(c->dd.wr);
+            c->dd.wr = NULL;
+            if (r < 0)
+            {
+                LOG_ERR("dedup commit: %s", strerror(errno));
+                session_end(w, idx, XFER_LOCAL_ERROR);
+                return;
+            }
+        }
+
+        h->flags &= ~SESS_F_OACK;
+        c->bytes += len;
+        h->retries = 0;
+        if (h->next_block == 1)
+        {
+            hist_record(tm, H_TTFB, now - c->start);
+            sess_trace(c, TR_FIRST_DATA, now, now - c->start, 0);
+        }
+        if (h->rtt_block == h->next_block)
+            rtt_sample(w, h, c);
+        h->next_block++;
+
+        // un ACK par fenêtre (RFC 7440), et toujours pour le dernier bloc
+        if (last || h->next_block - 1 - h->acked >= h->windowsize)
+        {
+            rtt_start(h, c, h->next_block); // ACK -> premier DATA de la fenêtre suivante
+            wrq_send_ack(h, block);
+            h->acked = h->next_block - 1;
+        }
+
+        if (last)
+        {
+            transfer_done(w, idx, now);
+            // dernier bloc : fichier complet, mais on reste joignable un timeout
+            // au cas où le dernier ACK se perdrait (RFC 1350, section 6)
+            if (h->fd >= 0)
+                SYS(close(h->fd));
+            h->fd = -1;
+            h->flags |= SESS_F_DALLY;
+        }
+        arm_timer(w, h, now);
+    }
+    else if (block == (uint16_t)(h->next_block - 1))
+    {
+        // doublon => re-ACK sans réécrire
+        c->duplicates++;
+        metric_add(tm, M_DUPLICATES, 1);
+        wrq_send_ack(h, block);
+        h->acked = h->next_block - 1;
+        h->rtt_block = 0;
+    }
+    else if ((uint16_t)(block - h->next_block) < 0x8000)
+    {
+        // bloc en avance : trou dans la fenêtre, on signale une fois le dernier
+        // bloc reçu dans l'ordre pour que l'émetteur reparte de là
+        c->duplicates++;
+        metric_add(tm, M_DUPLICATES, 1);
+        h->rtt_block = 0;
+        if (h->acked != h->next_block - 1)
+        {
+            wrq_send_ack(h, (uint16_t)(h->next_block - 1));
+            h->acked = h->next_block - 1;
+        }
+    }
+    else
+    {
+        c->duplicates++; // ancien bloc d'une fenêtre retransmise
+        metric_add(tm, M_DUPLICATES, 1);
+    }
+}
+
+/* ---------------------------- Event loop ---------------------------- */
+
+static void session_on_packet(struct worker *w, uint32_t idx, const uint8_t *rx, size_t n, uint64_t now)
+{
+    struct tftp_sess_hot *h = &w->sessions.hot[idx];
+
+    uint16_t op;
+    if (parse_opcode(rx, n, &op) < 0)
+        return;
+
+    if (op == OPCODE_ERROR)
+    {
+        metric_add(tm, M_ERR_RECV, 1);
+        LOG_WRN("session %s: transfer aborted by client", w->sessions.cold[idx].filename);
+        session_end(w, idx, XFER_PEER_ERROR);
+        return;
+    }
+
+    if (h->state == SESS_RRQ && op == OPCODE_ACK)
+    {
+        uint16_t ackb;
+        if (parse_block(rx, n, &ackb) == 0)
+            rrq_on_ack(w, idx, ackb, now);
+    }
+    else if (h->state == SESS_WRQ && op == OPCODE_DATA)
+        wrq_on_data(w, idx, rx, n, now);
+}
+
+// datagramme lu : attente dans la file d'après son horodatage noyau (rxq
+// peut être NULL), à défaut heure de lecture prise comme heure d'arrivée
+static void rx_stamped(struct worker *w, struct tftp_rtt *rxq)
+{
+    uint64_t at = now_ns();
+    if (!w->rx.sw)
+    {
+        w->rx.sw = at;
+        return;
+    }
+    uint64_t q = at > w->rx.sw ? at - w->rx.sw : 0;
+    hist_record(tm, H_RX_QUEUE, q);
+    if (rxq)
+        rtt_add(rxq, q);
+}
+
+static void session_readable(struct worker *w, uint32_t idx, uint32_t events, uint64_t now)
+{
+    uint8_t rx[4 + MAX_BLKSIZE + 64];
+
+    if (events & EPOLLERR)
+    {
+        // horodatage d'émission (-X) : retenu s'il suit le début de la mesure
+        // en cours (sinon il date d'une mesure abandonnée)
+        struct tftp_sess_hot *h = &w->sessions.hot[idx];
+        struct tstamp tx = {0, 0};
+        if (SYS(tstamp_tx(h->sock, &tx)))
+        {
+            if (h->rtt_block && tx.sw >= h->rtt_sent)
+                h->rtt_sent = tx.sw;
+            if (h->rtt_block && tx.hw)
+                w->sessions.cold[idx].tx_hw = tx.hw;
+            if (!(events & EPOLLIN))
+                return;
+        }
+        // sinon erreur de la socket : relevée par la lecture ci-dessous
+    }
+
+    for (int i = 0; i < RECV_BATCH; i++)
+    {
+        struct tftp_sess_hot *h = &w->sessions.hot[idx];
+        if (h->state == SESS_FREE)
+            return; // terminée pendant le lot
+
+        struct sockaddr_in src;
+        struct tftp_sess_cold *c = &w->sessions.cold[idx];
+        uint32_t drops = c->drops;
+        ssize_t n = SYS(sockbuf_recv(h->sock, rx, sizeof(rx), &src, &drops, &w->rx));
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG_ERR("recvfrom: %s", strerror(errno));
+                session_end(w, idx, XFER_LOCAL_ERROR);
+            }
+            return;
+        }
+        if (drops != c->drops)
+        {
+            metric_add(tm, M_DROPS_TID, drops - c->drops);
+            c->drops = drops;
+        }
+
+        metric_add(tm, M_RX_PACKETS, 1);
+        metric_add(tm, M_RX_BYTES, (uint64_t)n);
+
+        // TID check: on n'accepte que l'IP:port du client qui a initié
+        if (src.sin_addr.s_addr != h->peer_addr || src.sin_port != h->peer_port)
+            continue;
+
+        rx_stamped(w, &c->rxq);
+        session_on_packet(w, idx, rx, (size_t)n, now);
+    }
+}
+
+// mode démultiplexé : une socket TID sert plusieurs sessions, on retrouve
+// la session par l'adresse du client dans la table
+static void pool_readable(struct worker *w, uint32_t k, uint64_t now)
+{
+    uint8_t rx[4 + MAX_BLKSIZE + 64];
+    int sock = w->pool[k];
+
+    for (int i = 0; i < RECV_BATCH; i++)
+    {
+        struct sockaddr_in src;
+        uint32_t drops = w->pool_drops[k];
+        ssize_t n = SYS(sockbuf_recv(sock, rx, sizeof(rx), &src, &drops, &w->rx));
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                LOG_ERR("recvfrom pool: %s", strerror(errno));
+            return;
+        }
+        if (drops != w->pool_drops[k])
+        {
+            // socket partagée : sessions touchées inconnues, compteur global seul
+            metric_add(tm, M_DROPS_TID, drops - w->pool_drops[k]);
+            w->pool_drops[k] = drops;
+        }
+
+        metric_add(tm, M_RX_PACKETS, 1);
+        metric_add(tm, M_RX_BYTES, (uint64_t)n);
+
+        // TID check: session inconnue ou rattachée à une autre socket du pool
+        int idx = sess_lookup(&w->sessions, src.sin_addr.s_addr, src.sin_port);
+        if (idx < 0 || w->sessions.hot[idx].sock != sock)
+            continue;
+
+        rx_stamped(w, &w->sessions.cold[idx].rxq);
+        session_on_packet(w, (uint32_t)idx, rx, (size_t)n, now);
+    }
+}
+
+static void session_timeout(struct worker *w, uint32_t idx, uint64_t now)
+{
+    struct tftp_sess_hot *h = &w->sessions.hot[idx];
+    struct tftp_sess_cold *c = &w->sessions.cold[idx];
+
+    if (h->flags & SESS_F_DALLY)
+    {
+        if (++h->retries >= DALLY_TIMEOUTS)
+            session_end(w, idx, XFER_OK);
+        else
+            arm_timer(w, h, now);
+        return;
+    }
+
+    metric_add(tm, M_TIMEOUTS, 1);
+    sess_trace(c, TR_TIMEOUT, now, h->state == SESS_RRQ ? h->acked + 1 : h->next_block, h->retries + 1u);
+    h->rtt_block = 0;
+    if (++h->retries > MAX_RETRIES)
+    {
+        if (h->state == SESS_RRQ)
+            LOG_WRN("RRQ %s: timeout waiting ACK(%u)", c->filename, (uint16_t)(h->acked + 1));
+        else
+            LOG_WRN("WRQ %s: timeout waiting DATA(%u)", c->filename, (uint16_t)h->next_block);
+        session_end(w, idx, XFER_TIMEOUT);
+        return;
+    }
+
+    if (h->flags & SESS_F_OACK)
+    {
+        send_oack(h, c); // OACK sans réponse (ACK(0) ou DATA(1))
+        c->retransmits++;
+        metric_add(tm, M_RETRANSMITS, 1);
+        sess_trace(c, TR_RETRANSMIT, now, 0, 1);
+    }
+    else if (h->state == SESS_RRQ && w->cfg->pace_rate)
+    {
+        // fenêtre non acquittée renvoyée au rythme du pacing (go-back-N)
+        uint32_t lost = h->next_block - 1 - h->acked;
+        sess_trace(c, TR_RETRANSMIT, now, h->acked + 1, lost);
+        c->retransmits += lost;
+        metric_add(tm, M_RETRANSMITS, lost);
+        h->next_block = h->acked + 1;
+        if (rrq_fill_window(w, idx) < 0)
+        {
+            session_end(w, idx, XFER_LOCAL_ERROR);
+            return;
+        }
+    }
+    else if (h->state == SESS_RRQ)
+    {
+        // retransmission de toute la fenêtre non acquittée
+        sess_trace(c, TR_RETRANSMIT, now, h->acked + 1, h->next_block - 1 - h->acked);
+        for (uint32_t b = h->acked + 1; b < h->next_block; b++)
+        {
+            if (send_block(h, c, b) < 0)
+            {
+                session_end(w, idx, XFER_LOCAL_ERROR);
+                return;
+            }
+            c->retransmits++;
+            metric_add(tm, M_RETRANSMITS, 1);
+        }
+    }
+    else
+    {
+        // retransmission du dernier ACK (ACK0 ou ACK(expected-1))
+        wrq_send_ack(h, (uint16_t)(h->next_block - 1));
+        h->acked = h->next_block - 1;
+        c->retransmits++;
+        metric_add(tm, M_RETRANSMITS, 1);
+        sess_trace(c, TR_RETRANSMIT, now, h->acked, 1);
+    }
+    arm_timer(w, h, now);
+}
+
+static void scan_timeouts(struct worker *w, uint64_t now)
+{
+    struct tftp_sess_table *t = &w->sessions;
+    uint64_t next = UINT64_MAX;
+
+    for (uint32_t i = 0; i < t->high; i++)
+    {
+        struct tftp_sess_hot *h = &t->hot[i];
+        if (h->state == SESS_FREE)
+            continue;
+        if (h->deadline <= now)
+        {
+            session_timeout(w, i, now);
+            if (h->state == SESS_FREE)
+                continue;
+        }
+        if (h->deadline < next)
+            next = h->deadline;
+    }
+    w->next_scan = next;
+}
+
+/* ---------------------------- Nouvelle requête ---------------------------- */
+
+// options reconnues : blksize (RFC 2348), windowsize (RFC 7440), tsize (RFC 2349),
+// checksum (tftp_utils.h) ; les autres sont ignorées ; si aucune n'est retenue, pas d'OACK (RFC 1350 pur)
+static void negotiate(struct tftp_sess_hot *h, const struct tftp_opt *opts, size_t nopts)
+{
+    h->blksize = DATA_SIZE;
+    h->windowsize = 1;
+
+    const char *v;
+    if ((v = find_opt(opts, nopts, "blksize")) != NULL)
+    {
+        unsigned long b = strtoul(v, NULL, 10);
+        if (b >= MIN_BLKSIZE)
+        {
+            h->blksize = b > MAX_BLKSIZE ? MAX_BLKSIZE : (uint16_t)b;
+            h->flags |= SESS_F_BLKSIZE;
+        }
+    }
+    if ((v = find_opt(opts, nopts, "windowsize")) != NULL)
+    {
+        unsigned long ws = strtoul(v, NULL, 10);
+        if (ws >= 1)
+        {
+            h->windowsize = ws > MAX_WINDOWSIZE ? MAX_WINDOWSIZE : (uint16_t)ws;
+            h->flags |= SESS_F_WINDOWSIZE;
+        }
+    }
+    if ((v = find_opt(opts, nopts, "tsize")) != NULL)
+    {
+        h->size = strtoull(v, NULL, 10); // WRQ: taille annoncée, renvoyée telle quelle
+        h->flags |= SESS_F_TSIZE;
+    }
+    // somme sur les octets du réseau : pas en netascii (texte décodé à l'écriture)
+    if ((v = find_opt(opts, nopts, "checksum")) != NULL && strcasecmp(v, "crc32c") == 0 &&
+        !(h->flags & SESS_F_NETASCII))
+        h->flags |= SESS_F_SUM;
+
+    if (h->flags & (SESS_F_BLKSIZE | SESS_F_WINDOWSIZE | SESS_F_TSIZE | SESS_F_SUM))
+        h->flags |= SESS_F_OACK;
+}
+
+// empreinte de reprise (resume_crc_fd) d'un fichier dédupliqué
+static int resume_crc_dedup(struct dedup_reader *rd, uint64_t from, uint64_t to, uint32_t *crc)
+{
+    uint8_t *buf = malloc(RESUME_CRC_SPAN);
+    if (!buf)
+        return -1;
+    ssize_t r = dedup_pread(rd, buf, (size_t)(to - from), from);
+    if (r == (ssize_t)(to - from))
+        *crc = crc32c(0, buf, (size_t)r);
+    free(buf);
+    return r == (ssize_t)(to - from) ? 0 : -1;
+}
+
+// RRQ repris : le client a déjà `offset` octets ; refusé (transfert complet)
+// si le fichier est plus court ou si l'empreinte de son préfixe diffère ;
+// offset retenu arrondi au bloc (celui de l'OACK)
+static void rrq_resume(struct tftp_sess_hot *h, struct tftp_sess_cold *c,
+                       const struct tftp_opt *opts, size_t nopts)
+{
+    const char *v = find_opt(opts, nopts, "offset");
+    if (!v)
+        return;
+    uint64_t want = strtoull(v, NULL, 10);
+    if (want == 0 || want > h->size)
+        return;
+    if ((v = find_opt(opts, nopts, "offcrc")) != NULL)
+    {
+        uint32_t crc;
+        uint64_t from = want > RESUME_CRC_SPAN ? want - RESUME_CRC_SPAN : 0;
+        if (c->obj)
+            crc = crc32c(0, c->obj->data + from, (size_t)(want - from));
+        else if (c->dd.rd ? resume_crc_dedup(c->dd.rd, from, want, &crc) < 0
+                          : SYS(resume_crc_fd(h->fd, want, &crc)) < 0)
+            return;
+        if (crc != (uint32_t)strtoul(v, NULL, 10))
+        {
+            LOG_INF("RRQ %s: resume at %llu refused (prefix differs)", c->filename, (unsigned long long)want);
+            return;
+        }
+    }
+    c->offset = want - want % h->blksize;
+    h->flags |= SESS_F_OFFSET | SESS_F_OACK;
+}
+
+// RRQ par plage (GET découpé en sessions parallèles) : length borne la fin à
+// offset + length, offset demandé (le début servi, arrondi au bloc, peut être
+// avant : octets renvoyés en double, jamais de trou en fin de plage) ;
+// h->size devient la fin servie, tsize reste la taille du fichier ; offset
+// demandé mais refusé : length ignoré (pas d'OACK), le client voit qu'il
+// reçoit tout le fichier
+static void rrq_range(struct tftp_sess_hot *h, struct tftp_sess_cold *c,
+                      const struct tftp_opt *opts, size_t nopts)
+{
+    const char *v = find_opt(opts, nopts, "length");
+    if (!v)
+        return;
+    const char *off = find_opt(opts, nopts, "offset");
+    uint64_t want = off ? strtoull(off, NULL, 10) : 0;
+    if (want && !(h->flags & SESS_F_OFFSET))
+    {
+        LOG_INF("RRQ %s: range refused (offset %u not honoured)", c->filename, want);
+        return;
+    }
+    uint64_t len = strtoull(v, NULL, 10);
+    c->total = h->size;
+    if (len < h->size - want)
+        h->size = want + len;
+    h->flags |= SESS_F_RANGE | SESS_F_OACK;
+}
+
+// RRQ netascii : blocs encodés à l'envoi depuis le contenu, tel quel
+// (fichier, objet en mémoire ou manifeste) ; taille réseau connue au dernier
+// bloc seulement : tsize non acquitté ; pas de reprise ni de plage
+static int rrq_netascii(struct tftp_sess_hot *h, struct tftp_sess_cold *c)
+{
+    c->na = calloc(h->windowsize + 2u, sizeof(*c->na));
+    if (!c->na)
+        return -1;
+    na_at(h, c, 1)->pend = NETASCII_NONE;
+    c->total = h->size;
+    h->size = UINT64_MAX;
+    h->last_block = UINT32_MAX;
+    h->flags &= ~SESS_F_TSIZE;
+    if (!(h->flags & (SESS_F_BLKSIZE | SESS_F_WINDOWSIZE)))
+        h->flags &= ~SESS_F_OACK;
+    return 0;
+}
+
+// RRQ compressé (option compress=lz) : variante compressée en mémoire (cache
+// zcache.h pour les fichiers et les fichiers préchargés), sinon flux produit
+// trame par trame au fil des blocs, gardé ensuite comme variante ; taille
+// réseau alors inconnue avant le dernier bloc : tsize non acquitté ; contenu
+// incompressible d'après l'échantillon : option ignorée ; retourne 1 si la
+// session sert le flux compressé (ni reprise ni plage)
+static int rrq_compress(struct worker *w, struct tftp_sess_hot *h, struct tftp_sess_cold *c,
+                        const struct stat *st, const struct tftp_opt *opts, size_t nopts)
+{
+    const char *v = find_opt(opts, nopts, "compress");
+    if (!v || strcasecmp(v, "lz") != 0)
+        return 0;
+    // st : fstat() du fichier (du manifeste s'il est dédupliqué : réécrit à
+    // chaque dépôt), ou stat() de la vérification d'un préchargé ; fichier
+    // virtuel : rendu par client, pas de variante gardée
+    struct tftp_zcache *z = c->obj && !c->obj->src_ino ? NULL : w->cfg->zcache;
+    struct tftp_memobj *o;
+    int r = zcache_lookup(z, c->filename, st, &o);
+    if (r < 0)
+        return 0;
+    if (r > 0)
+    {
+        memobj_release(c->obj);
+        c->obj = o;
+        if (h->fd >= 0)
+            SYS(close(h->fd));
+        h->fd = -1;
+        dedup_close(c->dd.rd);
+        c->dd.rd = NULL;
+        h->size = o->len; // tsize : taille sur le réseau
+    }
+    else
+    {
+        struct rrq_src src = {h, c};
+        if (!zcache_worth(rrq_src_read, &src, h->size))
+        {
+            zcache_skip(z, c->filename, st);
+            return 0;
+        }
+        if ((c->zs = zcache_stream_new(z, st, h->size)) == NULL)
+            return 0;
+        c->total = h->size;
+        h->size = UINT64_MAX;
+        h->last_block = UINT32_MAX;
+        h->flags &= ~SESS_F_TSIZE;
+    }
+    h->flags |= SESS_F_LZ | SESS_F_OACK;
+    return 1;
+}
+
+// RRQ d'un fichier déposé en mode dédupliqué : manifeste remplacé par sa
+// lecture morceau par morceau (netascii et compress aussi, encodés au fil des
+// blocs depuis les morceaux) ; -1 si manifeste invalide
+static int rrq_dedup(struct worker *w, struct tftp_sess_hot *h, struct tftp_sess_cold *c)
+{
+    struct dedup_reader *rd;
+    int r = dedup_open(w->cfg->dedup, h->fd, &rd);
+    if (r <= 0)
+        return r;
+    SYS(close(h->fd));
+    h->fd = -1;
+    h->size = dedup_size(rd);
+    c->dd.rd = rd;
+    return 0;
+}
+
+// WRQ repris : on garde ce qu'on a déjà du fichier (au plus la taille de la
+// source du client), arrondi au blksize ; le client vérifie offcrc
+static int wrq_resume(struct tftp_sess_hot *h, struct tftp_sess_cold *c, const char *want_opt)
+{
+    struct stat st;
+    if (SYS(fstat(h->fd, &st)) < 0 || !S_ISREG(st.st_mode))
+        return -1;
+    uint64_t want = strtoull(want_opt, NULL, 10);
+    uint64_t have = (uint64_t)st.st_size < want ? (uint64_t)st.st_size : want;
+    have -= have % h->blksize;
+    if (have && SYS(resume_crc_fd(h->fd, have, &c->offcrc)) < 0)
+        have = 0;
+    if (SYS(ftruncate(h->fd, (off_t)have)) < 0)
+        return -1;
+    if (have)
+    {
+        c->offset = have;
+        h->flags |= SESS_F_OFFSET | SESS_F_OACK;
+    }
+    return 0;
+}
+
+// socket TID non bloquante sur port éphémère (SOCK_NONBLOCK : pas de fcntl)
+static int open_tid_socket(const struct worker *w)
+{
+    int sock = SYS(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0));
+    if (sock < 0)
+    {
+        LOG_ERR("socket session: %s", strerror(errno));
+        return -1;
+    }
+
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_ANY);
+    sa.sin_port = htons(0); // port éphémère
+    if (SYS(bind(sock, (struct sockaddr *)&sa, sizeof(sa))) < 0)
+    {
+        LOG_ERR("bind session: %s", strerror(errno));
+        close(sock);
+        return -1;
+    }
+    if (w->cfg->busy_poll_us)
+        SYS(affinity_busy_poll(sock, w->cfg->busy_poll_us)); // refus signalé au démarrage
+    SYS(sockbuf_drops_enable(sock));
+    if (w->rx_stamps)
+        SYS(tstamp_enable(sock));
+    if (w->txtime)
+        SYS(pace_txtime_enable(sock));
+    return sock;
+}
+
+// files TID à la mesure de la fenêtre négociée : DATA en vol côté émission
+// (RRQ), côté réception (WRQ) ; socket propre agrandie seulement si la
+// taille par défaut ne suffit pas, pool agrandi pour sa part des sessions
+// actives (jamais réduit : d'autres sessions s'y trouvent)
+static void tune_tid_buffers(struct worker *w, const struct tftp_sess_hot *h, uint16_t op)
+{
+    if (!(h->flags & SESS_F_POOLSOCK))
+    {
+        // horodatage d'émission en attente dans la file d'erreurs : compté
+        // sur la même réserve que la réception, une place de plus
+        uint32_t need = sockbuf_need(h->windowsize + (uint32_t)tx_stamps, (uint32_t)h->blksize + 4);
+        int opt = op == OPCODE_RRQ ? SO_SNDBUF : SO_RCVBUF;
+        int def = op == OPCODE_RRQ ? w->def_sndbuf : w->def_rcvbuf;
+        if (need > (uint32_t)def)
+            SYS(sockbuf_grow(h->sock, opt, need, 1));
+        return;
+    }
+
+    uint32_t share = (w->sessions.count + w->nassign - 1) / w->nassign;
+    uint32_t need = sockbuf_need((uint64_t)share * h->windowsize, (uint32_t)h->blksize + 4);
+    if (need <= w->pool_buf)
+        return;
+    for (uint32_t k = 0; k < w->nassign; k++)
+    {
+        SYS(sockbuf_grow(w->pool[k], SO_RCVBUF, need, 1));
+        SYS(sockbuf_grow(w->pool[k], SO_SNDBUF, need, 1));
+    }
+    w->pool_buf = need;
+}
+
+static void handle_request(struct worker *w, const uint8_t *buf, size_t n,
+                           const struct sockaddr_in *client, uint64_t now)
+{
+    uint16_t op;
+    if (parse_opcode(buf, n, &op) < 0 || (op != OPCODE_RRQ && op != OPCODE_WRQ))
+    {
+        LOG_DBG("ignored packet from %I:%u (%u bytes)", NULL, client->sin_addr.s_addr,
+                ntohs(client->sin_port), n);
+        metric_add(tm, M_REQ_OTHER, 1);
+        return;
+    }
+    metric_add(tm, op == OPCODE_RRQ ? M_REQ_RRQ : M_REQ_WRQ, 1);
+
+    char filename[512], mode[64];
+    struct tftp_opt opts[MAX_OPTIONS];
+    size_t nopts;
+    if (parse_rrq_wrq_opts(buf, n, filename, sizeof(filename), mode, sizeof(mode),
+                           opts, MAX_OPTIONS, &nopts) < 0)
+    {
+        send_error(w->sock69, client, 4, "Bad RRQ/WRQ format");
+        return;
+    }
+
+    if (!safe_name(filename) || (w->cfg->dedup && dedup_reserved(filename)))
+    {
+        send_error(w->sock69, client, 2, "Access violation");
+        return;
+    }
+
+    int netascii = strcasecmp(mode, "netascii") == 0;
+    if (!netascii && strcasecmp(mode, "octet") != 0)
+    {
+        send_error(w->sock69, client, 4, "Only octet and netascii modes supported");
+        return;
+    }
+
+    // requête retransmise par le client : la session existe déjà ; si elle ne
+    // fait qu'attendre la fin d'un WRQ, le port a été réutilisé par le client
+    // pour un nouveau transfert : l'ancien est bien terminé
+    int prev = sess_lookup(&w->sessions, client->sin_addr.s_addr, client->sin_port);
+    if (prev >= 0)
+    {
+        if (!(w->sessions.hot[prev].flags & SESS_F_DALLY))
+            return;
+        session_end(w, (uint32_t)prev, XFER_OK);
+    }
+
+    // socket TID : prise dans le pool (aucun syscall par requête) ou créée
+    int sess;
+    if (w->nassign > 0)
+        sess = w->pool[w->next_pool++ % w->nassign];
+    else if ((sess = open_tid_socket(w)) < 0)
+        return;
+
+    int idx = sess_alloc(&w->sessions, client);
+    if (idx < 0)
+    {
+        send_error(sess, client, 0, "Server busy");
+        if (w->nassign == 0)
+            close(sess);
+        return;
+    }
+    metric_add(tm, M_SESSIONS_STARTED, 1);
+    struct tftp_sess_hot *h = &w->sessions.hot[idx];
+    struct tftp_sess_cold *c = &w->sessions.cold[idx];
+    h->sock = sess;
+    if (w->nassign > 0)
+        h->flags |= SESS_F_POOLSOCK;
+    c->start = now;
+    c->filename = strdup(filename);
+    if (netascii)
+        h->flags |= SESS_F_NETASCII;
+    negotiate(h, opts, nopts);
+    tune_tid_buffers(w, h, op);
+    if (w->txtime && op == OPCODE_RRQ && !pace_loopback(h->peer_addr))
+        h->flags |= SESS_F_TXTIME;
+
+    c->trace_id = trace_sample(tt);
+    uint64_t t_open = 0;
+    if (c->trace_id)
+    {
+        trace_request(tt, c->trace_id, now, op, client->sin_addr.s_addr, client->sin_port, filename);
+        t_open = now_ns();
+        trace_event(tt, c->trace_id, TR_QUEUE, t_open, t_open - now, 0);
+    }
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", w->root_dir, filename);
+
+    if (op == OPCODE_RRQ)
+    {
+        struct stat st;
+        h->state = SESS_RRQ; // aussi pour le bilan d'un refus
+        h->fd = -1;
+        if (w->cfg->objects)
+            c->obj = memstore_get(w->cfg->objects, filename);
+        if (c->obj && c->obj->src_ino && (SYS(stat(path, &st)) < 0 || !preload_fresh(c->obj, &st)))
+        {
+            // fichier préchargé remplacé, modifié ou supprimé depuis : relu sur le disque
+            memstore_drop(w->cfg->objects, c->obj);
+            memobj_release(c->obj);
+            c->obj = NULL;
+        }
+        int from_root = !c->obj || c->obj->src_ino; // compté pour -H
+        if (!c->obj && w->cfg->vfile)
+            c->obj = vfile_get(w->cfg->vfile, filename, client->sin_addr.s_addr);
+        if (c->obj)
+            h->size = c->obj->len; // aussi la valeur de tsize dans l'OACK
+        else
+        {
+            h->fd = SYS(open(path, O_RDONLY));
+            if (h->fd < 0 || SYS(fstat(h->fd, &st)) < 0 || !S_ISREG(st.st_mode))
+            {
+                send_error(sess, client, 1, "File not found");
+                session_end(w, idx, XFER_REJECTED);
+                return;
+            }
+            h->size = (uint64_t)st.st_size;
+            if (w->cfg->dedup && rrq_dedup(w, h, c) < 0)
+            {
+                LOG_ERR("dedup manifest: %s", strerror(errno));
+                send_error(sess, client, 0, "Bad dedup manifest");
+                session_end(w, idx, XFER_LOCAL_ERROR);
+                return;
+            }
+        }
+        if (!netascii)
+        {
+            if (!rrq_compress(w, h, c, &st, opts, nopts))
+            {
+                rrq_resume(h, c, opts, nopts);
+                rrq_range(h, c, opts, nopts);
+            }
+        }
+        else if (rrq_netascii(h, c) < 0)
+        {
+            send_error(sess, client, 3, "Out of memory");
+            session_end(w, idx, XFER_LOCAL_ERROR);
+            return;
+        }
+        if (c->trace_id)
+        {
+            uint64_t t = now_ns();
+            trace_event(tt, c->trace_id, TR_OPEN, t, t - t_open, c->na || c->zs ? c->total : h->size);
+        }
+        if (from_root && w->cfg->hot_path)
+            preload_hot_add(&w->hot, filename, 1);
+        if (!c->na && !c->zs) // netascii, flux compressé : dernier bloc connu en le produisant
+        {
+            uint64_t stream = h->size - c->offset + ((h->flags & SESS_F_SUM) ? SUM_LEN : 0);
+            h->last_block = (uint32_t)(stream / h->blksize) + 1;
+        }
+        h->next_block = 1;
+        c->sum_at.next = 1;
+    }
+    else
+    {
+        h->state = SESS_WRQ;
+        // objet en mémoire ou fichier virtuel : lecture seule (pas un fichier
+        // préchargé : le dépôt le remplace, l'objet périmé est retiré au RRQ)
+        struct tftp_memobj *shadow = w->cfg->objects ? memstore_get(w->cfg->objects, filename) : NULL;
+        int readonly = (shadow && !shadow->src_ino) || (w->cfg->vfile && vfile_match(w->cfg->vfile, filename));
+        memobj_release(shadow);
+        // préfixe relu : O_RDWR, pas de O_TRUNC ; pas de reprise en netascii
+        // ni en mode dédupliqué (dépôt publié d'un bloc à la fin) ; checksum :
+        // reçu à part, publié si la somme concorde (tftp_utils.h)
+        const char *resume = netascii || w->cfg->dedup ? NULL : find_opt(opts, nopts, "offset");
+        h->fd = -1;
+        if (!readonly && w->cfg->dedup)
+            c->dd.wr = dedup_writer_new(w->cfg->dedup, path);
+        else if (!readonly && !resume && (h->flags & SESS_F_SUM))
+            h->fd = SYS(sum_dest_open(path));
+        else if (!readonly)
+            h->fd = SYS(open(path, resume ? O_RDWR | O_CREAT : O_WRONLY | O_CREAT | O_TRUNC, 0666));
+        if (h->fd >= 0 && resume && wrq_resume(h, c, resume) < 0)
+        {
+            SYS(close(h->fd));
+            h->fd = -1;
+        }
+        if (h->fd < 0 && !c->dd.wr)
+        {
+            send_error(sess, client, 2, "Access violation");
+            session_end(w, idx, XFER_REJECTED);
+            return;
+        }
+        h->next_block = 1;
+        if (c->trace_id)
+        {
+            uint64_t t = now_ns();
+            trace_event(tt, c->trace_id, TR_OPEN, t, t - t_open, 0);
+        }
+    }
+
+    if (w->nassign == 0)
+    {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = sess_tag(sess, (uint32_t)idx);
+        if (SYS(epoll_ctl(w->epfd, EPOLL_CTL_ADD, sess, &ev)) < 0)
+        {
+            LOG_ERR("epoll_ctl: %s", strerror(errno));
+            session_end(w, idx, XFER_LOCAL_ERROR);
+            return;
+        }
+    }
+
+    LOG_INF(op == OPCODE_RRQ ? "RRQ from %I:%u file=%s" : "WRQ from %I:%u file=%s", filename,
+            client->sin_addr.s_addr, ntohs(client->sin_port));
+    LOG_DBG("session %u: blksize=%u windowsize=%u", NULL, (unsigned)idx, h->blksize, h->windowsize);
+
+    if (h->flags & SESS_F_OACK)
+    {
+        send_oack(h, c); // attend ACK(0) (RRQ) ou DATA(1) (WRQ)
+        sess_trace(c, TR_OACK, now, h->blksize, h->windowsize);
+    }
+    else if (op == OPCODE_RRQ)
+    {
+        if (rrq_fill_window(w, (uint32_t)idx) < 0)
+        {
+            session_end(w, idx, XFER_LOCAL_ERROR);
+            return;
+        }
+        hist_record(tm, H_TTFB, now - c->start);
+        sess_trace(c, TR_FIRST_DATA, now, now - c->start, 0);
+    }
+    else
+        wrq_send_ack(h, 0); // ACK(0) = "ok, commence à DATA(1)"
+    arm_timer(w, h, now);
+}
+
+static void listen_readable(struct worker *w, uint64_t now)
+{
+    uint8_t buf[1024];
+
+    for (int i = 0; i < RECV_BATCH; i++)
+    {
+        struct sockaddr_in client;
+        uint32_t drops = w->listen_drops;
+
+        ssize_t n = SYS(sockbuf_recv(w->sock69, buf, sizeof(buf), &client, &drops, &w->rx));
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                LOG_ERR("recvfrom: %s", strerror(errno));
+            return;
+        }
+        if (drops != w->listen_drops)
+        {
+            metric_add(tm, M_DROPS_REQUEST, drops - w->listen_drops);
+            w->listen_drops = drops;
+        }
+        metric_add(tm, M_RX_PACKETS, 1);
+        metric_add(tm, M_RX_BYTES, (uint64_t)n);
+        rx_stamped(w, NULL);
+        w->requests++;
+        if (w->cpu >= 0)
+        {
+            // CPU qui a traité le dernier paquet de la socket : celui de la requête
+            int cpu = -1;
+            socklen_t len = sizeof(cpu);
+            if (SYS(getsockopt(w->sock69, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len)) == 0 && cpu != w->cpu)
+                w->cross_cpu++;
+        }
+        handle_request(w, buf, (size_t)n, &client, now);
+    }
+}
+
+/* ---------------------------- Workers ---------------------------- */
+
+// état reçu d'un processus précédent (-U), repris par les workers : l'ancien
+// worker k revient au worker k % workers (sockets du pool à la suite des
+// nôtres, à partir de pool_base[k])
+struct inherit
+{
+    uint32_t workers;
+    int *listen;       // socket de requêtes de chaque ancien worker (-1 : reprise)
+    int **pool;        // ses sockets TID partagées
+    uint32_t *npool;
+    uint32_t *pool_base;
+    struct handoff_frame *frames; // trames SESS
+    size_t nframes;
+};
+
+static int worker_setup(struct worker *w, struct inherit *in)
+{
+    const struct tftp_server_config *cfg = w->cfg;
+
+    uint32_t cap = (cfg->max_sessions + cfg->workers - 1) / cfg->workers;
+    if (sess_table_init(&w->sessions, cap) < 0)
+    {
+        fprintf(stderr, "Erreur: allocation de la table de sessions (%u)\n", cap);
+        return -1;
+    }
+
+    w->epfd = epoll_create1(0);
+    if (w->epfd < 0)
+    {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    // chaque worker a sa propre socket de requêtes : SO_REUSEPORT laisse le
+    // noyau répartir les RRQ/WRQ entre workers (hash du 4-uplet) ; avec -U
+    // aussi, pour qu'un successeur avec plus de workers puisse s'y ajouter
+    if (in && w->id < in->workers)
+    {
+        w->sock69 = in->listen[w->id]; // requêtes en attente comprises
+        in->listen[w->id] = -1;
+    }
+    else
+    {
+        w->sock69 = socket(AF_INET, SOCK_DGRAM, 0);
+        if (w->sock69 < 0)
+        {
+            perror("socket");
+            return -1;
+        }
+        int one = 1;
+        if ((cfg->workers > 1 || cfg->handoff_path) &&
+            setsockopt(w->sock69, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0)
+        {
+            perror("setsockopt SO_REUSEPORT");
+            return -1;
+        }
+
+        struct sockaddr_in a;
+        memset(&a, 0, sizeof(a));
+        a.sin_family = AF_INET;
+        a.sin_addr.s_addr = htonl(INADDR_ANY);
+        a.sin_port = htons(cfg->port);
+
+        if (bind(w->sock69, (struct sockaddr *)&a, sizeof(a)) < 0 || set_nonblock(w->sock69) < 0)
+        {
+            perror("bind");
+            return -1;
+        }
+    }
+
+    // files par défaut d'une socket TID, pour n'agrandir que si nécessaire
+    int probe = socket(AF_INET, SOCK_DGRAM, 0);
+    w->def_rcvbuf = probe >= 0 ? sockbuf_get(probe, SO_RCVBUF) : -1;
+    w->def_sndbuf = probe >= 0 ? sockbuf_get(probe, SO_SNDBUF) : -1;
+    // pacing (-R) : SO_TXTIME seulement si fq retient les datagrammes datés
+    w->txtime = cfg->pace_rate && probe >= 0 && pace_txtime_available() && pace_txtime_enable(probe) == 0;
+    w->pwait2 = 1;
+    if (probe >= 0)
+        close(probe);
+    if (w->def_rcvbuf < 0 || w->def_sndbuf < 0)
+    {
+        perror("getsockopt SO_RCVBUF");
+        return -1;
+    }
+    w->pool_buf = (uint32_t)(w->def_rcvbuf < w->def_sndbuf ? w->def_rcvbuf : w->def_sndbuf);
+
+    // une requête par session possible en file, même héritée (réglage idempotent)
+    w->listen_buf = sockbuf_grow(w->sock69, SO_RCVBUF, sockbuf_need(cap, SOCKBUF_REQUEST), 1);
+    if (sockbuf_drops_enable(w->sock69) < 0 && w->id == 0)
+        perror("setsockopt SO_RXQ_OVFL");
+    w->rx_stamps = tstamp_enable(w->sock69) == 0; // sinon horloge de la boucle
+
+    // placement (-c, -b) : refus signalé par le worker 0 seulement
+    if (w->cpu >= 0 && affinity_steer(w->sock69, w->cpu) < 0 && w->id == 0)
+        perror("setsockopt SO_INCOMING_CPU");
+    if (cfg->busy_poll_us && (affinity_busy_poll(w->sock69, cfg->busy_poll_us) < 0 ||
+                              affinity_epoll_busy_poll(w->epfd, cfg->busy_poll_us) < 0) && w->id == 0)
+        perror("busy poll");
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = LISTEN_TAG;
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->sock69, &ev) < 0)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+    ev.data.u64 = WAKE_TAG;
+    if (wake_fd >= 0 && epoll_ctl(w->epfd, EPOLL_CTL_ADD, wake_fd, &ev) < 0)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+
+    // pool de sockets TID liées une fois pour toutes (mode démultiplexé),
+    // suivi de celles des anciens workers repris par celui-ci
+    w->nassign = cfg->pool_sockets;
+    w->npool = w->nassign;
+    for (uint32_t k = w->id; in && k < in->workers; k += cfg->workers)
+    {
+        in->pool_base[k] = w->npool;
+        w->npool += in->npool[k];
+    }
+    if (w->npool > 0)
+    {
+        w->pool = malloc(w->npool * sizeof(int));
+        w->pool_drops = calloc(w->npool, sizeof(uint32_t));
+        if (!w->pool || !w->pool_drops)
+            return -1;
+        for (uint32_t k = 0; k < w->npool; k++)
+            w->pool[k] = -1;
+    }
+    for (uint32_t k = w->id; in && k < in->workers; k += cfg->workers)
+    {
+        for (uint32_t j = 0; j < in->npool[k]; j++)
+        {
+            w->pool[in->pool_base[k] + j] = in->pool[k][j];
+            in->pool[k][j] = -1;
+        }
+    }
+    for (uint32_t k = 0; k < w->npool; k++)
+    {
+        if (k < w->nassign && (w->pool[k] = open_tid_socket(w)) < 0)
+            return -1;
+        if (k >= w->nassign && cfg->busy_poll_us)
+            affinity_busy_poll(w->pool[k], cfg->busy_poll_us);
+        if (k >= w->nassign)
+            sockbuf_drops_enable(w->pool[k]);
+        if (k >= w->nassign && w->rx_stamps)
+            tstamp_enable(w->pool[k]);
+        if (k >= w->nassign && w->txtime)
+            pace_txtime_enable(w->pool[k]);
+        ev.data.u64 = POOL_TAG(k);
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->pool[k], &ev) < 0)
+        {
+            perror("epoll_ctl");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// session passée à un autre processus : ses fichiers et sockets y restent
+// ouverts, rien n'est envoyé, supprimé ni compté ici
+static void session_forget(struct worker *w, uint32_t idx)
+{
+    struct tftp_sess_hot *h = &w->sessions.hot[idx];
+    struct tftp_sess_cold *c = &w->sessions.cold[idx];
+    if (h->fd >= 0)
+        close(h->fd);
+    memobj_release(c->obj);
+    c->obj = NULL;
+    free(c->na);
+    c->na = NULL;
+    zcache_stream_free(c->zs);
+    c->zs = NULL;
+    if (h->state == SESS_WRQ)
+        dedup_writer_drop(c->dd.wr);
+    else
+        dedup_close(c->dd.rd);
+    c->dd.rd = NULL;
+    if (h->sock >= 0 && !(h->flags & SESS_F_POOLSOCK))
+        close(h->sock);
+    sess_release(&w->sessions, idx);
+}
+
+static void worker_cleanup(struct worker *w, int handed_off)
+{
+    tt = w->trace; // appelé depuis le thread principal pour tous les workers
+    if (w->sessions.hot)
+    {
+        for (uint32_t i = 0; i < w->sessions.high; i++)
+        {
+            if (w->sessions.hot[i].state == SESS_FREE)
+                continue;
+            if (handed_off)
+                session_forget(w, i);
+            else
+                session_end(w, i, (w->sessions.hot[i].flags & SESS_F_DALLY) ? XFER_OK : XFER_SHUTDOWN);
+        }
+    }
+    for (uint32_t k = 0; k < w->npool; k++)
+    {
+        if (w->pool[k] >= 0)
+            close(w->pool[k]);
+    }
+    free(w->pool);
+    free(w->pool_drops);
+    pace_queue_free(&w->paced);
+    if (w->epfd >= 0)
+        close(w->epfd);
+    if (w->sock69 >= 0)
+        close(w->sock69);
+    sess_table_free(&w->sessions);
+}
+
+/* ---------------------------- Passation (-U) ---------------------------- */
+
+// nouveau processus connecté : les workers s'arrêtent (réveillés par
+// wake_fd), la passation se fait depuis le thread principal ; pair qui n'est
+// pas ce serveur relancé (autre utilisateur, autre exécutable) : refusé,
+// sockets et sessions ne lui sont jamais passées
+static void handoff_accept(void)
+{
+    int conn = accept4(handoff_lfd, NULL, NULL, SOCK_CLOEXEC);
+    if (conn < 0)
+        return;
+    pid_t pid = 0;
+    uid_t uid = 0;
+    if (handoff_peer_check(conn, &pid, &uid) < 0)
+    {
+        LOG_WRN("handoff: connection refused (%s), pid %u uid %u", strerror(errno), (unsigned)pid, (unsigned)uid);
+        close(conn);
+        return;
+    }
+    if (__atomic_load_n(&handoff_requested, __ATOMIC_RELAXED))
+    {
+        close(conn); // une passation à la fois
+        return;
+    }
+    handoff_conn = conn;
+    __atomic_store_n(&handoff_requested, 1, __ATOMIC_RELAXED);
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0)
+        LOG_ERR("eventfd: %s", strerror(errno));
+}
+
+// contenu d'un objet en mémoire, passé avec sa session
+static int obj_memfd(const struct tftp_memobj *o)
+{
+    int fd = memfd_create("tftp-handoff", MFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    for (size_t done = 0; done < o->len;)
+    {
+        ssize_t r = write(fd, o->data + done, o->len - done);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+        {
+            close(fd);
+            return -1;
+        }
+        done += (size_t)r;
+    }
+    return fd;
+}
+
+static struct tftp_memobj *memfd_obj(const char *name, int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        return NULL;
+    size_t len = (size_t)st.st_size;
+    void *map = len ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    if (map == MAP_FAILED)
+        return NULL;
+    struct tftp_memobj *o = memobj_new(name, map ? map : "", len);
+    if (map)
+        munmap(map, len);
+    return o;
+}
+
+// trame SESS en construction ; own : memfd créés pour l'envoi, fermés ensuite
+struct sess_batch
+{
+    struct handoff_buf buf;
+    int fds[HANDOFF_MAX_FDS];
+    uint8_t own[HANDOFF_MAX_FDS];
+    size_t nfds;
+};
+
+// send = 0 : trame abandonnée (ses memfd fermés quand même)
+static int batch_flush(int sock, struct sess_batch *b, int send)
+{
+    int r = 0;
+    if (send && b->buf.len)
+        r = handoff_send(sock, HO_SESS, b->buf.data, b->buf.len, b->fds, b->nfds);
+    for (size_t i = 0; i < b->nfds; i++)
+    {
+        if (b->own[i])
+            close(b->fds[i]);
+    }
+    b->buf.len = 0;
+    b->nfds = 0;
+    return r;
+}
+
+static void batch_fd(struct sess_batch *b, struct handoff_sess *r, uint8_t bit, int fd, int own)
+{
+    r->fds |= bit;
+    b->own[b->nfds] = (uint8_t)own;
+    b->fds[b->nfds++] = fd;
+}
+
+static int export_session(int sock, struct sess_batch *b, const struct worker *w, uint32_t idx)
+{
+    const struct tftp_sess_hot *h = &w->sessions.hot[idx];
+    const struct tftp_sess_cold *c = &w->sessions.cold[idx];
+    if ((b->nfds + 4 > HANDOFF_MAX_FDS || b->buf.len > HANDOFF_MAX_FRAME / 2) && batch_flush(sock, b, 1) < 0)
+        return -1;
+
+    struct handoff_sess r;
+    memset(&r, 0, sizeof(r));
+    r.worker = w->id;
+    r.pool = -1;
+    for (uint32_t k = 0; (h->flags & SESS_F_POOLSOCK) && k < w->npool; k++)
+    {
+        if (w->pool[k] == h->sock)
+        {
+            r.pool = (int32_t)k;
+            break;
+        }
+    }
+    r.peer_addr = h->peer_addr;
+    r.peer_port = h->peer_port;
+    r.state = h->state;
+    r.retries = h->retries;
+    r.blksize = h->blksize;
+    r.windowsize = h->windowsize;
+    r.next_block = h->next_block;
+    r.acked = h->acked;
+    r.last_block = h->last_block;
+    r.flags = h->flags;
+    r.rtt_block = h->rtt_block;
+    r.deadline = h->deadline;
+    r.size = h->size;
+    r.rtt_sent = h->rtt_sent;
+    r.start = c->start;
+    r.bytes = c->bytes;
+    r.offset = c->offset;
+    r.total = c->total;
+    if (c->na)
+    {
+        const struct netascii_pos *p = na_at(h, c, h->acked + 1);
+        r.na_src = p->src;
+        r.na_pend = p->pend;
+    }
+    if (c->zs)
+    {
+        r.lz = 1;
+        r.lz_src = c->zs->sbase;
+        r.lz_base = c->zs->base;
+    }
+    r.retransmits = c->retransmits;
+    r.duplicates = c->duplicates;
+    r.drops = c->drops;
+    r.offcrc = c->offcrc;
+    r.sum = c->sum;
+    memcpy(r.sum_at, c->sum_at.tail, sizeof(r.sum_at));
+    r.rtt = c->rtt;
+    r.rxq = c->rxq;
+
+    if (r.pool < 0 && h->sock >= 0)
+        batch_fd(b, &r, HO_FD_SOCK, h->sock, 0);
+    if (h->fd >= 0)
+        batch_fd(b, &r, HO_FD_FILE, h->fd, 0);
+    if (c->obj)
+    {
+        int m = obj_memfd(c->obj);
+        if (m < 0)
+            return -1;
+        batch_fd(b, &r, HO_FD_OBJ, m, 1);
+    }
+    uint8_t *blob = NULL;
+    size_t blob_len = 0;
+    if (h->state == SESS_WRQ && c->dd.wr)
+    {
+        if ((blob = dedup_writer_save(c->dd.wr, &blob_len)) == NULL)
+            return -1;
+        r.dd = HO_DD_WRITER;
+        batch_fd(b, &r, HO_FD_DEDUP, dedup_writer_fd(c->dd.wr), 0);
+    }
+    else if (h->state == SESS_RRQ && c->dd.rd)
+    {
+        if ((blob = dedup_reader_save(c->dd.rd, &blob_len)) == NULL)
+            return -1;
+        r.dd = HO_DD_READER;
+    }
+    int ret = handoff_sess_put(&b->buf, &r, c->filename, blob, blob_len);
+    free(blob);
+    return ret;
+}
+
+// sockets du pool à passer : les nôtres, plus les héritées encore utilisées
+// (sinon elles s'accumuleraient de redémarrage en redémarrage)
+static uint32_t pool_in_use(const struct worker *w)
+{
+    uint32_t keep = w->nassign;
+    for (uint32_t idx = 0; idx < w->sessions.high; idx++)
+    {
+        const struct tftp_sess_hot *h = &w->sessions.hot[idx];
+        if (h->state == SESS_FREE || !(h->flags & SESS_F_POOLSOCK))
+            continue;
+        for (uint32_t k = keep; k < w->npool; k++)
+        {
+            if (w->pool[k] == h->sock)
+                keep = k + 1;
+        }
+    }
+    return keep;
+}
+
+// état des workers (arrêtés) vers le nouveau processus ; 0 une fois acquitté :
+// les sessions lui appartiennent, -1 sinon (rien n'a changé ici)
+static int handoff_export(struct worker *workers, uint32_t n, int sock, uint32_t *sessions)
+{
+    if (n > HANDOFF_MAX_FDS)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    struct handoff_hello hello;
+    memset(&hello, 0, sizeof(hello));
+    hello.rec_size = sizeof(struct handoff_sess);
+    hello.workers = n;
+    hello.port = workers[0].cfg->port;
+    if (handoff_send(sock, HO_HELLO, &hello, sizeof(hello), NULL, 0) < 0)
+        return -1;
+
+    int lfd[HANDOFF_MAX_FDS];
+    for (uint32_t i = 0; i < n; i++)
+        lfd[i] = workers[i].sock69;
+    if (handoff_send(sock, HO_LISTEN, NULL, 0, lfd, n) < 0)
+        return -1;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t keep = pool_in_use(&workers[i]);
+        for (uint32_t first = 0; first < keep; first += HANDOFF_MAX_FDS)
+        {
+            struct handoff_pool p = {i, first};
+            uint32_t cnt = keep - first;
+            if (cnt > HANDOFF_MAX_FDS)
+                cnt = HANDOFF_MAX_FDS;
+            if (handoff_send(sock, HO_POOL, &p, sizeof(p), workers[i].pool + first, cnt) < 0)
+                return -1;
+        }
+    }
+
+    struct sess_batch *b = calloc(1, sizeof(*b));
+    if (!b)
+        return -1;
+    int r = 0;
+    *sessions = 0;
+    for (uint32_t i = 0; r == 0 && i < n; i++)
+    {
+        const struct tftp_sess_table *t = &workers[i].sessions;
+        for (uint32_t idx = 0; r == 0 && idx < t->high; idx++)
+        {
+            if (t->hot[idx].state == SESS_FREE)
+                continue;
+            r = export_session(sock, b, &workers[i], idx);
+            (*sessions)++;
+        }
+    }
+    if (batch_flush(sock, b, r == 0) < 0)
+        r = -1;
+    handoff_buf_free(&b->buf);
+    free(b);
+
+    struct handoff_frame f;
+    if (r < 0 || handoff_send(sock, HO_END, NULL, 0, NULL, 0) < 0 || handoff_recv(sock, &f) < 0)
+        return -1;
+    r = f.type == HO_ACK ? 0 : -1;
+    handoff_frame_free(&f);
+    if (r < 0)
+        errno = EPROTO;
+    return r;
+}
+
+static void inherit_free(struct inherit *in)
+{
+    for (uint32_t k = 0; k < in->workers; k++)
+    {
+        if (in->listen && in->listen[k] >= 0)
+            close(in->listen[k]);
+        for (uint32_t j = 0; in->pool && j < in->npool[k]; j++)
+        {
+            if (in->pool[k][j] >= 0)
+                close(in->pool[k][j]);
+        }
+        if (in->pool)
+            free(in->pool[k]);
+    }
+    for (size_t i = 0; i < in->nframes; i++)
+        handoff_frame_free(&in->frames[i]);
+    free(in->listen);
+    free(in->pool);
+    free(in->npool);
+    free(in->pool_base);
+    free(in->frames);
+    memset(in, 0, sizeof(*in));
+}
+
+// état du serveur en marche (connexion sock) jusqu'à END ; -1 si
+// incompatible ou coupé (il reprend alors son service)
+static int inherit_recv(int sock, const struct tftp_server_config *cfg, struct inherit *in)
+{
+    struct handoff_frame f;
+    struct handoff_hello hello;
+    memset(in, 0, sizeof(*in));
+    if (handoff_recv(sock, &f) < 0)
+        return -1;
+    int ok = f.type == HO_HELLO && f.len == sizeof(hello);
+    if (ok)
+        memcpy(&hello, f.data, sizeof(hello));
+    handoff_frame_free(&f);
+    if (!ok || hello.rec_size != sizeof(struct handoff_sess) || hello.port != cfg->port ||
+        hello.workers == 0 || hello.workers > HANDOFF_MAX_FDS)
+    {
+        fprintf(stderr, "Erreur: serveur en marche incompatible (autre version ou autre port)\n");
+        errno = EPROTO;
+        return -1;
+    }
+
+    uint32_t n = hello.workers;
+    in->workers = n;
+    in->listen = malloc(n * sizeof(int));
+    in->pool = calloc(n, sizeof(int *));
+    in->npool = calloc(n, sizeof(uint32_t));
+    in->pool_base = calloc(n, sizeof(uint32_t));
+    if (!in->listen || !in->pool || !in->npool || !in->pool_base)
+    {
+        inherit_free(in);
+        return -1;
+    }
+    for (uint32_t k = 0; k < n; k++)
+        in->listen[k] = -1;
+
+    for (;;)
+    {
+        if (handoff_recv(sock, &f) < 0)
+        {
+            inherit_free(in);
+            return -1;
+        }
+        if (f.type == HO_END)
+        {
+            handoff_frame_free(&f);
+            return 0;
+        }
+        if (f.type == HO_SESS)
+        {
+            struct handoff_frame *nf = realloc(in->frames, (in->nframes + 1) * sizeof(*nf));
+            if (!nf)
+                break;
+            in->frames = nf;
+            in->frames[in->nframes++] = f; // fd gardés jusqu'à inherit_sessions
+            continue;
+        }
+
+        struct handoff_pool p;
+        if (f.type == HO_LISTEN && f.nfds == n)
+        {
+            for (uint32_t k = 0; k < n; k++)
+            {
+                in->listen[k] = f.fds[k];
+                f.fds[k] = -1;
+            }
+        }
+        else if (f.type == HO_POOL && f.len == sizeof(p))
+        {
+            memcpy(&p, f.data, sizeof(p));
+            if (p.worker >= n || p.first != in->npool[p.worker])
+                break;
+            int *np = realloc(in->pool[p.worker], (in->npool[p.worker] + f.nfds) * sizeof(int));
+            if (!np)
+                break;
+            in->pool[p.worker] = np;
+            for (size_t j = 0; j < f.nfds; j++)
+            {
+                np[in->npool[p.worker]++] = f.fds[j];
+                f.fds[j] = -1;
+            }
+        }
+        else
+            break;
+        handoff_frame_free(&f);
+    }
+    handoff_frame_free(&f);
+    inherit_free(in);
+    errno = EPROTO;
+    return -1;
+}
+
+// une session reçue, rattachée à w ; fds dans l'ordre HO_FD_* (-1 : absent) ;
+// RRQ netascii repris : anneau reconstruit depuis le début du bloc acked + 1,
+// blocs déjà envoyés de la fenêtre ré-encodés pour retrouver leur début
+static int rrq_netascii_import(struct tftp_sess_hot *h, struct tftp_sess_cold *c, const struct handoff_sess *r)
+{
+    uint8_t scratch[MAX_BLKSIZE];
+    if ((c->na = calloc(h->windowsize + 2u, sizeof(*c->na))) == NULL)
+        return -1;
+    na_at(h, c, h->acked + 1)->src = r->na_src;
+    na_at(h, c, h->acked + 1)->pend = r->na_pend;
+    for (uint32_t b = h->acked + 1; b < h->next_block; b++)
+    {
+        if (rrq_read_netascii(h, c, b, scratch) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+// -1 si elle ne peut être reprise (table pleine, store -D absent, état
+// invalide) : abandonnée, le client relancera le transfert
+static int session_import(struct worker *w, const struct inherit *in, const struct handoff_sess *r,
+                          const char *name, const uint8_t *blob, int fds[4])
+{
+    struct tftp_dedup *d = w->cfg->dedup;
+    struct tftp_memobj *obj = NULL;
+    struct dedup_reader *rd = NULL;
+    struct dedup_writer *wr = NULL;
+
+    int sock = fds[0];
+    if (r->pool >= 0 && r->worker < in->workers && (uint32_t)r->pool < in->npool[r->worker])
+        sock = w->pool[in->pool_base[r->worker] + (uint32_t)r->pool];
+    if (sock < 0 || (r->state != SESS_RRQ && r->state != SESS_WRQ))
+        goto drop;
+    if (fds[2] >= 0)
+    {
+        obj = memfd_obj(name, fds[2]);
+        close(fds[2]);
+        fds[2] = -1;
+        if (!obj)
+            goto drop;
+    }
+    if (r->dd == HO_DD_READER && (!d || (rd = dedup_reader_load(d, blob, r->blob_len)) == NULL))
+        goto drop;
+    if (r->dd == HO_DD_WRITER)
+    {
+        // sans -D ici : chargé quand même pour supprimer son manifeste en cours
+        if (fds[3] < 0 || (wr = dedup_writer_load(d, blob, r->blob_len, fds[3])) == NULL)
+            goto drop;
+        fds[3] = -1;
+        if (!d)
+            goto drop;
+    }
+
+    struct sockaddr_in peer;
+    memset(&peer, 0, sizeof(peer));
+    peer.sin_family = AF_INET;
+    peer.sin_addr.s_addr = r->peer_addr;
+    peer.sin_port = r->peer_port;
+    char *fname = strdup(name);
+    int idx = -1;
+    if (!fname || sess_lookup(&w->sessions, r->peer_addr, r->peer_port) >= 0 ||
+        (idx = sess_alloc(&w->sessions, &peer)) < 0)
+    {
+        free(fname);
+        goto drop;
+    }
+
+    struct tftp_sess_hot *h = &w->sessions.hot[idx];
+    struct tftp_sess_cold *c = &w->sessions.cold[idx];
+    h->state = r->state;
+    h->retries = r->retries;
+    h->sock = sock;
+    h->fd = fds[1];
+    h->blksize = r->blksize;
+    h->windowsize = r->windowsize;
+    h->next_block = r->next_block;
+    h->acked = r->acked;
+    h->last_block = r->last_block;
+    h->deadline = r->deadline;
+    h->size = r->size;
+    h->flags = r->pool >= 0 ? (r->flags | SESS_F_POOLSOCK) : (r->flags & ~SESS_F_POOLSOCK);
+    h->rtt_block = r->rtt_block;
+    h->rtt_sent = r->rtt_sent;
+    // -R selon ce processus : DATA datés si sa socket l'accepte, fenêtre en
+    // cours reprise au premier tour de la boucle
+    h->flags &= ~SESS_F_TXTIME;
+    if (h->state == SESS_RRQ && w->cfg->pace_rate && !(h->flags & SESS_F_OACK))
+    {
+        if (w->txtime && !pace_loopback(h->peer_addr) && (r->pool >= 0 || pace_txtime_enable(sock) == 0))
+            h->flags |= SESS_F_TXTIME;
+        uint64_t now = now_ns();
+        if (pace_queue_push(&w->paced, now, sess_tag(sock, (uint32_t)idx)) == 0)
+            c->pace_wake = now;
+    }
+    c->filename = fname;
+    c->obj = obj;
+    c->start = r->start;
+    c->bytes = r->bytes;
+    c->retransmits = r->retransmits;
+    c->duplicates = r->duplicates;
+    c->drops = r->drops;
+    c->offcrc = r->offcrc;
+    c->offset = r->offset;
+    c->total = r->total;
+    c->sum = r->sum;
+    memcpy(c->sum_at.tail, r->sum_at, sizeof(r->sum_at));
+    c->rtt = r->rtt;
+    c->rxq = r->rxq;
+    if (rd)
+        c->dd.rd = rd;
+    else
+        c->dd.wr = wr;
+    metric_add(w->metrics, M_SESSIONS_STARTED, 1);
+    if (h->state == SESS_RRQ && (((h->flags & SESS_F_NETASCII) && rrq_netascii_import(h, c, r) < 0) ||
+                                 (r->lz && (c->zs = zcache_stream_at(r->total, r->lz_src, r->lz_base)) == NULL)))
+    {
+        session_end(w, (uint32_t)idx, XFER_LOCAL_ERROR);
+        return -1;
+    }
+
+    if (r->pool < 0)
+    {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = sess_tag(sock, (uint32_t)idx);
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, sock, &ev) < 0)
+        {
+            LOG_ERR("epoll_ctl: %s", strerror(errno));
+            session_end(w, (uint32_t)idx, XFER_LOCAL_ERROR);
+            return -1;
+        }
+    }
+    if (h->deadline < w->next_scan)
+        w->next_scan = h->deadline;
+    return 0;
+
+drop:
+    for (int k = 0; k < 4; k++)
+    {
+        if (fds[k] >= 0)
+            close(fds[k]);
+    }
+    memobj_release(obj);
+    dedup_close(rd);
+    dedup_abort(wr);
+    LOG_WRN("handoff: session %s dropped", name);
+    return -1;
+}
+
+// sessions des trames SESS reçues, ancien worker k -> worker k % n
+static void inherit_sessions(struct worker *workers, uint32_t n, struct inherit *in, uint32_t *taken,
+                             uint32_t *dropped)
+{
+    for (size_t i = 0; i < in->nframes; i++)
+    {
+        struct handoff_frame *f = &in->frames[i];
+        size_t pos = 0, next_fd = 0;
+        struct handoff_sess r;
+        const char *name;
+        const uint8_t *blob;
+        int rc;
+        while ((rc = handoff_sess_next(f, &pos, &r, &name, &blob)) > 0)
+        {
+            int fds[4] = {-1, -1, -1, -1}; // HO_FD_SOCK, FILE, OBJ, DEDUP
+            for (int k = 0; k < 4 && rc > 0; k++)
+            {
+                if (!(r.fds & (1u << k)))
+                    continue;
+                if (next_fd >= f->nfds)
+                    rc = -1;
+                else
+                {
+                    fds[k] = f->fds[next_fd];
+                    f->fds[next_fd++] = -1;
+                }
+            }
+            if (rc < 0)
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    if (fds[k] >= 0)
+                        close(fds[k]);
+                }
+                (*dropped)++;
+                break;
+            }
+            if (session_import(&workers[r.worker % n], in, &r, name, blob, fds) == 0)
+                (*taken)++;
+            else
+                (*dropped)++;
+        }
+        if (rc < 0)
+            LOG_ERR("handoff: invalid session frame", NULL);
+    }
+}
+
+static void *worker_loop(void *arg)
+{
+    struct worker *w = arg;
+    struct epoll_event evs[MAX_EVENTS];
+
+    if (w->cpu >= 0 && affinity_pin(w->cpu) < 0)
+        LOG_WRN("cpu pinning: %s", strerror(errno));
+    tm = w->metrics;
+    tt = w->trace;
+    tx_stamps = w->cfg->tx_timestamps && w->rx_stamps;
+    nsyscalls = 0;
+    while (!stop_requested && !__atomic_load_n(&handoff_requested, __ATOMIC_RELAXED))
+    {
+        uint64_t now = now_ns();
+        int timeout = STOP_POLL_MS;
+        if (w->next_scan != UINT64_MAX && w->next_scan < now + (uint64_t)STOP_POLL_MS * 1000000ULL)
+            timeout = w->next_scan <= now ? 0 : (int)((w->next_scan - now) / 1000000ULL) + 1;
+        int held = net_flush(); // datagrammes retardés par netsim
+        if (held >= 0 && held < timeout)
+            timeout = held;
+
+        // réveil de pacing (-R) avant les autres échéances : à la microseconde
+        uint64_t paced = pace_queue_next(&w->paced);
+        int n;
+        if (paced < now + (uint64_t)timeout * 1000000ULL && w->pwait2)
+        {
+            struct timespec ts = {0, paced > now ? (long)(paced - now) : 0};
+            n = SYS(epoll_pwait2(w->epfd, evs, MAX_EVENTS, &ts, NULL));
+            if (n < 0 && errno == ENOSYS)
+            {
+                w->pwait2 = 0; // noyau antérieur à 5.11 : réveils à la ms
+                continue;
+            }
+        }
+        else
+        {
+            if (paced < now + (uint64_t)timeout * 1000000ULL)
+                timeout = paced > now ? (int)((paced - now + 999999) / 1000000ULL) : 0;
+            n = SYS(epoll_wait(w->epfd, evs, MAX_EVENTS, timeout));
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERR("epoll_wait: %s", strerror(errno));
+            break;
+        }
+
+        now = now_ns();
+        for (int i = 0; i < n; i++)
+        {
+            uint64_t tag = evs[i].data.u64;
+            if (tag == LISTEN_TAG)
+            {
+                listen_readable(w, now);
+                continue;
+            }
+            if (tag == HANDOFF_TAG)
+            {
+                handoff_accept();
+                continue;
+            }
+            if (tag == WAKE_TAG)
+                continue; // arrêt pour passation : condition de la boucle
+            if ((tag >> 32) == POOL_TAG_HI)
+            {
+                pool_readable(w, (uint32_t)tag, now);
+                continue;
+            }
+
+            uint32_t idx = (uint32_t)tag;
+            const struct tftp_sess_hot *h = &w->sessions.hot[idx];
+            if (h->state == SESS_FREE || tag != sess_tag(h->sock, idx))
+                continue; // événement d'une session déjà terminée
+            session_readable(w, idx, evs[i].events, now);
+        }
+
+        if (w->paced.n)
+            pace_run(w, now_ns());
+        if (now >= w->next_scan)
+            scan_timeouts(w, now);
+    }
+    w->syscalls += nsyscalls; // boucle relancée après une passation ratée
+    return NULL;
+}
+
+static void on_stop_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+/* ---------------------------- Public API ---------------------------- */
+int tftp_server_run_config(const struct tftp_server_config *cfg)
+{
+    if (cfg->workers == 0 || cfg->max_sessions < cfg->workers)
+    {
+        fprintf(stderr, "Erreur: configuration invalide (workers=%u, max_sessions=%u)\n",
+                cfg->workers, cfg->max_sessions);
+        return -1;
+    }
+    if (cfg->preload_path && !cfg->objects)
+    {
+        fprintf(stderr, "Erreur: préchargement sans objets en mémoire (cfg->objects)\n");
+        return -1;
+    }
+    uint64_t t_start = now_ns();
+    int cpus[AFFINITY_MAX_CPUS];
+    int ncpus = 0;
+    if (cfg->cpus && (ncpus = affinity_parse(cfg->cpus, cpus, AFFINITY_MAX_CPUS)) < 0)
+    {
+        fprintf(stderr, "Erreur: liste de CPU invalide '%s'\n", cfg->cpus);
+        return -1;
+    }
+
+    struct worker *workers = calloc(cfg->workers, sizeof(struct worker));
+    struct tftp_metrics *metrics = metrics_alloc(cfg->workers);
+    struct tftp_trace *traces = NULL;
+    if (workers && metrics && cfg->trace_path)
+    {
+        traces = calloc(cfg->workers, sizeof(struct tftp_trace));
+        for (uint32_t i = 0; traces && i < cfg->workers; i++)
+        {
+            if (trace_init(&traces[i], TRACE_DEFAULT_EVENTS, cfg->trace_every ? cfg->trace_every : 1) < 0)
+            {
+                fprintf(stderr, "Erreur: allocation des traces\n");
+                while (i-- > 0)
+                    trace_free(&traces[i]);
+                free(traces);
+                traces = NULL;
+            }
+        }
+    }
+    int acct_fd = -1;
+    if (workers && metrics && cfg->acct_path)
+        acct_fd = acct_open(cfg->acct_path);
+    if (!workers || !metrics || (cfg->trace_path && !traces) || (cfg->acct_path && acct_fd < 0))
+    {
+        if (traces)
+        {
+            for (uint32_t i = 0; i < cfg->workers; i++)
+                trace_free(&traces[i]);
+            free(traces);
+        }
+        free(workers);
+        metrics_free(metrics);
+        return -1;
+    }
+    tm = &metrics[0]; // thread principal = worker 0 (et nettoyage final)
+
+    // SIGINT/SIGTERM : arrêt propre (sans SA_RESTART pour interrompre epoll_wait)
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int ret = 0;
+    struct inherit in;
+    memset(&in, 0, sizeof(in));
+    int prev = -1; // connexion au serveur remplacé (-U)
+    // préchargement avant la reprise : l'ancien processus sert pendant ce temps
+    struct tftp_preload *preload = NULL;
+    if (cfg->preload_path)
+    {
+        preload = preload_start(cfg->preload_path, cfg->root_dir, cfg->objects, cfg->dedup,
+                                cfg->preload_threads, cfg->preload_lock);
+        if (!preload)
+            ret = -1;
+        else if (!cfg->preload_background)
+        {
+            preload_finish(preload, 0, NULL); // requêtes servies une fois tout chargé
+            preload = NULL;
+        }
+    }
+    if (ret == 0 && cfg->handoff_path)
+    {
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd < 0)
+        {
+            perror("eventfd");
+            ret = -1;
+        }
+        else if ((prev = handoff_connect(cfg->handoff_path)) >= 0 && inherit_recv(prev, cfg, &in) < 0)
+        {
+            perror("handoff");
+            ret = -1;
+        }
+    }
+    // mémoire de chaque worker allouée depuis son CPU (nœud NUMA local), puis
+    // thread principal rendu à son masque d'origine (threads lancés ensuite)
+    struct affinity_mask main_mask;
+    if (ncpus && affinity_get(&main_mask) < 0)
+        ncpus = 0;
+    for (uint32_t i = 0; i < cfg->workers; i++)
+    {
+        struct worker *w = &workers[i];
+        w->cpu = ncpus ? cpus[i % (uint32_t)ncpus] : -1;
+        if (ret == 0 && w->cpu >= 0 && affinity_pin(w->cpu) < 0)
+        {
+            fprintf(stderr, "Erreur: CPU %d: %s\n", w->cpu, strerror(errno));
+            ret = -1;
+        }
+        w->cfg = cfg;
+        w->id = i;
+        w->root_dir = cfg->root_dir;
+        w->next_scan = UINT64_MAX;
+        w->sock69 = -1;
+        w->epfd = -1;
+        w->metrics = &metrics[i];
+        w->trace = traces ? &traces[i] : NULL;
+        w->acct_fd = acct_fd;
+        if (ret == 0 && worker_setup(w, prev >= 0 ? &in : NULL) < 0)
+            ret = -1;
+    }
+    if (ncpus)
+        affinity_set(&main_mask);
+
+    // reprise : sessions installées, puis acquittement ; l'ancien processus
+    // libère son exporteur de métriques et ferme la connexion avant de partir
+    uint32_t taken = 0, dropped = 0;
+    int forget = 0; // sessions à ne pas terminer ici (rendues à l'ancien processus)
+    if (ret == 0 && prev >= 0)
+    {
+        inherit_sessions(workers, cfg->workers, &in, &taken, &dropped);
+        struct handoff_frame f;
+        if (handoff_send(prev, HO_ACK, NULL, 0, NULL, 0) < 0)
+        {
+            perror("handoff");
+            ret = -1;
+            forget = 1;
+        }
+        else if (handoff_recv(prev, &f) == 0)
+            handoff_frame_free(&f);
+    }
+    inherit_free(&in);
+    if (prev >= 0)
+        close(prev);
+    if (ret == 0 && cfg->handoff_path)
+    {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = HANDOFF_TAG;
+        handoff_lfd = handoff_listen(cfg->handoff_path);
+        if (handoff_lfd < 0 || epoll_ctl(workers[0].epfd, EPOLL_CTL_ADD, handoff_lfd, &ev) < 0)
+        {
+            perror(cfg->handoff_path);
+            if (prev < 0)
+                ret = -1; // sessions reprises : on continue, sans passation possible
+        }
+    }
+    if (ret == 0 && cfg->metrics_port && metrics_server_start(cfg->metrics_port, metrics, cfg->workers) < 0)
+        ret = -1;
+
+    int handed_off = 0;
+    uint32_t handed = 0;
+    if (ret == 0)
+    {
+        if (cfg->metrics_port)
+            printf("metrics: http://127.0.0.1:%u/metrics\n", (unsigned)cfg->metrics_port);
+        printf("TFTP server listening on UDP %u, root_dir=%s, max_sessions=%u, workers=%u, %s\n",
+               (unsigned)cfg->port, cfg->root_dir, cfg->max_sessions, cfg->workers,
+               cfg->pool_sockets ? "pooled TID sockets" : "one TID socket per session");
+        if (prev >= 0)
+            printf("handoff: %u sessions taken over, %u dropped\n", taken, dropped);
+        printf("socket buffers: request queue %d KB per worker, TID default rcv %d KB snd %d KB\n",
+               workers[0].listen_buf / 1024, workers[0].def_rcvbuf / 1024, workers[0].def_sndbuf / 1024);
+        if (cfg->pace_rate)
+            printf("pacing: %.1f Mbit/s per RRQ, %s\n", (double)cfg->pace_rate * 8 / 1e6,
+                   workers[0].txtime ? "kernel (SO_TXTIME + fq), timer for loopback peers" : "user-space timer");
+        printf("rtt: %s\n", !workers[0].rx_stamps ? "user-space clock (SO_TIMESTAMPING refused)"
+                            : cfg->tx_timestamps  ? "kernel timestamps, rx and tx"
+                                                  : "kernel rx timestamps");
+        if (ncpus)
+        {
+            printf("affinity: worker -> cpu (node)");
+            for (uint32_t i = 0; i < cfg->workers; i++)
+                printf(" %u->%d (%d)", i, workers[i].cpu, affinity_node(workers[i].cpu));
+            printf("%s\n", cfg->busy_poll_us ? ", busy poll" : "");
+        }
+        if (cfg->preload_path)
+            printf("ready: %.1f ms after start%s\n", (now_ns() - t_start) / 1e6,
+                   preload && !preload_done(preload) ? ", preload continues in background" : "");
+        fflush(stdout);
+        log_start(); // échec : le journal reste synchrone
+
+        for (;;)
+        {
+            // le worker 0 tourne dans le thread appelant
+            uint32_t started = 1;
+            for (; started < cfg->workers; started++)
+            {
+                if (pthread_create(&workers[started].thread, NULL, worker_loop, &workers[started]) != 0)
+                {
+                    fprintf(stderr, "Erreur: pthread_create\n");
+                    break;
+                }
+            }
+            worker_loop(&workers[0]);
+            if (ncpus)
+                affinity_set(&main_mask); // le thread appelant n'est plus le worker 0
+            if (!__atomic_load_n(&handoff_requested, __ATOMIC_RELAXED))
+                stop_requested = 1; // worker 0 sorti sur erreur : on arrête les autres
+            for (uint32_t i = 1; i < started; i++)
+                pthread_join(workers[i].thread, NULL);
+            if (stop_requested || handoff_conn < 0)
+                break;
+
+            if (handoff_export(workers, cfg->workers, handoff_conn, &handed) == 0)
+            {
+                handed_off = 1;
+                break;
+            }
+            // nouveau processus parti ou incompatible : on reprend le service
+            LOG_ERR("handoff failed: %s, resuming", strerror(errno));
+            close(handoff_conn);
+            handoff_conn = -1;
+            uint64_t v;
+            if (read(wake_fd, &v, sizeof(v)) < 0)
+                LOG_ERR("eventfd: %s", strerror(errno));
+            __atomic_store_n(&handoff_requested, 0, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (preload)
+        preload_finish(preload, 1, NULL); // arrêt avant la fin : fichiers restants abandonnés
+    metrics_server_stop();
+    if (handoff_conn >= 0)
+        close(handoff_conn); // le nouveau processus peut ouvrir ses métriques
+    handoff_conn = -1;
+    log_stop();
+
+    uint64_t transfers = 0, bytes = 0, syscalls = 0, requests = 0, cross_cpu = 0, drops_req = 0, drops_tid = 0;
+    for (uint32_t i = 0; i < cfg->workers; i++)
+    {
+        worker_cleanup(&workers[i], handed_off || forget);
+        drops_req += metrics[i].c[M_DROPS_REQUEST];
+        drops_tid += metrics[i].c[M_DROPS_TID];
+        transfers += workers[i].transfers;
+        bytes += workers[i].bytes;
+        syscalls += workers[i].syscalls;
+        requests += workers[i].requests;
+        cross_cpu += workers[i].cross_cpu;
+        if (i > 0)
+            preload_hot_merge(&workers[0].hot, &workers[i].hot);
+    }
+    if (ret == 0)
+        printf("TFTP server %s: transfers=%llu bytes=%llu syscalls=%llu\n",
+               handed_off ? "handed off" : "stopped", (unsigned long long)transfers,
+               (unsigned long long)bytes, (unsigned long long)syscalls);
+    if (handed_off)
+        printf("handoff: %u sessions passed to the new process\n", handed);
+    if (ret == 0 && (drops_req || drops_tid))
+        printf("socket drops: request=%llu tid=%llu (receive queue full)\n", (unsigned long long)drops_req,
+               (unsigned long long)drops_tid);
+    if (ret == 0 && ncpus)
+        printf("affinity: %llu of %llu requests received on another CPU\n", (unsigned long long)cross_cpu,
+               (unsigned long long)requests);
+    if (ret == 0 && cfg->hot_path && workers[0].hot.count) // sans RRQ : liste précédente gardée
+    {
+        int n = preload_hot_write(cfg->hot_path, &workers[0].hot, PRELOAD_HOT_MAX);
+        if (n >= 0)
+            printf("hot list: %d names written to %s\n", n, cfg->hot_path);
+    }
+    for (uint32_t i = 0; i < cfg->workers; i++)
+        preload_hot_free(&workers[i].hot);
+    if (handoff_lfd >= 0)
+    {
+        close(handoff_lfd);
+        if (!handed_off) // sinon le chemin est au nouveau processus
+            unlink(cfg->handoff_path);
+    }
+    handoff_lfd = -1;
+    if (wake_fd >= 0)
+        close(wake_fd);
+    wake_fd = -1;
+    __atomic_store_n(&handoff_requested, 0, __ATOMIC_RELAXED);
+    if (traces)
+    {
+        if (trace_write_json(cfg->trace_path, traces, cfg->workers) == 0 && ret == 0)
+            printf("trace: %s\n", cfg->trace_path);
+        for (uint32_t i = 0; i < cfg->workers; i++)
+            trace_free(&traces[i]);
+        free(traces);
+    }
+    if (acct_fd >= 0)
+        close(acct_fd);
+    free(workers);
+    metrics_free(metrics);
+    tm = NULL;
+    tt = NULL;
+    return ret;
+}
+
+int tftp_server_run(uint16_t server_port, const char *root_dir)
+{
+    struct tftp_server_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.port = server_port;
+    cfg.root_dir = root_dir;
+    cfg.max_sessions = DEFAULT_MAX_SESSIONS;
+    cfg.workers = 1;
+    return tftp_server_run_config(&cfg);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-n max_sessions] [-j workers] [-s pool_sockets] [-M metrics_port] [-N netsim] [-L level]\n"
+            "          [-T trace.json [-t N]] [-A accounting.log] [-m name=file]...\n"
+            "          [-G pattern=template]... [-I inventory] [-z cache_mb] [-D] [-U socket]\n"
+            "          [-P manifest [-W threads] [-K] [-B]] [-H hotlist]\n"
+            "          [-c cpus] [-b busy_poll_us] [-X] [-R rate] PORT [root_dir]\n"
+            "  -n N  transferts simultanés max (défaut %u)\n"
+            "  -j N  nombre de workers (threads, SO_REUSEPORT)\n"
+            "  -s N  N sockets TID pré-liées par worker, partagées entre sessions\n"
+            "        (0 = une socket éphémère par session, défaut)\n"
+            "  -M P  métriques Prometheus sur http://127.0.0.1:P/metrics\n"
+            "  -N S  simulation de pertes / délais, ex. loss=0.01,delay=5ms (voir netsim.h)\n"
+            "  -L L  niveau du journal : error, warn, info (défaut), debug\n"
+            "  -T F  traces par transfert (Chrome trace-event JSON) écrites dans F à l'arrêt\n"
+            "  -t N  une session tracée sur N (défaut 1 : toutes)\n"
+            "  -A F  bilan de chaque transfert ajouté à F (une ligne clé=valeur)\n"
+            "  -m N=F  sert le contenu de F sous le nom N depuis la mémoire (répétable)\n"
+            "  -G P=F  noms couverts par le motif P (un '*') rendus depuis le gabarit F\n"
+            "          avec les variables du client (répétable, voir vfile.h)\n"
+            "  -I F  inventaire des clients pour -G (clé var=valeur ...)\n"
+            "  -z M  Mo de variantes compressées gardées pour les RRQ compressés\n"
+            "        (défaut %u, 0 = trames compressées à chaque requête)\n"
+            "  -D    WRQ dédupliqués : morceaux rangés une fois sous root_dir/.dedup,\n"
+            "        fichiers déposés écrits en manifestes (voir dedup.h)\n"
+            "  -U S  redémarrage sans coupure : écoute sur la socket Unix S ; lancé\n"
+            "        alors qu'un serveur y écoute, reprend ses sockets et ses transferts\n"
+            "        en cours, puis l'arrête (voir handoff.h)\n"
+            "  -P F  fichiers listés dans F (un nom par ligne) chargés en mémoire au\n"
+            "        démarrage, avant de servir (voir preload.h)\n"
+            "  -W N  threads du préchargement (défaut %u)\n"
+            "  -K    contenus préchargés verrouillés en RAM (mlock)\n"
+            "  -B    requêtes servies dès le démarrage, préchargement en arrière-plan\n"
+            "  -H F  noms les plus demandés écrits dans F à l'arrêt (manifeste pour -P)\n"
+            "  -c L  worker i épinglé au i-ème CPU de L (\"auto\" ou liste, ex. 0-3,8),\n"
+            "        requêtes dirigées vers le worker du CPU qui les reçoit (voir affinity.h)\n"
+            "  -b US attente active de US microsecondes (SO_BUSY_POLL, epoll)\n"
+            "  -X    aller-retours datés aussi à l'émission par le noyau (SO_TIMESTAMPING ;\n"
+            "        réception toujours datée) : un appel système de plus par mesure\n"
+            "  -R R  DATA des RRQ espacés à R bits/s par transfert (ex. 200m, 1g) :\n"
+            "        SO_TXTIME si fq est la qdisc par défaut, minuterie sinon (voir pace.h)\n",
+            prog, DEFAULT_MAX_SESSIONS, ZCACHE_DEFAULT_MB, PRELOAD_DEFAULT_THREADS);
+}
+
+int main(int argc, char **argv)
+{
+    struct tftp_server_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.root_dir = ".";
+    cfg.max_sessions = DEFAULT_MAX_SESSIONS;
+    cfg.workers = 1;
+
+    struct tftp_memstore objects;
+    int have_objects = 0;
+    struct tftp_vfile vfile;
+    int have_vfile = 0;
+    struct tftp_zcache zcache;
+    unsigned long zcache_mb = ZCACHE_DEFAULT_MB;
+    struct tftp_dedup dedup;
+    int use_dedup = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:j:s:M:N:L:T:t:A:m:G:I:z:DU:P:W:KBH:c:b:XR:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+        {
+            char *eq = strchr(optarg, '=');
+            if (!eq || eq == optarg || !eq[1])
+            {
+                fprintf(stderr, "Erreur: -m attend nom=fichier\n");
+                return 1;
+            }
+            *eq = 0;
+            if (!have_objects && memstore_init(&objects) < 0)
+            {
+                fprintf(stderr, "Erreur: allocation des objets en mémoire\n");
+                return 1;
+            }
+            have_objects = 1;
+            if (memstore_put_file(&objects, optarg, eq + 1) < 0)
+                return 1;
+            cfg.objects = &objects;
+            break;
+        }
+        case 'G':
+        {
+            char *eq = strchr(optarg, '=');
+            if (!eq || eq == optarg || !eq[1])
+            {
+                fprintf(stderr, "Erreur: -G attend motif=gabarit\n");
+                return 1;
+            }
+            *eq = 0;
+            if (!have_vfile && vfile_init(&vfile) < 0)
+            {
+                fprintf(stderr, "Erreur: allocation des fichiers virtuels\n");
+                return 1;
+            }
+            have_vfile = 1;
+            if (vfile_add_rule(&vfile, optarg, eq + 1) < 0)
+                return 1;
+            cfg.vfile = &vfile;
+            break;
+        }
+        case 'I':
+            if (!have_vfile && vfile_init(&vfile) < 0)
+            {
+                fprintf(stderr, "Erreur: allocation des fichiers virtuels\n");
+                return 1;
+            }
+            have_vfile = 1;
+            if (vfile_set_inventory(&vfile, optarg) < 0)
+                return 1;
+            break;
+        case 'z':
+            zcache_mb = strtoul(optarg, NULL, 10);
+            break;
+        case 'D':
+            use_dedup = 1;
+            break;
+        case 'U':
+            cfg.handoff_path = optarg;
+            break;
+        case 'P':
+            cfg.preload_path = optarg;
+            break;
+        case 'W':
+            cfg.preload_threads = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'K':
+            cfg.preload_lock = 1;
+            break;
+        case 'B':
+            cfg.preload_background = 1;
+            break;
+        case 'H':
+            cfg.hot_path = optarg;
+            break;
+        case 'c':
+            cfg.cpus = optarg;
+            break;
+        case 'b':
+            cfg.busy_poll_us = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'X':
+            cfg.tx_timestamps = 1;
+            break;
+        case 'R':
+            if (pace_parse_rate(optarg, &cfg.pace_rate) < 0)
+            {
+                fprintf(stderr, "Erreur: débit invalide '%s' (ex. 200m, 1g)\n", optarg);
+                return 1;
+            }
+            break;
+        case 'n':
+            cfg.max_sessions = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'j':
+            cfg.workers = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            cfg.pool_sockets = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'M':
+            cfg.metrics_port = (uint16_t)atoi(optarg);
+            break;
+        case 'N':
+            if (netsim_configure(optarg) < 0)
+                return 1;
+            break;
+        case 'A':
+            cfg.acct_path = optarg;
+            break;
+        case 'T':
+            cfg.trace_path = optarg;
+            break;
+        case 't':
+            cfg.trace_every = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'L':
+        {
+            int level = log_parse_level(optarg);
+            if (level < 0)
+            {
+                fprintf(stderr, "Erreur: niveau de journal inconnu '%s'\n", optarg);
+                return 1;
+            }
+            log_set_level(level);
+            break;
+        }
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    cfg.port = (uint16_t)atoi(argv[optind]);
+    if (optind + 1 < argc)
+        cfg.root_dir = argv[optind + 1];
+
+    if (zcache_mb)
+    {
+        if (zcache_init(&zcache, (size_t)zcache_mb << 20) < 0)
+        {
+            fprintf(stderr, "Erreur: allocation du cache de compression\n");
+            return 1;
+        }
+        cfg.zcache = &zcache;
+    }
+    if (use_dedup)
+    {
+        if (dedup_init(&dedup, cfg.root_dir) < 0)
+        {
+            perror("dedup store");
+            return 1;
+        }
+        cfg.dedup = &dedup;
+    }
+    if (cfg.preload_path && !have_objects)
+    {
+        if (memstore_init(&objects) < 0)
+        {
+            fprintf(stderr, "Erreur: allocation des objets en mémoire\n");
+            return 1;
+        }
+        have_objects = 1;
+        cfg.objects = &objects;
+    }
+
+    int ret = tftp_server_run_config(&cfg);
+    if (have_objects)
+        memstore_free(&objects);
+    if (cfg.zcache)
+    {
+        printf("compress: %llu compressed, %llu cache hits, %llu incompressible, %llu evicted\n",
+               (unsigned long long)zcache.compressed, (unsigned long long)zcache.hits,
+               (unsigned long long)zcache.skipped, (unsigned long long)zcache.evicted);
+        zcache_free(&zcache);
+    }
+    if (cfg.dedup)
+    {
+        printf("dedup: %llu files, %.1f MB received, %.1f MB stored (%llu new chunks, %llu duplicates)\n",
+               (unsigned long long)dedup.files, dedup.bytes_in / 1e6, dedup.bytes_stored / 1e6,
+               (unsigned long long)dedup.chunks_new, (unsigned long long)dedup.chunks_dup);
+        dedup_free(&dedup);
+    }
+    if (have_vfile)
+    {
+        printf("vfile: %llu renders, %llu cache hits\n", (unsigned long long)vfile.renders,
+               (unsigned long long)vfile.hits);
+        vfile_free(&vfile);
+    }
+    return ret;
+}
@@ -0,0 +1,141 @@
+#include "session.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* --------------- Hash (ip, port) --------------- */
+
+static uint32_t sess_hash(uint32_t addr, uint16_t port)
+{
+    // finaliseur de murmur3 sur la clé 48 bits
+    uint64_t k = ((uint64_t)addr << 16) | port;
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return (uint32_t)k;
+}
+
+int sess_table_init(struct tftp_sess_table *t, uint32_t capacity)
+{
+    memset(t, 0, sizeof(*t));
+    if (capacity == 0)
+        return -1;
+
+    // charge du hash <= 50 %
+    uint32_t nslots = 16;
+    while (nslots < 2 * capacity)
+        nslots <<= 1;
+
+    t->hot = aligned_alloc(64, (size_t)capacity * sizeof(struct tftp_sess_hot));
+    t->cold = calloc(capacity, sizeof(struct tftp_sess_cold));
+    t->free_stack = malloc((size_t)capacity * sizeof(uint32_t));
+    t->slots = calloc(nslots, sizeof(uint32_t));
+    if (!t->hot || !t->cold || !t->free_stack || !t->slots)
+    {
+        sess_table_free(t);
+        return -1;
+    }
+    memset(t->hot, 0, (size_t)capacity * sizeof(struct tftp_sess_hot));
+
+    // on empile à l'envers pour distribuer les petits index d'abord
+    for (uint32_t i = 0; i < capacity; i++)
+        t->free_stack[i] = capacity - 1 - i;
+    t->nfree = capacity;
+    t->capacity = capacity;
+    t->mask = nslots - 1;
+    return 0;
+}
+
+void sess_table_free(struct tftp_sess_table *t)
+{
+    if (t->cold)
+    {
+        for (uint32_t i = 0; i < t->high; i++)
+            free(t->cold[i].filename);
+    }
+    free(t->hot);
+    free(t->cold);
+    free(t->free_stack);
+    free(t->slots);
+    memset(t, 0, sizeof(*t));
+}
+
+int sess_lookup(const struct tftp_sess_table *t, uint32_t addr, uint16_t port)
+{
+    uint32_t i = sess_hash(addr, port) & t->mask;
+    for (;;)
+    {
+        uint32_t s = t->slots[i];
+        if (s == 0)
+            return -1;
+        const struct tftp_sess_hot *h = &t->hot[s - 1];
+        if (h->peer_addr == addr && h->peer_port == port)
+            return (int)(s - 1);
+        i = (i + 1) & t->mask;
+    }
+}
+
+int sess_alloc(struct tftp_sess_table *t, const struct sockaddr_in *peer)
+{
+    if (t->nfree == 0)
+        return -1;
+
+    uint32_t idx = t->free_stack[--t->nfree];
+    struct tftp_sess_hot *h = &t->hot[idx];
+    memset(h, 0, sizeof(*h));
+    memset(&t->cold[idx], 0, sizeof(t->cold[idx]));
+    h->peer_addr = peer->sin_addr.s_addr;
+    h->peer_port = peer->sin_port;
+    h->sock = -1;
+    h->fd = -1;
+
+    uint32_t i = sess_hash(h->peer_addr, h->peer_port) & t->mask;
+    while (t->slots[i] != 0)
+        i = (i + 1) & t->mask;
+    t->slots[i] = idx + 1;
+
+    t->count++;
+    if (idx + 1 > t->high)
+        t->high = idx + 1;
+    return (int)idx;
+}
+
+void sess_release(struct tftp_sess_table *t, uint32_t idx)
+{
+    struct tftp_sess_hot *h = &t->hot[idx];
+
+    // retrait du hash : suppression par décalage arrière (Knuth 6.4, algo R)
+    uint32_t i = sess_hash(h->peer_addr, h->peer_port) & t->mask;
+    while (t->slots[i] != idx + 1)
+        i = (i + 1) & t->mask;
+
+    uint32_t j = i;
+    for (;;)
+    {
+        t->slots[i] = 0;
+        uint32_t k;
+        for (;;)
+        {
+            j = (j + 1) & t->mask;
+            if (t->slots[j] == 0)
+                goto done;
+            const struct tftp_sess_hot *o = &t->hot[t->slots[j] - 1];
+            k = sess_hash(o->peer_addr, o->peer_port) & t->mask;
+            // on ne déplace l'entrée j que si son slot idéal k n'est pas dans ]i, j]
+            if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+                continue;
+            break;
+        }
+        t->slots[i] = t->slots[j];
+        i = j;
+    }
+done:
+    free(t->cold[idx].filename);
+    t->cold[idx].filename = NULL;
+    h->state = SESS_FREE;
+    h->sock = -1;
+    h->fd = -1;
+    t->free_stack[t->nfree++] = idx;
+    t->count--;
+}
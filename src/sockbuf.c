@@ -0,0 +1,83 @@
+#define _GNU_SOURCE
+#include "sockbuf.h"
+#include "netsim.h"
+#include <string.h>
+#include <sys/socket.h>
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+uint32_t sockbuf_need(uint64_t n, uint32_t payload)
+{
+    // données + en-têtes + skb_shared_info allouées par kmalloc (puissance de
+    // 2 au-dessus), plus la structure sk_buff elle-même
+    uint64_t head = 1;
+    while (head < (uint64_t)payload + SOCKBUF_OVERHEAD)
+        head <<= 1;
+    uint64_t b = n * (head + SOCKBUF_OVERHEAD);
+    return b > SOCKBUF_MAX ? SOCKBUF_MAX : (uint32_t)b;
+}
+
+int sockbuf_get(int sock, int opt)
+{
+    int v = 0;
+    socklen_t l = sizeof(v);
+    if (getsockopt(sock, SOL_SOCKET, opt, &v, &l) < 0)
+        return -1;
+    return v;
+}
+
+int sockbuf_grow(int sock, int opt, uint32_t bytes, int force)
+{
+    int cur = sockbuf_get(sock, opt);
+    if (cur < 0 || (uint32_t)cur >= bytes)
+        return cur;
+
+    // le noyau double la valeur demandée (part réservée à sk_buff) : la
+    // taille lue par getsockopt est déjà ce double
+    int v = (int)(bytes / 2);
+    int forced = opt == SO_RCVBUF ? SO_RCVBUFFORCE : SO_SNDBUFFORCE;
+    if (!force || setsockopt(sock, SOL_SOCKET, forced, &v, sizeof(v)) < 0)
+        setsockopt(sock, SOL_SOCKET, opt, &v, sizeof(v)); // plafonné à [rw]mem_max
+    return sockbuf_get(sock, opt);
+}
+
+int sockbuf_drops_enable(int sock)
+{
+    int one = 1;
+    return setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+}
+
+ssize_t sockbuf_recv(int sock, void *buf, size_t len, struct sockaddr_in *from, uint32_t *drops,
+                     struct tstamp *ts)
+{
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(uint32_t)) + TSTAMP_CMSG_SPACE];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov = {.iov_base = buf, .iov_len = len};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = from;
+    msg.msg_namelen = sizeof(*from);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+
+    ssize_t n = net_recvmsg(sock, &msg, 0);
+    if (n < 0)
+        return n;
+    if (ts)
+        ts->sw = ts->hw = 0;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+    {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_RXQ_OVFL)
+            memcpy(drops, CMSG_DATA(cm), sizeof(*drops));
+        else if (ts)
+            tstamp_cmsg(cm, ts);
+    }
+    return n;
+}
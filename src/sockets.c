@@ -1,4 +1,7 @@
 #include "sockets.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
 
 void die(const char *msg)
 {
@@ -16,20 +19,51 @@ int addr_equal(const struct sockaddr_in *a, const struct sockaddr_in *b)
 ssize_t recvfrom_timeout(int sock, uint8_t *buf, size_t max,
                          struct sockaddr_in *src, int timeout_ms)
 {
-    fd_set rfds;
-    FD_ZERO(&rfds);
-    FD_SET(sock, &rfds);
+    uint64_t deadline = now_ns() + (uint64_t)timeout_ms * 1000000ULL;
+    for (;;)
+    {
+        // on se réveille aussi pour émettre les datagrammes retardés par netsim
+        uint64_t now = now_ns();
+        int wait_ms = now >= deadline ? 0 : (int)((deadline - now + 999999) / 1000000);
+        int next = net_flush();
+        if (next >= 0 && next < wait_ms)
+            wait_ms = next;
 
-    struct timeval tv;
-    tv.tv_sec = timeout_ms / 1000;
-    tv.tv_usec = (timeout_ms % 1000) * 1000;
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(sock, &rfds);
 
-    int r = select(sock + 1, &rfds, NULL, NULL, &tv); // y a d'autres alternative comme SO_RCVTIMEO() mais select() c'est le plus fiable pour attendre X ms
-    if (r < 0)
+        struct timeval tv;
+        tv.tv_sec = wait_ms / 1000;
+        tv.tv_usec = (wait_ms % 1000) * 1000;
+
+        int r = select(sock + 1, &rfds, NULL, NULL, &tv); // y a d'autres alternative comme SO_RCVTIMEO() mais select() c'est le plus fiable pour attendre X ms
+        if (r < 0)
+            return -1;
+        if (r > 0)
+        {
+            socklen_t sl = sizeof(*src);
+            ssize_t n = net_recvfrom(sock, buf, max, 0, (struct sockaddr *)src, &sl); // te dit qui t’a répondu (IP+port)
+            if (n >= 0 || errno != EAGAIN)
+                return n;
+        }
+        if (now_ns() >= deadline)
+            return 0; // timeout
+    }
+}
+
+int set_nonblock(int sock)
+{
+    int fl = fcntl(sock, F_GETFL, 0);
+    if (fl < 0)
         return -1;
-    if (r == 0)
-        return 0; // timeout
+    return fcntl(sock, F_SETFL, fl | O_NONBLOCK);
+}
 
-    socklen_t sl = sizeof(*src);
-    return recvfrom(sock, buf, max, 0, (struct sockaddr *)src, &sl); // te dit qui t’a répondu (IP+port)
-}
\ No newline at end of file
+// horloge monotone en nanosecondes (timeouts, durées)
+uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
@@ -1,4 +1,14 @@
+#define _GNU_SOURCE // O_TMPFILE
 #include "tftp_utils.h"
+#include "log.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define CRC32C_X86 1
+#endif
 
 void display_packet(const char *buffer, int size)
 {
@@ -102,7 +112,7 @@ void send_data(int sockfd, sockaddr_in *addr, unsigned char *data, size_t data_s
 
         while (tries < MAX_RETRIES && !ack_received)
         { // envoi paquet
-            printf("Envoi bloc #%d (%zu octets)...\n", block_number, chunk_size);
+            LOG_DBG("Envoi bloc #%u (%u octets)...", NULL, block_number, chunk_size);
             sendto(sockfd, packet, packet_len, 0, (struct sockaddr *)addr, addr_len);
 
             // attend ACK
@@ -115,12 +125,12 @@ void send_data(int sockfd, sockaddr_in *addr, unsigned char *data, size_t data_s
             {
                 if (errno == EAGAIN || errno == EWOULDBLOCK)
                 {
-                    printf("Timeout... On renvoie !");
+                    LOG_DBG("Timeout bloc #%u... On renvoie !", NULL, block_number);
                     tries++;
                 }
                 else
                 {
-                    fprintf(stderr, "Erreur fatale recvfrom\n");
+                    LOG_ERR("Erreur fatale recvfrom: %s", strerror(errno));
                     return;
                 }
             }
@@ -130,19 +140,19 @@ void send_data(int sockfd, sockaddr_in *addr, unsigned char *data, size_t data_s
                 unsigned short rcv_block = ntohs(*(unsigned short *)buffer_ack + 2);
                 if (rcv_opcode == OPCODE_ACK && rcv_block == block_number)
                 {
-                    printf("ACK #%d reçu\n", rcv_block);
+                    LOG_DBG("ACK #%u reçu", NULL, rcv_block);
                     ack_received = 1;
                 }
                 else
                 {
-                    printf("Paquet ignoré (opcode: %d, bloc: %d)\n", rcv_opcode, rcv_block);
+                    LOG_DBG("Paquet ignoré (opcode: %u, bloc: %u)", NULL, rcv_opcode, rcv_block);
                 }
             }
         }
         // connexion perdue
         if (!ack_received)
         {
-            fprintf(stderr, "Erreur: abandon après %d essais pour le bloc %d\n", tries, block_number);
+            LOG_ERR("Erreur: abandon après %u essais pour le bloc %u", NULL, tries, block_number);
             return;
         }
         // préparer le prochain tour
@@ -155,7 +165,7 @@ void send_data(int sockfd, sockaddr_in *addr, unsigned char *data, size_t data_s
             keep_sending = 0;
         }
     }
-    printf("Transfert terminé avec succès\n");
+    LOG_INF("Transfert terminé avec succès", NULL);
 }
 /*
 int split_data(FILE *file, char *buffer)
@@ -210,6 +220,73 @@ int build_rrq_wrq(uint16_t op_code, unsigned char *buffer, size_t buffer_size, c
 
     return offset;
 }
+// RRQ/WRQ avec options : [op(2)] [filename]\0 [mode]\0 ([opt]\0 [valeur]\0)*
+int build_rrq_wrq_opts(uint16_t op_code, unsigned char *buffer, size_t buffer_size,
+                      const char *filename, const char *mode,
+                      const struct tftp_opt *opts, size_t nopts)
+{
+    if (op_code != OPCODE_RRQ && op_code != OPCODE_WRQ)
+    {
+        fprintf(stderr, "Erreur RRQ/WRQ: le code est ni RRQ ni WRQ\n");
+        return -1;
+    }
+
+    size_t need = 2 + strlen(filename) + 1 + strlen(mode) + 1;
+    for (size_t k = 0; k < nopts; k++)
+        need += strlen(opts[k].name) + 1 + strlen(opts[k].value) + 1;
+    if (need > buffer_size)
+    {
+        fprintf(stderr, "Erreur: requête trop longue (%zu octets)\n", need);
+        return -1;
+    }
+
+    uint16_t opn = htons(op_code);
+    memcpy(buffer, &opn, 2);
+    size_t offset = 2;
+
+    const char *fields[2] = {filename, mode};
+    for (int f = 0; f < 2; f++)
+    {
+        size_t l = strlen(fields[f]) + 1;
+        memcpy(buffer + offset, fields[f], l);
+        offset += l;
+    }
+    for (size_t k = 0; k < nopts; k++)
+    {
+        size_t ln = strlen(opts[k].name) + 1;
+        size_t lv = strlen(opts[k].value) + 1;
+        memcpy(buffer + offset, opts[k].name, ln);
+        offset += ln;
+        memcpy(buffer + offset, opts[k].value, lv);
+        offset += lv;
+    }
+    return (int)offset;
+}
+
+// OACK : [op(2)] ([opt]\0 [valeur]\0)*
+int build_oack(uint8_t *buffer, size_t buffer_size, const struct tftp_opt *opts, size_t nopts)
+{
+    size_t need = 2;
+    for (size_t k = 0; k < nopts; k++)
+        need += strlen(opts[k].name) + 1 + strlen(opts[k].value) + 1;
+    if (need > buffer_size)
+        return -1;
+
+    uint16_t opn = htons(OPCODE_OACK);
+    memcpy(buffer, &opn, 2);
+    size_t offset = 2;
+    for (size_t k = 0; k < nopts; k++)
+    {
+        size_t ln = strlen(opts[k].name) + 1;
+        size_t lv = strlen(opts[k].value) + 1;
+        memcpy(buffer + offset, opts[k].name, ln);
+        offset += ln;
+        memcpy(buffer + offset, opts[k].value, lv);
+        offset += lv;
+    }
+    return (int)offset;
+}
+
 int build_data(uint8_t *buffer, size_t buffer_size, uint16_t block_number,
                const uint8_t *data, size_t data_len)
 {
@@ -225,6 +302,19 @@ int build_data(uint8_t *buffer, size_t buffer_size, uint16_t block_number,
     memcpy(buffer + 4, data, data_len);
     return (int)(4 + data_len);
 }
+// en-tête DATA seul : les données sont déjà en place dans buffer + 4 (pas de
+// copie, la taille n'est pas bornée à 512 octets : blksize négocié)
+int build_data_header(uint8_t *buffer, size_t buffer_size, uint16_t block_number)
+{
+    if (buffer_size < 4)
+        return -1;
+    uint16_t opn = htons(OPCODE_DATA);
+    uint16_t bn = htons(block_number);
+    memcpy(buffer, &opn, 2);
+    memcpy(buffer + 2, &bn, 2);
+    return 4;
+}
+
 int build_ack(unsigned char *buffer, size_t buffer_size, uint16_t block_number)
 {
     if (buffer_size < 4)
@@ -307,4 +397,348 @@ int parse_rrq_wrq(const uint8_t *buffer, size_t buffer_size,
     mode[m] = 0;
 
     return 0;
-}
\ No newline at end of file
+}
+
+// lit une chaîne terminée par \0 à partir de *i (tronquée en erreur si > max)
+static int parse_cstr(const uint8_t *buffer, size_t buffer_size, size_t *i,
+                      char *out, size_t max)
+{
+    size_t o = 0;
+    while (*i < buffer_size && buffer[*i] != 0)
+    {
+        if (o + 1 >= max)
+            return -1;
+        out[o++] = (char)buffer[(*i)++];
+    }
+    if (*i >= buffer_size)
+        return -1;
+    out[o] = 0;
+    (*i)++;
+    return 0;
+}
+
+// paires option/valeur jusqu'à la fin du paquet (les options en trop sont ignorées)
+static int parse_opt_pairs(const uint8_t *buffer, size_t buffer_size, size_t i,
+                           struct tftp_opt *opts, size_t max_opts, size_t *nopts)
+{
+    *nopts = 0;
+    while (i < buffer_size)
+    {
+        struct tftp_opt tmp;
+        if (parse_cstr(buffer, buffer_size, &i, tmp.name, sizeof(tmp.name)) < 0)
+            return -1;
+        if (parse_cstr(buffer, buffer_size, &i, tmp.value, sizeof(tmp.value)) < 0)
+            return -1;
+        if (*nopts < max_opts)
+            opts[(*nopts)++] = tmp;
+    }
+    return 0;
+}
+
+int parse_rrq_wrq_opts(const uint8_t *buffer, size_t buffer_size,
+                       char *filename, size_t fmax,
+                       char *mode, size_t mmax,
+                       struct tftp_opt *opts, size_t max_opts, size_t *nopts)
+{
+    if (buffer_size < 4)
+        return -1;
+    size_t i = 2;
+    if (parse_cstr(buffer, buffer_size, &i, filename, fmax) < 0)
+        return -1;
+    if (parse_cstr(buffer, buffer_size, &i, mode, mmax) < 0)
+        return -1;
+    return parse_opt_pairs(buffer, buffer_size, i, opts, max_opts, nopts);
+}
+
+int parse_oack(const uint8_t *buffer, size_t buffer_size,
+               struct tftp_opt *opts, size_t max_opts, size_t *nopts)
+{
+    if (buffer_size < 2)
+        return -1;
+    return parse_opt_pairs(buffer, buffer_size, 2, opts, max_opts, nopts);
+}
+
+// noms d'options insensibles à la casse (RFC 2347)
+const char *find_opt(const struct tftp_opt *opts, size_t nopts, const char *name)
+{
+    for (size_t k = 0; k < nopts; k++)
+    {
+        if (strcasecmp(opts[k].name, name) == 0)
+            return opts[k].value;
+    }
+    return NULL;
+}
+
+int set_opt_str(struct tftp_opt *opts, size_t *nopts, size_t max_opts,
+                const char *name, const char *value)
+{
+    if (*nopts >= max_opts)
+        return -1;
+    snprintf(opts[*nopts].name, sizeof(opts[*nopts].name), "%s", name);
+    snprintf(opts[*nopts].value, sizeof(opts[*nopts].value), "%s", value);
+    (*nopts)++;
+    return 0;
+}
+
+int set_opt(struct tftp_opt *opts, size_t *nopts, size_t max_opts,
+            const char *name, unsigned long value)
+{
+    if (*nopts >= max_opts)
+        return -1;
+    snprintf(opts[*nopts].name, sizeof(opts[*nopts].name), "%s", name);
+    snprintf(opts[*nopts].value, sizeof(opts[*nopts].value), "%lu", value);
+    (*nopts)++;
+    return 0;
+}
+
+/* ---------------- CRC32C ---------------- */
+
+// polynôme de Castagnoli (0x1EDC6F41, forme réfléchie 0x82F63B78)
+static const uint32_t crc32c_table[256] = {
+    0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c,
+    0x26a1e7e8, 0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+    0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c,
+    0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+    0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc,
+    0xbc267848, 0x4e4dfb4b, 0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+    0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35, 0xaa64d611, 0x580f5512,
+    0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+    0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad,
+    0x1642ae59, 0xe4292d5a, 0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+    0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595, 0x417b1dbc, 0xb3109ebf,
+    0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+    0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f,
+    0xed03a29b, 0x1f682198, 0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+    0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38, 0xdbfc821c, 0x2997011f,
+    0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+    0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e,
+    0x4767748a, 0xb50cf789, 0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+    0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46, 0x7198540d, 0x83f3d70e,
+    0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+    0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de,
+    0xdde0eb2a, 0x2f8b6829, 0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+    0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93, 0x082f63b7, 0xfa44e0b4,
+    0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+    0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b,
+    0xb4091bff, 0x466298fc, 0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+    0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033, 0xa24bb5a6, 0x502036a5,
+    0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+    0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975,
+    0x0e330a81, 0xfc588982, 0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+    0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622, 0x38cc2a06, 0xcaa7a905,
+    0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+    0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8,
+    0xe52cc12c, 0x1747422f, 0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+    0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0, 0xd3d3e1ab, 0x21b862a8,
+    0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+    0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78,
+    0x7fab5e8c, 0x8dc0dd8f, 0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+    0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1, 0x69e9f0d5, 0x9b8273d6,
+    0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+    0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69,
+    0xd5cf889d, 0x27a40b9e, 0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+    0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351,
+};
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t len)
+{
+    crc = ~crc;
+    while (len--)
+        crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+#ifdef CRC32C_X86
+// même polynôme, 8 octets par instruction
+__attribute__((target("sse4.2"))) static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t len)
+{
+    uint64_t c = ~crc;
+    for (; len >= 8; p += 8, len -= 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    uint32_t c32 = (uint32_t)c;
+    while (len--)
+        c32 = _mm_crc32_u8(c32, *p++);
+    return ~c32;
+}
+#endif
+
+static int crc_hw = -1; // -1 : pas encore choisi (atomique : workers du serveur)
+
+static int crc32c_use_hw(void)
+{
+    int hw = __atomic_load_n(&crc_hw, __ATOMIC_RELAXED);
+    if (hw < 0)
+    {
+#ifdef CRC32C_X86
+        hw = __builtin_cpu_supports("sse4.2");
+#else
+        hw = 0;
+#endif
+        __atomic_store_n(&crc_hw, hw, __ATOMIC_RELAXED);
+    }
+    return hw;
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+#ifdef CRC32C_X86
+    if (crc32c_use_hw())
+        return crc32c_hw(crc, buf, len);
+#endif
+    return crc32c_sw(crc, buf, len);
+}
+
+const char *crc32c_impl(void)
+{
+    return crc32c_use_hw() ? "sse4.2" : "table";
+}
+
+int crc32c_set_impl(const char *name)
+{
+    int hw;
+    if (strcmp(name, "table") == 0)
+        hw = 0;
+    else if (strcmp(name, "sse4.2") == 0)
+    {
+#ifdef CRC32C_X86
+        if (!__builtin_cpu_supports("sse4.2"))
+            return -1;
+        hw = 1;
+#else
+        return -1;
+#endif
+    }
+    else
+        return -1;
+    __atomic_store_n(&crc_hw, hw, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* ---------------- Somme de contrôle (option checksum) ---------------- */
+
+size_t sum_rx(uint32_t *crc, uint8_t tail[SUM_LEN], uint64_t seen, const uint8_t *d, size_t n,
+              uint8_t *out)
+{
+    size_t k = seen < SUM_LEN ? (size_t)seen : SUM_LEN; // octets valides de tail
+    if (k + n <= SUM_LEN)
+    {
+        memcpy(tail + k, d, n);
+        return 0;
+    }
+    // sortent des 4 derniers : le début de tail, puis le début de d
+    size_t out_len = k + n - SUM_LEN;
+    size_t from_tail = out_len < k ? out_len : k;
+    memcpy(out, tail, from_tail);
+    memcpy(out + from_tail, d, out_len - from_tail);
+    *crc = crc32c(*crc, out, out_len);
+    if (n >= SUM_LEN)
+        memcpy(tail, d + n - SUM_LEN, SUM_LEN);
+    else
+    {
+        memmove(tail, tail + from_tail, k - from_tail);
+        memcpy(tail + k - from_tail, d, n);
+    }
+    return out_len;
+}
+
+int sum_ok(uint32_t crc, const uint8_t tail[SUM_LEN], uint64_t seen)
+{
+    uint32_t want = (uint32_t)tail[0] << 24 | (uint32_t)tail[1] << 16 | (uint32_t)tail[2] << 8 | tail[3];
+    return seen >= SUM_LEN && want == crc;
+}
+
+size_t sum_put(uint32_t crc, uint64_t end, uint64_t pos, uint8_t *out, size_t room)
+{
+    if (pos < end || pos - end >= SUM_LEN)
+        return 0;
+    uint8_t be[SUM_LEN] = {(uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc};
+    size_t i = (size_t)(pos - end);
+    size_t n = SUM_LEN - i < room ? SUM_LEN - i : room;
+    memcpy(out, be + i, n);
+    return n;
+}
+
+// reprise : empreinte des RESUME_CRC_SPAN octets qui précèdent end
+int resume_crc_fd(int fd, uint64_t end, uint32_t *crc)
+{
+    uint8_t buf[4096];
+    uint64_t off = end > RESUME_CRC_SPAN ? end - RESUME_CRC_SPAN : 0;
+    *crc = 0;
+    while (off < end)
+    {
+        size_t want = end - off > sizeof(buf) ? sizeof(buf) : (size_t)(end - off);
+        ssize_t r = pread(fd, buf, want, (off_t)off);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        *crc = crc32c(*crc, buf, (size_t)r);
+        off += (uint64_t)r;
+    }
+    return 0;
+}
+
+/* ---------------- Destination vérifiée ---------------- */
+
+int sum_dest_open(const char *path)
+{
+    char dir[PATH_MAX] = ".";
+    const char *slash = strrchr(path, '/');
+    if (slash)
+    {
+        size_t n = slash == path ? 1 : (size_t)(slash - path);
+        if (n >= sizeof(dir))
+        {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memcpy(dir, path, n);
+        dir[n] = '\0';
+    }
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0666);
+    if (fd >= 0)
+        return fd;
+    return open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+}
+
+// fichier sans nom : aucun lien (st_nlink 0) avant sum_dest_commit
+static int sum_dest_unnamed(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 && st.st_nlink == 0;
+}
+
+int sum_dest_commit(int fd, const char *path)
+{
+    static uint64_t seq; // noms temporaires uniques dans le processus
+    if (!sum_dest_unnamed(fd))
+        return 0; // path ouvert directement : déjà en place
+    char proc[32], tmp[PATH_MAX];
+    snprintf(proc, sizeof(proc), "/proc/self/fd/%d", fd);
+    if (snprintf(tmp, sizeof(tmp), "%s.sum.%d.%llu", path, (int)getpid(),
+                 (unsigned long long)__atomic_add_fetch(&seq, 1, __ATOMIC_RELAXED)) >= (int)sizeof(tmp))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (linkat(AT_FDCWD, proc, AT_FDCWD, tmp, AT_SYMLINK_FOLLOW) < 0)
+        return -1;
+    if (rename(tmp, path) < 0)
+    {
+        int e = errno;
+        unlink(tmp);
+        errno = e;
+        return -1;
+    }
+    return 0;
+}
+
+void sum_dest_discard(int fd, const char *path)
+{
+    if (!sum_dest_unnamed(fd))
+        unlink(path); // ouvert directement : contenu non vérifié retiré
+}
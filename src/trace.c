@@ -0,0 +1,178 @@
+#include "trace.h"
+#include "tftp_utils.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const tr_names[TR_TYPES] = {
+    "request", "queue", "open", "oack", "first data", "timeout", "retransmit", "complete", "transfer",
+};
+
+int trace_init(struct tftp_trace *t, uint32_t cap, uint32_t every)
+{
+    memset(t, 0, sizeof(*t));
+    uint32_t pow2 = 1;
+    while (pow2 < cap)
+        pow2 <<= 1;
+    t->ev = calloc(pow2, sizeof(struct trace_ev));
+    if (!t->ev)
+        return -1;
+    t->cap = pow2;
+    t->every = every;
+    t->countdown = 1; // première session tracée
+    return 0;
+}
+
+void trace_free(struct tftp_trace *t)
+{
+    free(t->ev);
+    t->ev = NULL;
+}
+
+void trace_request(struct tftp_trace *t, uint32_t id, uint64_t ts, uint16_t op,
+                   uint32_t addr, uint16_t port, const char *filename)
+{
+    struct trace_ev *e = trace_push(t, id, TR_REQUEST, ts);
+    e->a = op;
+    e->b = addr;
+    e->c = port;
+    size_t n = strnlen(filename, TRACE_NAME_MAX - 1);
+    memcpy(e->name, filename, n);
+    e->name[n] = 0;
+}
+
+/* --------------- Export JSON --------------- */
+
+// événements "durée" : ts = fin, a = durée
+static int is_span(const struct trace_ev *e)
+{
+    return e->type == TR_QUEUE || e->type == TR_OPEN || e->type == TR_END;
+}
+
+static void json_str(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++)
+    {
+        unsigned char ch = (unsigned char)*s;
+        if (ch == '"' || ch == '\\')
+            fprintf(f, "\\%c", ch);
+        else if (ch < 0x20)
+            fprintf(f, "\\u%04x", ch);
+        else
+            fputc(ch, f);
+    }
+    fputc('"', f);
+}
+
+// en microsecondes relatives au premier événement conservé
+static double us(uint64_t ns, uint64_t base)
+{
+    return ns >= base ? (double)(ns - base) / 1000.0 : 0.0;
+}
+
+static void write_event(FILE *f, const struct trace_ev *e, uint32_t pid, uint64_t base)
+{
+    const char *name = tr_names[e->type];
+
+    if (e->type == TR_REQUEST)
+    {
+        // nom de la ligne du transfert dans la vue
+        char label[64];
+        snprintf(label, sizeof(label), "%s %s #%u", e->a == OPCODE_RRQ ? "RRQ" : "WRQ", e->name, e->id);
+        fprintf(f, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":",
+                pid, e->id);
+        json_str(f, label);
+        fputs("}}", f);
+    }
+
+    fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"tftp\",\"pid\":%u,\"tid\":%u,", name, pid, e->id);
+    if (is_span(e))
+        fprintf(f, "\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,", us(e->ts - e->a, base), (double)e->a / 1000.0);
+    else
+        fprintf(f, "\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,", us(e->ts, base));
+
+    fputs("\"args\":{", f);
+    switch (e->type)
+    {
+    case TR_REQUEST:
+    {
+        struct in_addr a;
+        char ip[INET_ADDRSTRLEN];
+        a.s_addr = (uint32_t)e->b;
+        inet_ntop(AF_INET, &a, ip, sizeof(ip));
+        fputs("\"file\":", f);
+        json_str(f, e->name);
+        fprintf(f, ",\"peer\":\"%s:%u\"", ip, (unsigned)ntohs((uint16_t)e->c));
+        break;
+    }
+    case TR_OPEN:
+        fprintf(f, "\"size\":%llu", (unsigned long long)e->b);
+        break;
+    case TR_OACK:
+        fprintf(f, "\"blksize\":%llu,\"windowsize\":%llu", (unsigned long long)e->a,
+                (unsigned long long)e->b);
+        break;
+    case TR_FIRST_DATA:
+        fprintf(f, "\"since_request_us\":%.3f", (double)e->a / 1000.0);
+        break;
+    case TR_TIMEOUT:
+        fprintf(f, "\"block\":%llu,\"retry\":%llu", (unsigned long long)e->a, (unsigned long long)e->b);
+        break;
+    case TR_RETRANSMIT:
+        fprintf(f, "\"from_block\":%llu,\"packets\":%llu", (unsigned long long)e->a,
+                (unsigned long long)e->b);
+        break;
+    case TR_END:
+        fprintf(f, "\"bytes\":%llu,\"retransmits\":%llu", (unsigned long long)e->b,
+                (unsigned long long)e->c);
+        break;
+    default:
+        break;
+    }
+    fputs("}}", f);
+}
+
+int trace_write_json(const char *path, const struct tftp_trace *t, uint32_t n)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    uint64_t base = UINT64_MAX, dropped = 0;
+    for (uint32_t w = 0; w < n; w++)
+    {
+        uint64_t first = t[w].written > t[w].cap ? t[w].written - t[w].cap : 0;
+        dropped += first;
+        for (uint64_t k = first; k < t[w].written; k++)
+        {
+            const struct trace_ev *e = &t[w].ev[k & (t[w].cap - 1)];
+            uint64_t start = is_span(e) ? e->ts - e->a : e->ts;
+            if (start < base)
+                base = start;
+        }
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"overwritten_events\":%llu},\n\"traceEvents\":[\n",
+            (unsigned long long)dropped);
+    for (uint32_t w = 0; w < n; w++)
+    {
+        fprintf(f, "%s{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%u,\"args\":{\"name\":\"worker %u\"}}",
+                w ? ",\n" : "", w, w);
+        uint64_t first = t[w].written > t[w].cap ? t[w].written - t[w].cap : 0;
+        for (uint64_t k = first; k < t[w].written; k++)
+            write_event(f, &t[w].ev[k & (t[w].cap - 1)], w, base);
+    }
+    fputs("\n]}\n", f);
+
+    if (fclose(f) != 0)
+    {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
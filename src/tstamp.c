@@ -0,0 +1,96 @@
+#define _GNU_SOURCE
+#include "tstamp.h"
+#include "netsim.h"
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <string.h>
+#include <time.h>
+
+#define RX_FLAGS (SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_RX_HARDWARE)
+#define REPORT_FLAGS (SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_OPT_TSONLY)
+#define TX_FLAGS (SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_TX_HARDWARE)
+
+static uint64_t ts_ns(const struct timespec *t)
+{
+    return (uint64_t)t->tv_sec * 1000000000ULL + (uint64_t)t->tv_nsec;
+}
+
+// heure CLOCK_REALTIME ramenée à CLOCK_MONOTONIC (écart lu maintenant)
+static uint64_t real_to_mono(uint64_t real)
+{
+    struct timespec r, m;
+    clock_gettime(CLOCK_REALTIME, &r);
+    clock_gettime(CLOCK_MONOTONIC, &m);
+    uint64_t off = ts_ns(&r) - ts_ns(&m);
+    return real > off ? real - off : 0;
+}
+
+int tstamp_enable(int sock)
+{
+    int flags = RX_FLAGS | REPORT_FLAGS;
+    return setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+}
+
+void tstamp_cmsg(const struct cmsghdr *cm, struct tstamp *ts)
+{
+    if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_TIMESTAMPING)
+        return;
+    struct scm_timestamping t;
+    memcpy(&t, CMSG_DATA(cm), sizeof(t));
+    uint64_t sw = ts_ns(&t.ts[0]), hw = ts_ns(&t.ts[2]);
+    if (sw)
+        ts->sw = real_to_mono(sw);
+    if (hw)
+        ts->hw = hw;
+}
+
+ssize_t tstamp_sendto(int sock, const void *buf, size_t len, const struct sockaddr_in *to)
+{
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(uint32_t))];
+        struct cmsghdr align;
+    } ctl;
+    memset(&ctl, 0, sizeof(ctl));
+    struct iovec iov = {.iov_base = (void *)buf, .iov_len = len};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void *)to;
+    msg.msg_namelen = sizeof(*to);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SO_TIMESTAMPING;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint32_t));
+    uint32_t flags = TX_FLAGS;
+    memcpy(CMSG_DATA(cm), &flags, sizeof(flags));
+    return net_sendmsg(sock, &msg, 0);
+}
+
+int tstamp_tx(int sock, struct tstamp *ts)
+{
+    union
+    {
+        char buf[TSTAMP_CMSG_SPACE + CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in))];
+        struct cmsghdr align;
+    } ctl;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+    if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        return 0;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        tstamp_cmsg(cm, ts);
+    return 1;
+}
+
+uint64_t tstamp_diff(const struct tstamp *tx, const struct tstamp *rx)
+{
+    if (tx->hw && rx->hw)
+        return rx->hw > tx->hw ? rx->hw - tx->hw : 0;
+    return rx->sw > tx->sw ? rx->sw - tx->sw : 0;
+}
@@ -0,0 +1,506 @@
+#include "vfile.h"
+#include "log.h"
+#include "sockets.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define VFILE_CHECK_NS 1000000000ULL // re-vérification des sources : 1 s
+#define VFILE_CACHE_BUCKETS 1024
+#define VFILE_MATCH_MAX 256
+
+static uint32_t str_hash(const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// contenu entier d'un fichier, terminé par 0 ; NULL si illisible
+static char *read_text(const char *path, struct stat *st)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    char *buf = NULL;
+    if (fstat(fileno(f), st) == 0 && (buf = malloc((size_t)st->st_size + 1)) != NULL)
+    {
+        size_t n = fread(buf, 1, (size_t)st->st_size, f);
+        buf[n] = 0;
+    }
+    fclose(f);
+    return buf;
+}
+
+static int64_t mtime_ns(const struct stat *st)
+{
+    return (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+static void src_record(struct vfile_src *s, const struct stat *st)
+{
+    s->dev = st->st_dev;
+    s->ino = st->st_ino;
+    s->size = st->st_size;
+    s->mtime_ns = mtime_ns(st);
+    s->version++;
+}
+
+static int src_changed(const struct vfile_src *s)
+{
+    struct stat st;
+    if (stat(s->path, &st) < 0)
+        return 0; // disparu : on garde la dernière version connue
+    return st.st_dev != s->dev || st.st_ino != s->ino || st.st_size != s->size || mtime_ns(&st) != s->mtime_ns;
+}
+
+/* --------------- Inventaire --------------- */
+
+static void inv_clear(struct tftp_vfile *v)
+{
+    if (!v->inv_buckets)
+        return;
+    for (uint32_t b = 0; b <= v->inv_mask; b++)
+    {
+        struct vfile_inv_entry *e = v->inv_buckets[b];
+        while (e)
+        {
+            struct vfile_inv_entry *next = e->next;
+            free(e->key);
+            free(e->vars);
+            free(e);
+            e = next;
+        }
+    }
+    free(v->inv_buckets);
+    v->inv_buckets = NULL;
+    v->inv_mask = 0;
+}
+
+static int inv_load(struct tftp_vfile *v)
+{
+    struct stat st;
+    char *text = read_text(v->inv.path, &st);
+    if (!text)
+        return -1;
+
+    uint32_t lines = 1;
+    for (const char *p = text; *p; p++)
+        lines += *p == '\n';
+    uint32_t nb = 16;
+    while (nb < 2 * lines)
+        nb <<= 1;
+    struct vfile_inv_entry **buckets = calloc(nb, sizeof(*buckets));
+    if (!buckets)
+    {
+        free(text);
+        return -1;
+    }
+
+    char *save = NULL;
+    for (char *line = strtok_r(text, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+    {
+        char *tsave = NULL;
+        char *key = strtok_r(line, " \t\r", &tsave);
+        if (!key || key[0] == '#')
+            continue;
+        struct vfile_inv_entry *e = calloc(1, sizeof(*e));
+        size_t vlen = strlen(tsave ? tsave : "") + 2;
+        if (!e || !(e->key = strdup(key)) || !(e->vars = calloc(1, vlen)))
+        {
+            if (e)
+                free(e->key);
+            free(e);
+            continue;
+        }
+        size_t o = 0;
+        for (char *tok = strtok_r(NULL, " \t\r", &tsave); tok; tok = strtok_r(NULL, " \t\r", &tsave))
+        {
+            if (!strchr(tok, '='))
+                continue;
+            size_t n = strlen(tok) + 1;
+            memcpy(e->vars + o, tok, n);
+            o += n;
+        }
+        uint32_t b = str_hash(key, strlen(key)) & (nb - 1);
+        e->next = buckets[b];
+        buckets[b] = e;
+    }
+    free(text);
+
+    inv_clear(v);
+    v->inv_buckets = buckets;
+    v->inv_mask = nb - 1;
+    src_record(&v->inv, &st);
+    return 0;
+}
+
+static const struct vfile_inv_entry *inv_find(const struct tftp_vfile *v, const char *key)
+{
+    if (!key || !v->inv_buckets)
+        return NULL;
+    const struct vfile_inv_entry *e = v->inv_buckets[str_hash(key, strlen(key)) & v->inv_mask];
+    while (e && strcmp(e->key, key) != 0)
+        e = e->next;
+    return e;
+}
+
+/* --------------- Règles --------------- */
+
+// capture = partie du nom couverte par '*' (copiée dans match)
+static int rule_match(const struct vfile_rule *r, const char *name, char *match, size_t msize)
+{
+    size_t pl = strlen(r->prefix), nl = strlen(name);
+    if (strncmp(name, r->prefix, pl) != 0)
+        return 0;
+    if (!r->suffix)
+    {
+        if (nl != pl)
+            return 0;
+        match[0] = 0;
+        return 1;
+    }
+    size_t sl = strlen(r->suffix);
+    if (nl < pl + sl || strcmp(name + nl - sl, r->suffix) != 0 || nl - pl - sl >= msize)
+        return 0;
+    memcpy(match, name + pl, nl - pl - sl);
+    match[nl - pl - sl] = 0;
+    return 1;
+}
+
+// première règle qui couvre ce nom
+static const struct vfile_rule *find_rule(const struct tftp_vfile *v, const char *name, char *match)
+{
+    for (uint32_t i = 0; i < v->nrules; i++)
+    {
+        if (rule_match(&v->rules[i], name, match, VFILE_MATCH_MAX))
+            return &v->rules[i];
+    }
+    return NULL;
+}
+
+/* --------------- Cache --------------- */
+
+static void cache_drop(struct vfile_cached *c)
+{
+    memobj_release(c->obj);
+    free(c->key);
+    free(c);
+}
+
+// retire les rendus dont le gabarit ou l'inventaire a changé
+static void cache_purge(struct tftp_vfile *v)
+{
+    char match[VFILE_MATCH_MAX];
+    for (uint32_t b = 0; b <= v->cache_mask; b++)
+    {
+        struct vfile_cached **pp = &v->cache[b];
+        while (*pp)
+        {
+            struct vfile_cached *c = *pp;
+            const struct vfile_rule *rule = find_rule(v, c->key, match); // clé : nom puis 0
+            int stale = !rule || c->inv_version != v->inv.version || c->tpl_version != rule->src.version;
+            if (stale)
+            {
+                *pp = c->next;
+                cache_drop(c);
+                v->cached--;
+            }
+            else
+                pp = &c->next;
+        }
+    }
+}
+
+/* --------------- Rendu --------------- */
+
+static int load_template(struct vfile_rule *r)
+{
+    struct stat st;
+    char *tpl = read_text(r->src.path, &st);
+    if (!tpl)
+        return -1;
+    free(r->tpl);
+    r->tpl = tpl;
+    src_record(&r->src, &st);
+    return 0;
+}
+
+static const char *lookup_var(const char *name, size_t len, const struct vfile_inv_entry *e,
+                              const char *ip, const char *file, const char *match)
+{
+    if (len == 2 && memcmp(name, "ip", 2) == 0)
+        return ip;
+    if (len == 4 && memcmp(name, "file", 4) == 0)
+        return file;
+    if (len == 5 && memcmp(name, "match", 5) == 0)
+        return match;
+    for (const char *p = e ? e->vars : ""; *p; p += strlen(p) + 1)
+    {
+        if (strncmp(p, name, len) == 0 && p[len] == '=')
+            return p + len + 1;
+    }
+    return "";
+}
+
+struct outbuf
+{
+    char *data;
+    size_t len, cap;
+    int failed;
+};
+
+static void out_put(struct outbuf *o, const char *s, size_t n)
+{
+    if (o->failed)
+        return;
+    if (o->len + n > o->cap)
+    {
+        size_t ncap = o->cap ? o->cap : 1024;
+        while (ncap < o->len + n)
+            ncap *= 2;
+        char *grown = realloc(o->data, ncap);
+        if (!grown)
+        {
+            o->failed = 1;
+            return;
+        }
+        o->data = grown;
+        o->cap = ncap;
+    }
+    memcpy(o->data + o->len, s, n);
+    o->len += n;
+}
+
+static struct tftp_memobj *render(const struct vfile_rule *r, const struct vfile_inv_entry *e,
+                                  const char *ip, const char *file, const char *match)
+{
+    struct outbuf o = {NULL, 0, 0, 0};
+    const char *p = r->tpl;
+    for (;;)
+    {
+        const char *v = strstr(p, "${");
+        const char *end = v ? strchr(v + 2, '}') : NULL;
+        if (!end)
+        {
+            out_put(&o, p, strlen(p));
+            break;
+        }
+        out_put(&o, p, (size_t)(v - p));
+        const char *val = lookup_var(v + 2, (size_t)(end - v - 2), e, ip, file, match);
+        out_put(&o, val, strlen(val));
+        p = end + 1;
+    }
+    struct tftp_memobj *obj = o.failed ? NULL : memobj_new(file, o.data ? o.data : "", o.len);
+    free(o.data);
+    return obj;
+}
+
+static void maybe_reload(struct tftp_vfile *v, uint64_t now)
+{
+    if (now < v->next_check)
+        return;
+    v->next_check = now + VFILE_CHECK_NS;
+    int changed = 0;
+    for (uint32_t i = 0; i < v->nrules; i++)
+    {
+        struct vfile_rule *r = &v->rules[i];
+        if (src_changed(&r->src))
+        {
+            if (load_template(r) == 0)
+                changed = 1;
+            else
+                LOG_WRN("vfile: cannot reload template %s", r->src.path);
+        }
+    }
+    if (v->inv.path && src_changed(&v->inv))
+    {
+        if (inv_load(v) == 0)
+            changed = 1;
+        else
+            LOG_WRN("vfile: cannot reload inventory %s", v->inv.path);
+    }
+    if (changed)
+        cache_purge(v);
+}
+
+/* --------------- API --------------- */
+
+int vfile_init(struct tftp_vfile *v)
+{
+    memset(v, 0, sizeof(*v));
+    v->cache = calloc(VFILE_CACHE_BUCKETS, sizeof(*v->cache));
+    if (!v->cache)
+        return -1;
+    v->cache_mask = VFILE_CACHE_BUCKETS - 1;
+    pthread_mutex_init(&v->lock, NULL);
+    return 0;
+}
+
+void vfile_free(struct tftp_vfile *v)
+{
+    for (uint32_t i = 0; i < v->nrules; i++)
+    {
+        free(v->rules[i].prefix);
+        free(v->rules[i].suffix);
+        free(v->rules[i].src.path);
+        free(v->rules[i].tpl);
+    }
+    inv_clear(v);
+    free(v->inv.path);
+    if (v->cache)
+    {
+        for (uint32_t b = 0; b <= v->cache_mask; b++)
+        {
+            struct vfile_cached *c = v->cache[b];
+            while (c)
+            {
+                struct vfile_cached *next = c->next;
+                cache_drop(c);
+                c = next;
+            }
+        }
+        free(v->cache);
+        v->cache = NULL;
+    }
+    pthread_mutex_destroy(&v->lock);
+}
+
+int vfile_add_rule(struct tftp_vfile *v, const char *pattern, const char *template_path)
+{
+    if (v->nrules == VFILE_MAX_RULES)
+    {
+        fprintf(stderr, "Erreur: %d règles de fichiers virtuels au plus\n", VFILE_MAX_RULES);
+        return -1;
+    }
+    struct vfile_rule *r = &v->rules[v->nrules];
+    memset(r, 0, sizeof(*r));
+    const char *star = strchr(pattern, '*');
+    if (star && strchr(star + 1, '*'))
+    {
+        fprintf(stderr, "Erreur: motif '%s' : un seul '*'\n", pattern);
+        return -1;
+    }
+    r->prefix = star ? strndup(pattern, (size_t)(star - pattern)) : strdup(pattern);
+    r->suffix = star ? strdup(star + 1) : NULL;
+    r->src.path = strdup(template_path);
+    if (!r->prefix || (star && !r->suffix) || !r->src.path || load_template(r) < 0)
+    {
+        perror(template_path);
+        free(r->prefix);
+        free(r->suffix);
+        free(r->src.path);
+        free(r->tpl);
+        return -1;
+    }
+    v->nrules++;
+    return 0;
+}
+
+int vfile_set_inventory(struct tftp_vfile *v, const char *path)
+{
+    free(v->inv.path);
+    v->inv.path = strdup(path);
+    if (!v->inv.path || inv_load(v) < 0)
+    {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+int vfile_match(struct tftp_vfile *v, const char *filename)
+{
+    char match[VFILE_MATCH_MAX];
+    return find_rule(v, filename, match) != NULL;
+}
+
+struct tftp_memobj *vfile_get(struct tftp_vfile *v, const char *filename, uint32_t client_addr)
+{
+    char match[VFILE_MATCH_MAX], ip[INET_ADDRSTRLEN];
+    struct in_addr a;
+    a.s_addr = client_addr;
+    inet_ntop(AF_INET, &a, ip, sizeof(ip));
+
+    pthread_mutex_lock(&v->lock);
+    maybe_reload(v, now_ns());
+
+    const struct vfile_rule *r = find_rule(v, filename, match);
+    const struct vfile_inv_entry *e = NULL;
+    if (r && v->inv.path)
+    {
+        e = inv_find(v, match[0] ? match : NULL);
+        if (!e)
+            e = inv_find(v, ip);
+        if (!e)
+            e = inv_find(v, "default");
+    }
+    if (!r || (v->inv.path && !e))
+    {
+        pthread_mutex_unlock(&v->lock);
+        return NULL;
+    }
+
+    // clé du rendu : fichier + client (les versions sont vérifiées à part)
+    char key[600];
+    int kl = snprintf(key, sizeof(key), "%s%c%s", filename, 0, ip);
+    size_t key_len = kl > 0 && (size_t)kl < sizeof(key) ? (size_t)kl : 0;
+    uint32_t b = str_hash(key, key_len) & v->cache_mask;
+    struct vfile_cached *c = v->cache[b];
+    while (c && (c->key_len != key_len || memcmp(c->key, key, key_len) != 0))
+        c = c->next;
+
+    struct tftp_memobj *obj;
+    if (c && c->tpl_version == r->src.version && c->inv_version == v->inv.version)
+    {
+        v->hits++;
+        obj = c->obj;
+        __atomic_add_fetch(&obj->refs, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&v->lock);
+        return obj;
+    }
+
+    obj = render(r, e, ip, filename, match);
+    v->renders++;
+    if (!obj)
+    {
+        pthread_mutex_unlock(&v->lock);
+        return NULL;
+    }
+
+    if (!c && v->cached >= VFILE_CACHE_MAX)
+        cache_purge(v);
+    if (!c && v->cached < VFILE_CACHE_MAX && key_len)
+    {
+        c = calloc(1, sizeof(*c));
+        if (c && (c->key = malloc(key_len)) != NULL)
+        {
+            memcpy(c->key, key, key_len);
+            c->key_len = key_len;
+            c->next = v->cache[b];
+            v->cache[b] = c;
+            v->cached++;
+        }
+        else
+        {
+            free(c);
+            c = NULL;
+        }
+    }
+    if (c)
+    {
+        memobj_release(c->obj); // ancienne version : libérée à la fin de ses transferts
+        c->obj = obj;
+        c->tpl_version = r->src.version;
+        c->inv_version = v->inv.version;
+        __atomic_add_fetch(&obj->refs, 1, __ATOMIC_RELAXED); // référence du cache
+    }
+    pthread_mutex_unlock(&v->lock);
+    return obj;
+}
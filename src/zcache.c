@@ -0,0 +1,318 @@
+#include "zcache.h"
+#include "lz.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ZCACHE_BUCKETS 1024
+
+static uint32_t str_hash(const char *s)
+{
+    uint32_t h = 2166136261u;
+    for (; *s; s++)
+    {
+        h ^= (uint8_t)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void key_of(struct zcache_key *k, const struct stat *st)
+{
+    k->dev = st->st_dev;
+    k->ino = st->st_ino;
+    k->size = st->st_size;
+    k->mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+static int same_key(const struct zcache_key *a, const struct zcache_key *b)
+{
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size && a->mtime_ns == b->mtime_ns;
+}
+
+static void lru_unlink(struct tftp_zcache *z, struct zcache_entry *e)
+{
+    if (e->lru_prev)
+        e->lru_prev->lru_next = e->lru_next;
+    else
+        z->lru_head = e->lru_next;
+    if (e->lru_next)
+        e->lru_next->lru_prev = e->lru_prev;
+    else
+        z->lru_tail = e->lru_prev;
+    e->lru_prev = e->lru_next = NULL;
+}
+
+static void lru_push(struct tftp_zcache *z, struct zcache_entry *e)
+{
+    e->lru_next = z->lru_head;
+    if (z->lru_head)
+        z->lru_head->lru_prev = e;
+    else
+        z->lru_tail = e;
+    z->lru_head = e;
+}
+
+// retirée du cache ; variante libérée à la fin des transferts qui la servent
+static void entry_drop(struct tftp_zcache *z, struct zcache_entry *e)
+{
+    struct zcache_entry **pp = &z->buckets[str_hash(e->name) & z->mask];
+    while (*pp != e)
+        pp = &(*pp)->next;
+    *pp = e->next;
+    lru_unlink(z, e);
+    z->bytes -= e->cost;
+    memobj_release(e->obj);
+    free(e->name);
+    free(e);
+}
+
+// place pour cost octets de plus : entrées les moins récemment servies
+// retirées, sauf celles qu'un transfert sert encore (mémoire non rendue) ;
+// 0 si la place est faite
+static int make_room(struct tftp_zcache *z, size_t cost)
+{
+    struct zcache_entry *e = z->lru_tail;
+    while (e && z->bytes + cost > z->max_bytes)
+    {
+        struct zcache_entry *prev = e->lru_prev;
+        if (!e->obj || __atomic_load_n(&e->obj->refs, __ATOMIC_RELAXED) == 1)
+        {
+            entry_drop(z, e);
+            z->evicted++;
+        }
+        e = prev;
+    }
+    return z->bytes + cost <= z->max_bytes ? 0 : -1;
+}
+
+int zcache_init(struct tftp_zcache *z, size_t max_bytes)
+{
+    memset(z, 0, sizeof(*z));
+    z->buckets = calloc(ZCACHE_BUCKETS, sizeof(*z->buckets));
+    if (!z->buckets)
+        return -1;
+    z->mask = ZCACHE_BUCKETS - 1;
+    z->max_bytes = max_bytes;
+    pthread_mutex_init(&z->lock, NULL);
+    return 0;
+}
+
+void zcache_free(struct tftp_zcache *z)
+{
+    if (!z->buckets)
+        return;
+    while (z->lru_head)
+        entry_drop(z, z->lru_head);
+    free(z->buckets);
+    z->buckets = NULL;
+    pthread_mutex_destroy(&z->lock);
+}
+
+int zcache_lookup(struct tftp_zcache *z, const char *name, const struct stat *st, struct tftp_memobj **o)
+{
+    *o = NULL;
+    if (!z)
+        return 0;
+    struct zcache_key k;
+    key_of(&k, st);
+    int ret = 0;
+    pthread_mutex_lock(&z->lock);
+    struct zcache_entry *e = z->buckets[str_hash(name) & z->mask];
+    while (e && strcmp(e->name, name) != 0)
+        e = e->next;
+    if (e && !same_key(&e->key, &k))
+        entry_drop(z, e); // ancienne version du fichier
+    else if (e)
+    {
+        lru_unlink(z, e);
+        lru_push(z, e);
+        if ((*o = e->obj) != NULL)
+        {
+            __atomic_add_fetch(&e->obj->refs, 1, __ATOMIC_RELAXED);
+            z->hits++;
+            ret = 1;
+        }
+        else
+        {
+            z->skipped++;
+            ret = -1;
+        }
+    }
+    pthread_mutex_unlock(&z->lock);
+    return ret;
+}
+
+int zcache_worth(zcache_read_fn rd, void *ctx, uint64_t size)
+{
+    // fenêtres de lz_worth mises bout à bout : même échantillon que sur le
+    // contenu entier
+    uint8_t sample[LZ_SAMPLES * LZ_SAMPLE_SIZE];
+    if (size <= sizeof(sample))
+        return rd(ctx, sample, (size_t)size, 0) == (ssize_t)size && lz_worth(sample, (size_t)size);
+    uint64_t step = (size - LZ_SAMPLE_SIZE) / (LZ_SAMPLES - 1);
+    for (int s = 0; s < LZ_SAMPLES; s++)
+        if (rd(ctx, sample + (size_t)s * LZ_SAMPLE_SIZE, LZ_SAMPLE_SIZE, (uint64_t)s * step) != LZ_SAMPLE_SIZE)
+            return 0;
+    return lz_worth(sample, sizeof(sample));
+}
+
+// entrée du fichier k : o (référence du cache prise ici) ou NULL si
+// incompressible ; deux workers peuvent produire le même fichier en même
+// temps, le dernier remplace l'autre
+static void insert(struct tftp_zcache *z, const char *name, const struct zcache_key *k, struct tftp_memobj *o)
+{
+    size_t cost = (o ? o->len : 0) + sizeof(struct zcache_entry) + strlen(name) + 1;
+    uint32_t b = str_hash(name) & z->mask;
+    pthread_mutex_lock(&z->lock);
+    if (o)
+        z->compressed++;
+    else
+        z->skipped++;
+    struct zcache_entry *e = z->buckets[b];
+    while (e && strcmp(e->name, name) != 0)
+        e = e->next;
+    if (e)
+        entry_drop(z, e); // ancienne version du fichier
+    if (make_room(z, cost) == 0 && (e = calloc(1, sizeof(*e))) != NULL)
+    {
+        if ((e->name = strdup(name)) == NULL)
+            free(e);
+        else
+        {
+            e->key = *k;
+            e->obj = o;
+            e->cost = cost;
+            if (o)
+                __atomic_add_fetch(&o->refs, 1, __ATOMIC_RELAXED); // référence du cache
+            z->bytes += cost;
+            e->next = z->buckets[b];
+            z->buckets[b] = e;
+            lru_push(z, e);
+        }
+    }
+    pthread_mutex_unlock(&z->lock);
+}
+
+void zcache_skip(struct tftp_zcache *z, const char *name, const struct stat *st)
+{
+    if (!z)
+        return;
+    struct zcache_key k;
+    key_of(&k, st);
+    insert(z, name, &k, NULL);
+}
+
+/* ---------------- Flux ---------------- */
+
+struct zcache_stream *zcache_stream_new(struct tftp_zcache *z, const struct stat *st, uint64_t size)
+{
+    struct zcache_stream *s = calloc(1, sizeof(*s));
+    if (!s)
+        return NULL;
+    s->size = size;
+    if (z && st && size <= ZCACHE_MAX_FILE && lz_bound((size_t)size) <= z->max_bytes)
+    {
+        s->z = z;
+        key_of(&s->key, st);
+    }
+    return s;
+}
+
+struct zcache_stream *zcache_stream_at(uint64_t size, uint64_t src, uint64_t base)
+{
+    struct zcache_stream *s = zcache_stream_new(NULL, NULL, size);
+    if (s)
+    {
+        s->src = s->sbase = src;
+        s->base = base;
+    }
+    return s;
+}
+
+// longueur de la trame en tête de p (en-tête compris)
+static size_t frame_size(const uint8_t *p)
+{
+    uint32_t h = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    return LZ_HDR + (h & ~LZ_RAW);
+}
+
+// trame suivante du contenu ajoutée au flux ; sans cache, trames finies
+// avant from oubliées d'abord
+static int next_frame(struct zcache_stream *s, zcache_read_fn rd, void *ctx, uint64_t from)
+{
+    uint8_t raw[LZ_FRAME];
+    size_t n = s->size - s->src < LZ_FRAME ? (size_t)(s->size - s->src) : LZ_FRAME;
+    if (!s->z)
+    {
+        size_t drop = 0, f;
+        while (drop < s->len && s->base + drop + (f = frame_size(s->buf + drop)) <= from)
+        {
+            drop += f;
+            s->sbase += LZ_FRAME; // seule la dernière trame est plus courte
+        }
+        memmove(s->buf, s->buf + drop, s->len - drop);
+        s->len -= drop;
+        s->base += drop;
+    }
+    if (s->cap - s->len < LZ_HDR + n)
+    {
+        size_t cap = s->cap ? s->cap : LZ_HDR + LZ_FRAME;
+        while (cap - s->len < LZ_HDR + n)
+            cap *= 2;
+        uint8_t *b = realloc(s->buf, cap);
+        if (!b)
+            return -1;
+        s->buf = b;
+        s->cap = cap;
+    }
+    if (rd(ctx, raw, n, s->src) != (ssize_t)n)
+        return -1;
+    s->len += lz_encode_frame(raw, n, s->buf + s->len);
+    s->src += n;
+    return 0;
+}
+
+ssize_t zcache_stream_read(struct zcache_stream *s, zcache_read_fn rd, void *ctx, uint64_t off, uint8_t *out,
+                           size_t len, uint64_t from)
+{
+    while (s->base + s->len < off + len && s->src < s->size)
+    {
+        if (next_frame(s, rd, ctx, from) < 0)
+            return -1;
+    }
+    if (off < s->base)
+        return -1; // déjà oublié : from mal choisi
+    uint64_t end = s->base + s->len;
+    size_t n = off >= end ? 0 : end - off < len ? (size_t)(end - off) : len;
+    if (n)
+        memcpy(out, s->buf + (off - s->base), n);
+    return (ssize_t)n;
+}
+
+struct tftp_memobj *zcache_stream_finish(struct zcache_stream *s, const char *name)
+{
+    if (!s->z || s->src < s->size)
+        return NULL;
+    uint8_t *b = realloc(s->buf, s->len ? s->len : 1); // au plus juste pour le cache
+    if (b)
+        s->buf = b;
+    struct tftp_memobj *o = memobj_adopt(name, s->buf, s->len);
+    if (!o)
+    {
+        s->z = NULL; // servi jusqu'au bout depuis le flux
+        return NULL;
+    }
+    insert(s->z, name, &s->key, o);
+    s->z = NULL;
+    s->buf = NULL;
+    s->len = s->cap = 0;
+    return o;
+}
+
+void zcache_stream_free(struct zcache_stream *s)
+{
+    if (!s)
+        return;
+    free(s->buf);
+    free(s);
+}
@@ -4,6 +4,36 @@
 #include <assert.h>
 #include <arpa/inet.h>
 #include "tftp_utils.h"
+#include "session.h"
+#include "netsim.h"
+#include "metrics.h"
+#include "log.h"
+#include "trace.h"
+#include "accounting.h"
+#include "libtftp.h"
+#include "memstore.h"
+#include "sockets.h"
+#include "vfile.h"
+#include "netascii.h"
+#include "lz.h"
+#include "zcache.h"
+#include "dedup.h"
+#include "handoff.h"
+#include "preload.h"
+#include "affinity.h"
+#include "sockbuf.h"
+#include "tstamp.h"
+#include "pace.h"
+#include "client.h"
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 // pour afficher le buffer en cas d'erreur
 void print_hex(char *buffer, int size)
@@ -462,6 +492,2900 @@ void test_parse_rrq_wrq()
     test_parse_rrq_missing_null_mode();
     printf("=== TOUS LES TESTS PARSE_RRQ_WRQ SONT PASSÉS ! ===\n");
 }
+// --- options (RFC 2347) ---
+void test_build_rrq_opts()
+{
+    printf("Test: RRQ avec options blksize/windowsize... ");
+    uint8_t buffer[DATA_SIZE];
+    struct tftp_opt opts[MAX_OPTIONS];
+    size_t nopts = 0;
+    assert(set_opt(opts, &nopts, MAX_OPTIONS, "blksize", 1428) == 0);
+    assert(set_opt(opts, &nopts, MAX_OPTIONS, "windowsize", 16) == 0);
+
+    int size = build_rrq_wrq_opts(OPCODE_RRQ, buffer, sizeof(buffer), "f", "octet", opts, nopts);
+    // op + "f\0" + "octet\0" + "blksize\0" "1428\0" + "windowsize\0" "16\0"
+    assert(size == 2 + 2 + 6 + 8 + 5 + 11 + 3);
+
+    char fname[16], mode[16];
+    struct tftp_opt parsed[MAX_OPTIONS];
+    size_t np;
+    assert(parse_rrq_wrq_opts(buffer, size, fname, sizeof(fname), mode, sizeof(mode),
+                              parsed, MAX_OPTIONS, &np) == 0);
+    assert(strcmp(fname, "f") == 0 && strcmp(mode, "octet") == 0);
+    assert(np == 2);
+    assert(strcmp(find_opt(parsed, np, "BLKSIZE"), "1428") == 0); // insensible à la casse
+    assert(strcmp(find_opt(parsed, np, "windowsize"), "16") == 0);
+    assert(find_opt(parsed, np, "tsize") == NULL);
+    printf("OK\n");
+}
+
+void test_parse_opts_truncated()
+{
+    printf("Test: Option sans valeur... ");
+    uint8_t buffer[] = {0, 1, 'f', 0, 'o', 'c', 't', 'e', 't', 0, 'b', 'l', 'k', 0};
+    char fname[16], mode[16];
+    struct tftp_opt parsed[MAX_OPTIONS];
+    size_t np;
+    int res = parse_rrq_wrq_opts(buffer, sizeof(buffer), fname, sizeof(fname), mode, sizeof(mode),
+                                 parsed, MAX_OPTIONS, &np);
+    assert(res == -1);
+    printf("OK (Erreur détectée)\n");
+}
+
+void test_oack_roundtrip()
+{
+    printf("Test: OACK build + parse... ");
+    uint8_t buffer[64];
+    struct tftp_opt opts[MAX_OPTIONS];
+    size_t nopts = 0;
+    set_opt(opts, &nopts, MAX_OPTIONS, "blksize", 8192);
+
+    int size = build_oack(buffer, sizeof(buffer), opts, nopts);
+    assert(size == 2 + 8 + 5);
+    assert(buffer[0] == 0 && buffer[1] == 6);
+
+    struct tftp_opt parsed[MAX_OPTIONS];
+    size_t np;
+    assert(parse_oack(buffer, size, parsed, MAX_OPTIONS, &np) == 0);
+    assert(np == 1 && strcmp(find_opt(parsed, np, "blksize"), "8192") == 0);
+
+    assert(build_oack(buffer, 8, opts, nopts) == -1); // buffer trop petit
+    printf("OK\n");
+}
+
+void test_data_header()
+{
+    printf("Test: En-tête DATA seul (blksize > 512)... ");
+    uint8_t buffer[4 + 1400];
+    memset(buffer + 4, 'Z', 1400);
+    assert(build_data_header(buffer, sizeof(buffer), 258) == 4);
+    assert(buffer[0] == 0 && buffer[1] == 3);
+    assert(buffer[2] == 1 && buffer[3] == 2);
+    assert(buffer[4] == 'Z'); // données intactes
+    assert(build_data_header(buffer, 3, 1) == -1);
+    printf("OK\n");
+}
+
+void test_crc32c()
+{
+    printf("Test: CRC32C et empreinte de reprise... ");
+    assert(crc32c(0, "123456789", 9) == 0xE3069283); // valeur de contrôle standard
+    assert(crc32c(crc32c(0, "1234", 4), "56789", 5) == 0xE3069283);
+    assert(crc32c(0, "", 0) == 0);
+
+    static uint8_t buf[RESUME_CRC_SPAN + 1000];
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = (uint8_t)(i * 7);
+    FILE *f = tmpfile();
+    assert(f && fwrite(buf, 1, sizeof(buf), f) == sizeof(buf) && fflush(f) == 0);
+    uint32_t crc;
+    assert(resume_crc_fd(fileno(f), sizeof(buf), &crc) == 0);
+    assert(crc == crc32c(0, buf + 1000, RESUME_CRC_SPAN)); // seulement la fin du préfixe
+    assert(resume_crc_fd(fileno(f), 100, &crc) == 0 && crc == crc32c(0, buf, 100));
+    assert(resume_crc_fd(fileno(f), sizeof(buf) + 1, &crc) == -1); // au-delà de la fin
+    fclose(f);
+    printf("OK\n");
+}
+
+void test_crc32c_impls()
+{
+    printf("Test: CRC32C, instruction SSE4.2 == table... ");
+    static uint8_t buf[4096 + 16];
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = (uint8_t)(i * 131 + (i >> 5));
+    const char *def = crc32c_impl();
+    assert(crc32c_set_impl("bogus") == -1);
+    if (crc32c_set_impl("sse4.2") == 0)
+    {
+        // longueurs et alignements autour des mots de 8 octets
+        size_t lens[] = {0, 1, 7, 8, 9, 15, 63, 512, 1427, 4096};
+        for (size_t a = 0; a < 16; a++)
+            for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++)
+            {
+                assert(crc32c_set_impl("sse4.2") == 0);
+                uint32_t hw = crc32c(0x1234, buf + a, lens[l]);
+                assert(crc32c_set_impl("table") == 0);
+                assert(hw == crc32c(0x1234, buf + a, lens[l]));
+            }
+        assert(crc32c_set_impl("sse4.2") == 0 && crc32c(0, "123456789", 9) == 0xE3069283);
+    }
+    assert(crc32c_set_impl("table") == 0 && strcmp(crc32c_impl(), "table") == 0);
+    assert(crc32c(0, "123456789", 9) == 0xE3069283);
+    assert(crc32c_set_impl(def) == 0);
+    printf("OK\n");
+}
+
+// flux données + somme découpé en blocs de b octets, relu comme le récepteur
+static int sum_stream(const uint8_t *d, size_t n, size_t b, int corrupt, uint8_t *out)
+{
+    uint32_t tx = crc32c(0, d, n), rx = 0;
+    uint8_t tail[SUM_LEN], blk[16], *o = out;
+    uint64_t seen = 0;
+    for (;;)
+    {
+        size_t len = seen < n ? (n - seen < b ? (size_t)(n - seen) : b) : 0;
+        memcpy(blk, d + seen, len);
+        len += sum_put(tx, n, seen + len, blk + len, b - len);
+        if (corrupt && seen == 0 && len)
+            blk[0] ^= 1;
+        o += sum_rx(&rx, tail, seen, blk, len, o);
+        seen += len;
+        if (len < b)
+            break;
+    }
+    assert((size_t)(o - out) == seen - SUM_LEN);
+    return sum_ok(rx, tail, seen);
+}
+
+void test_sum_stream()
+{
+    printf("Test: Somme de bout en bout à cheval sur les blocs... ");
+    uint8_t d[40], out[48];
+    for (size_t i = 0; i < sizeof(d); i++)
+        d[i] = (uint8_t)(i * 37 + 1);
+    for (size_t b = 1; b <= 9; b++)
+        for (size_t n = 0; n <= sizeof(d); n++)
+        {
+            memset(out, 0, sizeof(out));
+            assert(sum_stream(d, n, b, 0, out) == 1);
+            assert(memcmp(out, d, n) == 0);
+            assert(sum_stream(d, n, b, 1, out) == 0); // premier octet du flux altéré
+        }
+    uint8_t tail[SUM_LEN] = {0};
+    assert(sum_ok(0, tail, 3) == 0); // flux plus court que la somme
+    printf("OK\n");
+}
+
+void test_options()
+{
+    printf("\n=== TESTS OPTIONS ===\n");
+    test_build_rrq_opts();
+    test_parse_opts_truncated();
+    test_oack_roundtrip();
+    test_data_header();
+    test_crc32c();
+    test_crc32c_impls();
+    test_sum_stream();
+    printf("=== TOUS LES TESTS OPTIONS SONT PASSÉS ! ===\n");
+}
+
+// --- table de sessions ---
+static struct sockaddr_in mk_peer(uint32_t ip, uint16_t port)
+{
+    struct sockaddr_in a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(ip);
+    a.sin_port = htons(port);
+    return a;
+}
+
+void test_sess_alloc_lookup()
+{
+    printf("Test: Session alloc + lookup... ");
+    struct tftp_sess_table t;
+    assert(sess_table_init(&t, 8) == 0);
+
+    struct sockaddr_in p1 = mk_peer(0x7f000001, 1000);
+    struct sockaddr_in p2 = mk_peer(0x7f000001, 1001);
+    int a = sess_alloc(&t, &p1);
+    int b = sess_alloc(&t, &p2);
+    assert(a >= 0 && b >= 0 && a != b);
+    assert(t.count == 2);
+
+    assert(sess_lookup(&t, p1.sin_addr.s_addr, p1.sin_port) == a);
+    assert(sess_lookup(&t, p2.sin_addr.s_addr, p2.sin_port) == b);
+    assert(sess_lookup(&t, p1.sin_addr.s_addr, htons(1002)) == -1);
+
+    sess_table_free(&t);
+    printf("OK\n");
+}
+
+void test_sess_table_full()
+{
+    printf("Test: Table de sessions pleine... ");
+    struct tftp_sess_table t;
+    assert(sess_table_init(&t, 4) == 0);
+    for (uint16_t i = 0; i < 4; i++)
+    {
+        struct sockaddr_in p = mk_peer(0x0a000001, 2000 + i);
+        assert(sess_alloc(&t, &p) >= 0);
+    }
+    struct sockaddr_in p = mk_peer(0x0a000001, 3000);
+    assert(sess_alloc(&t, &p) == -1);
+    sess_table_free(&t);
+    printf("OK (Erreur détectée)\n");
+}
+
+void test_sess_release_many()
+{
+    printf("Test: Release avec collisions (1000 sessions)... ");
+    struct tftp_sess_table t;
+    assert(sess_table_init(&t, 1000) == 0);
+
+    int idx[1000];
+    for (int i = 0; i < 1000; i++)
+    {
+        struct sockaddr_in p = mk_peer(0x0a000000 + (i % 7), 1024 + i);
+        idx[i] = sess_alloc(&t, &p);
+        assert(idx[i] >= 0);
+    }
+    // on libère une session sur deux : les autres doivent rester trouvables
+    for (int i = 0; i < 1000; i += 2)
+        sess_release(&t, (uint32_t)idx[i]);
+    assert(t.count == 500);
+
+    for (int i = 0; i < 1000; i++)
+    {
+        struct sockaddr_in p = mk_peer(0x0a000000 + (i % 7), 1024 + i);
+        int r = sess_lookup(&t, p.sin_addr.s_addr, p.sin_port);
+        assert(r == ((i % 2) ? idx[i] : -1));
+    }
+    sess_table_free(&t);
+    printf("OK\n");
+}
+
+void test_session_table()
+{
+    printf("\n=== TESTS SESSION_TABLE ===\n");
+    test_sess_alloc_lookup();
+    test_sess_table_full();
+    test_sess_release_many();
+    printf("=== TOUS LES TESTS SESSION_TABLE SONT PASSÉS ! ===\n");
+}
+void test_netsim_parse()
+{
+    printf("Test: Parse spec netsim... ");
+    struct netsim_cfg c;
+    assert(netsim_parse("loss=0.05,dup=0.001,delay=5ms,jitter=500us,dist=normal,reorder=0.1,seed=42", &c) == 0);
+    assert(c.loss == 0.05 && c.dup == 0.001 && c.reorder == 0.1);
+    assert(c.delay_us == 5000 && c.jitter_us == 500);
+    assert(c.dist == NETSIM_DIST_NORMAL && c.seed == 42);
+    assert(c.reorder_delay_us == 1000); // défaut
+    assert(netsim_parse("delay=1s", &c) == 0 && c.delay_us == 1000000);
+    printf("OK\n");
+}
+
+void test_netsim_parse_invalid()
+{
+    printf("Test: Spec netsim invalide... ");
+    struct netsim_cfg c;
+    assert(netsim_parse("loss=1.5", &c) == -1);
+    assert(netsim_parse("delay=3h", &c) == -1);
+    assert(netsim_parse("foo=1", &c) == -1);
+    assert(netsim_parse("loss", &c) == -1);
+    printf("OK (Erreur détectée)\n");
+}
+
+void test_netsim_delay()
+{
+    printf("Test: Datagramme retardé puis émis par net_flush... ");
+    int s = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    assert(s >= 0);
+    struct sockaddr_in a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(s, (struct sockaddr *)&a, sizeof(a)) == 0);
+    socklen_t al = sizeof(a);
+    getsockname(s, (struct sockaddr *)&a, &al);
+
+    assert(netsim_configure("delay=20ms") == 0);
+    uint8_t msg[4] = {1, 2, 3, 4}, rx[8];
+    assert(net_sendto(s, msg, 4, 0, (struct sockaddr *)&a, sizeof(a)) == 4);
+    assert(recv(s, rx, sizeof(rx), 0) == -1 && errno == EAGAIN); // encore retenu
+    int next = net_flush();
+    assert(next > 0 && next <= 20);
+    usleep(25000);
+    assert(net_flush() == -1);
+    assert(recv(s, rx, sizeof(rx), 0) == 4 && memcmp(rx, msg, 4) == 0);
+
+    assert(netsim_configure("loss=1") == 0);
+    assert(net_sendto(s, msg, 4, 0, (struct sockaddr *)&a, sizeof(a)) == 4);
+    usleep(1000);
+    assert(recv(s, rx, sizeof(rx), 0) == -1 && errno == EAGAIN); // perdu
+
+    assert(netsim_configure("") == 0); // plus aucune perturbation
+    net_close(s);
+    printf("OK\n");
+}
+
+void test_netsim()
+{
+    printf("\n=== TESTS NETSIM ===\n");
+    test_netsim_parse();
+    test_netsim_parse_invalid();
+    test_netsim_delay();
+    printf("=== TOUS LES TESTS NETSIM SONT PASSÉS ! ===\n");
+}
+void test_hist_buckets()
+{
+    printf("Test: Classes d'histogramme (bornes, monotonie)... ");
+    unsigned prev = 0;
+    for (uint64_t v = 1; v < (1ULL << 41); v = v * 3 / 2 + 1)
+    {
+        unsigned i = hist_index(v);
+        assert(i < HIST_BUCKETS && i >= prev);
+        if (v < (1ULL << HIST_MAX_EXP))
+        {
+            assert(v < hist_bucket_upper(i));
+            assert(i == 0 || v >= hist_bucket_upper(i - 1));
+            // erreur relative <= 1/16
+            assert((double)(hist_bucket_upper(i) - v) <= (double)v / HIST_SUB + 1);
+        }
+        prev = i;
+    }
+    assert(hist_index(UINT64_MAX) == HIST_BUCKETS - 1);
+    printf("OK\n");
+}
+
+void test_hist_quantile()
+{
+    printf("Test: Quantiles d'histogramme... ");
+    struct tftp_metrics *m = metrics_alloc(2);
+    assert(m != NULL);
+    for (uint64_t v = 1; v <= 1000; v++)
+        hist_record(&m[v % 2], H_BLOCK_RTT, v * 1000); // 1 us .. 1 ms, réparti sur 2 workers
+    metric_add(&m[0], M_RETRANSMITS, 3);
+    metric_add(&m[1], M_RETRANSMITS, 4);
+    metric_add(&m[1], M_DROPS_TID, 5);
+
+    struct tftp_metrics *s = malloc(sizeof(*s));
+    assert(s != NULL);
+    metrics_sum(m, 2, s);
+    assert(s->c[M_RETRANSMITS] == 7);
+    assert(s->h[H_BLOCK_RTT].count == 1000);
+
+    uint64_t p50 = hist_quantile(&s->h[H_BLOCK_RTT], 0.5);
+    uint64_t p99 = hist_quantile(&s->h[H_BLOCK_RTT], 0.99);
+    assert(p50 > 470000 && p50 < 530000);
+    assert(p99 > 930000 && p99 < 1050000);
+    assert(hist_quantile(&s->h[H_TRANSFER], 0.5) == 0); // vide
+
+    char buf[65536];
+    size_t len = metrics_render(m, 2, buf, sizeof(buf));
+    assert(len > 0 && len < sizeof(buf));
+    assert(strstr(buf, "tftp_retransmits_total 7\n") != NULL);
+    assert(strstr(buf, "tftp_socket_drops_total{socket=\"request\"} 0\n") != NULL);
+    assert(strstr(buf, "tftp_socket_drops_total{socket=\"tid\"} 5\n") != NULL);
+    assert(strstr(buf, "tftp_block_rtt_seconds_count 1000\n") != NULL);
+
+    free(s);
+    metrics_free(m);
+    printf("OK\n");
+}
+
+void test_metrics()
+{
+    printf("\n=== TESTS METRICS ===\n");
+    test_hist_buckets();
+    test_hist_quantile();
+    printf("=== TOUS LES TESTS METRICS SONT PASSÉS ! ===\n");
+}
+void test_log_format()
+{
+    printf("Test: Formatage des enregistrements de journal... ");
+    char out[128];
+    uint64_t a[] = {(uint64_t)-5, 42, htonl(0x7f000001), 0xbeef};
+
+    log_format(out, sizeof(out), "d=%d u=%lu ip=%I x=%x 100%%", NULL, a, 4);
+    assert(strcmp(out, "d=-5 u=42 ip=127.0.0.1 x=beef 100%") == 0);
+
+    uint64_t b[] = {htonl(0x0a000002), 6969};
+    log_format(out, sizeof(out), "RRQ from %I:%u file=%s", "a.bin", b, 2);
+    assert(strcmp(out, "RRQ from 10.0.0.2:6969 file=a.bin") == 0);
+
+    // arguments manquants = 0, sortie tronquée proprement
+    log_format(out, sizeof(out), "%u/%u", NULL, a + 1, 1);
+    assert(strcmp(out, "42/0") == 0);
+    size_t len = log_format(out, 8, "0123456789", NULL, NULL, 0);
+    assert(len == 7 && strcmp(out, "0123456") == 0);
+
+    assert(log_parse_level("debug") == LOG_DEBUG);
+    assert(log_parse_level("WARN") == LOG_WARN);
+    assert(log_parse_level("0") == LOG_ERROR);
+    assert(log_parse_level("verbose") == -1);
+    printf("OK\n");
+}
+
+static int log_arg_evals;
+static uint64_t log_counted_arg(void)
+{
+    log_arg_evals++;
+    return 1;
+}
+
+void test_log_async()
+{
+    printf("Test: Journal asynchrone (niveau, anneau, vidage)... ");
+    fflush(stdout);
+
+    // stdout redirigé dans un tube le temps du test
+    int fds[2];
+    assert(pipe(fds) == 0);
+    int saved = dup(STDOUT_FILENO);
+    assert(saved >= 0 && dup2(fds[1], STDOUT_FILENO) >= 0);
+
+    log_set_level(LOG_INFO);
+    assert(log_start() == 0);
+    LOG_DBG("filtré %u", NULL, log_counted_arg()); // arguments non évalués
+    for (int i = 0; i < 100; i++)
+        LOG_INF("ligne %u %s", "async", (uint64_t)i);
+    log_stop();
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(fds[1]);
+
+    static char buf[16384];
+    size_t got = 0;
+    ssize_t r;
+    while ((r = read(fds[0], buf + got, sizeof(buf) - 1 - got)) > 0)
+        got += (size_t)r;
+    close(fds[0]);
+    buf[got] = 0;
+
+    assert(log_arg_evals == 0);
+    assert(log_dropped() == 0);
+    assert(strstr(buf, " INFO  ligne 0 async\n") != NULL);
+    assert(strstr(buf, " INFO  ligne 99 async\n") != NULL);
+    assert(strstr(buf, "filtré") == NULL);
+    int lines = 0;
+    for (size_t i = 0; i < got; i++)
+        lines += buf[i] == '\n';
+    assert(lines == 100);
+    printf("OK\n");
+}
+
+void test_log()
+{
+    printf("\n=== TESTS LOG ===\n");
+    test_log_format();
+    test_log_async();
+    printf("=== TOUS LES TESTS LOG SONT PASSÉS ! ===\n");
+}
+void test_trace_sample()
+{
+    printf("Test: Échantillonnage et anneau de traces... ");
+    struct tftp_trace t;
+    assert(trace_init(&t, 5, 3) == 0);
+    assert(t.cap == 8); // arrondi à la puissance de 2
+
+    // 1 session sur 3, la première comprise
+    uint32_t ids[9];
+    for (int i = 0; i < 9; i++)
+        ids[i] = trace_sample(&t);
+    assert(ids[0] == 1 && ids[1] == 0 && ids[2] == 0);
+    assert(ids[3] == 2 && ids[6] == 3 && ids[8] == 0);
+    assert(trace_sample(NULL) == 0);
+
+    // anneau plein : les plus anciens sont écrasés
+    for (uint64_t i = 0; i < 10; i++)
+        trace_event(&t, 1, TR_RETRANSMIT, 1000 + i, i, 1);
+    assert(t.written == 10);
+    assert(t.ev[0].a == 8 && t.ev[1].a == 9 && t.ev[2].a == 2);
+    trace_free(&t);
+    printf("OK\n");
+}
+
+void test_trace_json()
+{
+    printf("Test: Export Chrome trace-event... ");
+    struct tftp_trace t[2];
+    assert(trace_init(&t[0], 64, 1) == 0);
+    assert(trace_init(&t[1], 64, 1) == 0);
+
+    uint32_t id = trace_sample(&t[1]);
+    trace_request(&t[1], id, 1000000, OPCODE_RRQ, htonl(0x7f000001), htons(6969), "boot/\"vmlinuz\"");
+    trace_event(&t[1], id, TR_OPEN, 1500000, 200000, 4096);
+    trace_event(&t[1], id, TR_FIRST_DATA, 1600000, 600000, 0);
+    struct trace_ev *e = trace_push(&t[1], id, TR_END, 3000000);
+    e->a = 2000000;
+    e->b = 4096;
+    e->c = 2;
+
+    char path[] = "/tmp/tftp_trace_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    assert(trace_write_json(path, t, 2) == 0);
+
+    static char buf[8192];
+    FILE *f = fopen(path, "r");
+    assert(f != NULL);
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    buf[n] = 0;
+    fclose(f);
+    unlink(path);
+
+    assert(strstr(buf, "\"name\":\"worker 1\"") != NULL);
+    assert(strstr(buf, "RRQ boot/\\\"vmlinuz\\\" #1") != NULL); // guillemets échappés
+    assert(strstr(buf, "\"peer\":\"127.0.0.1:6969\"") != NULL);
+    // durées : ts = début (relatif au premier événement), dur en us
+    assert(strstr(buf, "\"name\":\"open\",\"cat\":\"tftp\",\"pid\":1,\"tid\":1,\"ph\":\"X\",\"ts\":300.000,\"dur\":200.000") != NULL);
+    assert(strstr(buf, "\"ph\":\"X\",\"ts\":0.000,\"dur\":2000.000,\"args\":{\"bytes\":4096,\"retransmits\":2}") != NULL);
+    assert(buf[n - 3] == ']' && buf[n - 2] == '}');
+
+    trace_free(&t[0]);
+    trace_free(&t[1]);
+    printf("OK\n");
+}
+
+void test_trace()
+{
+    printf("\n=== TESTS TRACE ===\n");
+    test_trace_sample();
+    test_trace_json();
+    printf("=== TOUS LES TESTS TRACE SONT PASSÉS ! ===\n");
+}
+void test_xfer_format()
+{
+    printf("Test: Ligne de bilan d'un transfert... ");
+    struct tftp_xfer_stats st;
+    memset(&st, 0, sizeof(st));
+    st.side = "server";
+    st.file = "boot/\"a b\"";
+    st.peer_addr = htonl(0x0a000007);
+    st.peer_port = htons(41000);
+    st.op = OPCODE_RRQ;
+    st.result = XFER_OK;
+    st.bytes = 1000000;
+    st.blocks = 701;
+    st.blksize = 1428;
+    st.windowsize = 8;
+    st.tsize = 1000000;
+    st.duration_ns = 500000000; // 0,5 s
+    st.retransmits = 3;
+    rtt_add(&st.rtt, 40000);
+    rtt_add(&st.rtt, 120000);
+    rtt_add(&st.rtt, 80000);
+    assert(st.rtt.samples == 3 && st.rtt.min_ns == 40000 && st.rtt.max_ns == 120000);
+
+    char line[1024];
+    size_t len = xfer_format(&st, line, sizeof(line));
+    assert(len == strlen(line) && line[len - 1] == '\n');
+    assert(strncmp(line, "ts=", 3) == 0);
+    assert(strstr(line, " side=server dir=get peer=10.0.0.7:41000 file=\"boot/\\\"a b\\\"\" result=ok ") != NULL);
+    assert(strstr(line, " bytes=1000000 blocks=701 blksize=1428 windowsize=8 tsize=1000000 ") != NULL);
+    assert(strstr(line, " duration_ms=500.000 goodput_Bps=2000000 retransmits=3 duplicates=0 ") != NULL);
+    assert(strstr(line, " rtt_samples=3 rtt_min_us=40 rtt_avg_us=80 rtt_max_us=120\n") != NULL);
+
+    // échec sans échantillon ni option : pas de rtt_*, tsize=-
+    memset(&st.rtt, 0, sizeof(st.rtt));
+    st.tsize = -1;
+    st.op = OPCODE_WRQ;
+    st.result = XFER_TIMEOUT;
+    xfer_format(&st, line, sizeof(line));
+    assert(strstr(line, " dir=put ") != NULL && strstr(line, " result=timeout ") != NULL);
+    assert(strstr(line, " tsize=- ") != NULL && strstr(line, "rtt_min") == NULL);
+
+    // attente dans la file (horodatage noyau) ; fusion de deux bilans
+    struct tftp_rtt q = {0, 0, 0, 0};
+    rtt_add(&q, 30000);
+    rtt_merge(&st.rxq, &q);
+    rtt_add(&q, 10000);
+    rtt_merge(&st.rxq, &q);
+    assert(st.rxq.samples == 3 && st.rxq.min_ns == 10000 && st.rxq.max_ns == 30000);
+    xfer_format(&st, line, sizeof(line));
+    assert(strstr(line, " rxq_avg_us=23 rxq_max_us=30\n") != NULL);
+    memset(&st.rxq, 0, sizeof(st.rxq));
+
+    // transfert repris
+    st.offset = 4096;
+    xfer_format(&st, line, sizeof(line));
+    assert(strstr(line, " offset=4096\n") != NULL);
+
+    // datagrammes jetés par le noyau (file pleine)
+    st.drops = 12;
+    xfer_format(&st, line, sizeof(line));
+    assert(strstr(line, " offset=4096 drops=12\n") != NULL);
+
+    // tampon trop petit : tronqué, toujours terminé par 0
+    len = xfer_format(&st, line, 32);
+    assert(len == 31 && strlen(line) == 31);
+    printf("OK\n");
+}
+
+void test_accounting()
+{
+    printf("\n=== TESTS ACCOUNTING ===\n");
+    test_xfer_format();
+    printf("=== TOUS LES TESTS ACCOUNTING SONT PASSÉS ! ===\n");
+}
+// ----- libtftp -----
+void test_membuf()
+{
+    printf("Test: Puits / source mémoire... ");
+    struct tftp_membuf m;
+    memset(&m, 0, sizeof(m));
+    struct tftp_sink sink;
+    tftp_sink_mem(&sink, &m);
+    uint8_t blk[512];
+    memset(blk, 'x', sizeof(blk));
+    for (int i = 0; i < 20; i++)
+        assert(sink.write(sink.ctx, (uint64_t)i * sizeof(blk), blk, sizeof(blk)) == 0);
+    assert(m.len == 20 * 512 && m.cap >= m.len && m.data[10239] == 'x');
+
+    struct tftp_source src;
+    tftp_source_mem(&src, &m);
+    assert(src.size == 10240);
+    uint8_t out[600];
+    assert(src.read(src.ctx, 10000, out, sizeof(out)) == 240);
+    assert(src.read(src.ctx, 10240, out, sizeof(out)) == 0);
+    tftp_membuf_free(&m);
+
+    m.max = 1000; // plafond : le transfert est abandonné au-delà
+    assert(sink.write(sink.ctx, 0, blk, sizeof(blk)) == 0);
+    assert(sink.write(sink.ctx, 512, blk, sizeof(blk)) == -1);
+    assert(m.len == 512 && m.cap <= 1000);
+    tftp_membuf_free(&m);
+    printf("OK\n");
+}
+
+// faux serveur : socket UDP sur 127.0.0.1, port éphémère
+static int fake_server(struct sockaddr_in *addr)
+{
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(s >= 0);
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(s, (struct sockaddr *)addr, sizeof(*addr)) == 0);
+    socklen_t sl = sizeof(*addr);
+    assert(getsockname(s, (struct sockaddr *)addr, &sl) == 0);
+    return s;
+}
+
+static int done_calls;
+static void on_done(struct tftp_xfer *x, void *user)
+{
+    assert(user == &done_calls && tftp_xfer_done(x));
+    done_calls++;
+}
+
+void test_xfer_get()
+{
+    printf("Test: GET non bloquant vers un tampon mémoire... ");
+    struct sockaddr_in srv, peer;
+    int s = fake_server(&srv);
+    struct tftp_membuf m;
+    memset(&m, 0, sizeof(m));
+
+    struct tftp_xfer_req req;
+    memset(&req, 0, sizeof(req));
+    req.op = OPCODE_RRQ;
+    req.server = srv;
+    req.remote = "pxelinux.0";
+    tftp_sink_mem(&req.sink, &m);
+    req.on_done = on_done;
+    req.user = &done_calls;
+    done_calls = 0;
+    struct tftp_xfer *x = tftp_xfer_start(&req);
+    assert(x && tftp_xfer_fd(x) >= 0 && tftp_xfer_timeout_ms(x) > 0);
+
+    uint8_t buf[1024];
+    char fname[64], mode[16];
+    ssize_t n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+    uint16_t op;
+    assert(n > 0 && parse_opcode(buf, (size_t)n, &op) == 0 && op == OPCODE_RRQ);
+    assert(parse_rrq_wrq(buf, (size_t)n, fname, sizeof(fname), mode, sizeof(mode)) == 0);
+    assert(strcmp(fname, "pxelinux.0") == 0);
+
+    // rien de lisible : l'appel ne bloque pas
+    assert(tftp_xfer_process_events(x) == 1);
+
+    uint8_t data[4 + DATA_SIZE];
+    memset(data + 4, 'a', DATA_SIZE);
+    build_data_header(data, sizeof(data), 1);
+    sendto(s, data, sizeof(data), 0, (struct sockaddr *)&peer, sizeof(peer));
+    assert(tftp_xfer_process_events(x) == 1);
+    uint16_t blk;
+    n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+    assert(n == 4 && parse_block(buf, 4, &blk) == 0 && blk == 1);
+
+    build_data_header(data, sizeof(data), 2);
+    memset(data + 4, 'b', 10);
+    sendto(s, data, 14, 0, (struct sockaddr *)&peer, sizeof(peer));
+    assert(tftp_xfer_process_events(x) == 0);
+    assert(done_calls == 1 && tftp_xfer_fd(x) == -1 && tftp_xfer_timeout_ms(x) == -1);
+    n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+    assert(n == 4 && parse_block(buf, 4, &blk) == 0 && blk == 2);
+
+    const struct tftp_xfer_stats *st = tftp_xfer_stats(x);
+    assert(tftp_xfer_result(x) == XFER_OK && st->bytes == 522 && st->blocks == 2);
+    assert(m.len == 522 && m.data[511] == 'a' && m.data[512] == 'b');
+    tftp_xfer_free(x);
+    tftp_membuf_free(&m);
+    close(s);
+    printf("OK\n");
+}
+
+// source en flux : 700 octets générés, taille inconnue à l'avance
+static ssize_t pattern_read(void *ctx, uint64_t off, uint8_t *buf, size_t len)
+{
+    (void)ctx;
+    size_t n = 0;
+    for (; n < len && off + n < 700; n++)
+        buf[n] = (uint8_t)(off + n);
+    return (ssize_t)n;
+}
+
+void test_xfer_put_stream()
+{
+    printf("Test: PUT non bloquant depuis une source en flux... ");
+    struct sockaddr_in srv, peer;
+    int s = fake_server(&srv);
+
+    struct tftp_xfer_req req;
+    memset(&req, 0, sizeof(req));
+    req.op = OPCODE_WRQ;
+    req.server = srv;
+    req.remote = "upload.bin";
+    req.source.read = pattern_read;
+    req.source.size = TFTP_SIZE_UNKNOWN;
+    struct tftp_xfer *x = tftp_xfer_start(&req);
+    assert(x);
+
+    uint8_t buf[1024], ack[4];
+    ssize_t n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+    uint16_t op, blk;
+    assert(n > 0 && parse_opcode(buf, (size_t)n, &op) == 0 && op == OPCODE_WRQ);
+
+    size_t expect_len[2] = {DATA_SIZE, 700 - DATA_SIZE};
+    for (uint16_t b = 0; b <= 2; b++)
+    {
+        build_ack(ack, sizeof(ack), b);
+        sendto(s, ack, sizeof(ack), 0, (struct sockaddr *)&peer, sizeof(peer));
+        assert(tftp_xfer_process_events(x) == (b < 2));
+        if (b == 2)
+            break;
+        n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+        assert(n == (ssize_t)(4 + expect_len[b]) && parse_block(buf, (size_t)n, &blk) == 0 && blk == b + 1);
+        assert(buf[4] == (uint8_t)(b * DATA_SIZE));
+    }
+    assert(tftp_xfer_result(x) == XFER_OK && tftp_xfer_stats(x)->bytes == 700);
+    tftp_xfer_free(x);
+    close(s);
+    printf("OK\n");
+}
+
+void test_xfer_peer_error()
+{
+    printf("Test: ERROR du serveur -> résultat et message... ");
+    struct sockaddr_in srv, peer;
+    int s = fake_server(&srv);
+    struct tftp_membuf m;
+    memset(&m, 0, sizeof(m));
+
+    struct tftp_xfer_req req;
+    memset(&req, 0, sizeof(req));
+    req.op = OPCODE_RRQ;
+    req.server = srv;
+    req.remote = "absent";
+    tftp_sink_mem(&req.sink, &m);
+    struct tftp_xfer *x = tftp_xfer_start(&req);
+    assert(x);
+
+    uint8_t buf[1024];
+    assert(recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000) > 0);
+    int el = build_error(buf, sizeof(buf), 1, "File not found");
+    sendto(s, buf, (size_t)el, 0, (struct sockaddr *)&peer, sizeof(peer));
+    assert(tftp_xfer_process_events(x) == 0);
+    assert(tftp_xfer_result(x) == XFER_PEER_ERROR);
+    assert(strcmp(tftp_xfer_error(x), "TFTP ERROR 1: File not found") == 0);
+    assert(m.len == 0);
+    tftp_xfer_free(x);
+    close(s);
+
+    // requête invalide : pas de poignée
+    req.sink.write = NULL;
+    errno = 0;
+    assert(tftp_xfer_start(&req) == NULL && errno == EINVAL);
+    printf("OK\n");
+}
+
+void test_xfer_get_resume()
+{
+    printf("Test: GET repris (offset retenu par le serveur)... ");
+    struct sockaddr_in srv, peer;
+    int s = fake_server(&srv);
+    struct tftp_membuf m;
+    memset(&m, 0, sizeof(m));
+    m.data = malloc(1000);
+    m.len = m.cap = 1000;
+    memset(m.data, 'p', 1000);
+
+    struct tftp_xfer_req req;
+    memset(&req, 0, sizeof(req));
+    req.op = OPCODE_RRQ;
+    req.server = srv;
+    req.remote = "image.iso";
+    req.offset = 1000;
+    req.offset_check = 1;
+    req.offset_crc = crc32c(0, m.data, 1000);
+    tftp_sink_mem(&req.sink, &m);
+    struct tftp_xfer *x = tftp_xfer_start(&req);
+    assert(x);
+
+    uint8_t buf[1024];
+    char fname[64], mode[16];
+    struct tftp_opt opts[MAX_OPTIONS];
+    size_t nopts;
+    ssize_t n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+    assert(n > 0 && parse_rrq_wrq_opts(buf, (size_t)n, fname, sizeof(fname), mode, sizeof(mode),
+                                       opts, MAX_OPTIONS, &nopts) == 0);
+    assert(strcmp(find_opt(opts, nopts, "offset"), "1000") == 0);
+    assert(strtoul(find_opt(opts, nopts, "offcrc"), NULL, 10) == req.offset_crc);
+
+    // le serveur arrondit au bloc : DATA(1) porte l'octet 512
+    nopts = 0;
+    set_opt(opts, &nopts, MAX_OPTIONS, "offset", 512);
+    int len = build_oack(buf, sizeof(buf), opts, nopts);
+    sendto(s, buf, (size_t)len, 0, (struct sockaddr *)&peer, sizeof(peer));
+    assert(tftp_xfer_process_events(x) == 1);
+    uint16_t blk;
+    n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+    assert(n == 4 && parse_block(buf, 4, &blk) == 0 && blk == 0);
+
+    uint8_t data[4 + 10];
+    build_data_header(data, sizeof(data), 1);
+    memset(data + 4, 'z', 10);
+    sendto(s, data, sizeof(data), 0, (struct sockaddr *)&peer, sizeof(peer));
+    assert(tftp_xfer_process_events(x) == 0);
+    const struct tftp_xfer_stats *st = tftp_xfer_stats(x);
+    assert(tftp_xfer_result(x) == XFER_OK && st->offset == 512 && st->bytes == 10);
+    assert(m.data[511] == 'p' && m.data[512] == 'z' && m.data[521] == 'z');
+    n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000); // ACK(1) final
+    assert(n == 4 && parse_block(buf, 4, &blk) == 0 && blk == 1);
+    tftp_xfer_free(x);
+
+    // offset plus grand que demandé : OACK refusé
+    x = tftp_xfer_start(&req);
+    assert(x && recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000) > 0);
+    nopts = 0;
+    set_opt(opts, &nopts, MAX_OPTIONS, "offset", 1024);
+    len = build_oack(buf, sizeof(buf), opts, nopts);
+    sendto(s, buf, (size_t)len, 0, (struct sockaddr *)&peer, sizeof(peer));
+    assert(tftp_xfer_process_events(x) == 0 && tftp_xfer_result(x) == XFER_REJECTED);
+    tftp_xfer_free(x);
+    tftp_membuf_free(&m);
+    close(s);
+    printf("OK\n");
+}
+
+void test_xfer_get_range()
+{
+    printf("Test: GET d'une plage (length, tsize)... ");
+    struct sockaddr_in srv, peer;
+    int s = fake_server(&srv);
+    struct tftp_membuf m;
+    memset(&m, 0, sizeof(m));
+
+    struct tftp_xfer_req req;
+    memset(&req, 0, sizeof(req));
+    req.op = OPCODE_RRQ;
+    req.server = srv;
+    req.remote = "image.iso";
+    req.offset = 4096;
+    req.length = 600;
+    req.tsize = 1;
+    tftp_sink_mem(&req.sink, &m);
+    struct tftp_xfer *x = tftp_xfer_start(&req);
+    assert(x);
+
+    uint8_t buf[1024];
+    char fname[64], mode[16];
+    struct tftp_opt opts[MAX_OPTIONS];
+    size_t nopts;
+    ssize_t n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+    assert(n > 0 && parse_rrq_wrq_opts(buf, (size_t)n, fname, sizeof(fname), mode, sizeof(mode),
+                                       opts, MAX_OPTIONS, &nopts) == 0);
+    assert(strcmp(find_opt(opts, nopts, "offset"), "4096") == 0);
+    assert(strcmp(find_opt(opts, nopts, "length"), "600") == 0);
+    assert(strcmp(find_opt(opts, nopts, "tsize"), "0") == 0);
+    assert(find_opt(opts, nopts, "offcrc") == NULL);
+
+    // tsize : taille du fichier entier, pas de la plage
+    nopts = 0;
+    set_opt(opts, &nopts, MAX_OPTIONS, "offset", 4096);
+    set_opt(opts, &nopts, MAX_OPTIONS, "length", 600);
+    set_opt(opts, &nopts, MAX_OPTIONS, "tsize", 1048576);
+    int len = build_oack(buf, sizeof(buf), opts, nopts);
+    sendto(s, buf, (size_t)len, 0, (struct sockaddr *)&peer, sizeof(peer));
+    assert(tftp_xfer_process_events(x) == 1);
+    uint16_t blk;
+    n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+    assert(n == 4 && parse_block(buf, 4, &blk) == 0 && blk == 0);
+
+    uint8_t data[4 + DATA_SIZE];
+    size_t dlen[2] = {DATA_SIZE, 600 - DATA_SIZE};
+    for (uint16_t b = 1; b <= 2; b++)
+    {
+        build_data_header(data, sizeof(data), b);
+        memset(data + 4, 'a' + b, dlen[b - 1]);
+        sendto(s, data, 4 + dlen[b - 1], 0, (struct sockaddr *)&peer, sizeof(peer));
+        assert(tftp_xfer_process_events(x) == (b < 2));
+        n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+        assert(n == 4 && parse_block(buf, 4, &blk) == 0 && blk == b);
+    }
+    const struct tftp_xfer_stats *st = tftp_xfer_stats(x);
+    assert(tftp_xfer_result(x) == XFER_OK && st->offset == 4096 && st->bytes == 600);
+    assert(st->tsize == 1048576);
+    assert(m.len == 4096 + 600 && m.data[4096] == 'b' && m.data[4096 + DATA_SIZE] == 'c');
+    tftp_xfer_free(x);
+    tftp_membuf_free(&m);
+    close(s);
+    printf("OK\n");
+}
+
+void test_xfer_netascii()
+{
+    printf("Test: GET / PUT netascii (paires coupées entre deux blocs)... ");
+    struct sockaddr_in srv, peer;
+    int s = fake_server(&srv);
+    struct tftp_membuf m;
+    memset(&m, 0, sizeof(m));
+
+    // GET : CR en fin de DATA(1), LF en tête de DATA(2)
+    struct tftp_xfer_req req;
+    memset(&req, 0, sizeof(req));
+    req.op = OPCODE_RRQ;
+    req.server = srv;
+    req.remote = "switch.cfg";
+    req.netascii = 1;
+    req.offset = 100; // ignoré en netascii
+    tftp_sink_mem(&req.sink, &m);
+    struct tftp_xfer *x = tftp_xfer_start(&req);
+    assert(x);
+    uint8_t buf[1024], pkt[4 + DATA_SIZE];
+    char fname[64], mode[16];
+    struct tftp_opt opts[MAX_OPTIONS];
+    size_t nopts;
+    ssize_t n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+    assert(n > 0 && parse_rrq_wrq_opts(buf, (size_t)n, fname, sizeof(fname), mode, sizeof(mode),
+                                       opts, MAX_OPTIONS, &nopts) == 0);
+    assert(strcmp(mode, "netascii") == 0 && nopts == 0);
+    build_data_header(pkt, sizeof(pkt), 1);
+    memset(pkt + 4, 'a', DATA_SIZE - 1);
+    pkt[4 + DATA_SIZE - 1] = '\r';
+    sendto(s, pkt, sizeof(pkt), 0, (struct sockaddr *)&peer, sizeof(peer));
+    assert(tftp_xfer_process_events(x) == 1);
+    build_data_header(pkt, sizeof(pkt), 2);
+    memcpy(pkt + 4, "\n\r\0z\r", 5);
+    sendto(s, pkt, 9, 0, (struct sockaddr *)&peer, sizeof(peer));
+    assert(tftp_xfer_process_events(x) == 0 && tftp_xfer_result(x) == XFER_OK);
+    assert(tftp_xfer_stats(x)->bytes == DATA_SIZE + 5);
+    assert(m.len == DATA_SIZE - 1 + 4 && memcmp(m.data + DATA_SIZE - 1, "\n\rz\r", 4) == 0);
+    assert(recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000) == 4); // ACK(1)
+    assert(recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000) == 4); // ACK(2)
+    tftp_xfer_free(x);
+
+    // PUT : LF à l'octet 511 -> CR dans DATA(1), LF dans DATA(2), relu à la
+    // retransmission
+    memcpy(m.data + DATA_SIZE - 1, "\ny\r", 3);
+    m.len = DATA_SIZE + 2;
+    memset(&req, 0, sizeof(req));
+    req.op = OPCODE_WRQ;
+    req.server = srv;
+    req.remote = "switch.cfg";
+    req.windowsize = 2;
+    req.netascii = 1;
+    tftp_source_mem(&req.source, &m);
+    x = tftp_xfer_start(&req);
+    assert(x && recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000) > 0);
+    nopts = 0;
+    set_opt(opts, &nopts, MAX_OPTIONS, "windowsize", 2);
+    int len = build_oack(buf, sizeof(buf), opts, nopts);
+    sendto(s, buf, (size_t)len, 0, (struct sockaddr *)&peer, sizeof(peer));
+    assert(tftp_xfer_process_events(x) == 1);
+    uint16_t blk;
+    n = recvfrom_timeout(s, pkt, sizeof(pkt), &peer, 1000);
+    assert(n == 4 + DATA_SIZE && parse_block(pkt, (size_t)n, &blk) == 0 && blk == 1);
+    assert(pkt[4] == 'a' && pkt[4 + DATA_SIZE - 1] == '\r');
+    for (int round = 0; round < 2; round++)
+    {
+        n = recvfrom_timeout(s, pkt, sizeof(pkt), &peer, 1000);
+        assert(n == 4 + 4 && parse_block(pkt, (size_t)n, &blk) == 0 && blk == 2);
+        assert(memcmp(pkt + 4, "\ny\r\0", 4) == 0);
+        build_ack(buf, 4, (uint16_t)(round + 1)); // ACK(1) : DATA(2) renvoyé
+        sendto(s, buf, 4, 0, (struct sockaddr *)&peer, sizeof(peer));
+        assert(tftp_xfer_process_events(x) == (round == 0));
+    }
+    assert(tftp_xfer_result(x) == XFER_OK && tftp_xfer_stats(x)->bytes == DATA_SIZE + 4);
+    tftp_xfer_free(x);
+    tftp_membuf_free(&m);
+    close(s);
+    printf("OK\n");
+}
+
+void test_xfer_checksum()
+{
+    printf("Test: GET / PUT avec somme CRC32C (checksum)... ");
+    struct sockaddr_in srv, peer;
+    int s = fake_server(&srv);
+    uint8_t src[DATA_SIZE], buf[1024], pkt[4 + DATA_SIZE];
+    for (size_t i = 0; i < sizeof(src); i++)
+        src[i] = (uint8_t)(i * 13);
+    uint32_t crc = crc32c(0, src, 510);
+    uint8_t be[SUM_LEN] = {(uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc};
+    char fname[64], mode[16];
+    struct tftp_opt opts[MAX_OPTIONS];
+    size_t nopts;
+    uint16_t op, blk;
+
+    // GET de 510 octets : DATA(1) = 510 + 2 octets de somme, DATA(2) = les 2
+    // derniers ; second passage avec une somme fausse
+    for (int bad = 0; bad < 2; bad++)
+    {
+        struct tftp_membuf m;
+        memset(&m, 0, sizeof(m));
+        struct tftp_xfer_req req;
+        memset(&req, 0, sizeof(req));
+        req.op = OPCODE_RRQ;
+        req.server = srv;
+        req.remote = "kernel";
+        req.checksum = 1;
+        tftp_sink_mem(&req.sink, &m);
+        struct tftp_xfer *x = tftp_xfer_start(&req);
+        assert(x);
+        ssize_t n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+        assert(n > 0 && parse_rrq_wrq_opts(buf, (size_t)n, fname, sizeof(fname), mode, sizeof(mode),
+                                           opts, MAX_OPTIONS, &nopts) == 0);
+        assert(strcmp(find_opt(opts, nopts, "checksum"), "crc32c") == 0);
+        nopts = 0;
+        set_opt_str(opts, &nopts, MAX_OPTIONS, "checksum", "crc32c");
+        int len = build_oack(buf, sizeof(buf), opts, nopts);
+        sendto(s, buf, (size_t)len, 0, (struct sockaddr *)&peer, sizeof(peer));
+        assert(tftp_xfer_process_events(x) == 1);
+        assert(recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000) == 4); // ACK(0)
+
+        build_data_header(pkt, sizeof(pkt), 1);
+        memcpy(pkt + 4, src, 510);
+        memcpy(pkt + 4 + 510, be, 2);
+        sendto(s, pkt, sizeof(pkt), 0, (struct sockaddr *)&peer, sizeof(peer));
+        assert(tftp_xfer_process_events(x) == 1);
+        assert(recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000) == 4); // ACK(1)
+        build_data_header(pkt, sizeof(pkt), 2);
+        memcpy(pkt + 4, be + 2, 2);
+        pkt[5] ^= (uint8_t)bad;
+        sendto(s, pkt, 6, 0, (struct sockaddr *)&peer, sizeof(peer));
+        assert(tftp_xfer_process_events(x) == 0);
+        n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+        assert(n > 0 && parse_opcode(buf, (size_t)n, &op) == 0);
+        assert(op == (bad ? OPCODE_ERROR : OPCODE_ACK));
+        assert(tftp_xfer_result(x) == (bad ? XFER_CHECKSUM : XFER_OK));
+        assert(tftp_xfer_stats(x)->bytes == 510 && m.len == 510 && memcmp(m.data, src, 510) == 0);
+        tftp_xfer_free(x);
+        tftp_membuf_free(&m);
+    }
+
+    // PUT de 510 octets : même découpage côté émetteur
+    struct tftp_membuf m = {src, 510, 510, 0};
+    struct tftp_xfer_req req;
+    memset(&req, 0, sizeof(req));
+    req.op = OPCODE_WRQ;
+    req.server = srv;
+    req.remote = "kernel";
+    req.checksum = 1;
+    tftp_source_mem(&req.source, &m);
+    struct tftp_xfer *x = tftp_xfer_start(&req);
+    assert(x && recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000) > 0);
+    nopts = 0;
+    set_opt_str(opts, &nopts, MAX_OPTIONS, "checksum", "crc32c");
+    int len = build_oack(buf, sizeof(buf), opts, nopts);
+    sendto(s, buf, (size_t)len, 0, (struct sockaddr *)&peer, sizeof(peer));
+    assert(tftp_xfer_process_events(x) == 1);
+    ssize_t n = recvfrom_timeout(s, pkt, sizeof(pkt), &peer, 1000);
+    assert(n == 4 + DATA_SIZE && parse_block(pkt, (size_t)n, &blk) == 0 && blk == 1);
+    assert(memcmp(pkt + 4, src, 510) == 0 && memcmp(pkt + 4 + 510, be, 2) == 0);
+    build_ack(buf, 4, 1);
+    sendto(s, buf, 4, 0, (struct sockaddr *)&peer, sizeof(peer));
+    assert(tftp_xfer_process_events(x) == 1);
+    n = recvfrom_timeout(s, pkt, sizeof(pkt), &peer, 1000);
+    assert(n == 4 + 2 && parse_block(pkt, (size_t)n, &blk) == 0 && blk == 2);
+    assert(memcmp(pkt + 4, be + 2, 2) == 0);
+    build_ack(buf, 4, 2);
+    sendto(s, buf, 4, 0, (struct sockaddr *)&peer, sizeof(peer));
+    assert(tftp_xfer_process_events(x) == 0 && tftp_xfer_result(x) == XFER_OK);
+    assert(tftp_xfer_stats(x)->bytes == 510);
+    tftp_xfer_free(x);
+    close(s);
+    printf("OK\n");
+}
+
+void test_xfer_compress()
+{
+    printf("Test: GET compressé (compress=lz, décodage en flux)... ");
+    struct sockaddr_in srv, peer;
+    int s = fake_server(&srv);
+    static uint8_t src[100000], stream[100000 + 16];
+    for (size_t i = 0; i < sizeof(src); i++)
+        src[i] = (uint8_t)"kernel line\n"[i % 12] + (uint8_t)(i / 4096 % 3);
+    size_t slen = lz_encode(src, sizeof(src), stream);
+    assert(slen < sizeof(src) / 4);
+    uint8_t buf[1024], pkt[4 + DATA_SIZE];
+    char fname[64], mode[16];
+    struct tftp_opt opts[MAX_OPTIONS];
+    size_t nopts;
+    uint16_t op;
+
+    // second passage : flux coupé au milieu de la dernière trame
+    for (int cut = 0; cut < 2; cut++)
+    {
+        size_t wire = slen - (size_t)cut * 7;
+        struct tftp_membuf m;
+        memset(&m, 0, sizeof(m));
+        struct tftp_xfer_req req;
+        memset(&req, 0, sizeof(req));
+        req.op = OPCODE_RRQ;
+        req.server = srv;
+        req.remote = "kernel";
+        req.compress = 1;
+        tftp_sink_mem(&req.sink, &m);
+        struct tftp_xfer *x = tftp_xfer_start(&req);
+        assert(x);
+        ssize_t n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+        assert(n > 0 && parse_rrq_wrq_opts(buf, (size_t)n, fname, sizeof(fname), mode, sizeof(mode),
+                                           opts, MAX_OPTIONS, &nopts) == 0);
+        assert(strcmp(find_opt(opts, nopts, "compress"), "lz") == 0);
+        nopts = 0;
+        set_opt_str(opts, &nopts, MAX_OPTIONS, "compress", "lz");
+        int len = build_oack(buf, sizeof(buf), opts, nopts);
+        sendto(s, buf, (size_t)len, 0, (struct sockaddr *)&peer, sizeof(peer));
+        assert(tftp_xfer_process_events(x) == 1);
+        assert(recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000) == 4); // ACK(0)
+
+        size_t blocks = wire / DATA_SIZE + 1;
+        for (size_t b = 0; b < blocks; b++)
+        {
+            size_t off = b * DATA_SIZE, k = wire - off < DATA_SIZE ? wire - off : DATA_SIZE;
+            build_data_header(pkt, sizeof(pkt), (uint16_t)(b + 1));
+            memcpy(pkt + 4, stream + off, k);
+            sendto(s, pkt, 4 + k, 0, (struct sockaddr *)&peer, sizeof(peer));
+            assert(tftp_xfer_process_events(x) == (b + 1 < blocks ? 1 : 0));
+            n = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+            assert(n > 0 && parse_opcode(buf, (size_t)n, &op) == 0);
+            assert(op == (cut && b + 1 == blocks ? OPCODE_ERROR : OPCODE_ACK));
+        }
+        assert(tftp_xfer_result(x) == (cut ? XFER_LOCAL_ERROR : XFER_OK));
+        if (!cut)
+        {
+            assert(tftp_xfer_stats(x)->bytes == wire); // octets sur le réseau
+            assert(m.len == sizeof(src) && memcmp(m.data, src, sizeof(src)) == 0);
+        }
+        tftp_xfer_free(x);
+        tftp_membuf_free(&m);
+    }
+    close(s);
+    printf("OK\n");
+}
+
+void test_libtftp()
+{
+    printf("\n=== TESTS LIBTFTP ===\n");
+    test_membuf();
+    test_xfer_get();
+    test_xfer_put_stream();
+    test_xfer_peer_error();
+    test_xfer_get_resume();
+    test_xfer_get_range();
+    test_xfer_netascii();
+    test_xfer_checksum();
+    test_xfer_compress();
+    printf("=== TOUS LES TESTS LIBTFTP SONT PASSÉS ! ===\n");
+}
+
+/* ========================= TESTS SERVEUR ========================= */
+
+// ./tftp_server (make tests le construit) sur un port libre de loopback,
+// racine SERVER_ROOT, sortie jetée ; prêt quand il répond à un RRQ
+#define SERVER_ROOT "/tmp/tftp_test_server"
+
+static uint16_t server_port;
+
+static pid_t server_start(void)
+{
+    struct sockaddr_in a;
+    int s = fake_server(&a); // port choisi par le noyau, libéré aussitôt
+    close(s);
+    server_port = ntohs(a.sin_port);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+    {
+        char port[8];
+        snprintf(port, sizeof(port), "%u", server_port);
+        int fd = open("/dev/null", O_WRONLY);
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        execl("./tftp_server", "tftp_server", port, SERVER_ROOT, (char *)NULL);
+        _exit(127);
+    }
+
+    a.sin_port = htons(server_port);
+    s = socket(AF_INET, SOCK_DGRAM, 0);
+    uint8_t req[64], rx[512];
+    int len = build_rrq_wrq(OPCODE_RRQ, req, sizeof(req), "__probe__");
+    struct sockaddr_in src;
+    int ready = 0;
+    for (int i = 0; i < 50 && !ready; i++)
+    {
+        sendto(s, req, (size_t)len, 0, (struct sockaddr *)&a, sizeof(a));
+        ready = recvfrom_timeout(s, rx, sizeof(rx), &src, 100) > 0;
+    }
+    close(s);
+    assert(ready);
+    return pid;
+}
+
+static void server_stop(pid_t pid)
+{
+    int status;
+    kill(pid, SIGINT);
+    assert(waitpid(pid, &status, 0) == pid);
+}
+
+// contenu pseudo-aléatoire de len octets écrit sous SERVER_ROOT
+static uint8_t *server_file(const char *name, size_t len)
+{
+    uint8_t *data = malloc(len);
+    assert(data);
+    uint32_t rnd = 7;
+    for (size_t i = 0; i < len; i++)
+    {
+        rnd = rnd * 1103515245u + 12345u;
+        data[i] = (uint8_t)(rnd >> 16);
+    }
+    char path[128];
+    snprintf(path, sizeof(path), SERVER_ROOT "/%s", name);
+    FILE *f = fopen(path, "w");
+    assert(f && fwrite(data, 1, len, f) == len);
+    fclose(f);
+    return data;
+}
+
+void test_server_range()
+{
+    printf("Test: Serveur, plages hors bloc (blksize réduit, GET par plages)... ");
+    size_t size = 1000000;
+    uint8_t *data = server_file("image.bin", size);
+    pid_t pid = server_start();
+    struct sockaddr_in srv;
+    memset(&srv, 0, sizeof(srv));
+    srv.sin_family = AF_INET;
+    srv.sin_port = htons(server_port);
+    srv.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // plage alignée sur 65535, blksize ramené à 65464 : début arrondi au
+    // bloc accordé, fin toujours offset + length
+    struct tftp_membuf m;
+    memset(&m, 0, sizeof(m));
+    struct tftp_xfer_req req;
+    memset(&req, 0, sizeof(req));
+    req.op = OPCODE_RRQ;
+    req.server = srv;
+    req.remote = "image.bin";
+    req.blksize = 65535;
+    req.offset = 4 * 65535;
+    req.length = 4 * 65535;
+    tftp_sink_mem(&req.sink, &m);
+    struct tftp_xfer *x = tftp_xfer_start(&req);
+    assert(x);
+    while (!tftp_xfer_done(x))
+    {
+        struct pollfd p = {tftp_xfer_fd(x), POLLIN, 0};
+        poll(&p, 1, tftp_xfer_timeout_ms(x));
+        tftp_xfer_process_events(x);
+    }
+    const struct tftp_xfer_stats *st = tftp_xfer_stats(x);
+    assert(tftp_xfer_result(x) == XFER_OK && st->blksize == 65464);
+    assert(st->offset == 4 * 65464 && st->offset + st->bytes == 8 * 65535);
+    assert(m.len == 8 * 65535 && memcmp(m.data + st->offset, data + st->offset, st->bytes) == 0);
+    tftp_xfer_free(x);
+    tftp_membuf_free(&m);
+
+    // GET en 4 plages avec le même blksize refusé : fichier identique
+    struct tftp_client_opts o;
+    memset(&o, 0, sizeof(o));
+    o.blksize = 65535;
+    o.stripes = 4;
+    o.quiet = 1;
+    assert(tftp_client_get_opts("127.0.0.1", server_port, "image.bin", SERVER_ROOT "/out.bin", &o) == 0);
+    FILE *f = fopen(SERVER_ROOT "/out.bin", "r");
+    assert(f);
+    uint8_t *out = malloc(size + 1);
+    assert(out && fread(out, 1, size + 1, f) == size && memcmp(out, data, size) == 0);
+    fclose(f);
+    free(out);
+
+    server_stop(pid);
+    free(data);
+    printf("OK\n");
+}
+
+// somme CRC32C gros-boutiste de data, faussée si bad
+static void sum_be(uint8_t *out, const uint8_t *data, size_t len, int bad)
+{
+    uint32_t crc = crc32c(0, data, len) ^ (uint32_t)bad;
+    out[0] = (uint8_t)(crc >> 24);
+    out[1] = (uint8_t)(crc >> 16);
+    out[2] = (uint8_t)(crc >> 8);
+    out[3] = (uint8_t)crc;
+}
+
+// PUT vérifié de len octets (un seul bloc, somme comprise) au serveur ;
+// retourne l'opcode de sa réponse au dernier bloc
+static uint16_t server_put_sum(const char *name, const uint8_t *data, size_t len, int bad)
+{
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in srv, peer;
+    memset(&srv, 0, sizeof(srv));
+    srv.sin_family = AF_INET;
+    srv.sin_port = htons(server_port);
+    srv.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    struct tftp_opt opts[MAX_OPTIONS];
+    size_t nopts = 0;
+    set_opt_str(opts, &nopts, MAX_OPTIONS, "checksum", "crc32c");
+    uint8_t buf[DATA_SIZE + 4];
+    int n = build_rrq_wrq_opts(OPCODE_WRQ, buf, sizeof(buf), name, "octet", opts, nopts);
+    sendto(s, buf, (size_t)n, 0, (struct sockaddr *)&srv, sizeof(srv));
+    assert(recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000) > 0); // OACK
+    build_data_header(buf, sizeof(buf), 1);
+    memcpy(buf + 4, data, len);
+    sum_be(buf + 4 + len, data, len, bad);
+    sendto(s, buf, 4 + len + SUM_LEN, 0, (struct sockaddr *)&peer, sizeof(peer));
+    uint16_t op = 0;
+    ssize_t r = recvfrom_timeout(s, buf, sizeof(buf), &peer, 1000);
+    assert(r > 0 && parse_opcode(buf, (size_t)r, &op) == 0);
+    close(s);
+    return op;
+}
+
+// faux serveur dans un processus fils : un RRQ vérifié, len octets et leur
+// somme (fausse si bad) en un bloc
+static pid_t fake_sum_server(struct sockaddr_in *srv, const uint8_t *data, size_t len, int bad)
+{
+    int s = fake_server(srv);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+    {
+        uint8_t buf[DATA_SIZE + 4];
+        struct sockaddr_in peer;
+        if (recvfrom_timeout(s, buf, sizeof(buf), &peer, 2000) <= 0)
+            _exit(1);
+        struct tftp_opt opts[MAX_OPTIONS];
+        size_t nopts = 0;
+        set_opt_str(opts, &nopts, MAX_OPTIONS, "checksum", "crc32c");
+        int n = build_oack(buf, sizeof(buf), opts, nopts);
+        sendto(s, buf, (size_t)n, 0, (struct sockaddr *)&peer, sizeof(peer));
+        if (recvfrom_timeout(s, buf, sizeof(buf), &peer, 2000) != 4) // ACK(0)
+            _exit(1);
+        build_data_header(buf, sizeof(buf), 1);
+        memcpy(buf + 4, data, len);
+        sum_be(buf + 4 + len, data, len, bad);
+        sendto(s, buf, 4 + len + SUM_LEN, 0, (struct sockaddr *)&peer, sizeof(peer));
+        recvfrom_timeout(s, buf, sizeof(buf), &peer, 2000); // ACK(1) ou ERROR
+        _exit(0);
+    }
+    close(s);
+    return pid;
+}
+
+// contenu du fichier path égal à len octets de data
+static int file_is(const char *path, const uint8_t *data, size_t len)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+    uint8_t *got = malloc(len + 1);
+    int same = got && fread(got, 1, len + 1, f) == len && memcmp(got, data, len) == 0;
+    free(got);
+    fclose(f);
+    return same;
+}
+
+void test_server_checksum()
+{
+    printf("Test: Somme fausse, destination intacte (PUT serveur, GET client)... ");
+    uint8_t *old = server_file("push.img", 3000);
+    uint8_t img[100];
+    for (size_t i = 0; i < sizeof(img); i++)
+        img[i] = (uint8_t)(i * 7);
+    pid_t pid = server_start();
+
+    // PUT : somme fausse -> ERROR, l'image d'avant reste, aucun fichier de
+    // plus ; somme bonne -> remplacée
+    assert(server_put_sum("push.img", img, sizeof(img), 1) == OPCODE_ERROR);
+    assert(file_is(SERVER_ROOT "/push.img", old, 3000));
+    assert(system("test $(ls -A " SERVER_ROOT " | wc -l) -eq 3") == 0); // image.bin, out.bin, push.img
+    assert(server_put_sum("push.img", img, sizeof(img), 0) == OPCODE_ACK);
+    assert(file_is(SERVER_ROOT "/push.img", img, sizeof(img)));
+    assert(server_put_sum("new.img", img, sizeof(img), 1) == OPCODE_ERROR);
+    assert(access(SERVER_ROOT "/new.img", F_OK) < 0);
+    server_stop(pid);
+
+    // GET : même chose pour le fichier local
+    struct tftp_client_opts o;
+    memset(&o, 0, sizeof(o));
+    o.checksum = 1;
+    o.quiet = 1;
+    const char *local = SERVER_ROOT "/local.img";
+    FILE *f = fopen(local, "w");
+    assert(f && fwrite(old, 1, 3000, f) == 3000);
+    fclose(f);
+    for (int bad = 1; bad >= 0; bad--)
+    {
+        struct sockaddr_in srv;
+        pid_t fake = fake_sum_server(&srv, img, sizeof(img), bad);
+        int status;
+        assert(tftp_client_get_opts("127.0.0.1", ntohs(srv.sin_port), "kernel", local, &o) == (bad ? -1 : 0));
+        assert(waitpid(fake, &status, 0) == fake && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        assert(bad ? file_is(local, old, 3000) : file_is(local, img, sizeof(img)));
+    }
+    free(old);
+    printf("OK\n");
+}
+
+void test_server()
+{
+    printf("\n=== TESTS SERVEUR ===\n");
+    assert(system("rm -rf " SERVER_ROOT " && mkdir " SERVER_ROOT) == 0);
+    test_server_range();
+    test_server_checksum();
+    assert(system("rm -rf " SERVER_ROOT) == 0);
+    printf("=== TOUS LES TESTS SERVEUR SONT PASSÉS ! ===\n");
+}
+// ----- memstore -----
+void test_memstore_basic()
+{
+    printf("Test: Objets en mémoire (ajout, remplacement, retrait)... ");
+    struct tftp_memstore s;
+    assert(memstore_init(&s) == 0);
+    assert(memstore_get(&s, "pxelinux.cfg/default") == NULL);
+
+    assert(memstore_put(&s, "pxelinux.cfg/default", "v1", 2) == 0);
+    struct tftp_memobj *o = memstore_get(&s, "pxelinux.cfg/default");
+    assert(o && o->len == 2 && memcmp(o->data, "v1", 2) == 0);
+
+    // remplacement : la session en cours garde l'ancienne version
+    assert(memstore_put(&s, "pxelinux.cfg/default", "version2", 8) == 0);
+    assert(o->len == 2 && memcmp(o->data, "v1", 2) == 0 && o->refs == 1);
+    struct tftp_memobj *o2 = memstore_get(&s, "pxelinux.cfg/default");
+    assert(o2 != o && o2->len == 8);
+    memobj_release(o);
+    memobj_release(o2);
+    assert(s.count == 1);
+
+    assert(memstore_put(&s, "empty", "", 0) == 0);
+    o = memstore_get(&s, "empty");
+    assert(o && o->len == 0);
+    memobj_release(o);
+
+    assert(memstore_remove(&s, "pxelinux.cfg/default") == 0);
+    assert(memstore_remove(&s, "pxelinux.cfg/default") == -1);
+    assert(memstore_get(&s, "pxelinux.cfg/default") == NULL && s.count == 1);
+    memstore_free(&s);
+    printf("OK\n");
+}
+
+void test_memstore_grow()
+{
+    printf("Test: Objets en mémoire (agrandissement du hash)... ");
+    struct tftp_memstore s;
+    assert(memstore_init(&s) == 0);
+    char name[32];
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(name, sizeof(name), "grub/%02x.cfg", i);
+        assert(memstore_put(&s, name, name, strlen(name)) == 0);
+    }
+    assert(s.count == 1000 && s.mask + 1 >= 1000);
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(name, sizeof(name), "grub/%02x.cfg", i);
+        struct tftp_memobj *o = memstore_get(&s, name);
+        assert(o && o->len == strlen(name) && memcmp(o->data, name, o->len) == 0);
+        memobj_release(o);
+    }
+    memstore_free(&s);
+    printf("OK\n");
+}
+
+void test_memstore()
+{
+    printf("\n=== TESTS MEMSTORE ===\n");
+    test_memstore_basic();
+    test_memstore_grow();
+    printf("=== TOUS LES TESTS MEMSTORE SONT PASSÉS ! ===\n");
+}
+
+// ----- fichiers virtuels -----
+static void write_text(const char *path, const char *text)
+{
+    FILE *f = fopen(path, "w");
+    assert(f);
+    fputs(text, f);
+    fclose(f);
+}
+
+void test_vfile_render()
+{
+    printf("Test: Fichiers virtuels (rendu par client, cache)... ");
+    write_text("/tmp/tftp_test_vfile.tpl", "host ${hostname} role=${role} ip=${ip} m=${match} x=${nope};");
+    write_text("/tmp/tftp_test_vfile.inv", "# inventaire\n"
+                                           "01-aa hostname=node1 role=compute\n"
+                                           "10.0.0.9 hostname=node9\n");
+    struct tftp_vfile v;
+    assert(vfile_init(&v) == 0);
+    assert(vfile_add_rule(&v, "pxe/*.cfg", "/tmp/tftp_test_vfile.tpl") == 0);
+    assert(vfile_set_inventory(&v, "/tmp/tftp_test_vfile.inv") == 0);
+    assert(vfile_match(&v, "pxe/01-aa.cfg") && !vfile_match(&v, "pxe/01-aa.txt"));
+
+    // clé = partie '*'
+    const char *want = "host node1 role=compute ip=10.0.0.1 m=01-aa x=;";
+    struct tftp_memobj *o = vfile_get(&v, "pxe/01-aa.cfg", inet_addr("10.0.0.1"));
+    assert(o && o->len == strlen(want) && memcmp(o->data, want, o->len) == 0);
+    struct tftp_memobj *o2 = vfile_get(&v, "pxe/01-aa.cfg", inet_addr("10.0.0.1"));
+    assert(o2 == o && v.renders == 1 && v.hits == 1);
+    memobj_release(o);
+    memobj_release(o2);
+
+    // clé = IP du client ; sans entrée ni "default" : pas de rendu
+    o = vfile_get(&v, "pxe/zz.cfg", inet_addr("10.0.0.9"));
+    want = "host node9 role= ip=10.0.0.9 m=zz x=;";
+    assert(o && o->len == strlen(want) && memcmp(o->data, want, o->len) == 0);
+    memobj_release(o);
+    assert(vfile_get(&v, "pxe/zz.cfg", inet_addr("10.0.0.10")) == NULL);
+    assert(vfile_get(&v, "other.cfg", inet_addr("10.0.0.9")) == NULL);
+    vfile_free(&v);
+    printf("OK\n");
+}
+
+void test_vfile_invalidate()
+{
+    printf("Test: Fichiers virtuels (invalidation au changement du gabarit)... ");
+    write_text("/tmp/tftp_test_vfile.tpl", "v1 ${file}");
+    struct tftp_vfile v;
+    assert(vfile_init(&v) == 0);
+    assert(vfile_add_rule(&v, "grub.cfg", "/tmp/tftp_test_vfile.tpl") == 0);
+    struct tftp_memobj *o = vfile_get(&v, "grub.cfg", inet_addr("10.0.0.1"));
+    assert(o && o->len == 11 && memcmp(o->data, "v1 grub.cfg", 11) == 0);
+
+    write_text("/tmp/tftp_test_vfile.tpl", "version2 ${file}");
+    v.next_check = 0; // sans attendre la seconde entre deux vérifications
+    struct tftp_memobj *o2 = vfile_get(&v, "grub.cfg", inet_addr("10.0.0.1"));
+    assert(o2 && o2 != o && o2->len == 17 && memcmp(o2->data, "version2 grub.cfg", 17) == 0);
+    assert(memcmp(o->data, "v1 grub.cfg", 11) == 0); // transfert en cours : ancienne version
+    assert(v.renders == 2 && v.cached == 1);
+    memobj_release(o);
+    memobj_release(o2);
+    vfile_free(&v);
+    unlink("/tmp/tftp_test_vfile.tpl");
+    unlink("/tmp/tftp_test_vfile.inv");
+    printf("OK\n");
+}
+
+void test_vfile()
+{
+    printf("\n=== TESTS VFILE ===\n");
+    test_vfile_render();
+    test_vfile_invalidate();
+    printf("=== TOUS LES TESTS VFILE SONT PASSÉS ! ===\n");
+}
+// ----- netascii -----
+static const char na_text[] = "line one\nline two\r\nbare cr\rcr cr\r\r\n\n\nlf end\n"
+                              "tab\there\r\0nul after cr\rx\n\r";
+
+void test_netascii_basic()
+{
+    printf("Test: netascii (LF -> CR LF, CR -> CR NUL, et retour)... ");
+    uint8_t out[64], back[64];
+    size_t used;
+    int pend = NETASCII_NONE, cr = 0;
+    size_t n = netascii_encode((const uint8_t *)"a\nb\rc", 5, &used, out, sizeof(out), &pend);
+    assert(n == 7 && used == 5 && pend == NETASCII_NONE && memcmp(out, "a\r\nb\r\0c", 7) == 0);
+    size_t m = netascii_decode(out, n, back, &cr);
+    assert(m == 5 && cr == 0 && memcmp(back, "a\nb\rc", 5) == 0);
+
+    // CR suivi d'autre chose (non conforme) : gardé ; CR final : flush
+    m = netascii_decode((const uint8_t *)"x\ry\r", 4, back, &cr);
+    assert(m == 3 && cr == 1 && memcmp(back, "x\ry", 3) == 0);
+    assert(netascii_flush(back, &cr) == 1 && back[0] == '\r' && cr == 0);
+    assert(netascii_flush(back, &cr) == 0);
+    printf("OK\n");
+}
+
+void test_netascii_boundaries()
+{
+    printf("Test: netascii, paires coupées à toutes les frontières... ");
+    const uint8_t *text = (const uint8_t *)na_text;
+    size_t tlen = sizeof(na_text) - 1;
+    uint8_t ref[256], got[256], dec[256];
+    size_t used;
+    int pend = NETASCII_NONE;
+    size_t rlen = netascii_encode(text, tlen, &used, ref, sizeof(ref), &pend);
+    assert(used == tlen && pend == NETASCII_NONE);
+
+    // encodage en blocs de k octets (les blocs d'un transfert)
+    for (size_t k = 1; k <= 24; k++)
+    {
+        size_t in = 0, o = 0, n;
+        pend = NETASCII_NONE;
+        do
+        {
+            n = netascii_encode(text + in, tlen - in, &used, got + o, k, &pend);
+            in += used;
+            o += n;
+        } while (n == k);
+        assert(o == rlen && in == tlen && memcmp(got, ref, rlen) == 0);
+    }
+
+    // décodage coupé à chaque position
+    for (size_t cut = 0; cut <= rlen; cut++)
+    {
+        int cr = 0;
+        size_t d = netascii_decode(ref, cut, dec, &cr);
+        d += netascii_decode(ref + cut, rlen - cut, dec + d, &cr);
+        d += netascii_flush(dec + d, &cr);
+        assert(d == tlen && memcmp(dec, text, tlen) == 0);
+    }
+    printf("OK\n");
+}
+
+void test_netascii_impls()
+{
+    printf("Test: netascii, recherche vectorisée == scalaire... ");
+    static uint8_t in[4096], ref[8192], out[8192], dref[4097], dout[4097];
+    for (size_t i = 0; i < sizeof(in); i++)
+        in[i] = (uint8_t)('a' + i % 26);
+    // CR / LF autour des frontières de 16 et 32 octets, et en rafale
+    const size_t at[] = {0, 15, 16, 17, 31, 32, 33, 63, 64, 100, 101, 102, 1023, 2048, 4095};
+    for (size_t i = 0; i < sizeof(at) / sizeof(at[0]); i++)
+        in[at[i]] = (i & 1) ? '\r' : '\n';
+
+    const char *prev = netascii_impl();
+    const char *impls[] = {"scalar", "sse2", "avx2"};
+    size_t rlen = 0, dlen = 0;
+    for (size_t k = 0; k < 3; k++)
+    {
+        if (netascii_set_impl(impls[k]) < 0)
+            continue; // absente sur ce processeur
+        assert(strcmp(netascii_impl(), impls[k]) == 0);
+        size_t used;
+        int pend = NETASCII_NONE, cr = 0;
+        size_t n = netascii_encode(in, sizeof(in), &used, out, sizeof(out), &pend);
+        size_t d = netascii_decode(out, n, dout, &cr);
+        if (k == 0)
+        {
+            rlen = n;
+            dlen = d;
+            memcpy(ref, out, n);
+            memcpy(dref, dout, d);
+        }
+        assert(n == rlen && memcmp(out, ref, n) == 0);
+        assert(d == dlen && d == sizeof(in) && memcmp(dout, dref, d) == 0 && memcmp(dout, in, d) == 0);
+    }
+    assert(netascii_set_impl("neon") < 0);
+    assert(netascii_set_impl(prev) == 0);
+    printf("OK\n");
+}
+
+void test_netascii()
+{
+    printf("\n=== TESTS NETASCII ===\n");
+    test_netascii_basic();
+    test_netascii_boundaries();
+    test_netascii_impls();
+    printf("=== TOUS LES TESTS NETASCII SONT PASSÉS ! ===\n");
+}
+
+// ----- compression lz -----
+struct lz_collect
+{
+    uint8_t *data;
+    size_t len;
+};
+
+static int lz_collect_out(void *ctx, const uint8_t *data, size_t len)
+{
+    struct lz_collect *c = ctx;
+    memcpy(c->data + c->len, data, len);
+    c->len += len;
+    return 0;
+}
+
+static void fill_lz_text(uint8_t *p, size_t n)
+{
+    static const char *words[] = {"kernel ", "initrd ", "append ", "root=/dev/sda1 ", "quiet\n", "label "};
+    uint32_t r = 1;
+    size_t i = 0;
+    while (i < n)
+    {
+        r = r * 1103515245u + 12345u;
+        const char *w = words[(r >> 16) % 6];
+        for (; *w && i < n; w++)
+            p[i++] = (uint8_t)*w;
+    }
+}
+
+void test_lz_frame()
+{
+    printf("Test: Trame lz (aller-retour, tailles limites)... ");
+    static uint8_t src[LZ_FRAME], comp[LZ_FRAME + 512], back[LZ_FRAME];
+    size_t sizes[] = {0, 1, 12, 13, 100, 4096, LZ_FRAME};
+    for (int kind = 0; kind < 2; kind++)
+    {
+        if (kind == 0)
+            fill_lz_text(src, sizeof(src));
+        else
+            memset(src, 0, sizeof(src));
+        for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++)
+        {
+            size_t n = sizes[k];
+            size_t c = lz_compress_frame(src, n, comp, sizeof(comp));
+            assert(c > 0);
+            assert(lz_decompress_frame(comp, c, back, sizeof(back)) == (ssize_t)n);
+            assert(memcmp(back, src, n) == 0);
+        }
+    }
+    // zéros : une longue correspondance qui se recouvre
+    size_t c = lz_compress_frame(src, LZ_FRAME, comp, sizeof(comp));
+    assert(c < 300);
+    // place insuffisante pour le résultat
+    assert(lz_compress_frame(src, LZ_FRAME, comp, 10) == 0);
+    assert(lz_decompress_frame(comp, c, back, LZ_FRAME - 1) == -1);
+
+    // distance avant le début de la trame, charge tronquée
+    const uint8_t bad_off[] = {0x10, 'a', 0x05, 0x00};
+    assert(lz_decompress_frame(bad_off, sizeof(bad_off), back, sizeof(back)) == -1);
+    const uint8_t truncated[] = {0xf0, 0xff};
+    assert(lz_decompress_frame(truncated, sizeof(truncated), back, sizeof(back)) == -1);
+    printf("OK\n");
+}
+
+void test_lz_stream()
+{
+    printf("Test: Flux lz (trames stockées, décodage par petits morceaux)... ");
+    size_t n = 3 * LZ_FRAME + 1000;
+    uint8_t *src = malloc(n), *stream = malloc(lz_bound(n)), *back = malloc(n);
+    assert(src && stream && back);
+    fill_lz_text(src, n);
+    uint32_t r = 7;
+    for (size_t i = LZ_FRAME; i < 2 * LZ_FRAME; i++) // deuxième trame aléatoire
+    {
+        r = r * 1103515245u + 12345u;
+        src[i] = (uint8_t)(r >> 16);
+    }
+    size_t slen = lz_encode(src, n, stream);
+    assert(slen < n && slen <= lz_bound(n));
+    size_t c1 = (size_t)stream[1] << 16 | (size_t)stream[2] << 8 | stream[3];
+    assert(!(stream[0] & 0x80) && c1 < LZ_FRAME);
+    const uint8_t *h2 = stream + LZ_HDR + c1;
+    assert(h2[0] == 0x80 && ((size_t)h2[2] << 8 | h2[3]) == 0 && h2[1] == 1); // stockée, 65536 octets
+
+    size_t chunks[] = {1, 3, 512, 1428, 70000};
+    for (size_t k = 0; k < sizeof(chunks) / sizeof(chunks[0]); k++)
+    {
+        struct lz_dec d;
+        memset(&d, 0, sizeof(d));
+        struct lz_collect col = {back, 0};
+        for (size_t off = 0; off < slen; off += chunks[k])
+        {
+            size_t len = slen - off < chunks[k] ? slen - off : chunks[k];
+            assert(lz_dec_feed(&d, stream + off, len, lz_collect_out, &col) == 0);
+        }
+        assert(lz_dec_idle(&d) && col.len == n && memcmp(back, src, n) == 0);
+        lz_dec_free(&d);
+    }
+
+    // flux coupé : pas entre deux trames ; en-tête invalide : refusé
+    struct lz_dec d;
+    memset(&d, 0, sizeof(d));
+    struct lz_collect col = {back, 0};
+    assert(lz_dec_feed(&d, stream, slen - 1, lz_collect_out, &col) == 0 && !lz_dec_idle(&d));
+    lz_dec_free(&d);
+    memset(&d, 0, sizeof(d));
+    const uint8_t zero_len[] = {0, 0, 0, 0};
+    assert(lz_dec_feed(&d, zero_len, sizeof(zero_len), lz_collect_out, &col) == -1);
+    lz_dec_free(&d);
+    memset(&d, 0, sizeof(d));
+    const uint8_t too_big[] = {0x80, 0x01, 0x00, 0x01};
+    assert(lz_dec_feed(&d, too_big, sizeof(too_big), lz_collect_out, &col) == -1);
+    lz_dec_free(&d);
+
+    // échantillonnage : texte oui, aléatoire non
+    assert(lz_worth(src, LZ_FRAME));
+    assert(!lz_worth(src + LZ_FRAME, LZ_FRAME));
+    free(src);
+    free(stream);
+    free(back);
+    printf("OK\n");
+}
+
+static ssize_t zs_read_fd(void *ctx, uint8_t *buf, size_t len, uint64_t off)
+{
+    return pread(*(int *)ctx, buf, len, (off_t)off);
+}
+
+static ssize_t zs_read_obj(void *ctx, uint8_t *buf, size_t len, uint64_t off)
+{
+    const struct tftp_memobj *o = ctx;
+    memcpy(buf, o->data + off, len);
+    return (ssize_t)len;
+}
+
+// flux lu bloc par bloc comme par le serveur (fenêtre de 1, chaque bloc relu
+// une fois comme pour une retransmission), jusqu'au bloc court
+static uint8_t *zs_drain(struct zcache_stream *s, zcache_read_fn rd, void *ctx, uint64_t off, size_t *len)
+{
+    uint8_t *out = malloc(1 << 20);
+    assert(out);
+    size_t n = 0;
+    for (;;)
+    {
+        uint8_t blk[1428], again[1428];
+        ssize_t r = zcache_stream_read(s, rd, ctx, off + n, blk, sizeof(blk), off + n);
+        assert(r >= 0 && n + (size_t)r <= (1 << 20));
+        assert(zcache_stream_read(s, rd, ctx, off + n, again, sizeof(again), off + n) == r);
+        assert(memcmp(blk, again, (size_t)r) == 0);
+        memcpy(out + n, blk, (size_t)r);
+        n += (size_t)r;
+        if ((size_t)r < sizeof(blk))
+            break;
+    }
+    *len = n;
+    return out;
+}
+
+// variante de src produite en flux puis gardée sous name
+static struct tftp_memobj *zs_variant(struct tftp_zcache *z, const char *name, const struct stat *st,
+                                      struct tftp_memobj *src)
+{
+    struct zcache_stream *s = zcache_stream_new(z, st, src->len);
+    size_t len;
+    free(zs_drain(s, zs_read_obj, src, 0, &len));
+    struct tftp_memobj *o = zcache_stream_finish(s, name);
+    zcache_stream_free(s);
+    return o;
+}
+
+void test_zcache()
+{
+    printf("Test: Cache des variantes compressées (flux au fil des blocs, réutilisation, invalidation, éviction)... ");
+    const char *path = "/tmp/tftp_test_zcache.txt";
+    static uint8_t text[200000];
+    fill_lz_text(text, sizeof(text));
+    FILE *f = fopen(path, "w");
+    assert(f && fwrite(text, 1, sizeof(text), f) == sizeof(text));
+    fclose(f);
+    uint8_t *ref = malloc(lz_bound(sizeof(text)));
+    assert(ref);
+    size_t ref_len = lz_encode(text, sizeof(text), ref);
+
+    // absent : flux produit trame par trame, identique au flux complet, puis
+    // gardé comme variante
+    struct tftp_zcache z;
+    assert(zcache_init(&z, 1 << 20) == 0);
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    assert(fd >= 0 && fstat(fd, &st) == 0);
+    struct tftp_memobj *o;
+    assert(zcache_lookup(&z, "boot.cfg", &st, &o) == 0 && o == NULL);
+    assert(zcache_worth(zs_read_fd, &fd, sizeof(text)));
+    struct zcache_stream *s = zcache_stream_new(&z, &st, sizeof(text));
+    size_t len;
+    uint8_t *got = zs_drain(s, zs_read_fd, &fd, 0, &len);
+    assert(len == ref_len && memcmp(got, ref, len) == 0);
+    free(got);
+    o = zcache_stream_finish(s, "boot.cfg");
+    zcache_stream_free(s);
+    assert(o && o->len == ref_len && memcmp(o->data, ref, ref_len) == 0 && z.compressed == 1);
+    struct tftp_memobj *o2;
+    assert(zcache_lookup(&z, "boot.cfg", &st, &o2) == 1);
+    assert(o2 == o && z.hits == 1 && o->refs == 3); // deux transferts + le cache
+    memobj_release(o2);
+    close(fd);
+
+    // fichier réécrit (autre taille) : variante périmée, remplacée par le flux
+    // suivant ; l'ancienne reste valable pour le transfert en cours
+    f = fopen(path, "w");
+    assert(f && fwrite(text, 1, sizeof(text) / 2, f) == sizeof(text) / 2);
+    fclose(f);
+    fd = open(path, O_RDONLY);
+    assert(fd >= 0 && fstat(fd, &st) == 0);
+    assert(zcache_lookup(&z, "boot.cfg", &st, &o2) == 0);
+    s = zcache_stream_new(&z, &st, sizeof(text) / 2);
+    free(zs_drain(s, zs_read_fd, &fd, 0, &len));
+    o2 = zcache_stream_finish(s, "boot.cfg");
+    zcache_stream_free(s);
+    assert(o2 && o2 != o && z.compressed == 2 && o->refs == 1);
+    uint8_t *back = malloc(sizeof(text));
+    assert(back);
+    struct lz_dec d;
+    memset(&d, 0, sizeof(d));
+    struct lz_collect col = {back, 0};
+    assert(lz_dec_feed(&d, o2->data, o2->len, lz_collect_out, &col) == 0 && lz_dec_idle(&d));
+    assert(col.len == sizeof(text) / 2 && memcmp(back, text, col.len) == 0);
+    lz_dec_free(&d);
+    free(back);
+    memobj_release(o);
+    memobj_release(o2);
+    close(fd);
+
+    // sans cache : fenêtre seulement, trames acquittées oubliées ; reprise
+    // (passation) à la plus ancienne trame gardée : mêmes octets ensuite
+    struct tftp_memobj src = {.data = text, .len = sizeof(text)};
+    s = zcache_stream_new(NULL, NULL, sizeof(text));
+    uint8_t blk[1428];
+    uint64_t at = 40 * sizeof(blk);
+    for (uint64_t off = 0; off <= at; off += sizeof(blk))
+        assert(zcache_stream_read(s, zs_read_obj, &src, off, blk, sizeof(blk), off) == (ssize_t)sizeof(blk));
+    assert(s->cap <= 2 * (LZ_HDR + LZ_FRAME) && s->base > 0 && s->base <= at);
+    assert(zcache_stream_read(s, zs_read_obj, &src, s->base - 1, blk, 1, s->base - 1) == -1);
+    struct zcache_stream *r = zcache_stream_at(sizeof(text), s->sbase, s->base);
+    assert(zcache_stream_finish(s, "x") == NULL);
+    got = zs_drain(r, zs_read_obj, &src, at, &len);
+    assert(len == ref_len - at && memcmp(got, ref + at, len) == 0);
+    free(got);
+    zcache_stream_free(s);
+    zcache_stream_free(r);
+
+    // incompressible : retenu comme tel
+    uint32_t rnd = 3;
+    for (size_t i = 0; i < sizeof(text); i++)
+    {
+        rnd = rnd * 1103515245u + 12345u;
+        text[i] = (uint8_t)(rnd >> 16);
+    }
+    f = fopen(path, "w");
+    assert(f && fwrite(text, 1, sizeof(text), f) == sizeof(text));
+    fclose(f);
+    fd = open(path, O_RDONLY);
+    assert(fd >= 0 && fstat(fd, &st) == 0);
+    assert(zcache_lookup(&z, "rand.bin", &st, &o) == 0 && !zcache_worth(zs_read_fd, &fd, sizeof(text)));
+    zcache_skip(&z, "rand.bin", &st);
+    assert(z.skipped == 1 && zcache_lookup(&z, "rand.bin", &st, &o) == -1 && o == NULL);
+    assert(z.skipped == 2 && z.compressed == 2);
+    close(fd);
+    free(ref);
+    zcache_free(&z);
+
+    // cache plein : variantes les moins récemment servies évincées, sauf
+    // celles qu'un transfert sert encore ; sans place, flux non gardé
+    struct tftp_memobj var = {.data = text, .len = 8192}; // aléatoire : variante de la taille du fichier
+    assert(zcache_init(&z, 1 << 20) == 0);
+    memobj_release(zs_variant(&z, "f0", &st, &var));
+    size_t cost = z.bytes;
+    zcache_free(&z);
+    assert(cost > 0 && zcache_init(&z, 3 * cost) == 0);
+    struct tftp_memobj *busy = zs_variant(&z, "f0", &st, &var); // transfert en cours
+    memobj_release(zs_variant(&z, "f1", &st, &var));
+    memobj_release(zs_variant(&z, "f2", &st, &var));
+    assert(z.bytes == 3 * cost && z.evicted == 0);
+    memobj_release(zs_variant(&z, "f3", &st, &var));
+    assert(z.bytes == 3 * cost && z.evicted == 1);
+    assert(zcache_lookup(&z, "f1", &st, &o) == 0);
+    struct tftp_memobj *held[3];
+    assert(zcache_lookup(&z, "f2", &st, &held[0]) == 1);
+    assert(zcache_lookup(&z, "f3", &st, &held[1]) == 1);
+    assert(zcache_lookup(&z, "f0", &st, &held[2]) == 1 && held[2] == busy);
+    o = zs_variant(&z, "f4", &st, &var);
+    assert(o && o->refs == 1 && z.evicted == 1 && zcache_lookup(&z, "f4", &st, &o2) == 0);
+    memobj_release(o);
+    for (int i = 0; i < 3; i++)
+        memobj_release(held[i]);
+    memobj_release(busy);
+    // f0 servi en dernier : f2 la plus ancienne, évincée la première
+    memobj_release(zs_variant(&z, "f4", &st, &var));
+    assert(z.evicted == 2 && zcache_lookup(&z, "f2", &st, &o) == 0);
+    assert(zcache_lookup(&z, "f0", &st, &o) == 1);
+    memobj_release(o);
+    zcache_free(&z);
+    unlink(path);
+    printf("OK\n");
+}
+
+void test_lz()
+{
+    printf("\n=== TESTS LZ ===\n");
+    test_lz_frame();
+    test_lz_stream();
+    test_zcache();
+    printf("=== TOUS LES TESTS LZ SONT PASSÉS ! ===\n");
+}
+
+// ----- store dédupliqué -----
+static void hex32(char out[65], const uint8_t h[SHA256_LEN])
+{
+    for (int i = 0; i < SHA256_LEN; i++)
+        sprintf(out + 2 * i, "%02x", h[i]);
+}
+
+void test_sha256()
+{
+    printf("Test: SHA-256 (vecteurs FIPS 180-2)... ");
+    uint8_t h[SHA256_LEN];
+    char hex[65];
+    sha256("", 0, h);
+    hex32(hex, h);
+    assert(strcmp(hex, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855") == 0);
+    sha256("abc", 3, h);
+    hex32(hex, h);
+    assert(strcmp(hex, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") == 0);
+    const char *m = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"; // 56 octets : 2 blocs de bourrage
+    sha256(m, strlen(m), h);
+    hex32(hex, h);
+    assert(strcmp(hex, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1") == 0);
+    printf("OK\n");
+}
+
+static void fill_random(uint8_t *p, size_t n, uint32_t seed);
+
+void test_sha256_impls()
+{
+    printf("Test: SHA-256, extensions SHA == scalaire... ");
+    if (sha256_set_impl("sha-ni") < 0)
+    {
+        printf("OK (sha-ni indisponible)\n");
+        return;
+    }
+    static uint8_t buf[4096];
+    fill_random(buf, sizeof(buf), 11);
+    for (size_t len = 0; len <= sizeof(buf); len += len < 200 ? 1 : 997)
+    {
+        uint8_t a[SHA256_LEN], b[SHA256_LEN];
+        assert(sha256_set_impl("sha-ni") == 0);
+        sha256(buf + len % 7, len - len % 7, a);
+        assert(sha256_set_impl("scalar") == 0);
+        sha256(buf + len % 7, len - len % 7, b);
+        assert(memcmp(a, b, SHA256_LEN) == 0);
+    }
+    assert(sha256_set_impl("sha-ni") == 0 && strcmp(sha256_impl(), "sha-ni") == 0);
+    assert(sha256_set_impl("md5") == -1);
+    printf("OK\n");
+}
+
+static void fill_random(uint8_t *p, size_t n, uint32_t seed)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        p[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+// fins des morceaux de data (au plus max)
+static size_t cut_points(const uint8_t *data, size_t len, size_t *ends, size_t max)
+{
+    size_t n = 0, off = 0;
+    while (off < len && n < max)
+    {
+        size_t c = dedup_cut(data + off, len - off);
+        assert(c > 0 && c <= DEDUP_MAX_CHUNK && (c >= DEDUP_MIN_CHUNK || off + c == len));
+        off += c;
+        ends[n++] = off;
+    }
+    return n;
+}
+
+void test_dedup_cut()
+{
+    printf("Test: Découpage par le contenu (bornes, insertion en tête)... ");
+    size_t len = 1 << 20;
+    uint8_t *a = malloc(len + 100), *b = malloc(len + 100);
+    assert(a && b);
+    fill_random(a, len, 5);
+    memcpy(b, "inserted", 8);
+    memcpy(b + 8, a, len);
+    static size_t ea[1024], eb[1024];
+    size_t na = cut_points(a, len, ea, 1024), nb = cut_points(b, len + 8, eb, 1024);
+    assert(na > len / DEDUP_MAX_CHUNK && na < len / DEDUP_MIN_CHUNK);
+    // mêmes frontières (décalées de 8) sauf au voisinage de l'insertion
+    size_t same = 0;
+    for (size_t i = 0, j = 0; i < na && j < nb;)
+    {
+        if (ea[i] + 8 == eb[j])
+        {
+            same++;
+            i++;
+            j++;
+        }
+        else if (ea[i] + 8 < eb[j])
+            i++;
+        else
+            j++;
+    }
+    assert(same + 2 >= na);
+
+    // zéros : pas de frontière, morceaux de DEDUP_MAX_CHUNK
+    memset(a, 0, len);
+    assert(dedup_cut(a, len) == DEDUP_MAX_CHUNK);
+    assert(dedup_cut(a, 100) == 100);
+    free(a);
+    free(b);
+    printf("OK\n");
+}
+
+static void dedup_put(struct tftp_dedup *d, const char *path, const uint8_t *data, size_t len, size_t piece)
+{
+    struct dedup_writer *wr = dedup_writer_new(d, path);
+    assert(wr);
+    for (size_t off = 0; off < len; off += piece)
+        assert(dedup_write(wr, data + off, len - off < piece ? len - off : piece) == 0);
+    assert(dedup_commit(wr) == 0);
+}
+
+void test_dedup_store()
+{
+    printf("Test: Store dédupliqué (dépôt, doublons, relecture, abandon)... ");
+    const char *root = "/tmp/tftp_test_dedup";
+    char path[256];
+    assert(system("rm -rf /tmp/tftp_test_dedup && mkdir /tmp/tftp_test_dedup") == 0);
+    struct tftp_dedup d;
+    assert(dedup_init(&d, root) == 0);
+
+    size_t len = 700000;
+    uint8_t *src = malloc(len), *back = malloc(len);
+    assert(src && back);
+    fill_random(src, len, 9);
+    snprintf(path, sizeof(path), "%s/a.bin", root);
+    dedup_put(&d, path, src, len, 512);
+    uint64_t chunks = d.chunks_new;
+    assert(chunks > 1 && d.chunks_dup == 0 && d.bytes_stored == len && d.files == 1);
+
+    // même contenu, autre découpage des blocs reçus : rien de nouveau
+    snprintf(path, sizeof(path), "%s/b.bin", root);
+    dedup_put(&d, path, src, len, 1428);
+    assert(d.chunks_new == chunks && d.chunks_dup == chunks && d.bytes_stored == len && d.bytes_in == 2 * len);
+
+    // relecture : lectures à cheval sur les morceaux, fin de fichier
+    int fd = open(path, O_RDONLY);
+    struct dedup_reader *rd;
+    assert(fd >= 0 && dedup_open(&d, fd, &rd) == 1);
+    close(fd);
+    assert(dedup_size(rd) == len);
+    assert(dedup_pread(rd, back, len, 0) == (ssize_t)len && memcmp(back, src, len) == 0);
+    uint64_t offs[] = {len - 10, 3, 65530, 400000, 0};
+    for (size_t k = 0; k < sizeof(offs) / sizeof(offs[0]); k++)
+    {
+        size_t want = len - offs[k] < 9000 ? len - offs[k] : 9000;
+        assert(dedup_pread(rd, back, 9000, offs[k]) == (ssize_t)want);
+        assert(memcmp(back, src + offs[k], want) == 0);
+    }
+    assert(dedup_pread(rd, back, 10, len) == 0);
+    dedup_close(rd);
+
+    // dépôt abandonné : manifeste précédent intact, pas de fichier temporaire
+    struct dedup_writer *wr = dedup_writer_new(&d, path);
+    assert(wr && dedup_write(wr, src + 1000, 100000) == 0);
+    dedup_abort(wr);
+    fd = open(path, O_RDONLY);
+    assert(fd >= 0 && dedup_open(&d, fd, &rd) == 1 && dedup_size(rd) == len);
+    close(fd);
+    dedup_close(rd);
+    assert(system("test $(ls -A /tmp/tftp_test_dedup | wc -l) -eq 3") == 0); // .dedup, a.bin, b.bin
+
+    // fichier ordinaire, manifeste invalide
+    snprintf(path, sizeof(path), "%s/plain.txt", root);
+    write_text(path, "just a file\n");
+    fd = open(path, O_RDONLY);
+    assert(fd >= 0 && dedup_open(&d, fd, &rd) == 0);
+    close(fd);
+    write_text(path, "TFTPDEDUP 1 10 1\n10 zz\n");
+    fd = open(path, O_RDONLY);
+    assert(fd >= 0 && dedup_open(&d, fd, &rd) == -1);
+    close(fd);
+
+    assert(dedup_reserved(".dedup") && dedup_reserved(".dedup/ab/cd") && dedup_reserved("./.dedup/x"));
+    assert(!dedup_reserved(".dedupe") && !dedup_reserved("backups/.dedup"));
+    dedup_free(&d);
+    free(src);
+    free(back);
+    assert(system("rm -rf /tmp/tftp_test_dedup") == 0);
+    printf("OK\n");
+}
+
+void test_dedup_handoff()
+{
+    printf("Test: Store dédupliqué (dépôt et relecture repris par un autre processus)... ");
+    const char *root = "/tmp/tftp_test_dedup";
+    char path[256];
+    assert(system("rm -rf /tmp/tftp_test_dedup && mkdir /tmp/tftp_test_dedup") == 0);
+    struct tftp_dedup d;
+    assert(dedup_init(&d, root) == 0);
+    size_t len = 300000, cut = 123457;
+    uint8_t *src = malloc(len), *back = malloc(len);
+    assert(src && back);
+    fill_random(src, len, 11);
+    snprintf(path, sizeof(path), "%s/up.bin", root);
+
+    // dépôt interrompu au milieu d'un morceau, repris sur le même manifeste en cours
+    struct dedup_writer *wr = dedup_writer_new(&d, path);
+    assert(wr && dedup_write(wr, src, cut) == 0);
+    size_t bl;
+    uint8_t *blob = dedup_writer_save(wr, &bl);
+    assert(blob);
+    int fd = dup(dedup_writer_fd(wr)); // passé par SCM_RIGHTS en vrai
+    dedup_writer_drop(wr);
+    assert(access(path, F_OK) < 0 && system("test $(ls /tmp/tftp_test_dedup | wc -l) -eq 1") == 0);
+    assert(dedup_writer_load(&d, blob, bl - 1, fd) == NULL);
+    wr = dedup_writer_load(&d, blob, bl, fd);
+    free(blob);
+    assert(wr && dedup_write(wr, src + cut, len - cut) == 0 && dedup_commit(wr) == 0);
+
+    // relecture reprise au milieu : même contenu
+    struct dedup_reader *rd;
+    fd = open(path, O_RDONLY);
+    assert(fd >= 0 && dedup_open(&d, fd, &rd) == 1);
+    close(fd);
+    assert(dedup_pread(rd, back, 1000, 0) == 1000);
+    blob = dedup_reader_save(rd, &bl);
+    dedup_close(rd);
+    assert(blob && dedup_reader_load(&d, blob, bl - 1) == NULL);
+    rd = dedup_reader_load(&d, blob, bl);
+    free(blob);
+    assert(rd && dedup_size(rd) == len);
+    assert(dedup_pread(rd, back, len, 0) == (ssize_t)len && memcmp(back, src, len) == 0);
+    dedup_close(rd);
+
+    dedup_free(&d);
+    free(src);
+    free(back);
+    assert(system("rm -rf /tmp/tftp_test_dedup") == 0);
+    printf("OK\n");
+}
+
+void test_dedup()
+{
+    printf("\n=== TESTS DEDUP ===\n");
+    test_sha256();
+    test_sha256_impls();
+    test_dedup_cut();
+    test_dedup_store();
+    test_dedup_handoff();
+    printf("=== TOUS LES TESTS DEDUP SONT PASSÉS ! ===\n");
+}
+
+/* ========================= TESTS HANDOFF ========================= */
+
+static int same_file(int a, int b)
+{
+    struct stat sa, sb;
+    return fstat(a, &sa) == 0 && fstat(b, &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+void test_handoff_frames()
+{
+    printf("Test: Passation (trames, fd passés par SCM_RIGHTS)... ");
+    int sv[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    int p[2];
+    assert(pipe(p) == 0);
+
+    // charge + 2 fd : mêmes fichiers de l'autre côté
+    int fds[2] = {p[0], p[1]};
+    assert(handoff_send(sv[0], HO_POOL, "abcdef", 6, fds, 2) == 0);
+    struct handoff_frame f;
+    assert(handoff_recv(sv[1], &f) == 0);
+    assert(f.type == HO_POOL && f.len == 6 && memcmp(f.data, "abcdef", 6) == 0 && f.nfds == 2);
+    assert(f.fds[0] != p[0] && same_file(f.fds[0], p[0]) && same_file(f.fds[1], p[1]));
+    assert(write(f.fds[1], "x", 1) == 1);
+    char c;
+    assert(read(p[0], &c, 1) == 1 && c == 'x');
+    handoff_frame_free(&f);
+
+    // trame vide, puis le maximum de fd
+    assert(handoff_send(sv[0], HO_END, NULL, 0, NULL, 0) == 0);
+    assert(handoff_recv(sv[1], &f) == 0 && f.type == HO_END && f.len == 0 && !f.data && f.nfds == 0);
+    int many[HANDOFF_MAX_FDS];
+    for (int i = 0; i < HANDOFF_MAX_FDS; i++)
+        many[i] = p[0];
+    assert(handoff_send(sv[0], HO_LISTEN, NULL, 0, many, HANDOFF_MAX_FDS + 1) == -1);
+    assert(handoff_send(sv[0], HO_LISTEN, NULL, 0, many, HANDOFF_MAX_FDS) == 0);
+    assert(handoff_recv(sv[1], &f) == 0 && f.nfds == HANDOFF_MAX_FDS && same_file(f.fds[252], p[0]));
+    handoff_frame_free(&f);
+
+    // en-tête invalide, connexion fermée
+    uint8_t junk[sizeof(struct handoff_hdr)];
+    memset(junk, 0x5a, sizeof(junk));
+    assert(write(sv[0], junk, sizeof(junk)) == (ssize_t)sizeof(junk));
+    assert(handoff_recv(sv[1], &f) == -1);
+    close(sv[0]);
+    assert(handoff_recv(sv[1], &f) == -1);
+    close(sv[1]);
+    close(p[0]);
+    close(p[1]);
+    printf("OK\n");
+}
+
+void test_handoff_sessions()
+{
+    printf("Test: Passation (enregistrements de sessions)... ");
+    struct handoff_buf b;
+    memset(&b, 0, sizeof(b));
+    struct handoff_sess r;
+    memset(&r, 0, sizeof(r));
+    r.worker = 1;
+    r.pool = -1;
+    r.peer_addr = htonl(0x0a000007);
+    r.peer_port = htons(41000);
+    r.state = SESS_RRQ;
+    r.blksize = 1428;
+    r.next_block = 70000; // au-delà de 65535 : compteur interne sur 32 bits
+    r.deadline = 123456789;
+    r.fds = HO_FD_SOCK | HO_FD_FILE;
+    assert(handoff_sess_put(&b, &r, "boot/vmlinuz", NULL, 0) == 0);
+    r.worker = 0;
+    r.dd = HO_DD_READER;
+    assert(handoff_sess_put(&b, &r, "up.bin", "blob!", 5) == 0);
+
+    struct handoff_frame f;
+    memset(&f, 0, sizeof(f));
+    f.type = HO_SESS;
+    f.data = b.data;
+    f.len = b.len;
+    size_t pos = 0;
+    struct handoff_sess o;
+    const char *name;
+    const uint8_t *blob;
+    assert(handoff_sess_next(&f, &pos, &o, &name, &blob) == 1);
+    assert(o.worker == 1 && o.peer_port == htons(41000) && o.next_block == 70000 && o.deadline == 123456789);
+    assert(strcmp(name, "boot/vmlinuz") == 0 && o.blob_len == 0 && o.fds == (HO_FD_SOCK | HO_FD_FILE));
+    assert(handoff_sess_next(&f, &pos, &o, &name, &blob) == 1);
+    assert(o.worker == 0 && o.dd == HO_DD_READER && strcmp(name, "up.bin") == 0);
+    assert(o.blob_len == 5 && memcmp(blob, "blob!", 5) == 0);
+    assert(handoff_sess_next(&f, &pos, &o, &name, &blob) == 0);
+
+    // charge tronquée, nom non terminé
+    f.len = b.len - 1;
+    pos = 0;
+    assert(handoff_sess_next(&f, &pos, &o, &name, &blob) == 1);
+    assert(handoff_sess_next(&f, &pos, &o, &name, &blob) == -1);
+    f.len = b.len;
+    b.data[sizeof(r) + strlen("boot/vmlinuz")] = 'X';
+    pos = 0;
+    assert(handoff_sess_next(&f, &pos, &o, &name, &blob) == -1);
+    handoff_buf_free(&b);
+    printf("OK\n");
+}
+
+void test_handoff_socket()
+{
+    printf("Test: Passation (socket Unix de contrôle)... ");
+    const char *path = "/tmp/tftp_test_handoff.sock";
+    unlink(path);
+    assert(handoff_connect(path) == -1 && errno == ENOENT);
+
+    // réservée au propriétaire ; pair = ce processus (même utilisateur, même
+    // exécutable) : accepté
+    int l = handoff_listen(path);
+    struct stat st;
+    assert(l >= 0 && stat(path, &st) == 0 && (st.st_mode & 0777) == 0600);
+    int c = handoff_connect(path);
+    assert(c >= 0);
+    int a = accept(l, NULL, NULL);
+    pid_t pid;
+    uid_t uid;
+    assert(a >= 0 && handoff_peer_check(a, &pid, &uid) == 0 && pid == getpid() && uid == getuid());
+    assert(handoff_send(c, HO_ACK, NULL, 0, NULL, 0) == 0);
+    struct handoff_frame f;
+    assert(handoff_recv(a, &f) == 0 && f.type == HO_ACK);
+    close(a);
+    close(c);
+
+    // processus mort sans nettoyer : personne n'écoute, remplacé au suivant
+    close(l);
+    assert(handoff_connect(path) == -1 && errno == ECONNREFUSED);
+    l = handoff_listen(path);
+    assert(l >= 0 && (c = handoff_connect(path)) >= 0);
+    close(c);
+    close(l);
+    unlink(path);
+    printf("OK\n");
+}
+
+void test_handoff()
+{
+    printf("\n=== TESTS HANDOFF ===\n");
+    test_handoff_frames();
+    test_handoff_sessions();
+    test_handoff_socket();
+    printf("=== TOUS LES TESTS HANDOFF SONT PASSÉS ! ===\n");
+}
+
+/* ========================= TESTS PRELOAD ========================= */
+
+void test_preload_load()
+{
+    printf("Test: Préchargement (manifeste, threads, cohérence avec le disque)... ");
+    const char *root = "/tmp/tftp_test_preload";
+    char path[256];
+    assert(system("rm -rf /tmp/tftp_test_preload && mkdir -p /tmp/tftp_test_preload/sub") == 0);
+    size_t len = 100000;
+    uint8_t *src = malloc(len);
+    assert(src);
+    fill_random(src, len, 5);
+    snprintf(path, sizeof(path), "%s/a.bin", root);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0 && write(fd, src, len) == (ssize_t)len);
+    close(fd);
+    char text[4096] = "";
+    while (strlen(text) + 32 < sizeof(text))
+        strcat(text, "label linux kernel vmlinuz\n");
+    snprintf(path, sizeof(path), "%s/sub/b.cfg", root);
+    write_text(path, text);
+    snprintf(path, sizeof(path), "%s/empty", root);
+    write_text(path, "");
+    const char *manifest = "/tmp/tftp_test_preload/list";
+    write_text(manifest, "# démarrage\n\na.bin\nsub/b.cfg\r\nmissing\nempty\nsub\n");
+
+    // bloquant : tout est publié au retour
+    struct tftp_memstore s;
+    assert(memstore_init(&s) == 0);
+    struct tftp_preload_stats st;
+    struct tftp_preload *p = preload_start(manifest, root, &s, NULL, 3, 1);
+    assert(p);
+    preload_finish(p, 0, &st);
+    assert(st.files == 3 && st.failed == 2 && st.bytes == len + strlen(text) && st.locked <= st.bytes);
+    struct tftp_memobj *o = memstore_get(&s, "a.bin");
+    assert(o && o->len == len && memcmp(o->data, src, len) == 0 && o->src_ino != 0);
+    struct stat fst;
+    snprintf(path, sizeof(path), "%s/a.bin", root);
+    assert(stat(path, &fst) == 0 && preload_fresh(o, &fst));
+    memobj_release(o);
+    o = memstore_get(&s, "empty");
+    assert(o && o->len == 0);
+    memobj_release(o);
+    assert(memstore_get(&s, "missing") == NULL && memstore_get(&s, "sub") == NULL);
+
+    // variante compressée d'un objet préchargé : gardée dans le cache
+    struct tftp_zcache z;
+    assert(zcache_init(&z, 1 << 20) == 0);
+    o = memstore_get(&s, "sub/b.cfg");
+    snprintf(path, sizeof(path), "%s/sub/b.cfg", root);
+    assert(o && stat(path, &fst) == 0);
+    struct tftp_memobj *c1, *c2;
+    assert(zcache_lookup(&z, "sub/b.cfg", &fst, &c1) == 0);
+    struct zcache_stream *zs = zcache_stream_new(&z, &fst, o->len);
+    size_t zlen;
+    free(zs_drain(zs, zs_read_obj, o, 0, &zlen));
+    c1 = zcache_stream_finish(zs, "sub/b.cfg");
+    zcache_stream_free(zs);
+    assert(c1 && c1->len == zlen && zcache_lookup(&z, "sub/b.cfg", &fst, &c2) == 1);
+    assert(c1 == c2 && z.compressed == 1 && z.hits == 1);
+    memobj_release(c1);
+    memobj_release(c2);
+    zcache_free(&z);
+
+    // fichier remplacé : l'objet n'est plus frais, retiré une seule fois
+    write_text("/tmp/tftp_test_preload/new", "changed\n");
+    assert(rename("/tmp/tftp_test_preload/new", path) == 0);
+    assert(stat(path, &fst) == 0 && !preload_fresh(o, &fst));
+    assert(memstore_drop(&s, o) == 0 && memstore_drop(&s, o) == -1);
+    assert(memstore_get(&s, "sub/b.cfg") == NULL);
+    memobj_release(o);
+
+    // arrière-plan : les objets arrivent pendant que l'appelant continue
+    p = preload_start(manifest, root, &s, NULL, 2, 0);
+    assert(p);
+    while (!preload_done(p))
+        usleep(1000);
+    preload_finish(p, 0, &st);
+    assert(st.files == 3 && st.locked == 0);
+    o = memstore_get(&s, "sub/b.cfg");
+    assert(o && o->len == strlen("changed\n"));
+    memobj_release(o);
+
+    // arrêt immédiat : fichiers restants abandonnés ; manifeste absent
+    p = preload_start(manifest, root, &s, NULL, 1, 0);
+    assert(p);
+    preload_finish(p, 1, &st);
+    assert(st.files + st.failed <= 5);
+    assert(preload_start("/tmp/tftp_test_preload/none", root, &s, NULL, 1, 0) == NULL);
+
+    memstore_free(&s);
+    free(src);
+    assert(system("rm -rf /tmp/tftp_test_preload") == 0);
+    printf("OK\n");
+}
+
+void test_preload_hot()
+{
+    printf("Test: Préchargement (liste des plus demandés)... ");
+    struct preload_hot w0, w1;
+    memset(&w0, 0, sizeof(w0));
+    memset(&w1, 0, sizeof(w1));
+    for (int i = 0; i < 5; i++)
+        preload_hot_add(&w0, "pxelinux.0", 1);
+    preload_hot_add(&w0, "b.cfg", 2);
+    preload_hot_add(&w1, "a.cfg", 2);
+    preload_hot_add(&w1, "pxelinux.0", 1);
+    preload_hot_add(&w1, "bad\nname", 9);
+    preload_hot_add(&w1, "rare", 1);
+    for (int i = 0; i < 300; i++) // plusieurs agrandissements de la table
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "f%d", i);
+        preload_hot_add(&w1, name, 1);
+    }
+    assert(w0.count == 2 && w1.count == 304);
+
+    preload_hot_merge(&w0, &w1);
+    assert(w0.count == 305);
+    const char *path = "/tmp/tftp_test_hot";
+    assert(preload_hot_write(path, &w0, 3) == 3);
+    FILE *f = fopen(path, "r");
+    assert(f);
+    char line[128];
+    assert(fgets(line, sizeof(line), f) && line[0] == '#');
+    assert(fgets(line, sizeof(line), f) && strcmp(line, "pxelinux.0\n") == 0);
+    assert(fgets(line, sizeof(line), f) && strcmp(line, "a.cfg\n") == 0); // égalité : ordre des noms
+    assert(fgets(line, sizeof(line), f) && strcmp(line, "b.cfg\n") == 0);
+    assert(!fgets(line, sizeof(line), f));
+    fclose(f);
+    assert(preload_hot_write("/nonexistent/dir/hot", &w0, 3) == -1);
+
+    preload_hot_free(&w0);
+    preload_hot_free(&w1);
+    unlink(path);
+    printf("OK\n");
+}
+
+void test_preload()
+{
+    printf("\n=== TESTS PRELOAD ===\n");
+    test_preload_load();
+    test_preload_hot();
+    printf("=== TOUS LES TESTS PRELOAD SONT PASSÉS ! ===\n");
+}
+
+/* ========================= TESTS AFFINITY ========================= */
+
+void test_affinity_parse()
+{
+    printf("Test: Placement (listes de CPU)... ");
+    int cpus[16];
+    assert(affinity_parse("3", cpus, 16) == 1 && cpus[0] == 3);
+    assert(affinity_parse("0-3,8,10-11", cpus, 16) == 7);
+    assert(cpus[0] == 0 && cpus[3] == 3 && cpus[4] == 8 && cpus[5] == 10 && cpus[6] == 11);
+    assert(affinity_parse("0-31", cpus, 16) == 16 && cpus[15] == 15); // tronquée à max
+    assert(affinity_parse("", cpus, 16) == -1);
+    assert(affinity_parse("3-1", cpus, 16) == -1);
+    assert(affinity_parse("1,", cpus, 16) == -1);
+    assert(affinity_parse("a", cpus, 16) == -1);
+    assert(affinity_parse("0-", cpus, 16) == -1);
+    assert(affinity_parse("99999", cpus, 16) == -1);
+    int n = affinity_parse("auto", cpus, 16);
+    assert(n >= 1 && cpus[0] >= 0);
+    printf("OK\n");
+}
+
+void test_affinity_pin()
+{
+    printf("Test: Placement (épinglage, SO_INCOMING_CPU)... ");
+    int cpus[AFFINITY_MAX_CPUS];
+    int n = affinity_parse("auto", cpus, AFFINITY_MAX_CPUS);
+    assert(n >= 1);
+    struct affinity_mask before, pinned;
+    assert(affinity_get(&before) == 0);
+    int last = cpus[n - 1];
+    assert(affinity_pin(last) == 0 && affinity_get(&pinned) == 0);
+    for (int i = 0; i < AFFINITY_MAX_CPUS; i++)
+        assert(((pinned.bits[i / 64] >> (i % 64)) & 1) == (i == last));
+    assert(affinity_set(&before) == 0 && affinity_get(&pinned) == 0);
+    assert(memcmp(&pinned, &before, sizeof(before)) == 0);
+    assert(affinity_pin(-1) == -1 && errno == EINVAL);
+    assert(affinity_node(last) >= -1);
+
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(s >= 0 && affinity_steer(s, last) == 0);
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    assert(getsockopt(s, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 && cpu == last);
+    close(s);
+    printf("OK\n");
+}
+
+void test_affinity()
+{
+    printf("\n=== TESTS AFFINITY ===\n");
+    test_affinity_parse();
+    test_affinity_pin();
+    printf("=== TOUS LES TESTS AFFINITY SONT PASSÉS ! ===\n");
+}
+
+/* ========================= TESTS SOCKBUF ========================= */
+
+void test_sockbuf_grow()
+{
+    printf("Test: Files des sockets (taille)... ");
+    assert(sockbuf_need(0, 512) == 0);
+    assert(sockbuf_need(4, 1428) == 4 * (4096 + SOCKBUF_OVERHEAD)); // 1428 + 768 -> 4096
+    assert(sockbuf_need(3, 512) == 3 * (2048 + SOCKBUF_OVERHEAD));
+    assert(sockbuf_need(1u << 20, 65468) == SOCKBUF_MAX);
+
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(s >= 0);
+    int def = sockbuf_get(s, SO_RCVBUF);
+    assert(def > 0);
+    assert(sockbuf_grow(s, SO_RCVBUF, 1024, 0) == def); // déjà assez grande : inchangée
+    int got = sockbuf_grow(s, SO_RCVBUF, (uint32_t)def + 65536, 1);
+    assert(got >= def); // plafonnée par rmem_max sans CAP_NET_ADMIN
+    assert(sockbuf_grow(s, SO_SNDBUF, 4096, 0) == sockbuf_get(s, SO_SNDBUF));
+    close(s);
+    printf("OK\n");
+}
+
+void test_sockbuf_drops()
+{
+    printf("Test: Files des sockets (SO_RXQ_OVFL)... ");
+    int rx = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0), tx = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(rx >= 0 && tx >= 0);
+    int small = 1; // ramenée au minimum du noyau
+    assert(setsockopt(rx, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small)) == 0);
+    assert(sockbuf_drops_enable(rx) == 0);
+    struct sockaddr_in a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(rx, (struct sockaddr *)&a, sizeof(a)) == 0);
+    socklen_t al = sizeof(a);
+    assert(getsockname(rx, (struct sockaddr *)&a, &al) == 0);
+
+    // file pleine : les suivants sont jetés par le noyau
+    uint8_t buf[1024];
+    memset(buf, 'x', sizeof(buf));
+    for (int i = 0; i < 64; i++)
+        assert(sendto(tx, buf, sizeof(buf), 0, (struct sockaddr *)&a, sizeof(a)) == (ssize_t)sizeof(buf));
+
+    // les datagrammes en file ont été reçus avant les pertes : cumul à 0
+    struct sockaddr_in from;
+    uint32_t drops = 0;
+    int queued = 0;
+    while (sockbuf_recv(rx, buf, sizeof(buf), &from, &drops, NULL) == (ssize_t)sizeof(buf))
+        queued++;
+    assert(errno == EAGAIN && queued > 0 && queued < 64 && drops == 0);
+    assert(from.sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+
+    // le suivant porte le cumul des pertes
+    assert(sendto(tx, buf, 16, 0, (struct sockaddr *)&a, sizeof(a)) == 16);
+    assert(sockbuf_recv(rx, buf, sizeof(buf), &from, &drops, NULL) == 16);
+    assert(drops == (uint32_t)(64 - queued));
+    close(rx);
+    close(tx);
+    printf("OK\n");
+}
+
+void test_sockbuf()
+{
+    printf("\n=== TESTS SOCKBUF ===\n");
+    test_sockbuf_grow();
+    test_sockbuf_drops();
+    printf("=== TOUS LES TESTS SOCKBUF SONT PASSÉS ! ===\n");
+}
+
+/* ========================= TESTS TSTAMP ========================= */
+
+void test_tstamp_diff()
+{
+    printf("Test: Horodatage (écart émission -> réception)... ");
+    struct tstamp a = {1000, 0}, b = {5000, 0};
+    assert(tstamp_diff(&a, &b) == 4000 && tstamp_diff(&b, &a) == 0);
+    a.hw = 100;
+    assert(tstamp_diff(&a, &b) == 4000); // une seule horloge de carte : logicielles
+    b.hw = 350;
+    assert(tstamp_diff(&a, &b) == 250);
+    printf("OK\n");
+}
+
+void test_tstamp_loopback()
+{
+    printf("Test: Horodatage noyau (SO_TIMESTAMPING)... ");
+    int rx = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0), tx = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    assert(rx >= 0 && tx >= 0);
+    assert(tstamp_enable(rx) == 0 && tstamp_enable(tx) == 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(rx, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    socklen_t al = sizeof(addr);
+    assert(getsockname(rx, (struct sockaddr *)&addr, &al) == 0);
+
+    // émission horodatée : relue dans la file d'erreurs, une fois
+    uint64_t t0 = now_ns();
+    assert(tstamp_sendto(tx, "ping", 4, &addr) == 4);
+    struct tstamp sent = {0, 0};
+    assert(tstamp_tx(tx, &sent) == 1);
+    assert(sent.sw >= t0 - 1000000 && sent.sw <= now_ns() + 1000000); // ramenée à CLOCK_MONOTONIC
+    assert(tstamp_tx(tx, &sent) == 0);
+
+    // réception horodatée, avant la lecture
+    usleep(2000);
+    uint8_t buf[16];
+    struct sockaddr_in from;
+    uint32_t drops = 0;
+    struct tstamp got = {0, 0};
+    assert(sockbuf_recv(rx, buf, sizeof(buf), &from, &drops, &got) == 4);
+    uint64_t t1 = now_ns();
+    assert(got.sw >= sent.sw && got.sw + 1500000 < t1); // attente dans la file visible
+    assert(tstamp_diff(&sent, &got) < 1000000);
+
+    // envoi ordinaire : pas d'horodatage d'émission
+    assert(sendto(tx, "x", 1, 0, (struct sockaddr *)&addr, sizeof(addr)) == 1);
+    assert(tstamp_tx(tx, &sent) == 0);
+    close(rx);
+    close(tx);
+    printf("OK\n");
+}
+
+void test_tstamp()
+{
+    printf("\n=== TESTS TSTAMP ===\n");
+    test_tstamp_diff();
+    test_tstamp_loopback();
+    printf("=== TOUS LES TESTS TSTAMP SONT PASSÉS ! ===\n");
+}
+
+/* ========================= TESTS PACE ========================= */
+
+void test_pace_parse_rate()
+{
+    printf("Test: Débit de pacing (bits/s -> octets/s)... ");
+    uint64_t r = 0;
+    assert(pace_parse_rate("200m", &r) == 0 && r == 25000000);
+    assert(pace_parse_rate("1G", &r) == 0 && r == 125000000);
+    assert(pace_parse_rate("1.5k", &r) == 0 && r == 187);
+    assert(pace_parse_rate("64000", &r) == 0 && r == 8000);
+    assert(pace_parse_rate("", &r) == -1 && pace_parse_rate("0", &r) == -1);
+    assert(pace_parse_rate("10mb", &r) == -1 && pace_parse_rate("x", &r) == -1);
+    assert(pace_parse_rate("4", &r) == -1); // moins d'un octet/s
+    printf("OK\n");
+}
+
+void test_pace_take()
+{
+    printf("Test: Créneaux d'émission (pace_take)... ");
+    uint64_t rate = 1000000, gap = pace_gap(rate, 972); // 1000 octets sur le fil : 1 ms
+    assert(gap == 1000000);
+
+    // départ : pas de rafale, un datagramme par créneau
+    uint64_t next = 0, now = 50000000, at = 0;
+    assert(pace_take(&next, rate, 972, 0, now, &at) == 1 && at == now && next == now + gap);
+    assert(pace_take(&next, rate, 972, 0, now, &at) == 0 && at == now + gap);
+    assert(pace_take(&next, rate, 972, 0, now + gap, &at) == 1 && at == now + gap);
+
+    // réveil en retard de moins de PACE_BURST créneaux : rattrapé
+    now += 3 * gap + gap / 2; // next = now - 1,5 créneau
+    int sent = 0;
+    while (pace_take(&next, rate, 972, 0, now, &at) == 1)
+        sent++;
+    assert(sent == 2 && at == now + gap / 2);
+
+    // après un repos (attente d'un ACK) : aucun crédit
+    now += 10 * gap;
+    assert(pace_take(&next, rate, 972, 0, now, &at) == 1 && at == now);
+    assert(pace_take(&next, rate, 972, 0, now, &at) == 0);
+
+    // SO_TXTIME : PACE_TXTIME_AHEAD datagrammes d'avance, heures espacées
+    now += 10 * gap;
+    for (int i = 0; i < PACE_TXTIME_AHEAD + 1; i++)
+    {
+        assert(pace_take(&next, rate, 972, 1, now, &at) == 1);
+        assert(at == now + (uint64_t)i * gap);
+    }
+    assert(pace_take(&next, rate, 972, 1, now, &at) == 0 && at == now + gap);
+    printf("OK\n");
+}
+
+void test_pace_queue()
+{
+    printf("Test: File des réveils (ordre des échéances)... ");
+    struct pace_queue q;
+    memset(&q, 0, sizeof(q));
+    assert(pace_queue_next(&q) == UINT64_MAX);
+    uint64_t due, tag;
+    for (uint64_t i = 0; i < 200; i++)
+        assert(pace_queue_push(&q, (i * 7919) % 200 + 1, i) == 0);
+    assert(q.n == 200 && pace_queue_next(&q) == 1);
+    assert(pace_queue_pop(&q, 0, &due, &tag) == 0); // rien d'échu
+    uint64_t prev = 0;
+    int popped = 0;
+    while (pace_queue_pop(&q, 150, &due, &tag) == 1)
+    {
+        assert(due >= prev && due <= 150 && (tag * 7919) % 200 + 1 == due);
+        prev = due;
+        popped++;
+    }
+    assert(popped == 150 && pace_queue_next(&q) == 151);
+    pace_queue_free(&q);
+    assert(q.n == 0 && q.e == NULL);
+    printf("OK\n");
+}
+
+void test_pace_bottleneck()
+{
+    printf("Test: Goulot netsim (rafale débordée, envoi espacé reçu)... ");
+    struct netsim_cfg c;
+    assert(netsim_parse("rate=8m,queue=3k", &c) == 0 && c.rate == 1000000 && c.queue == 3000);
+    assert(netsim_parse("rate=1x", &c) == -1 && netsim_parse("queue=-1", &c) == -1);
+
+    int s = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    assert(s >= 0);
+    struct sockaddr_in a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(s, (struct sockaddr *)&a, sizeof(a)) == 0);
+    socklen_t al = sizeof(a);
+    getsockname(s, (struct sockaddr *)&a, &al);
+
+    // 10 x 1000 octets d'un coup sur 1 Mo/s, file de 3000 : 3 passent
+    assert(netsim_configure("rate=8m,queue=3000") == 0);
+    uint8_t buf[1000], rx[1000];
+    memset(buf, 'p', sizeof(buf));
+    for (int i = 0; i < 10; i++)
+        assert(net_sendto(s, buf, sizeof(buf), 0, (struct sockaddr *)&a, sizeof(a)) == (ssize_t)sizeof(buf));
+    usleep(5000);
+    while (net_flush() >= 0)
+        usleep(1000);
+    int got = 0;
+    while (recv(s, rx, sizeof(rx), 0) == (ssize_t)sizeof(rx))
+        got++;
+    assert(got == 3);
+
+    // mêmes datagrammes espacés (heures SO_TXTIME) : tous passent
+    uint64_t next = 0, at = 0;
+    for (int i = 0; i < 10; i++)
+    {
+        assert(pace_take(&next, 1000000, sizeof(buf), 1, now_ns(), &at) == 1);
+        assert(pace_sendto(s, buf, sizeof(buf), &a, at) == (ssize_t)sizeof(buf));
+    }
+    usleep(12000);
+    while (net_flush() >= 0)
+        usleep(1000);
+    got = 0;
+    while (recv(s, rx, sizeof(rx), 0) == (ssize_t)sizeof(rx))
+        got++;
+    assert(got == 10);
+
+    assert(netsim_configure("") == 0);
+    net_close(s);
+    printf("OK\n");
+}
+
+void test_pace()
+{
+    printf("\n=== TESTS PACE ===\n");
+    test_pace_parse_rate();
+    test_pace_take();
+    test_pace_queue();
+    test_pace_bottleneck();
+    printf("=== TOUS LES TESTS PACE SONT PASSÉS ! ===\n");
+}
+
 int main()
 {
     test_build_rrq_wrq();
@@ -472,6 +3396,45 @@ int main()
     test_parse_opcode();
     test_parse_block();
     test_parse_rrq_wrq();
+    test_options();
+
+    test_session_table();
+
+    test_netsim();
+
+    test_metrics();
+
+    test_log();
+
+    test_trace();
+
+    test_accounting();
+
+    test_libtftp();
+
+    test_server();
+
+    test_memstore();
+
+    test_vfile();
+
+    test_netascii();
+
+    test_lz();
+
+    test_dedup();
+
+    test_handoff();
+
+    test_preload();
+
+    test_affinity();
+
+    test_sockbuf();
+
+    test_tstamp();
+
+    test_pace();
 
     return 0;
 }
\ No newline at end of file